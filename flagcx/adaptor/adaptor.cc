@@ -3,49 +3,40 @@
 
 #include "adaptor.h"
 
-#ifdef USE_NVIDIA_ADAPTOR
-#ifdef USE_BOOTSTRAP_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&bootstrapAdaptor,
-                                                      &ncclAdaptor};
+// With both host CCLs built, each op goes to the faster or supporting one
+#if defined(USE_BOOTSTRAP_ADAPTOR) && defined(USE_GLOO_ADAPTOR)
+#define FLAGCX_HOST_CCL_ADAPTOR hostCCLAdaptor
+#elif USE_BOOTSTRAP_ADAPTOR
+#define FLAGCX_HOST_CCL_ADAPTOR bootstrapAdaptor
 #elif USE_GLOO_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&glooAdaptor,
-                                                      &ncclAdaptor};
+#define FLAGCX_HOST_CCL_ADAPTOR glooAdaptor
 #endif
+
+#ifdef USE_NVIDIA_ADAPTOR
+struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&FLAGCX_HOST_CCL_ADAPTOR,
+                                                      &ncclAdaptor};
 struct flagcxDeviceAdaptor *deviceAdaptor = &cudaAdaptor;
 #elif USE_ILUVATAR_COREX_ADAPTOR
-#ifdef USE_BOOTSTRAP_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&bootstrapAdaptor,
-                                                      &ixncclAdaptor};
-#elif USE_GLOO_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&glooAdaptor,
+struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&FLAGCX_HOST_CCL_ADAPTOR,
                                                       &ixncclAdaptor};
-#endif
 struct flagcxDeviceAdaptor *deviceAdaptor = &ixcudaAdaptor;
 #elif USE_CAMBRICON_ADAPTOR
-#ifdef USE_BOOTSTRAP_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&bootstrapAdaptor,
+struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&FLAGCX_HOST_CCL_ADAPTOR,
                                                       &cnclAdaptor};
-#elif USE_GLOO_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&glooAdaptor,
-                                                      &cnclAdaptor};
-#endif
 struct flagcxDeviceAdaptor *deviceAdaptor = &mluAdaptor;
 #elif USE_METAX_ADAPTOR
-#ifdef USE_BOOTSTRAP_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&bootstrapAdaptor,
+struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&FLAGCX_HOST_CCL_ADAPTOR,
                                                       &mcclAdaptor};
-#elif USE_GLOO_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&glooAdaptor,
-                                                      &mcclAdaptor};
-#endif
 struct flagcxDeviceAdaptor *deviceAdaptor = &macaAdaptor;
 #elif USE_DU_ADAPTOR
-#ifdef USE_BOOTSTRAP_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&bootstrapAdaptor,
+struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&FLAGCX_HOST_CCL_ADAPTOR,
                                                       &duncclAdaptor};
-#elif USE_GLOO_ADAPTOR
-struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&glooAdaptor,
-                                                      &duncclAdaptor};
-#endif
 struct flagcxDeviceAdaptor *deviceAdaptor = &ducudaAdaptor;
-#endif
\ No newline at end of file
+#elif USE_HOST_ADAPTOR
+// Streams, events and memory are emulated on the CPU. The bootstrap CCL also
+// serves the homo comms, as it is the one that can wire itself from a unique
+// id.
+struct flagcxCCLAdaptor *cclAdaptors[NCCLADAPTORS] = {&FLAGCX_HOST_CCL_ADAPTOR,
+                                                      &bootstrapAdaptor};
+struct flagcxDeviceAdaptor *deviceAdaptor = &hostAdaptor;
+#endif
@@ -24,6 +24,7 @@ extern struct flagcxCCLAdaptor ixncclAdaptor;
 extern struct flagcxCCLAdaptor cnclAdaptor;
 extern struct flagcxCCLAdaptor mcclAdaptor;
 extern struct flagcxCCLAdaptor duncclAdaptor;
+extern struct flagcxCCLAdaptor hostCCLAdaptor;
 extern struct flagcxCCLAdaptor *cclAdaptors[];
 
 extern struct flagcxDeviceAdaptor cudaAdaptor;
@@ -31,6 +32,7 @@ extern struct flagcxDeviceAdaptor ixcudaAdaptor;
 extern struct flagcxDeviceAdaptor mluAdaptor;
 extern struct flagcxDeviceAdaptor macaAdaptor;
 extern struct flagcxDeviceAdaptor ducudaAdaptor;
+extern struct flagcxDeviceAdaptor hostAdaptor;
 extern struct flagcxDeviceAdaptor *deviceAdaptor;
 
 inline bool flagcxCCLAdaptorNeedSendrecv(size_t value) { return value != 0; }
@@ -57,7 +59,7 @@ struct flagcxCCLAdaptor {
                                         int *device);
   flagcxResult_t (*commUserRank)(const flagcxInnerComm_t comm, int *rank);
   flagcxResult_t (*commGetAsyncError)(flagcxInnerComm_t comm,
-                                      flagcxResult_t asyncError);
+                                      flagcxResult_t *asyncError);
 
   // Communication functions
   flagcxResult_t (*reduce)(const void *sendbuff, void *recvbuff, size_t count,
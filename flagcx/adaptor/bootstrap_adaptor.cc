@@ -8,9 +8,13 @@ flagcxResult_t bootstrapAdaptorGetVersion(int *version) {
   return flagcxNotSupported;
 }
 
-// TODO: unsupported
 flagcxResult_t bootstrapAdaptorGetUniqueId(flagcxUniqueId_t *uniqueId) {
-  return flagcxNotSupported;
+  struct flagcxBootstrapHandle handle;
+  FLAGCXCHECK(bootstrapNetInit());
+  FLAGCXCHECK(bootstrapGetUniqueId(&handle));
+  memset((void *)*uniqueId, 0, sizeof(**uniqueId));
+  memcpy((void *)*uniqueId, &handle, sizeof(handle));
+  return flagcxSuccess;
 }
 
 // TODO: unsupported
@@ -24,12 +28,22 @@ const char *bootstrapAdaptorGetLastError(flagcxInnerComm_t comm) {
 }
 
 flagcxResult_t bootstrapAdaptorCommInitRank(flagcxInnerComm_t *comm, int nranks,
-                                            flagcxUniqueId_t /*commId*/,
+                                            flagcxUniqueId_t commId,
                                             int rank,
                                             bootstrapState *bootstrap) {
   if (*comm == NULL) {
     FLAGCXCHECK(flagcxCalloc(comm, 1));
   }
+  if (bootstrap == NULL) {
+    // Used as the device ccl, the ranks meet through the unique id
+    struct flagcxBootstrapHandle *handle = (struct flagcxBootstrapHandle *)commId;
+    FLAGCXCHECK(flagcxCalloc(&bootstrap, 1));
+    bootstrap->rank = rank;
+    bootstrap->nranks = nranks;
+    bootstrap->magic = handle->magic;
+    FLAGCXCHECK(bootstrapInit(handle, bootstrap));
+    (*comm)->ownBootstrap = true;
+  }
   (*comm)->base = bootstrap;
 
   return flagcxSuccess;
@@ -41,6 +55,10 @@ flagcxResult_t bootstrapAdaptorCommFinalize(flagcxInnerComm_t comm) {
 }
 
 flagcxResult_t bootstrapAdaptorCommDestroy(flagcxInnerComm_t comm) {
+  if (comm->ownBootstrap) {
+    FLAGCXCHECK(bootstrapClose(comm->base));
+  }
+  free(comm);
   return flagcxSuccess;
 }
 
@@ -79,7 +97,7 @@ flagcxResult_t bootstrapAdaptorCommUserRank(const flagcxInnerComm_t comm,
 
 // TODO: unsupported
 flagcxResult_t bootstrapAdaptorCommGetAsyncError(flagcxInnerComm_t comm,
-                                                 flagcxResult_t asyncError) {
+                                                 flagcxResult_t *asyncError) {
   return flagcxNotSupported;
 }
 
@@ -109,16 +127,27 @@ flagcxResult_t bootstrapAdaptorBroadcast(const void *sendbuff, void *recvbuff,
   return flagcxNotSupported;
 }
 
+// The collectives run on the calling thread, so work already queued on the
+// stream has to finish first
+static flagcxResult_t bootstrapAdaptorWaitStream(flagcxStream_t stream) {
+  if (stream != NULL) {
+    FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t bootstrapAdaptorAllReduce(const void *sendbuff, void *recvbuff, size_t count,
                                         flagcxDataType_t datatype, flagcxRedOp_t op,
-                                        flagcxInnerComm_t comm, flagcxStream_t /*stream*/) {
+                                        flagcxInnerComm_t comm, flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(AllReduceBootstrap(comm->base, sendbuff, recvbuff, count, datatype, op));
   return flagcxSuccess;
 }
 
 flagcxResult_t bootstrapAdaptorReduce(const void *sendbuff, void *recvbuff, size_t count,
                                         flagcxDataType_t datatype, flagcxRedOp_t op, int root,
-                                        flagcxInnerComm_t comm, flagcxStream_t /*stream*/) {
+                                        flagcxInnerComm_t comm, flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(ReduceBootstrap(comm->base, sendbuff, recvbuff, count, datatype, op, root));
   return flagcxSuccess;
 }
@@ -128,7 +157,8 @@ flagcxResult_t bootstrapAdaptorReduceScatter(const void *sendbuff,
                                              flagcxDataType_t datatype,
                                              flagcxRedOp_t op,
                                              flagcxInnerComm_t comm,
-                                             flagcxStream_t /*stream*/) {
+                                             flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(ReduceScatterBootstrap(comm->base, sendbuff, recvbuff, recvcount, datatype, op));
   return flagcxSuccess;
 
@@ -138,7 +168,8 @@ flagcxResult_t bootstrapAdaptorAllGather(const void *sendbuff, void *recvbuff,
                                          size_t sendcount,
                                          flagcxDataType_t datatype,
                                          flagcxInnerComm_t comm,
-                                         flagcxStream_t /*stream*/) {
+                                         flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(AllGatherBootstrap(comm->base, sendbuff, recvbuff, sendcount, datatype));
   return flagcxSuccess;
 }
@@ -146,7 +177,8 @@ flagcxResult_t bootstrapAdaptorAllGather(const void *sendbuff, void *recvbuff,
 flagcxResult_t bootstrapAdaptorAlltoAll(const void *sendbuff, void *recvbuff,
                                         size_t count, flagcxDataType_t datatype,
                                         flagcxInnerComm_t comm,
-                                        flagcxStream_t /*stream*/) {
+                                        flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(AlltoAllBootstrap(comm->base, sendbuff, recvbuff, count, datatype));
   return flagcxSuccess;
 }
@@ -164,7 +196,8 @@ bootstrapAdaptorAlltoAllv(const void *sendbuff, size_t *sendcounts,
 flagcxResult_t bootstrapAdaptorSend(const void *sendbuff, size_t count,
                                     flagcxDataType_t datatype, int peer,
                                     flagcxInnerComm_t comm,
-                                    flagcxStream_t /*stream*/) {
+                                    flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(bootstrapSend(comm->base, peer, BOOTSTRAP_SEND_RECV_TAG, (void *)sendbuff, count * getFlagcxDataTypeSize(datatype)));
   return flagcxSuccess;
 }
@@ -172,7 +205,8 @@ flagcxResult_t bootstrapAdaptorSend(const void *sendbuff, size_t count,
 flagcxResult_t bootstrapAdaptorRecv(void *recvbuff, size_t count,
                                     flagcxDataType_t datatype, int peer,
                                     flagcxInnerComm_t comm,
-                                    flagcxStream_t /*stream*/) {
+                                    flagcxStream_t stream) {
+  FLAGCXCHECK(bootstrapAdaptorWaitStream(stream));
   FLAGCXCHECK(bootstrapRecv(comm->base, peer, BOOTSTRAP_SEND_RECV_TAG, recvbuff, count * getFlagcxDataTypeSize(datatype)));
   return flagcxSuccess;
 }
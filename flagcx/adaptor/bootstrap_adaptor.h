@@ -9,6 +9,8 @@
 
 struct flagcxInnerComm {
   bootstrapState *base;
+  // set when the comm was wired from its own unique id
+  bool ownBootstrap;
 };
 
 #endif // USE_BOOTSTRAP_ADAPTOR
\ No newline at end of file
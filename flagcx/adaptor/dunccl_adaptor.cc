@@ -67,9 +67,9 @@ flagcxResult_t duncclAdaptorCommUserRank(const flagcxInnerComm_t comm,
 }
 
 flagcxResult_t duncclAdaptorCommGetAsyncError(flagcxInnerComm_t comm,
-                                              flagcxResult_t asyncError) {
+                                              flagcxResult_t *asyncError) {
   return (flagcxResult_t)ncclCommGetAsyncError(comm->base,
-                                               (ncclResult_t *)&asyncError);
+                                               (ncclResult_t *)asyncError);
 }
 
 flagcxResult_t duncclAdaptorReduce(const void *sendbuff, void *recvbuff,
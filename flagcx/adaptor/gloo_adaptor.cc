@@ -111,7 +111,7 @@ flagcxResult_t glooAdaptorCommUserRank(const flagcxInnerComm_t comm,
 
 // TODO: unsupported
 flagcxResult_t glooAdaptorCommGetAsyncError(flagcxInnerComm_t comm,
-                                            flagcxResult_t asyncError) {
+                                            flagcxResult_t *asyncError) {
   return flagcxNotSupported;
 }
 
@@ -148,10 +148,19 @@ flagcxResult_t glooAdaptorBroadcast(const void *sendbuff, void *recvbuff,
   return flagcxNotSupported;
 }
 
+// Gloo does not know about streams, let the queued work land in the buffers
+static flagcxResult_t glooAdaptorWaitStream(flagcxStream_t stream) {
+  if (stream != NULL) {
+    FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t glooAdaptorAllReduce(const void *sendbuff, void *recvbuff,
                                     size_t count, flagcxDataType_t datatype,
                                     flagcxRedOp_t op, flagcxInnerComm_t comm,
-                                    flagcxStream_t /*stream*/) {
+                                    flagcxStream_t stream) {
+  FLAGCXCHECK(glooAdaptorWaitStream(stream));
   ::gloo::AllreduceOptions opts(comm->base);
   opts.setReduceFunction(
       getFunction<::gloo::AllreduceOptions::Func>(datatype, op));
@@ -173,7 +182,8 @@ glooAdaptorReduceScatter(const void *sendbuff, void *recvbuff, size_t recvcount,
 flagcxResult_t glooAdaptorAllGather(const void *sendbuff, void *recvbuff,
                                     size_t sendcount, flagcxDataType_t datatype,
                                     flagcxInnerComm_t comm,
-                                    flagcxStream_t /*stream*/) {
+                                    flagcxStream_t stream) {
+  FLAGCXCHECK(glooAdaptorWaitStream(stream));
   ::gloo::AllgatherOptions opts(comm->base);
   GENERATE_GLOO_TYPES(datatype, setInput, opts, const_cast<void *>(sendbuff),
                       sendcount);
@@ -186,7 +196,8 @@ flagcxResult_t glooAdaptorAllGather(const void *sendbuff, void *recvbuff,
 flagcxResult_t glooAdaptorAlltoAll(const void *sendbuff, void *recvbuff,
                                    size_t count, flagcxDataType_t datatype,
                                    flagcxInnerComm_t comm,
-                                   flagcxStream_t /*stream*/) {
+                                   flagcxStream_t stream) {
+  FLAGCXCHECK(glooAdaptorWaitStream(stream));
   ::gloo::AlltoallOptions opts(comm->base);
   GENERATE_GLOO_TYPES(datatype, setInput, opts, const_cast<void *>(sendbuff),
                       comm->base->size * count);
@@ -209,7 +220,8 @@ flagcxResult_t glooAdaptorAlltoAllv(const void *sendbuff, size_t *sendcounts,
 flagcxResult_t glooAdaptorSend(const void *sendbuff, size_t count,
                                flagcxDataType_t datatype, int peer,
                                flagcxInnerComm_t comm,
-                               flagcxStream_t /*stream*/) {
+                               flagcxStream_t stream) {
+  FLAGCXCHECK(glooAdaptorWaitStream(stream));
   size_t size = count * getFlagcxDataTypeSize(datatype);
   inputBuffers.push(
       comm->base->createUnboundBuffer(const_cast<void *>(sendbuff), size));
@@ -223,7 +235,8 @@ flagcxResult_t glooAdaptorSend(const void *sendbuff, size_t count,
 flagcxResult_t glooAdaptorRecv(void *recvbuff, size_t count,
                                flagcxDataType_t datatype, int peer,
                                flagcxInnerComm_t comm,
-                               flagcxStream_t /*stream*/) {
+                               flagcxStream_t stream) {
+  FLAGCXCHECK(glooAdaptorWaitStream(stream));
   size_t size = count * getFlagcxDataTypeSize(datatype);
   auto buf =
       comm->base->createUnboundBuffer(const_cast<void *>(recvbuff), size);
@@ -0,0 +1,431 @@
+#include "host_adaptor.h"
+
+#ifdef USE_HOST_ADAPTOR
+
+#include "param.h"
+#include <climits>
+#include <linux/futex.h>
+#include <map>
+#include <set>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Number of devices a host exposes, ranks pick one with setDevice
+FLAGCX_PARAM(HostDeviceCount, "HOST_DEVICE_COUNT", 8);
+
+static thread_local int hostCurrentDev = 0;
+
+// Device memory is mmap'd, the sizes are kept for munmap
+static std::mutex hostMapMutex;
+static std::map<void *, size_t> hostMapSizes;
+
+// Live streams, for deviceSynchronize
+static std::mutex hostStreamMutex;
+static std::set<struct flagcxHostStream *> hostStreams;
+
+static void hostSeqWait(struct flagcxHostSeq *seq, uint32_t target) {
+  uint32_t value = seq->value.load();
+  if ((int32_t)(value - target) >= 0)
+    return;
+  seq->waiters.fetch_add(1);
+  while ((int32_t)((value = seq->value.load()) - target) < 0) {
+    syscall(SYS_futex, &seq->value, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+  }
+  seq->waiters.fetch_sub(1);
+}
+
+static void hostSeqWake(struct flagcxHostSeq *seq) {
+  if (seq->waiters.load() > 0) {
+    syscall(SYS_futex, &seq->value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL,
+            0);
+  }
+}
+
+static void hostSeqAdvance(struct flagcxHostSeq *seq, uint32_t target) {
+  uint32_t value = seq->value.load();
+  while ((int32_t)(value - target) < 0 &&
+         !seq->value.compare_exchange_weak(value, target)) {
+  }
+  hostSeqWake(seq);
+}
+
+static void *hostStreamWorker(void *arg) {
+  struct flagcxHostStream *s = (struct flagcxHostStream *)arg;
+  uint32_t done = 0;
+  while (!s->stop) {
+    hostSeqWait(&s->submitted, done + 1);
+    std::function<void()> op;
+    {
+      std::lock_guard<std::mutex> lock(s->mutex);
+      op = std::move(s->ops.front());
+      s->ops.pop_front();
+    }
+    op();
+    s->completed.value.store(++done);
+    hostSeqWake(&s->completed);
+  }
+  return NULL;
+}
+
+static void hostStreamEnqueue(struct flagcxHostStream *s,
+                              std::function<void()> op) {
+  {
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->ops.push_back(std::move(op));
+    s->submitted.value.fetch_add(1);
+  }
+  hostSeqWake(&s->submitted);
+}
+
+static void hostStreamWait(struct flagcxHostStream *s) {
+  hostSeqWait(&s->completed, s->submitted.value.load());
+}
+
+static flagcxResult_t hostMapAlloc(void **ptr, size_t size) {
+  size = std::max<size_t>(size, 1);
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    WARN("Host device failed to map %zu bytes : %s", size, strerror(errno));
+    return flagcxSystemError;
+  }
+  std::lock_guard<std::mutex> lock(hostMapMutex);
+  hostMapSizes[addr] = size;
+  *ptr = addr;
+  return flagcxSuccess;
+}
+
+static flagcxResult_t hostMapFree(void *ptr) {
+  size_t size;
+  {
+    std::lock_guard<std::mutex> lock(hostMapMutex);
+    auto it = hostMapSizes.find(ptr);
+    if (it == hostMapSizes.end()) {
+      WARN("Host device pointer %p was not allocated by the adaptor", ptr);
+      return flagcxInvalidArgument;
+    }
+    size = it->second;
+    hostMapSizes.erase(it);
+  }
+  SYSCHECK(munmap(ptr, size), "munmap");
+  return flagcxSuccess;
+}
+
+static flagcxResult_t hostMemFree(void *ptr, flagcxMemType_t type) {
+  if (ptr == NULL) {
+    return flagcxSuccess;
+  }
+  if (type == flagcxMemHost) {
+    free(ptr);
+    return flagcxSuccess;
+  }
+  return hostMapFree(ptr);
+}
+
+flagcxResult_t hostAdaptorDeviceSynchronize() {
+  std::lock_guard<std::mutex> lock(hostStreamMutex);
+  for (auto s : hostStreams) {
+    hostStreamWait(s);
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorDeviceMemcpy(void *dst, void *src, size_t size,
+                                       flagcxMemcpyType_t type,
+                                       flagcxStream_t stream, void *args) {
+  if (stream == NULL) {
+    memcpy(dst, src, size);
+  } else {
+    hostStreamEnqueue(stream->base, [=]() { memcpy(dst, src, size); });
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorDeviceMemset(void *ptr, int value, size_t size,
+                                       flagcxMemType_t type,
+                                       flagcxStream_t stream) {
+  if (type == flagcxMemHost || stream == NULL) {
+    memset(ptr, value, size);
+  } else {
+    hostStreamEnqueue(stream->base, [=]() { memset(ptr, value, size); });
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorDeviceMalloc(void **ptr, size_t size,
+                                       flagcxMemType_t type,
+                                       flagcxStream_t stream) {
+  if (type == flagcxMemHost) {
+    *ptr = malloc(size);
+    if (*ptr == NULL && size > 0) {
+      WARN("Host device failed to malloc %zu bytes", size);
+      return flagcxSystemError;
+    }
+  } else {
+    FLAGCXCHECK(hostMapAlloc(ptr, size));
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorDeviceFree(void *ptr, flagcxMemType_t type,
+                                     flagcxStream_t stream) {
+  if (stream == NULL || type == flagcxMemHost) {
+    return hostMemFree(ptr, type);
+  }
+  // earlier operations of the stream may still use the memory
+  hostStreamEnqueue(stream->base, [=]() { hostMemFree(ptr, type); });
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorSetDevice(int dev) {
+  if (dev < 0 || dev >= flagcxParamHostDeviceCount()) {
+    return flagcxInvalidArgument;
+  }
+  hostCurrentDev = dev;
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGetDevice(int *dev) {
+  *dev = hostCurrentDev;
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGetDeviceCount(int *count) {
+  *count = flagcxParamHostDeviceCount();
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGetVendor(char *vendor) {
+  strcpy(vendor, "HOST");
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGdrMemAlloc(void **ptr, size_t size,
+                                      void *memHandle) {
+  if (ptr == NULL) {
+    return flagcxInvalidArgument;
+  }
+  FLAGCXCHECK(hostMapAlloc(ptr, size));
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGdrMemFree(void *ptr, void *memHandle) {
+  if (ptr == NULL) {
+    return flagcxSuccess;
+  }
+  FLAGCXCHECK(hostMapFree(ptr));
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorStreamCreate(flagcxStream_t *stream) {
+  (*stream) = NULL;
+  FLAGCXCHECK(flagcxCalloc(stream, 1));
+  struct flagcxHostStream *s = new struct flagcxHostStream();
+  s->stop = false;
+  DEVCHECK(pthread_create(&s->thread, NULL, hostStreamWorker, s));
+  flagcxSetThreadName(s->thread, "FLAGCX HostStream");
+  {
+    std::lock_guard<std::mutex> lock(hostStreamMutex);
+    hostStreams.insert(s);
+  }
+  (*stream)->base = s;
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorStreamDestroy(flagcxStream_t stream) {
+  if (stream != NULL) {
+    struct flagcxHostStream *s = stream->base;
+    {
+      std::lock_guard<std::mutex> lock(hostStreamMutex);
+      hostStreams.erase(s);
+    }
+    // pending operations run before the worker stops
+    hostStreamEnqueue(s, [s]() { s->stop = true; });
+    pthread_join(s->thread, NULL);
+    delete s;
+    free(stream);
+    stream = NULL;
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorStreamCopy(flagcxStream_t *newStream,
+                                     void *oldStream) {
+  (*newStream) = NULL;
+  FLAGCXCHECK(flagcxCalloc(newStream, 1));
+  memcpy((void *)*newStream, oldStream, sizeof(struct flagcxHostStream *));
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorStreamFree(flagcxStream_t stream) {
+  if (stream != NULL) {
+    free(stream);
+    stream = NULL;
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorStreamSynchronize(flagcxStream_t stream) {
+  if (stream != NULL) {
+    hostStreamWait(stream->base);
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorStreamQuery(flagcxStream_t stream) {
+  flagcxResult_t res = flagcxSuccess;
+  if (stream != NULL) {
+    struct flagcxHostStream *s = stream->base;
+    if (s->completed.value.load() != s->submitted.value.load()) {
+      res = flagcxInProgress;
+    }
+  }
+  return res;
+}
+
+flagcxResult_t hostAdaptorStreamWaitEvent(flagcxStream_t stream,
+                                          flagcxEvent_t event) {
+  if (stream != NULL && event != NULL) {
+    std::shared_ptr<struct flagcxHostEvent> e = event->base;
+    uint32_t target = e->recorded.load();
+    hostStreamEnqueue(stream->base,
+                      [e, target]() { hostSeqWait(&e->done, target); });
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorEventCreate(flagcxEvent_t *event) {
+  (*event) = new struct flagcxEvent();
+  (*event)->base = std::make_shared<struct flagcxHostEvent>();
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorEventDestroy(flagcxEvent_t event) {
+  if (event != NULL) {
+    // operations still referring to the event keep it alive
+    delete event;
+    event = NULL;
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorEventRecord(flagcxEvent_t event,
+                                      flagcxStream_t stream) {
+  if (event != NULL) {
+    std::shared_ptr<struct flagcxHostEvent> e = event->base;
+    uint32_t target = e->recorded.fetch_add(1) + 1;
+    if (stream != NULL) {
+      hostStreamEnqueue(stream->base,
+                        [e, target]() { hostSeqAdvance(&e->done, target); });
+    } else {
+      hostSeqAdvance(&e->done, target);
+    }
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorEventSynchronize(flagcxEvent_t event) {
+  if (event != NULL) {
+    hostSeqWait(&event->base->done, event->base->recorded.load());
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorEventQuery(flagcxEvent_t event) {
+  flagcxResult_t res = flagcxSuccess;
+  if (event != NULL) {
+    struct flagcxHostEvent *e = event->base.get();
+    if ((int32_t)(e->done.value.load() - e->recorded.load()) < 0) {
+      res = flagcxInProgress;
+    }
+  }
+  return res;
+}
+
+flagcxResult_t hostAdaptorLaunchHostFunc(flagcxStream_t stream,
+                                         void (*fn)(void *), void *args) {
+  if (stream != NULL) {
+    hostStreamEnqueue(stream->base, [fn, args]() { fn(args); });
+  } else {
+    fn(args);
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGetDeviceProperties(struct flagcxDevProps *props,
+                                              int dev) {
+  if (props == NULL) {
+    return flagcxInvalidArgument;
+  }
+  snprintf(props->name, sizeof(props->name), "HOST %d", dev);
+  props->pciBusId = dev;
+  props->pciDeviceId = 0;
+  props->pciDomainId = 0xffff;
+  return flagcxSuccess;
+}
+
+// Host devices get distinct bus ids in an unused PCI domain, so that ranks
+// sharing a host are not seen as duplicates
+flagcxResult_t hostAdaptorGetDevicePciBusId(char *pciBusId, int len, int dev) {
+  if (pciBusId == NULL) {
+    return flagcxInvalidArgument;
+  }
+  snprintf(pciBusId, len, "ffff:%02x:00.0", dev);
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostAdaptorGetDeviceByPciBusId(int *dev, const char *pciBusId) {
+  if (dev == NULL || pciBusId == NULL) {
+    return flagcxInvalidArgument;
+  }
+  unsigned int domain, bus;
+  if (sscanf(pciBusId, "%x:%x", &domain, &bus) != 2 || domain != 0xffff ||
+      (int)bus >= flagcxParamHostDeviceCount()) {
+    return flagcxInvalidArgument;
+  }
+  *dev = bus;
+  return flagcxSuccess;
+}
+
+struct flagcxDeviceAdaptor hostAdaptor {
+  "HOST",
+      // Basic functions
+      hostAdaptorDeviceSynchronize, hostAdaptorDeviceMemcpy,
+      hostAdaptorDeviceMemset, hostAdaptorDeviceMalloc, hostAdaptorDeviceFree,
+      hostAdaptorSetDevice, hostAdaptorGetDevice, hostAdaptorGetDeviceCount,
+      hostAdaptorGetVendor,
+      // GDR functions
+      NULL, // flagcxResult_t (*memHandleInit)(int dev_id, void **memHandle);
+      NULL, // flagcxResult_t (*memHandleDestroy)(int dev, void *memHandle);
+      hostAdaptorGdrMemAlloc, hostAdaptorGdrMemFree,
+      NULL, // flagcxResult_t (*hostShareMemAlloc)(void **ptr, size_t size, void
+            // *memHandle);
+      NULL, // flagcxResult_t (*hostShareMemFree)(void *ptr, void *memHandle);
+      // Stream functions
+      hostAdaptorStreamCreate, hostAdaptorStreamDestroy, hostAdaptorStreamCopy,
+      hostAdaptorStreamFree, hostAdaptorStreamSynchronize,
+      hostAdaptorStreamQuery, hostAdaptorStreamWaitEvent,
+      // Event functions
+      hostAdaptorEventCreate, hostAdaptorEventDestroy, hostAdaptorEventRecord,
+      hostAdaptorEventSynchronize, hostAdaptorEventQuery,
+      // Kernel launch
+      NULL, // flagcxResult_t (*launchKernel)(void *func, unsigned int block_x,
+            // unsigned int block_y, unsigned int block_z, unsigned int grid_x,
+            // unsigned int grid_y, unsigned int grid_z, void **args, size_t
+            // share_mem, void *stream, void *memHandle);
+      NULL, // flagcxResult_t (*copyArgsInit)(void **args);
+      NULL, // flagcxResult_t (*copyArgsFree)(void *args);
+      // Others
+      hostAdaptorGetDeviceProperties, // flagcxResult_t
+                                      // (*getDeviceProperties)(struct
+                                      // flagcxDevProps *props, int dev);
+      hostAdaptorGetDevicePciBusId, // flagcxResult_t (*getDevicePciBusId)(char
+                                    // *pciBusId, int len, int dev);
+      hostAdaptorGetDeviceByPciBusId, // flagcxResult_t
+                                      // (*getDeviceByPciBusId)(int
+                                      // *dev, const char *pciBusId);
+      hostAdaptorLaunchHostFunc
+};
+
+#endif // USE_HOST_ADAPTOR
@@ -0,0 +1,51 @@
+#ifdef USE_HOST_ADAPTOR
+
+#include "adaptor.h"
+#include "alloc.h"
+#include "comm.h"
+#include "flagcx.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+
+// Monotonic counter that threads can sleep on through a futex
+struct flagcxHostSeq {
+  std::atomic<uint32_t> value{0};
+  std::atomic<int> waiters{0};
+};
+
+// A stream is a worker thread running its operations in submission order
+struct flagcxHostStream {
+  pthread_t thread;
+  std::mutex mutex;
+  std::deque<std::function<void()>> ops;
+  struct flagcxHostSeq submitted;
+  struct flagcxHostSeq completed;
+  bool stop;
+};
+
+// An event is complete once the last record reached its stream position
+struct flagcxHostEvent {
+  std::atomic<uint32_t> recorded{0};
+  struct flagcxHostSeq done;
+};
+
+struct flagcxStream {
+  struct flagcxHostStream *base;
+};
+
+struct flagcxEvent {
+  std::shared_ptr<struct flagcxHostEvent> base;
+};
+
+#define DEVCHECK(func)                                                         \
+  {                                                                            \
+    int ret = func;                                                            \
+    if (ret != 0)                                                              \
+      return flagcxUnhandledDeviceError;                                       \
+  }
+
+#endif // USE_HOST_ADAPTOR
@@ -0,0 +1,386 @@
+#include "host_ccl_adaptor.h"
+
+#if defined(USE_BOOTSTRAP_ADAPTOR) && defined(USE_GLOO_ADAPTOR)
+
+#include "param.h"
+#include <vector>
+
+// Time both backends at communicator creation to fill the dispatch table
+FLAGCX_PARAM(HostCCLTune, "HOST_CCL_TUNE", 0);
+FLAGCX_PARAM(HostCCLTuneMaxBytes, "HOST_CCL_TUNE_MAX_BYTES", 16 << 20);
+FLAGCX_PARAM(HostCCLTuneIters, "HOST_CCL_TUNE_ITERS", 4);
+
+#define FLAGCX_HOST_CCL_TUNE_MIN_BYTES 1024
+
+static struct flagcxCCLAdaptor *hostCCLBackends[flagcxHostCCLNumBackends] = {
+    &bootstrapAdaptor, &glooAdaptor};
+
+static const char *hostCCLOpNames[flagcxHostCCLNumOps] = {
+    "AllReduce", "AllGather", "AlltoAll", "SendRecv"};
+
+static void hostCCLTableFill(struct flagcxHostCCLTable *table, int backend) {
+  for (int op = 0; op < flagcxHostCCLNumOps; op++) {
+    table->nBuckets[op] = 1;
+    table->buckets[op][0] = {SIZE_MAX, backend};
+  }
+}
+
+static int hostCCLSelect(flagcxInnerComm_t comm, int op, size_t bytes) {
+  const struct flagcxHostCCLBucket *buckets = comm->table.buckets[op];
+  int b = 0;
+  while (b < comm->table.nBuckets[op] - 1 && bytes > buckets[b].maxBytes) {
+    b++;
+  }
+  return buckets[b].backend;
+}
+
+#define HOSTCCL_DISPATCH(comm, op, bytes, func, ...)                           \
+  do {                                                                         \
+    int backend = hostCCLSelect(comm, op, bytes);                              \
+    return hostCCLBackends[backend]->func(__VA_ARGS__,                         \
+                                          comm->backends[backend], stream);    \
+  } while (0)
+
+#define HOSTCCL_BOOTSTRAP(comm, func, ...)                                     \
+  bootstrapAdaptor.func(__VA_ARGS__, comm->backends[flagcxHostCCLBootstrap],   \
+                        stream)
+
+// Run one op of the benchmark on the given backend, bytes is the size the
+// dispatcher sees for the op
+static flagcxResult_t hostCCLTuneRun(flagcxInnerComm_t comm, int op,
+                                     int backend, size_t bytes, int nranks,
+                                     void *sendbuff, void *recvbuff) {
+  struct flagcxCCLAdaptor *adaptor = hostCCLBackends[backend];
+  flagcxInnerComm_t inner = comm->backends[backend];
+  size_t count = bytes / sizeof(float);
+  switch (op) {
+    case flagcxHostCCLOpAllReduce:
+      return adaptor->allReduce(sendbuff, recvbuff, count, flagcxFloat,
+                                flagcxSum, inner, NULL);
+    case flagcxHostCCLOpAllGather:
+      return adaptor->allGather(sendbuff, recvbuff, count / nranks,
+                                flagcxFloat, inner, NULL);
+    case flagcxHostCCLOpAlltoAll:
+      return adaptor->alltoAll(sendbuff, recvbuff, count / nranks, flagcxFloat,
+                               inner, NULL);
+  }
+  return flagcxInternalError;
+}
+
+// Sweep the sizes on both backends and keep the faster one for each size.
+// The slowest rank decides, so that every rank builds the same table.
+static flagcxResult_t hostCCLTune(flagcxInnerComm_t comm, int rank, int nranks,
+                                  bootstrapState *bootstrap) {
+  size_t maxBytes = std::max<int64_t>(flagcxParamHostCCLTuneMaxBytes(),
+                                      FLAGCX_HOST_CCL_TUNE_MIN_BYTES);
+  int iters = std::max<int64_t>(flagcxParamHostCCLTuneIters(), 1);
+  std::vector<size_t> sizes;
+  for (size_t bytes = FLAGCX_HOST_CCL_TUNE_MIN_BYTES;
+       bytes <= maxBytes && sizes.size() < FLAGCX_HOST_CCL_MAX_BUCKETS;
+       bytes *= 4) {
+    sizes.push_back(bytes);
+  }
+  int nSizes = sizes.size();
+  // the send/recv row keeps its default
+  int nOps = flagcxHostCCLOpSendRecv;
+  std::vector<double> localTimes(nOps * nSizes * flagcxHostCCLNumBackends);
+  std::vector<double> times(localTimes.size());
+  char *sendbuff, *recvbuff;
+  FLAGCXCHECK(flagcxCalloc(&sendbuff, sizes.back()));
+  FLAGCXCHECK(flagcxCalloc(&recvbuff, sizes.back()));
+  uint64_t start = clockNano();
+  flagcxResult_t ret = flagcxSuccess;
+  for (int op = 0; op < nOps; op++) {
+    for (int s = 0; s < nSizes; s++) {
+      for (int backend = 0; backend < flagcxHostCCLNumBackends; backend++) {
+        // the first iteration warms up
+        uint64_t t0 = 0;
+        for (int i = -1; i < iters; i++) {
+          if (i == 0) {
+            t0 = clockNano();
+          }
+          FLAGCXCHECKGOTO(hostCCLTuneRun(comm, op, backend, sizes[s], nranks,
+                                         sendbuff, recvbuff),
+                          ret, exit);
+        }
+        localTimes[(op * nSizes + s) * flagcxHostCCLNumBackends + backend] =
+            (clockNano() - t0) / 1e3 / iters;
+      }
+    }
+  }
+  FLAGCXCHECKGOTO(AllReduceBootstrap(bootstrap, localTimes.data(),
+                                     times.data(), times.size(), flagcxDouble,
+                                     flagcxMax),
+                  ret, exit);
+
+  for (int op = 0; op < nOps; op++) {
+    int n = 0;
+    for (int s = 0; s < nSizes; s++) {
+      double *t = times.data() + (op * nSizes + s) * flagcxHostCCLNumBackends;
+      int backend = t[flagcxHostCCLGloo] < t[flagcxHostCCLBootstrap]
+                        ? flagcxHostCCLGloo
+                        : flagcxHostCCLBootstrap;
+      if (n > 0 && comm->table.buckets[op][n - 1].backend == backend) {
+        comm->table.buckets[op][n - 1].maxBytes = sizes[s];
+      } else {
+        comm->table.buckets[op][n++] = {sizes[s], backend};
+      }
+      if (rank == 0) {
+        INFO(FLAGCX_INIT,
+             "HOST_CCL tune: %s %zu bytes bootstrap %.1f us gloo %.1f us",
+             hostCCLOpNames[op], sizes[s], t[flagcxHostCCLBootstrap],
+             t[flagcxHostCCLGloo]);
+      }
+    }
+    comm->table.buckets[op][n - 1].maxBytes = SIZE_MAX;
+    comm->table.nBuckets[op] = n;
+  }
+  INFO(FLAGCX_INIT, "HOST_CCL tune: %d sizes up to %zu bytes in %.2f ms",
+       nSizes, sizes.back(), (clockNano() - start) / 1e6);
+
+exit:
+  free(sendbuff);
+  free(recvbuff);
+  return ret;
+}
+
+flagcxResult_t hostCCLAdaptorGetVersion(int *version) {
+  return bootstrapAdaptor.getVersion(version);
+}
+
+flagcxResult_t hostCCLAdaptorGetUniqueId(flagcxUniqueId_t *uniqueId) {
+  return bootstrapAdaptor.getUniqueId(uniqueId);
+}
+
+const char *hostCCLAdaptorGetErrorString(flagcxResult_t result) {
+  return bootstrapAdaptor.getErrorString(result);
+}
+
+const char *hostCCLAdaptorGetLastError(flagcxInnerComm_t comm) {
+  return bootstrapAdaptor.getLastError(
+      comm->backends[flagcxHostCCLBootstrap]);
+}
+
+flagcxResult_t hostCCLAdaptorCommInitRank(flagcxInnerComm_t *comm, int nranks,
+                                          flagcxUniqueId_t commId, int rank,
+                                          bootstrapState *bootstrap) {
+  if (bootstrap == NULL) {
+    WARN("HOST_CCL needs the bootstrap state of the communicator");
+    return flagcxInvalidUsage;
+  }
+  if (*comm == NULL) {
+    FLAGCXCHECK(flagcxCalloc(comm, 1));
+  }
+  for (int b = 0; b < flagcxHostCCLNumBackends; b++) {
+    FLAGCXCHECK(hostCCLBackends[b]->commInitRank(
+        &(*comm)->backends[b], nranks, commId, rank, bootstrap));
+  }
+
+  // FLAGCX_HOST_CCL forces a backend, gloo serves its ops by default
+  const char *forced = flagcxGetEnv("FLAGCX_HOST_CCL");
+  if (forced && strcasecmp(forced, "bootstrap") == 0) {
+    hostCCLTableFill(&(*comm)->table, flagcxHostCCLBootstrap);
+  } else if (forced && strcasecmp(forced, "gloo") == 0) {
+    hostCCLTableFill(&(*comm)->table, flagcxHostCCLGloo);
+  } else {
+    hostCCLTableFill(&(*comm)->table, flagcxHostCCLGloo);
+    if (flagcxParamHostCCLTune()) {
+      FLAGCXCHECK(hostCCLTune(*comm, rank, nranks, bootstrap));
+    }
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostCCLAdaptorCommFinalize(flagcxInnerComm_t comm) {
+  for (int b = 0; b < flagcxHostCCLNumBackends; b++) {
+    FLAGCXCHECK(hostCCLBackends[b]->commFinalize(comm->backends[b]));
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostCCLAdaptorCommDestroy(flagcxInnerComm_t comm) {
+  for (int b = 0; b < flagcxHostCCLNumBackends; b++) {
+    FLAGCXCHECK(hostCCLBackends[b]->commDestroy(comm->backends[b]));
+  }
+  free(comm);
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostCCLAdaptorCommAbort(flagcxInnerComm_t comm) {
+  for (int b = 0; b < flagcxHostCCLNumBackends; b++) {
+    FLAGCXCHECK(hostCCLBackends[b]->commAbort(comm->backends[b]));
+  }
+  return flagcxSuccess;
+}
+
+// TODO: unsupported
+flagcxResult_t hostCCLAdaptorCommResume(flagcxInnerComm_t comm) {
+  return flagcxNotSupported;
+}
+
+// TODO: unsupported
+flagcxResult_t hostCCLAdaptorCommSuspend(flagcxInnerComm_t comm) {
+  return flagcxNotSupported;
+}
+
+flagcxResult_t hostCCLAdaptorCommCount(const flagcxInnerComm_t comm,
+                                       int *count) {
+  return bootstrapAdaptor.commCount(comm->backends[flagcxHostCCLBootstrap],
+                                    count);
+}
+
+flagcxResult_t hostCCLAdaptorCommCuDevice(const flagcxInnerComm_t comm,
+                                          int *device) {
+  return bootstrapAdaptor.commGetDeviceNumber(
+      comm->backends[flagcxHostCCLBootstrap], device);
+}
+
+flagcxResult_t hostCCLAdaptorCommUserRank(const flagcxInnerComm_t comm,
+                                          int *rank) {
+  return bootstrapAdaptor.commUserRank(comm->backends[flagcxHostCCLBootstrap],
+                                       rank);
+}
+
+// TODO: unsupported
+flagcxResult_t hostCCLAdaptorCommGetAsyncError(flagcxInnerComm_t comm,
+                                               flagcxResult_t *asyncError) {
+  return flagcxNotSupported;
+}
+
+flagcxResult_t hostCCLAdaptorReduce(const void *sendbuff, void *recvbuff,
+                                    size_t count, flagcxDataType_t datatype,
+                                    flagcxRedOp_t op, int root,
+                                    flagcxInnerComm_t comm,
+                                    flagcxStream_t stream) {
+  return HOSTCCL_BOOTSTRAP(comm, reduce, sendbuff, recvbuff, count, datatype,
+                           op, root);
+}
+
+flagcxResult_t hostCCLAdaptorGather(const void *sendbuff, void *recvbuff,
+                                    size_t count, flagcxDataType_t datatype,
+                                    int root, flagcxInnerComm_t comm,
+                                    flagcxStream_t stream) {
+  return HOSTCCL_BOOTSTRAP(comm, gather, sendbuff, recvbuff, count, datatype,
+                           root);
+}
+
+flagcxResult_t hostCCLAdaptorScatter(const void *sendbuff, void *recvbuff,
+                                     size_t count, flagcxDataType_t datatype,
+                                     int root, flagcxInnerComm_t comm,
+                                     flagcxStream_t stream) {
+  return HOSTCCL_BOOTSTRAP(comm, scatter, sendbuff, recvbuff, count, datatype,
+                           root);
+}
+
+flagcxResult_t hostCCLAdaptorBroadcast(const void *sendbuff, void *recvbuff,
+                                       size_t count, flagcxDataType_t datatype,
+                                       int root, flagcxInnerComm_t comm,
+                                       flagcxStream_t stream) {
+  return HOSTCCL_BOOTSTRAP(comm, broadcast, sendbuff, recvbuff, count,
+                           datatype, root);
+}
+
+flagcxResult_t hostCCLAdaptorAllReduce(const void *sendbuff, void *recvbuff,
+                                       size_t count, flagcxDataType_t datatype,
+                                       flagcxRedOp_t op, flagcxInnerComm_t comm,
+                                       flagcxStream_t stream) {
+  HOSTCCL_DISPATCH(comm, flagcxHostCCLOpAllReduce,
+                   count * getFlagcxDataTypeSize(datatype), allReduce,
+                   sendbuff, recvbuff, count, datatype, op);
+}
+
+flagcxResult_t
+hostCCLAdaptorReduceScatter(const void *sendbuff, void *recvbuff,
+                            size_t recvcount, flagcxDataType_t datatype,
+                            flagcxRedOp_t op, flagcxInnerComm_t comm,
+                            flagcxStream_t stream) {
+  return HOSTCCL_BOOTSTRAP(comm, reduceScatter, sendbuff, recvbuff, recvcount,
+                           datatype, op);
+}
+
+flagcxResult_t hostCCLAdaptorAllGather(const void *sendbuff, void *recvbuff,
+                                       size_t sendcount,
+                                       flagcxDataType_t datatype,
+                                       flagcxInnerComm_t comm,
+                                       flagcxStream_t stream) {
+  int nranks;
+  FLAGCXCHECK(hostCCLAdaptorCommCount(comm, &nranks));
+  HOSTCCL_DISPATCH(comm, flagcxHostCCLOpAllGather,
+                   sendcount * getFlagcxDataTypeSize(datatype) * nranks,
+                   allGather, sendbuff, recvbuff, sendcount, datatype);
+}
+
+flagcxResult_t hostCCLAdaptorAlltoAll(const void *sendbuff, void *recvbuff,
+                                      size_t count, flagcxDataType_t datatype,
+                                      flagcxInnerComm_t comm,
+                                      flagcxStream_t stream) {
+  int nranks;
+  FLAGCXCHECK(hostCCLAdaptorCommCount(comm, &nranks));
+  HOSTCCL_DISPATCH(comm, flagcxHostCCLOpAlltoAll,
+                   count * getFlagcxDataTypeSize(datatype) * nranks, alltoAll,
+                   sendbuff, recvbuff, count, datatype);
+}
+
+flagcxResult_t
+hostCCLAdaptorAlltoAllv(const void *sendbuff, size_t *sendcounts,
+                        size_t *sdispls, void *recvbuff, size_t *recvcounts,
+                        size_t *rdispls, flagcxDataType_t datatype,
+                        flagcxInnerComm_t comm, flagcxStream_t stream) {
+  return HOSTCCL_BOOTSTRAP(comm, alltoAllv, sendbuff, sendcounts, sdispls,
+                           recvbuff, recvcounts, rdispls, datatype);
+}
+
+// Both sides see the same size, so a send and its recv pick the same backend
+flagcxResult_t hostCCLAdaptorSend(const void *sendbuff, size_t count,
+                                  flagcxDataType_t datatype, int peer,
+                                  flagcxInnerComm_t comm,
+                                  flagcxStream_t stream) {
+  HOSTCCL_DISPATCH(comm, flagcxHostCCLOpSendRecv,
+                   count * getFlagcxDataTypeSize(datatype), send, sendbuff,
+                   count, datatype, peer);
+}
+
+flagcxResult_t hostCCLAdaptorRecv(void *recvbuff, size_t count,
+                                  flagcxDataType_t datatype, int peer,
+                                  flagcxInnerComm_t comm,
+                                  flagcxStream_t stream) {
+  HOSTCCL_DISPATCH(comm, flagcxHostCCLOpSendRecv,
+                   count * getFlagcxDataTypeSize(datatype), recv, recvbuff,
+                   count, datatype, peer);
+}
+
+flagcxResult_t hostCCLAdaptorGroupStart() {
+  for (int b = 0; b < flagcxHostCCLNumBackends; b++) {
+    FLAGCXCHECK(hostCCLBackends[b]->groupStart());
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t hostCCLAdaptorGroupEnd() {
+  for (int b = 0; b < flagcxHostCCLNumBackends; b++) {
+    FLAGCXCHECK(hostCCLBackends[b]->groupEnd());
+  }
+  return flagcxSuccess;
+}
+
+struct flagcxCCLAdaptor hostCCLAdaptor = {
+    "HOSTCCL",
+    // Basic functions
+    hostCCLAdaptorGetVersion, hostCCLAdaptorGetUniqueId,
+    hostCCLAdaptorGetErrorString, hostCCLAdaptorGetLastError,
+    // Communicator functions
+    hostCCLAdaptorCommInitRank, hostCCLAdaptorCommFinalize,
+    hostCCLAdaptorCommDestroy, hostCCLAdaptorCommAbort,
+    hostCCLAdaptorCommResume, hostCCLAdaptorCommSuspend,
+    hostCCLAdaptorCommCount, hostCCLAdaptorCommCuDevice,
+    hostCCLAdaptorCommUserRank, hostCCLAdaptorCommGetAsyncError,
+    // Communication functions
+    hostCCLAdaptorReduce, hostCCLAdaptorGather, hostCCLAdaptorScatter,
+    hostCCLAdaptorBroadcast, hostCCLAdaptorAllReduce,
+    hostCCLAdaptorReduceScatter, hostCCLAdaptorAllGather,
+    hostCCLAdaptorAlltoAll, hostCCLAdaptorAlltoAllv, hostCCLAdaptorSend,
+    hostCCLAdaptorRecv,
+    // Group semantics
+    hostCCLAdaptorGroupStart, hostCCLAdaptorGroupEnd};
+
+#endif // USE_BOOTSTRAP_ADAPTOR && USE_GLOO_ADAPTOR
@@ -0,0 +1,45 @@
+#if defined(USE_BOOTSTRAP_ADAPTOR) && defined(USE_GLOO_ADAPTOR)
+
+#include "adaptor.h"
+#include "alloc.h"
+#include "check.h"
+#include "comm.h"
+#include "flagcx.h"
+#include "utils.h"
+
+#define FLAGCX_HOST_CCL_MAX_BUCKETS 16
+
+enum flagcxHostCCLBackend {
+  flagcxHostCCLBootstrap = 0,
+  flagcxHostCCLGloo = 1,
+  flagcxHostCCLNumBackends = 2
+};
+
+// Ops both backends implement, the others always go to bootstrap
+enum flagcxHostCCLOp {
+  flagcxHostCCLOpAllReduce = 0,
+  flagcxHostCCLOpAllGather = 1,
+  flagcxHostCCLOpAlltoAll = 2,
+  flagcxHostCCLOpSendRecv = 3,
+  flagcxHostCCLNumOps = 4
+};
+
+// Messages up to maxBytes use backend, buckets are sorted by size and the
+// last one is unbounded
+struct flagcxHostCCLBucket {
+  size_t maxBytes;
+  int backend;
+};
+
+struct flagcxHostCCLTable {
+  int nBuckets[flagcxHostCCLNumOps];
+  struct flagcxHostCCLBucket buckets[flagcxHostCCLNumOps]
+                                   [FLAGCX_HOST_CCL_MAX_BUCKETS];
+};
+
+struct flagcxInnerComm {
+  flagcxInnerComm_t backends[flagcxHostCCLNumBackends];
+  struct flagcxHostCCLTable table;
+};
+
+#endif // USE_BOOTSTRAP_ADAPTOR && USE_GLOO_ADAPTOR
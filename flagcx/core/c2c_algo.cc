@@ -1,13 +1,19 @@
 #include "c2c_algo.h"
 #include <cstdint>
 
+const char *flagcxC2cAlgoStr[] = {"Default", "MultiNicBfs", "MultiNicDfs",
+                                  "SingleNic", "HostComm"};
+
 size_t getC2cCommPatternHash(size_t count, flagcxCommOp_t commOp,
-                             flagcxRedOp_t redOp, flagcxComm_t comm) {
+                             flagcxRedOp_t redOp, flagcxDataType_t datatype,
+                             flagcxComm_t comm) {
   std::size_t h1 = std::hash<size_t>()(count);
   std::size_t h2 = std::hash<size_t>()(commOp);
   std::size_t h3 = std::hash<size_t>()(redOp);
   std::size_t h4 = std::hash<size_t>()((size_t)((uintptr_t)comm));
-  return static_cast<size_t>(h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3));
+  std::size_t h5 = std::hash<size_t>()(datatype);
+  return static_cast<size_t>(h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^
+                             (h5 << 4));
 }
 
 // homoType: 0, pre; 1, homoInter; 2, post,
@@ -78,21 +84,21 @@ flagcxCommOp_t getC2cHomoCommOp(flagcxCommOp_t commOp, int homoType, int mode) {
 }
 
 flagcxInterRankBufferInfoManager::flagcxInterRankBufferInfoManager(
-    int totalCount)
+    size_t totalCount)
     : totalCount_(totalCount) {}
 
 flagcxInterRankBufferInfoManager::~flagcxInterRankBufferInfoManager() {}
 
 bool flagcxInterRankBufferInfoManager::checkIfPossibleToPush(int clusterId,
                                                              int rank,
-                                                             int offset,
-                                                             int count) {
+                                                             size_t offset,
+                                                             size_t count) {
   if (auto clusterSearch = bufferInfos_.find(clusterId);
       clusterSearch != bufferInfos_.end()) {
     if (auto rankSearch = clusterSearch->second.find(rank);
         rankSearch != clusterSearch->second.end()) {
-      auto infoList = rankSearch->second;
-      for (auto info : infoList) {
+      const auto &infoList = rankSearch->second;
+      for (const auto &info : infoList) {
         if ((offset < info.offset_ && offset + count > info.offset_) ||
             offset == info.offset_ ||
             (offset > info.offset_ && offset < info.offset_ + info.count_)) {
@@ -105,16 +111,16 @@ bool flagcxInterRankBufferInfoManager::checkIfPossibleToPush(int clusterId,
 }
 
 bool flagcxInterRankBufferInfoManager::checkIfPossibleToSplitAndPush(
-    int clusterId, int rank, int offset, int count, int *splitCount,
+    int clusterId, int rank, size_t offset, size_t count, size_t *splitCount,
     int *pushMode) {
-  int maxSplitCount = 0;
+  size_t maxSplitCount = 0;
   int finalPushMode = 0; // 0: prePush, 1: postPush
   if (auto clusterSearch = bufferInfos_.find(clusterId);
       clusterSearch != bufferInfos_.end()) {
     if (auto rankSearch = clusterSearch->second.find(rank);
         rankSearch != clusterSearch->second.end()) {
-      auto infoList = rankSearch->second;
-      for (auto info : infoList) {
+      const auto &infoList = rankSearch->second;
+      for (const auto &info : infoList) {
         if (offset < info.offset_ && offset + count > info.offset_) {
           if (checkIfPossibleToPush(clusterId, rank, offset,
                                     info.offset_ - offset)) {
@@ -144,13 +150,13 @@ bool flagcxInterRankBufferInfoManager::checkIfPossibleToSplitAndPush(
 }
 
 bool flagcxInterRankBufferInfoManager::checkIsFull(int clusterId, int rank) {
-  int rankCount = 0;
+  size_t rankCount = 0;
   if (auto clusterSearch = bufferInfos_.find(clusterId);
       clusterSearch != bufferInfos_.end()) {
     if (auto rankSearch = clusterSearch->second.find(rank);
         rankSearch != clusterSearch->second.end()) {
-      auto infoList = rankSearch->second;
-      for (auto info : infoList) {
+      const auto &infoList = rankSearch->second;
+      for (const auto &info : infoList) {
         rankCount += info.count_;
       }
     }
@@ -167,8 +173,8 @@ bool flagcxInterRankBufferInfoManager::checkIsScheduled(int clusterId,
       clusterSearch != bufferInfos_.end()) {
     if (auto rankSearch = clusterSearch->second.find(rank);
         rankSearch != clusterSearch->second.end()) {
-      auto infoList = rankSearch->second;
-      for (auto info : infoList) {
+      const auto &infoList = rankSearch->second;
+      for (const auto &info : infoList) {
         if (!info.isScheduled_) {
           return false;
         }
@@ -196,7 +202,7 @@ flagcxInterRankBufferInfoManager::getBufferInfoList(int clusterId, int rank) {
 }
 
 void flagcxInterRankBufferInfoManager::pushBackBufferInfo(
-    int clusterId, int rank, int offset, int count, int clusterIdToSend,
+    int clusterId, int rank, size_t offset, size_t count, int clusterIdToSend,
     int isRecv, int isScheduled, int peerRank, int loopId) {
   bufferInfos_[clusterId][rank].emplace_back(
       offset, count, clusterIdToSend, isRecv, isScheduled, peerRank, loopId);
@@ -227,7 +233,7 @@ void flagcxInterRankBufferInfoManager::printBufferInfo(int step) {
         if (step == 0) {
           TRACE_CALL(
               "Initial InterRankBufferInfo: cluster_id = %d, rank = %d, "
-              "offset = %d, count = %d, clusterIdToSend = %d, "
+              "offset = %zu, count = %zu, clusterIdToSend = %d, "
               "isRecv = %d, isScheduled = %d, peerRank = %d, loopId = %d",
               clusterIt->first, rankIt->first, bufferIt->offset_,
               bufferIt->count_, bufferIt->clusterIdToSend_, bufferIt->isRecv_,
@@ -235,7 +241,7 @@ void flagcxInterRankBufferInfoManager::printBufferInfo(int step) {
         } else if (step == 1) {
           TRACE_CALL(
               "Internal InterRankBufferInfo: cluster_id = %d, rank = %d, "
-              "offset = %d, count = %d, clusterIdToSend = %d, "
+              "offset = %zu, count = %zu, clusterIdToSend = %d, "
               "isRecv = %d, isScheduled = %d, peerRank = %d, loopId = %d",
               clusterIt->first, rankIt->first, bufferIt->offset_,
               bufferIt->count_, bufferIt->clusterIdToSend_, bufferIt->isRecv_,
@@ -243,7 +249,7 @@ void flagcxInterRankBufferInfoManager::printBufferInfo(int step) {
         } else if (step == 2) {
           TRACE_CALL(
               "Final InterRankBufferInfo: cluster_id = %d, rank = %d, "
-              "offset = %d, count = %d, clusterIdToSend = %d, "
+              "offset = %zu, count = %zu, clusterIdToSend = %d, "
               "isRecv = %d, isScheduled = %d, peerRank = %d, loopId = %d",
               clusterIt->first, rankIt->first, bufferIt->offset_,
               bufferIt->count_, bufferIt->clusterIdToSend_, bufferIt->isRecv_,
@@ -254,8 +260,8 @@ void flagcxInterRankBufferInfoManager::printBufferInfo(int step) {
   }
 }
 
-flagcxC2cP2pOp::flagcxC2cP2pOp(int rank, int peerRank, int offset, int count,
-                               int isRecv)
+flagcxC2cP2pOp::flagcxC2cP2pOp(int rank, int peerRank, size_t offset,
+                               size_t count, int isRecv)
     : rank_(rank), peerRank_(peerRank), offset_(offset), count_(count),
       isRecv_(isRecv) {}
 flagcxC2cP2pOp::~flagcxC2cP2pOp() {}
@@ -263,8 +269,8 @@ flagcxC2cP2pOp::~flagcxC2cP2pOp() {}
 flagcxResult_t flagcxC2cP2pOp::run(void *buff, flagcxDataType_t datatype,
                                    flagcxComm_t comm, flagcxStream_t stream) {
   TRACE_CALL(
-      "flagcxC2cP2pOp run: rank = %d, peerRank = %d, offset = %d, count = %d, "
-      "isRecv = %d, datatype = %d",
+      "flagcxC2cP2pOp run: rank = %d, peerRank = %d, offset = %zu, count = "
+      "%zu, isRecv = %d, datatype = %d",
       comm->rank, peerRank_, offset_, count_, isRecv_, datatype);
   void *ptr =
       static_cast<char *>(buff) + offset_ * getFlagcxDataTypeSize(datatype);
@@ -277,8 +283,8 @@ flagcxResult_t flagcxC2cP2pOp::run(void *buff, flagcxDataType_t datatype,
   }
 }
 
-flagcxC2cHomoFunc::flagcxC2cHomoFunc(int rootRank, int sendOffset,
-                                     int recvOffset, int count,
+flagcxC2cHomoFunc::flagcxC2cHomoFunc(int rootRank, size_t sendOffset,
+                                     size_t recvOffset, size_t count,
                                      int isHomoInterComm, flagcxCommOp_t commOp)
     : rootRank_(rootRank), sendOffset_(sendOffset), recvOffset_(recvOffset),
       count_(count), isHomoInterComm_(isHomoInterComm), commOp_(commOp) {}
@@ -294,8 +300,8 @@ flagcxResult_t flagcxC2cHomoFunc::run(const void *sendbuff, void *recvbuff,
     return flagcxSuccess;
   }
   TRACE_CALL(
-      "flagcxC2cHomoFunc run: rank = %d, rootRank = %d, sendOffset = %d, "
-      "recvOffset = %d, count = %d, "
+      "flagcxC2cHomoFunc run: rank = %d, rootRank = %d, sendOffset = %zu, "
+      "recvOffset = %zu, count = %zu, "
       "isHomoInterComm = %d, commOp = %d, datatype = %d, redOp = %d, root = %d",
       comm->rank, rootRank_, sendOffset_, recvOffset_, count_, isHomoInterComm_,
       commOp_, datatype, redOp, root);
@@ -335,8 +341,8 @@ flagcxResult_t flagcxC2cHomoFunc::run(const void *sendbuff, void *recvbuff,
 flagcxC2cHeteroFunc::flagcxC2cHeteroFunc() {}
 flagcxC2cHeteroFunc::~flagcxC2cHeteroFunc() {}
 
-void flagcxC2cHeteroFunc::addP2pOp(int rank, int peerRank, int offset,
-                                   int count, int isRecv) {
+void flagcxC2cHeteroFunc::addP2pOp(int rank, int peerRank, size_t offset,
+                                   size_t count, int isRecv) {
   p2pOps_.emplace_back(rank, peerRank, offset, count, isRecv);
 }
 
@@ -344,7 +350,7 @@ flagcxResult_t flagcxC2cHeteroFunc::run(void *buff, flagcxDataType_t datatype,
                                         flagcxComm_t comm,
                                         flagcxStream_t stream) {
   flagcxHeteroGroupStart();
-  for (auto op : p2pOps_) {
+  for (auto &op : p2pOps_) {
     FLAGCXCHECK(op.run(buff, datatype, comm, stream));
   }
   flagcxHeteroGroupEnd();
@@ -353,14 +359,15 @@ flagcxResult_t flagcxC2cHeteroFunc::run(void *buff, flagcxDataType_t datatype,
 
 flagcxC2cRefreshFunc::flagcxC2cRefreshFunc()
     : offset_(0), count_(0), totalCount_(0), redOp_(flagcxSum) {}
-flagcxC2cRefreshFunc::flagcxC2cRefreshFunc(int offset, int count,
-                                           int totalCount, flagcxRedOp_t redOp)
+flagcxC2cRefreshFunc::flagcxC2cRefreshFunc(size_t offset, size_t count,
+                                           size_t totalCount,
+                                           flagcxRedOp_t redOp)
     : offset_(offset), count_(count), totalCount_(totalCount), redOp_(redOp) {}
 flagcxC2cRefreshFunc::~flagcxC2cRefreshFunc() {}
 
 flagcxResult_t flagcxC2cRefreshFunc::run(void *buff, flagcxDataType_t datatype,
                                          flagcxStream_t stream) {
-  TRACE_CALL("flagcxC2cRefreshFunc run: offset = %d, count = %d, "
+  TRACE_CALL("flagcxC2cRefreshFunc run: offset = %zu, count = %zu, "
              "datatype = %d, redOp = %d",
              offset_, count_, datatype, redOp_);
   if (redOp_ == flagcxSum) {
@@ -377,7 +384,7 @@ flagcxResult_t flagcxC2cRefreshFunc::run(void *buff, flagcxDataType_t datatype,
   return flagcxSuccess;
 }
 
-flagcxC2cPlanner::flagcxC2cPlanner(int totalCount, int recvCount,
+flagcxC2cPlanner::flagcxC2cPlanner(size_t totalCount, size_t recvCount,
                                    flagcxComm_t comm, flagcxCommOp_t commOp,
                                    flagcxRedOp_t redOp)
     : totalCount_(totalCount), recvCount_(recvCount), comm_(comm),
@@ -424,16 +431,37 @@ flagcxC2cPlanner::flagcxC2cPlanner(int totalCount, int recvCount,
 
 flagcxC2cPlanner::~flagcxC2cPlanner() {}
 
+flagcxResult_t flagcxC2cPlanner::setAlgo(flagcxC2cAlgo_t algo) {
+  switch (algo) {
+    case flagcxC2cAlgoMultiNicBfs:
+    case flagcxC2cAlgoMultiNicDfs:
+      if (!multiNic_) {
+        WARN("Multi-nic C2C algo %s is not available for this communicator",
+             flagcxC2cAlgoStr[algo]);
+        return flagcxInvalidUsage;
+      }
+      searchMethod_ = (algo == flagcxC2cAlgoMultiNicBfs) ? 1 : 0;
+      break;
+    case flagcxC2cAlgoSingleNic:
+      multiNic_ = 0;
+      break;
+    default:
+      break;
+  }
+  algo_ = algo;
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxC2cPlanner::refresh(int isSendRecv) {
   if (isSendRecv) {
     interRankBufferInfoManager_.resetBufferInfo();
     for (size_t i = 0; i < clusterInterRankList_.size(); ++i) {
       size_t nClusterInterRanks =
           multiNic_ ? clusterInterRankList_[i].size() : 1;
-      int sendCount = totalCount_ / nClusterInterRanks;
-      int sendRes = totalCount_ % nClusterInterRanks;
+      size_t sendCount = totalCount_ / nClusterInterRanks;
+      size_t sendRes = totalCount_ % nClusterInterRanks;
       for (size_t j = 0; j < nClusterInterRanks; ++j) {
-        int finalCount =
+        size_t finalCount =
             (j == nClusterInterRanks - 1) ? sendCount + sendRes : sendCount;
         for (size_t z = 0; z < clusterInterRankList_.size(); ++z) {
           if (i != z) {
@@ -495,8 +523,8 @@ flagcxResult_t flagcxC2cPlanner::searchHeteroSendRecvOps(int searchMethod,
               }
             }
             if (!it->isScheduled_) {
-              int splitCount = 0;
-              int maxSplitCount = 0;
+              size_t splitCount = 0;
+              size_t maxSplitCount = 0;
               int pushMode = 0;
               int finalPushMode = 0;
               int splitRank = clusterInterRankList_[z][0];
@@ -577,8 +605,8 @@ flagcxResult_t flagcxC2cPlanner::searchHeteroSendRecvOps(int searchMethod,
               }
             }
             if (!it->isScheduled_) {
-              int splitCount = 0;
-              int maxSplitCount = 0;
+              size_t splitCount = 0;
+              size_t maxSplitCount = 0;
               int pushMode = 0;
               int finalPushMode = 0;
               int splitRank = clusterInterRankList_[j][0];
@@ -689,7 +717,7 @@ flagcxResult_t flagcxC2cPlanner::findStrategy() {
     heteroAndHomoInterFuncLoops_ = 1;
     for (int i = 0; i < heteroAndHomoInterFuncLoops_; ++i) {
       // search by BFS or DFS
-      searchHeteroSendRecvOps(1, i);
+      searchHeteroSendRecvOps(searchMethod_, i);
 
       int scheduleCompleted = 1;
       for (size_t j = 0; j < clusterInterRankList_.size(); ++j) {
@@ -833,6 +861,38 @@ flagcxResult_t flagcxC2cPlanner::findStrategy() {
   return flagcxSuccess;
 }
 
+static void printHomoFuncs(FILE *file, const char *name,
+                           const std::vector<flagcxC2cHomoFunc> &funcs) {
+  for (size_t i = 0; i < funcs.size(); ++i) {
+    const flagcxC2cHomoFunc &func = funcs[i];
+    fprintf(file,
+            "  %s[%zu]: commOp = %d, rootRank = %d, sendOffset = %zu, "
+            "recvOffset = %zu, count = %zu, isHomoInterComm = %d\n",
+            name, i, func.commOp_, func.rootRank_, func.sendOffset_,
+            func.recvOffset_, func.count_, func.isHomoInterComm_);
+  }
+}
+
+void flagcxC2cPlanner::printStrategy(FILE *file) const {
+  fprintf(file,
+          "rank %d: algo = %s, multiNic = %d, eachNicPerRank = %d, "
+          "predictedTime = %.2f us\n",
+          rank_, flagcxC2cAlgoStr[algo_], multiNic_, eachNicPerRank_,
+          predictedTime_);
+  printHomoFuncs(file, "preHomo", preHomoFuncList_);
+  for (size_t i = 0; i < heteroFuncList_.size(); ++i) {
+    for (auto &op : heteroFuncList_[i].p2pOps_) {
+      fprintf(file,
+              "  hetero[%zu]: %s peerRank = %d, offset = %zu, count = %zu\n",
+              i,
+              op.isRecv_ ? "recv" : "send", op.peerRank_, op.offset_,
+              op.count_);
+    }
+  }
+  printHomoFuncs(file, "homoInter", homoInterFuncList_);
+  printHomoFuncs(file, "postHomo", postHomoFuncList_);
+}
+
 flagcxResult_t flagcxC2cPlanner::execute(const void *sendbuff, void *recvbuff,
                                          flagcxDataType_t datatype, int root,
                                          flagcxStream_t stream) {
@@ -844,11 +904,11 @@ flagcxResult_t flagcxC2cPlanner::execute(const void *sendbuff, void *recvbuff,
     }
   }
 
-  // init scratch buffer if needed
+  // get scratch buffer from the communicator arena if needed
   if (commOp_ == flagcxCommOpReduceScatter) {
-    deviceAdaptor->deviceMalloc(&scratchBuffer_,
-                                totalCount_ * getFlagcxDataTypeSize(datatype),
-                                flagcxMemDevice, stream);
+    FLAGCXCHECK(flagcxScratchArenaGet(
+        &comm_->scratchArena, totalCount_ * getFlagcxDataTypeSize(datatype),
+        stream, &scratchBuffer_));
   } else {
     scratchBuffer_ = nullptr;
   }
@@ -891,9 +951,10 @@ flagcxResult_t flagcxC2cPlanner::execute(const void *sendbuff, void *recvbuff,
                              comm_, stream);
   }
 
-  // free scratch buffer if needed
+  // return scratch buffer to the arena if needed
   if (scratchBuffer_ != nullptr) {
-    deviceAdaptor->deviceFree(scratchBuffer_, flagcxMemDevice, stream);
+    FLAGCXCHECK(flagcxScratchArenaRelease(&comm_->scratchArena, stream));
+    scratchBuffer_ = nullptr;
   }
 
   return flagcxSuccess;
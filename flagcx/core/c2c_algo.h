@@ -13,7 +13,19 @@
 #include <unordered_map>
 
 size_t getC2cCommPatternHash(size_t count, flagcxCommOp_t commOp,
-                             flagcxRedOp_t redOp, flagcxComm_t comm);
+                             flagcxRedOp_t redOp, flagcxDataType_t datatype,
+                             flagcxComm_t comm);
+
+// Candidate strategies scored by flagcxAlgoTimeEstimator
+typedef enum {
+  flagcxC2cAlgoDefault = 0, // chosen from the topology without estimation
+  flagcxC2cAlgoMultiNicBfs = 1,
+  flagcxC2cAlgoMultiNicDfs = 2,
+  flagcxC2cAlgoSingleNic = 3,
+  flagcxC2cAlgoHostComm = 4,
+  flagcxC2cAlgoNum = 5
+} flagcxC2cAlgo_t;
+extern const char *flagcxC2cAlgoStr[];
 
 template <typename Key, typename Value>
 class flagcxLRUCache {
@@ -63,15 +75,15 @@ flagcxCommOp_t getC2cHomoCommOp(flagcxCommOp_t commOp, int homoType, int mode);
 
 struct flagcxBufferInfo {
 public:
-  flagcxBufferInfo(int offset, int count, int clusterIdToSend, int isRecv,
+  flagcxBufferInfo(size_t offset, size_t count, int clusterIdToSend, int isRecv,
                    int isScheduled, int peerRank, int loopId)
       : offset_(offset), count_(count), clusterIdToSend_(clusterIdToSend),
         isRecv_(isRecv), isScheduled_(isScheduled), peerRank_(peerRank),
         loopId_(loopId) {}
   ~flagcxBufferInfo() {}
 
-  int offset_;
-  int count_;
+  size_t offset_;
+  size_t count_;
   int clusterIdToSend_; // only required for send
   int isRecv_;          // 0: send, 1: recv
   int isScheduled_;     // 0: un-scheduled, 1: scheduled
@@ -81,26 +93,28 @@ public:
 
 class flagcxInterRankBufferInfoManager {
 public:
-  flagcxInterRankBufferInfoManager(int totalCount);
+  flagcxInterRankBufferInfoManager(size_t totalCount);
   ~flagcxInterRankBufferInfoManager();
   flagcxInterRankBufferInfoManager() = default;
   flagcxInterRankBufferInfoManager(const flagcxInterRankBufferInfoManager &) =
       default;
 
-  bool checkIfPossibleToPush(int clusterId, int rank, int offset, int count);
-  bool checkIfPossibleToSplitAndPush(int clusterId, int rank, int offset,
-                                     int count, int *splitCount, int *pushMode);
+  bool checkIfPossibleToPush(int clusterId, int rank, size_t offset,
+                             size_t count);
+  bool checkIfPossibleToSplitAndPush(int clusterId, int rank, size_t offset,
+                                     size_t count, size_t *splitCount,
+                                     int *pushMode);
   bool checkIsFull(int clusterId, int rank);
   bool checkIsScheduled(int clusterId, int rank);
   std::list<flagcxBufferInfo> &getBufferInfoList(int clusterId, int rank);
-  void pushBackBufferInfo(int clusterId, int rank, int offset, int count,
+  void pushBackBufferInfo(int clusterId, int rank, size_t offset, size_t count,
                           int clusterIdToSend, int isRecv, int isScheduled,
                           int peerRank, int loopId);
   void popFrontBufferInfo(int clusterId, int rank);
   void resetBufferInfo();
   void printBufferInfo(int step); // 0: intial, 1: internal, 2: final
 
-  int totalCount_; // total communication count
+  size_t totalCount_; // total communication count
   std::map<int, std::map<int, std::list<flagcxBufferInfo>>>
       bufferInfos_; // map<clusterId, map<rank, list[struct{offset, count,
                     // isRecv, isScheduled}]>>
@@ -108,7 +122,8 @@ public:
 
 class flagcxC2cP2pOp {
 public:
-  flagcxC2cP2pOp(int rank, int peerRank, int offset, int count, int isRecv);
+  flagcxC2cP2pOp(int rank, int peerRank, size_t offset, size_t count,
+                 int isRecv);
   ~flagcxC2cP2pOp();
 
   flagcxResult_t run(void *buff, flagcxDataType_t datatype, flagcxComm_t comm,
@@ -116,15 +131,15 @@ public:
 
   int rank_;
   int peerRank_;
-  int offset_;
-  int count_;
+  size_t offset_;
+  size_t count_;
   int isRecv_; // 0: send, 1: recv
 };
 
 class flagcxC2cHomoFunc {
 public:
-  flagcxC2cHomoFunc(int rootRank, int sendOffset, int recvOffset, int count,
-                    int isHomoInterComm, flagcxCommOp_t commOp);
+  flagcxC2cHomoFunc(int rootRank, size_t sendOffset, size_t recvOffset,
+                    size_t count, int isHomoInterComm, flagcxCommOp_t commOp);
   ~flagcxC2cHomoFunc();
 
   flagcxResult_t run(const void *sendbuff, void *recvbuff,
@@ -132,9 +147,9 @@ public:
                      flagcxComm_t comm, flagcxStream_t stream);
 
   int rootRank_;
-  int sendOffset_;
-  int recvOffset_;
-  int count_;
+  size_t sendOffset_;
+  size_t recvOffset_;
+  size_t count_;
   int isHomoInterComm_;
   flagcxCommOp_t commOp_;
 };
@@ -142,10 +157,12 @@ public:
 class flagcxC2cHeteroFunc {
 public:
   friend class flagcxAlgoTimeEstimator;
+  friend class flagcxC2cPlanner;
   flagcxC2cHeteroFunc();
   ~flagcxC2cHeteroFunc();
 
-  void addP2pOp(int rank, int peerRank, int offset, int count, int isRecv);
+  void addP2pOp(int rank, int peerRank, size_t offset, size_t count,
+                int isRecv);
   flagcxResult_t run(void *buff, flagcxDataType_t datatype, flagcxComm_t comm,
                      flagcxStream_t stream);
 
@@ -156,23 +173,23 @@ private:
 class flagcxC2cRefreshFunc {
 public:
   flagcxC2cRefreshFunc();
-  flagcxC2cRefreshFunc(int offset, int count, int totalCount,
+  flagcxC2cRefreshFunc(size_t offset, size_t count, size_t totalCount,
                        flagcxRedOp_t redOp);
   ~flagcxC2cRefreshFunc();
 
   flagcxResult_t run(void *buff, flagcxDataType_t datatype,
                      flagcxStream_t stream);
 
-  int offset_;
-  int count_;
-  int totalCount_;
+  size_t offset_;
+  size_t count_;
+  size_t totalCount_;
   flagcxRedOp_t redOp_;
 };
 
 class flagcxC2cPlanner {
 public:
   friend class flagcxAlgoTimeEstimator;
-  flagcxC2cPlanner(int totalCount, int recvCount, flagcxComm_t comm,
+  flagcxC2cPlanner(size_t totalCount, size_t recvCount, flagcxComm_t comm,
                    flagcxCommOp_t commOp, flagcxRedOp_t redOp);
   ~flagcxC2cPlanner();
   flagcxC2cPlanner() = default;
@@ -187,10 +204,18 @@ public:
   flagcxResult_t execute(const void *sendbuff, void *recvbuff,
                          flagcxDataType_t datatype, int root,
                          flagcxStream_t stream);
+  // must be called before findStrategy
+  flagcxResult_t setAlgo(flagcxC2cAlgo_t algo);
+  flagcxC2cAlgo_t getAlgo() const { return algo_; }
+  int isMultiNic() const { return multiNic_; }
+  void setPredictedTime(float time) { predictedTime_ = time; }
+  float getPredictedTime() const { return predictedTime_; }
+  // print the functions set up by findStrategy
+  void printStrategy(FILE *file) const;
 
 private:
-  int totalCount_; // equal to sendCount_
-  int recvCount_;
+  size_t totalCount_; // equal to sendCount_
+  size_t recvCount_;
   flagcxComm_t comm_;
   flagcxCommOp_t commOp_;
   flagcxRedOp_t redOp_;
@@ -207,6 +232,10 @@ private:
   int clusterOffset_;
   int multiNic_;
   int eachNicPerRank_;
+  int searchMethod_ = 1; // 0: DFS; 1: BFS
+  flagcxC2cAlgo_t algo_ = flagcxC2cAlgoDefault;
+  // predicted execution time in us, negative if not estimated
+  float predictedTime_ = -1.0;
   int preHomoFuncLoops_;            // number of loops for preHomoFunc
   int heteroAndHomoInterFuncLoops_; // number of loops for heteroFunc and
                                     // homoInterFunc
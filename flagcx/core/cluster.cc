@@ -1,86 +1,118 @@
 #include "cluster.h"
 #include <cstring>
+#include <mutex>
 
-flagcxResult_t flagcxCollectClusterInfos(const flagcxVendor *allData,
-                                         flagcxCommunicatorType_t *type,
-                                         int *homo_rank, int *homo_root_rank,
-                                         int *homo_ranks, int *cluster_id,
-                                         int *cluster_inter_rank, int *ncluster,
-                                         int rank, int nranks) {
-  *homo_rank = rank;
-  *homo_root_rank = 0;
-  *homo_ranks = 1;
-  *cluster_id = 0;
-  *cluster_inter_rank = -1;
-  *ncluster = 1;
-  *type = flagcxCommunicatorHomo;
-
-  if (nranks <= 1)
+// FLAGCX_EMULATE_VENDORS="0-3:NVIDIA,4-7:METAX" makes the listed ranks report
+// a fake vendor, so that the hetero paths run on a single host. A process
+// keeps the vendor resolved on its first communicator, like a real device.
+static flagcxResult_t flagcxGetEmulatedVendor(int rank, std::string *vendor) {
+  static std::mutex mutex;
+  static bool resolved = false;
+  static std::string emulated;
+  std::lock_guard<std::mutex> lock(mutex);
+  if (resolved) {
+    *vendor = emulated;
     return flagcxSuccess;
-
-  std::map<std::string, int> clusterMap;
-  clusterMap[allData[0].internal] = 1;
-  int numClusters = 1;
-  int currCluster = 0;
-  int aggRanks = 1;
-  int homoRootRank = 0;
-  for (int i = 1; i < nranks; ++i) {
-    std::string cls = allData[i].internal;
-    auto it = clusterMap.find(cls);
-    if (it != clusterMap.end()) {
-      it->second = it->second + 1;
-    } else {
-      clusterMap[cls] = 1;
-      numClusters += 1;
-      if (*homo_rank >= aggRanks) {
-        *homo_rank = *homo_rank - aggRanks;
-        currCluster += 1;
-      }
-      aggRanks = 0;
-      homoRootRank = i;
+  }
+  const char *env = flagcxGetEnv("FLAGCX_EMULATE_VENDORS");
+  std::string map = env ? env : "";
+  size_t pos = 0;
+  while (pos < map.size()) {
+    size_t end = map.find(',', pos);
+    if (end == std::string::npos) {
+      end = map.size();
     }
-    aggRanks += 1;
-
-    if (i == rank) {
-      *homo_root_rank = homoRootRank;
+    std::string entry = map.substr(pos, end - pos);
+    pos = end + 1;
+    int first, last, n = 0;
+    char name[MAX_VENDOR_LEN];
+    bool valid =
+        sscanf(entry.c_str(), "%d-%d:%127s%n", &first, &last, name, &n) == 3;
+    if (!valid) {
+      valid = sscanf(entry.c_str(), "%d:%127s%n", &first, name, &n) == 2;
+      last = first;
+    }
+    if (!valid || n != (int)entry.size()) {
+      WARN("Invalid FLAGCX_EMULATE_VENDORS entry '%s', expected "
+           "<first>[-<last>]:<vendor>",
+           entry.c_str());
+      return flagcxInvalidArgument;
+    }
+    if (rank >= first && rank <= last) {
+      emulated = name;
+      INFO(FLAGCX_INIT, "Rank %d emulates vendor %s", rank, name);
+      break;
     }
   }
+  resolved = true;
+  *vendor = emulated;
+  return flagcxSuccess;
+}
 
-  *homo_ranks = clusterMap[allData[rank].internal];
-
-  if (clusterMap.size() > 1) {
-    *type = flagcxCommunicatorHybrid;
+flagcxResult_t flagcxFillRankInfo(struct flagcxRankInfo *info, int rank) {
+  memset(info, 0, sizeof(*info));
+  info->version = FLAGCX_RANK_INFO_VERSION;
+  const char *useDev = flagcxGetEnv("FLAGCX_USEDEV");
+  info->useDev = useDev ? std::stoi(useDev) : -1;
+  std::string emulated;
+  FLAGCXCHECK(flagcxGetEmulatedVendor(rank, &emulated));
+  if (emulated.empty()) {
+    deviceAdaptor->getVendor(info->vendor.internal);
   } else {
-    *type = flagcxCommunicatorHomo;
+    strncpy(info->vendor.internal, emulated.c_str(), MAX_VENDOR_LEN - 1);
   }
+  return flagcxSuccess;
+}
 
-  if (*type == flagcxCommunicatorHybrid) {
-    const char *useDev = flagcxGetEnv("FLAGCX_USEDEV");
-    int useDev_;
-    if (useDev == NULL) {
-      useDev_ = -1;
-    } else {
-      useDev_ = std::stoi(useDev);
+flagcxResult_t flagcxCollectClusterInfos(const struct flagcxRankInfo *allInfo,
+                                         flagcxCommunicatorType_t *type,
+                                         int *homoRanks, int *homoRootRanks,
+                                         int *clusterIds,
+                                         int *clusterInterRanks,
+                                         int *nclusters, int nranks) {
+  std::set<std::string> vendors;
+  std::vector<int> clusterSizes;
+  int root = 0;
+  for (int i = 0; i < nranks; ++i) {
+    if (allInfo[i].version != FLAGCX_RANK_INFO_VERSION) {
+      WARN("Rank %d uses rank info version %d, expected %d", i,
+           allInfo[i].version, FLAGCX_RANK_INFO_VERSION);
+      return flagcxInvalidUsage;
     }
-    if (*homo_rank == useDev_) {
-      *cluster_inter_rank = rank;
+    if (vendors.insert(allInfo[i].vendor.internal).second) {
+      clusterSizes.push_back(0);
+      root = i;
     }
-    if (*homo_ranks <= useDev_ && *homo_rank == *homo_ranks - 1) {
-      *cluster_inter_rank = rank;
+    homoRanks[i] = i - root;
+    homoRootRanks[i] = root;
+    clusterIds[i] = clusterSizes.size() - 1;
+    clusterInterRanks[i] = -1;
+    clusterSizes.back() += 1;
+  }
+  *nclusters = clusterSizes.size();
+  *type = *nclusters > 1 ? flagcxCommunicatorHybrid : flagcxCommunicatorHomo;
+
+  if (*type == flagcxCommunicatorHybrid) {
+    for (int i = 0; i < nranks; ++i) {
+      int useDev = allInfo[i].useDev;
+      int homoSize = clusterSizes[clusterIds[i]];
+      if (homoRanks[i] == useDev ||
+          (homoSize <= useDev && homoRanks[i] == homoSize - 1)) {
+        clusterInterRanks[i] = i;
+      }
     }
-    *cluster_id = currCluster;
-    *ncluster = numClusters;
   }
 
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxFillClusterVendorInfo(const flagcxVendor *allData,
-                                           flagcxComm *comm, int *clusterIdData,
-                                           int nranks, int ncluster) {
+flagcxResult_t
+flagcxFillClusterVendorInfo(const struct flagcxRankInfo *allInfo,
+                            flagcxComm *comm, int *clusterIdData, int nranks,
+                            int ncluster) {
   comm->clusterVendorMap.resize(ncluster);
   for (int i = 0; i < nranks; i++) {
-    std::string vendor = allData[i].internal;
+    std::string vendor = allInfo[i].vendor.internal;
     int cluster = clusterIdData[i];
     if (vendor == "NVIDIA") {
       comm->clusterVendorMap[cluster] = FLAGCX_VENDOR_NVIDIA;
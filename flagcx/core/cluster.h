@@ -5,17 +5,35 @@
 #include "flagcx.h"
 #include "param.h"
 #include <map>
+#include <set>
 #include <string>
 
-flagcxResult_t flagcxCollectClusterInfos(const flagcxVendor *allData,
+// Per-rank metadata exchanged in a single allgather at communicator creation.
+// Bump the version whenever the layout changes.
+#define FLAGCX_RANK_INFO_VERSION 1
+
+struct flagcxRankInfo {
+  int version;
+  int useDev; // FLAGCX_USEDEV of the rank, -1 if unset
+  flagcxVendor vendor;
+};
+
+// The vendor comes from the device adaptor, unless FLAGCX_EMULATE_VENDORS
+// assigns one to the rank
+flagcxResult_t flagcxFillRankInfo(struct flagcxRankInfo *info, int rank);
+
+// Derive the cluster layout of all ranks from the gathered rank infos. A new
+// cluster starts at the first rank of a vendor that has not been seen before.
+flagcxResult_t flagcxCollectClusterInfos(const struct flagcxRankInfo *allInfo,
                                          flagcxCommunicatorType_t *type,
-                                         int *homo_rank, int *homo_root_rank,
-                                         int *homo_ranks, int *cluster_id,
-                                         int *cluster_inter_rank,
-                                         int *nclusters, int rank, int nranks);
+                                         int *homoRanks, int *homoRootRanks,
+                                         int *clusterIds,
+                                         int *clusterInterRanks,
+                                         int *nclusters, int nranks);
 
-flagcxResult_t flagcxFillClusterVendorInfo(const flagcxVendor *allData,
-                                           flagcxComm *comm, int *clusterIdData,
-                                           int nranks, int ncluster);
+flagcxResult_t
+flagcxFillClusterVendorInfo(const struct flagcxRankInfo *allInfo,
+                            flagcxComm *comm, int *clusterIdData, int nranks,
+                            int ncluster);
 
 #endif // end include guard
\ No newline at end of file
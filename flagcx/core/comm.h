@@ -195,7 +195,7 @@ struct flagcxHeteroComm {
   int compCap;                // compute capability of the GPU
   int minCompCap, maxCompCap; // min/max compute capability in the communicator
   int64_t busId;              // my PCI bus ID in int format
-  cpu_set_t cpuAffinity;      // CPU affinity of the GPU
+  cpu_set_t cpuAffinity;      // CPU affinity of netDev
   int cudaArch;               // matches __CUDA_ARCH__ of device
 
   int node;
@@ -435,6 +435,13 @@ static inline flagcxRedOp_t flagcxUserRedOpMangle(flagcxHeteroComm *comm,
   return op1 < int(flagcxNumRedOps) ? op : flagcxRedOp_t(op1);
 }
 
+// Rank in the communicator owning the topology and connections that comm
+// uses, which is comm itself unless comm was split from another one
+static inline int flagcxTopParentRank(struct flagcxHeteroComm *comm,
+                                      int rank) {
+  return comm->topParentRanks ? comm->topParentRanks[rank] : rank;
+}
+
 flagcxResult_t flagcxCommEnsureReady(flagcxHeteroComm_t comm);
 flagcxResult_t flagcxCommSetAsyncError(flagcxHeteroComm_t comm,
                                        flagcxResult_t nextState);
@@ -0,0 +1,443 @@
+#include "cost_calib.h"
+#include "adaptor.h"
+#include "comm.h"
+#include "cost_model.h"
+#include "flagcx_hetero.h"
+#include "param.h"
+#include "topo.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// 0: only load persisted parameters; 1: calibrate when no parameters are
+// persisted for the current topology; 2: always calibrate
+FLAGCX_PARAM(CostCalib, "COST_CALIB", 0);
+FLAGCX_PARAM(CostCalibMaxBytes, "COST_CALIB_MAX_BYTES", 16 << 20);
+FLAGCX_PARAM(CostCalibIters, "COST_CALIB_ITERS", 5);
+
+#define FLAGCX_COST_CALIB_MIN_BYTES 4096
+#define FLAGCX_COST_CALIB_STEP 8
+
+static void flagcxCostCalibPath(char *path, size_t len) {
+  const char *file = flagcxGetEnv("FLAGCX_COST_CALIB_FILE");
+  if (file != NULL) {
+    snprintf(path, len, "%s", file);
+  } else {
+    const char *home = flagcxGetEnv("HOME");
+    snprintf(path, len, "%s/.flagcx_cost_calib", home ? home : "/tmp");
+  }
+}
+
+// The key covers what the parameters depend on: vendor and size of every
+// cluster, and the set of nics used by the communicator
+uint64_t flagcxCostTableKey(flagcxComm_t comm, uint64_t *nicGuids) {
+  std::string desc;
+  char buf[64];
+  for (int i = 0; i < comm->nclusters; i++) {
+    snprintf(buf, sizeof(buf), "v%dx%d;", (int)comm->clusterVendorMap[i],
+             comm->cluster_sizes[i]);
+    desc += buf;
+  }
+  std::vector<uint64_t> guids(nicGuids, nicGuids + comm->nranks);
+  std::sort(guids.begin(), guids.end());
+  guids.erase(std::unique(guids.begin(), guids.end()), guids.end());
+  for (auto guid : guids) {
+    snprintf(buf, sizeof(buf), "n%lx;", guid);
+    desc += buf;
+  }
+  return getHash(desc.c_str(), desc.size());
+}
+
+// Least-squares fit of time(us) = a + b * bytes
+static void flagcxCostFit(const std::vector<double> &bytes,
+                          const std::vector<double> &times, double *a,
+                          double *b) {
+  int n = bytes.size();
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (int i = 0; i < n; i++) {
+    sx += bytes[i];
+    sy += times[i];
+    sxx += bytes[i] * bytes[i];
+    sxy += bytes[i] * times[i];
+  }
+  double den = n * sxx - sx * sx;
+  *b = (n > 1 && den > 0) ? (n * sxy - sx * sy) / den : 0;
+  *a = std::max(0.0, (sy - *b * sx) / n);
+}
+
+static flagcxResult_t flagcxCostCalibHomo(flagcxComm_t comm, void *buff,
+                                          flagcxStream_t stream,
+                                          struct flagcxAlphaBeta *cost) {
+  int p = comm->homo_ranks;
+  int iters = flagcxParamCostCalibIters();
+  std::vector<double> bytes, times;
+  memset(cost, 0, sizeof(*cost));
+  if (p < 2) {
+    return flagcxSuccess;
+  }
+  for (size_t size = FLAGCX_COST_CALIB_MIN_BYTES;
+       size <= (size_t)flagcxParamCostCalibMaxBytes();
+       size *= FLAGCX_COST_CALIB_STEP) {
+    size_t count = size / sizeof(float);
+    uint64_t start = 0;
+    for (int i = -1; i < iters; i++) {
+      if (i == 0) {
+        start = clockNano();
+      }
+      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->allReduce(
+          buff, buff, count, flagcxFloat, flagcxSum, comm->homo_comm, stream));
+      FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+    }
+    bytes.push_back(size);
+    times.push_back((clockNano() - start) / 1e3 / iters);
+  }
+  // ring allreduce: 2(p-1) steps of alpha + bytes/p over the link
+  double a, b;
+  flagcxCostFit(bytes, times, &a, &b);
+  if (b > 0) {
+    cost->alpha = a / (2 * (p - 1));
+    cost->beta = 2.0 * (p - 1) / p / (1000 * b);
+  }
+  return flagcxSuccess;
+}
+
+static flagcxResult_t flagcxCostCalibPingPong(flagcxComm_t comm, int peer,
+                                              int initiator, void *buff,
+                                              flagcxStream_t stream,
+                                              struct flagcxAlphaBeta *cost) {
+  int iters = flagcxParamCostCalibIters();
+  std::vector<double> bytes, times;
+  for (size_t size = FLAGCX_COST_CALIB_MIN_BYTES;
+       size <= (size_t)flagcxParamCostCalibMaxBytes();
+       size *= FLAGCX_COST_CALIB_STEP) {
+    uint64_t start = 0;
+    // the first round trip also sets up the connection
+    for (int i = -1; i < iters; i++) {
+      if (i == 0) {
+        start = clockNano();
+      }
+      for (int dir = 0; dir < 2; dir++) {
+        FLAGCXCHECK(flagcxHeteroGroupStart());
+        if ((dir == 0) == (initiator == 1)) {
+          FLAGCXCHECK(flagcxHeteroSend(buff, size, flagcxChar, peer,
+                                       comm->hetero_comm, stream));
+        } else {
+          FLAGCXCHECK(flagcxHeteroRecv(buff, size, flagcxChar, peer,
+                                       comm->hetero_comm, stream));
+        }
+        FLAGCXCHECK(flagcxHeteroGroupEnd());
+        FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+      }
+    }
+    bytes.push_back(size);
+    times.push_back((clockNano() - start) / 1e3 / iters / 2);
+  }
+  double a, b;
+  flagcxCostFit(bytes, times, &a, &b);
+  cost->alpha = a;
+  cost->beta = (b > 0) ? 1.0 / (1000 * b) : 0;
+  return flagcxSuccess;
+}
+
+// Keep the worst of the measured costs, an entry with beta == 0 is unset
+static void flagcxCostMergeWorst(struct flagcxAlphaBeta *dst,
+                                 const struct flagcxAlphaBeta *src) {
+  if (src->beta <= 0) {
+    return;
+  }
+  if (dst->beta <= 0) {
+    *dst = *src;
+    return;
+  }
+  dst->alpha = std::max(dst->alpha, src->alpha);
+  dst->beta = std::min(dst->beta, src->beta);
+}
+
+static flagcxResult_t flagcxCostCalibrate(flagcxComm_t comm,
+                                          uint64_t *nicGuids,
+                                          struct flagcxCostTable *table) {
+  int rank = comm->rank;
+  int nranks = comm->nranks;
+  struct bootstrapState *state = comm->bootstrap;
+  size_t maxBytes = flagcxParamCostCalibMaxBytes();
+  flagcxStream_t stream;
+  void *buff;
+  FLAGCXCHECK(deviceAdaptor->streamCreate(&stream));
+  FLAGCXCHECK(
+      deviceAdaptor->deviceMalloc(&buff, maxBytes, flagcxMemDevice, stream));
+  FLAGCXCHECK(deviceAdaptor->deviceMemset(buff, 0, maxBytes, flagcxMemDevice,
+                                          stream));
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+
+  // homo collectives, all clusters at once
+  struct flagcxAlphaBeta *homoCost;
+  FLAGCXCHECK(flagcxCalloc(&homoCost, nranks));
+  FLAGCXCHECK(flagcxCostCalibHomo(comm, buff, stream, homoCost + rank));
+  FLAGCXCHECK(bootstrapAllGather(state, (void *)homoCost,
+                                 sizeof(struct flagcxAlphaBeta)));
+  for (int r = 0; r < nranks; r++) {
+    int vendor = comm->clusterVendorMap[comm->cluster_ids[r]];
+    if (comm->globalrank2homorank[r] == 0) {
+      flagcxCostMergeWorst(&table->homo[vendor], homoCost + r);
+    }
+  }
+  free(homoCost);
+
+  // inter-cluster ping-pong, one pair at a time so that pairs sharing a nic
+  // do not disturb each other
+  std::vector<std::pair<int, int>> pairs;
+  auto &interRanks = comm->clusterInterRankList;
+  for (int i = 0; i < comm->nclusters; i++) {
+    for (int j = i + 1; j < comm->nclusters; j++) {
+      size_t n = std::max(interRanks[i].size(), interRanks[j].size());
+      for (size_t k = 0; k < n; k++) {
+        if (interRanks[i].empty() || interRanks[j].empty()) {
+          break;
+        }
+        auto pair = std::make_pair(interRanks[i][k % interRanks[i].size()],
+                                   interRanks[j][k % interRanks[j].size()]);
+        if (std::find(pairs.begin(), pairs.end(), pair) == pairs.end() &&
+            pairs.size() < FLAGCX_COST_MAX_NIC_PAIRS) {
+          pairs.push_back(pair);
+        }
+      }
+    }
+  }
+  for (auto &pair : pairs) {
+    struct flagcxAlphaBeta cost = {0.0, 0.0};
+    if (rank == pair.first) {
+      FLAGCXCHECK(flagcxCostCalibPingPong(comm, pair.second, 1, buff, stream,
+                                          &cost));
+    } else if (rank == pair.second) {
+      FLAGCXCHECK(flagcxCostCalibPingPong(comm, pair.first, 0, buff, stream,
+                                          &cost));
+    }
+    FLAGCXCHECK(bootstrapBroadcast(state, rank, nranks, pair.first, &cost,
+                                   sizeof(cost)));
+    struct flagcxNicPairCost *nicPair = &table->nicPairs[table->nNicPairs++];
+    nicPair->localGuid = nicGuids[pair.first];
+    nicPair->remoteGuid = nicGuids[pair.second];
+    nicPair->cost = cost;
+    flagcxCostMergeWorst(
+        &table->p2p[comm->clusterVendorMap[comm->cluster_ids[pair.first]]],
+        &cost);
+    flagcxCostMergeWorst(
+        &table->p2p[comm->clusterVendorMap[comm->cluster_ids[pair.second]]],
+        &cost);
+    INFO(FLAGCX_TUNING,
+         "COST_CALIB: p2p rank %d (nic %lx) <-> rank %d (nic %lx): "
+         "alpha %.2f us, beta %.2f GB/s",
+         pair.first, nicPair->localGuid, pair.second, nicPair->remoteGuid,
+         cost.alpha, cost.beta);
+  }
+
+  FLAGCXCHECK(deviceAdaptor->deviceFree(buff, flagcxMemDevice, stream));
+  FLAGCXCHECK(deviceAdaptor->streamSynchronize(stream));
+  FLAGCXCHECK(deviceAdaptor->streamDestroy(stream));
+  table->valid = 1;
+  return flagcxSuccess;
+}
+
+static flagcxResult_t flagcxCostTableLoad(const char *path,
+                                          struct flagcxCostTable *table) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return flagcxSystemError;
+  }
+  char line[256];
+  int inSection = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    unsigned long key, local, remote;
+    int vendor;
+    struct flagcxAlphaBeta cost;
+    if (sscanf(line, "key %lx", &key) == 1) {
+      inSection = (key == table->key);
+    } else if (!inSection) {
+      continue;
+    } else if (strncmp(line, "end", 3) == 0) {
+      table->valid = 1;
+      break;
+    } else if (sscanf(line, "homo %d %f %f", &vendor, &cost.alpha,
+                      &cost.beta) == 3 &&
+               vendor >= 0 && vendor < FLAGCX_VENDOR_NUM) {
+      table->homo[vendor] = cost;
+    } else if (sscanf(line, "p2p %d %f %f", &vendor, &cost.alpha,
+                      &cost.beta) == 3 &&
+               vendor >= 0 && vendor < FLAGCX_VENDOR_NUM) {
+      table->p2p[vendor] = cost;
+    } else if (sscanf(line, "nic %lx %lx %f %f", &local, &remote, &cost.alpha,
+                      &cost.beta) == 4 &&
+               table->nNicPairs < FLAGCX_COST_MAX_NIC_PAIRS) {
+      struct flagcxNicPairCost *nicPair = &table->nicPairs[table->nNicPairs++];
+      nicPair->localGuid = local;
+      nicPair->remoteGuid = remote;
+      nicPair->cost = cost;
+    }
+  }
+  fclose(file);
+  return table->valid ? flagcxSuccess : flagcxInternalError;
+}
+
+// Rewrite the calibration file, replacing the section of table->key
+static flagcxResult_t flagcxCostTableSave(const char *path,
+                                          struct flagcxCostTable *table) {
+  std::string content;
+  FILE *file = fopen(path, "r");
+  if (file != NULL) {
+    char line[256];
+    int skip = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+      unsigned long key;
+      if (sscanf(line, "key %lx", &key) == 1) {
+        skip = (key == table->key);
+      }
+      if (!skip) {
+        content += line;
+      }
+      if (skip && strncmp(line, "end", 3) == 0) {
+        skip = 0;
+      }
+    }
+    fclose(file);
+  }
+  if (content.empty()) {
+    content = "# FLAGCX cost calibration, "
+              "time(us) = alpha + bytes / (1000 * beta GB/s)\n";
+  }
+
+  char tmpPath[PATH_MAX + 8];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+  file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    WARN("Unable to write cost calibration file %s", tmpPath);
+    return flagcxSystemError;
+  }
+  fputs(content.c_str(), file);
+  fprintf(file, "key %lx\n", table->key);
+  for (int v = 0; v < FLAGCX_VENDOR_NUM; v++) {
+    if (table->homo[v].beta > 0) {
+      fprintf(file, "homo %d %f %f\n", v, table->homo[v].alpha,
+              table->homo[v].beta);
+    }
+    if (table->p2p[v].beta > 0) {
+      fprintf(file, "p2p %d %f %f\n", v, table->p2p[v].alpha,
+              table->p2p[v].beta);
+    }
+  }
+  for (int i = 0; i < table->nNicPairs; i++) {
+    struct flagcxNicPairCost *nicPair = &table->nicPairs[i];
+    fprintf(file, "nic %lx %lx %f %f\n", nicPair->localGuid,
+            nicPair->remoteGuid, nicPair->cost.alpha, nicPair->cost.beta);
+  }
+  fprintf(file, "end\n");
+  fclose(file);
+  if (rename(tmpPath, path) != 0) {
+    WARN("Unable to rename %s to %s", tmpPath, path);
+    return flagcxSystemError;
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxCostTableInit(flagcxComm_t comm) {
+  comm->costTable = NULL;
+  // the table is only consumed by the algo time estimator
+  if (!flagcxAlgoEstimatorEnabled()) {
+    return flagcxSuccess;
+  }
+  int rank = comm->rank;
+  int nranks = comm->nranks;
+  struct bootstrapState *state = comm->bootstrap;
+
+  uint64_t *nicGuids;
+  FLAGCXCHECK(flagcxCalloc(&nicGuids, nranks));
+  struct flagcxTopoNode *net;
+  FLAGCXCHECK(flagcxTopoGetLocalNetNode(
+      comm->hetero_comm->topoServer,
+      flagcxTopParentRank(comm->hetero_comm, rank), &net));
+  nicGuids[rank] = net->net.guid;
+  FLAGCXCHECK(bootstrapAllGather(state, (void *)nicGuids, sizeof(uint64_t)));
+
+  struct flagcxCostTable *table;
+  FLAGCXCHECK(flagcxCalloc(&table, 1));
+  table->key = flagcxCostTableKey(comm, nicGuids);
+
+  char path[PATH_MAX];
+  flagcxCostCalibPath(path, sizeof(path));
+  int mode = flagcxParamCostCalib();
+  int loaded = 0;
+  if (rank == 0 && mode != 2) {
+    loaded = (flagcxCostTableLoad(path, table) == flagcxSuccess);
+  }
+  FLAGCXCHECK(
+      bootstrapBroadcast(state, rank, nranks, 0, &loaded, sizeof(int)));
+  if (loaded) {
+    FLAGCXCHECK(bootstrapBroadcast(state, rank, nranks, 0, table,
+                                   sizeof(struct flagcxCostTable)));
+    INFO(FLAGCX_INIT, "COST_CALIB: loaded parameters %lx from %s",
+         table->key, path);
+  } else if (mode > 0) {
+    uint64_t start = clockNano();
+    FLAGCXCHECK(flagcxCostCalibrate(comm, nicGuids, table));
+    INFO(FLAGCX_INIT, "COST_CALIB: calibrated parameters %lx in %.2f ms",
+         table->key, (clockNano() - start) / 1e6);
+    if (rank == 0 && flagcxCostTableSave(path, table) == flagcxSuccess) {
+      INFO(FLAGCX_INIT, "COST_CALIB: saved parameters %lx to %s", table->key,
+           path);
+    }
+  }
+  free(nicGuids);
+
+  if (!table->valid) {
+    free(table);
+    return flagcxSuccess;
+  }
+  for (int v = 0; v < FLAGCX_VENDOR_NUM; v++) {
+    INFO(FLAGCX_TUNING,
+         "COST_CALIB: vendor %d homo alpha %.2f us beta %.2f GB/s, p2p alpha "
+         "%.2f us beta %.2f GB/s",
+         v, table->homo[v].alpha, table->homo[v].beta, table->p2p[v].alpha,
+         table->p2p[v].beta);
+  }
+  comm->costTable = table;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxCostTableLoadFile(const char *path, uint64_t key,
+                                      struct flagcxCostTable **table) {
+  struct flagcxCostTable *loaded;
+  FLAGCXCHECK(flagcxCalloc(&loaded, 1));
+  loaded->key = key;
+  if (flagcxCostTableLoad(path, loaded) != flagcxSuccess) {
+    free(loaded);
+    return flagcxInternalError;
+  }
+  *table = loaded;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxCostTableDestroy(flagcxComm_t comm) {
+  free(comm->costTable);
+  comm->costTable = NULL;
+  return flagcxSuccess;
+}
+
+const struct flagcxAlphaBeta *
+flagcxCostTableGetNicPair(const struct flagcxCostTable *table,
+                          uint64_t localGuid, uint64_t remoteGuid) {
+  if (table == NULL) {
+    return NULL;
+  }
+  for (int i = 0; i < table->nNicPairs; i++) {
+    const struct flagcxNicPairCost *nicPair = &table->nicPairs[i];
+    if ((nicPair->localGuid == localGuid &&
+         nicPair->remoteGuid == remoteGuid) ||
+        (nicPair->localGuid == remoteGuid &&
+         nicPair->remoteGuid == localGuid)) {
+      return nicPair->cost.beta > 0 ? &nicPair->cost : NULL;
+    }
+  }
+  return NULL;
+}
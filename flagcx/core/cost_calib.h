@@ -0,0 +1,57 @@
+#ifndef FLAGCX_COST_CALIB_H_
+#define FLAGCX_COST_CALIB_H_
+
+#include "flagcx.h"
+
+#define FLAGCX_VENDOR_NUM 4
+#define FLAGCX_COST_MAX_NIC_PAIRS 64
+
+// time(us) = alpha + bytes / (1000 * beta), alpha in us and beta in GB/s.
+// An entry with beta == 0 has not been calibrated.
+struct flagcxAlphaBeta {
+  float alpha;
+  float beta;
+};
+
+struct flagcxNicPairCost {
+  uint64_t localGuid;
+  uint64_t remoteGuid;
+  struct flagcxAlphaBeta cost;
+};
+
+// Calibrated cost parameters of a communicator. The table is a flat struct so
+// that it can be broadcast through bootstrap as is.
+struct flagcxCostTable {
+  uint64_t key; // hash of cluster vendors, cluster sizes and nics
+  int valid;
+  // per-step latency and link bandwidth of the homo ring collectives
+  struct flagcxAlphaBeta homo[FLAGCX_VENDOR_NUM];
+  // inter-server p2p, worst nic pair seen by each vendor
+  struct flagcxAlphaBeta p2p[FLAGCX_VENDOR_NUM];
+  int nNicPairs;
+  struct flagcxNicPairCost nicPairs[FLAGCX_COST_MAX_NIC_PAIRS];
+};
+
+// Load the cost table of comm from the calibration file, running the
+// calibration microbenchmarks first when requested by FLAGCX_COST_CALIB.
+// Collective over all ranks of comm.
+flagcxResult_t flagcxCostTableInit(flagcxComm_t comm);
+
+flagcxResult_t flagcxCostTableDestroy(flagcxComm_t comm);
+
+// Key of the calibration file section matching comm, nicGuids holds the nic
+// guid of every rank
+uint64_t flagcxCostTableKey(flagcxComm_t comm, uint64_t *nicGuids);
+
+// Load the section key of a calibration file written by flagcxCostTableInit,
+// so that offline tools see the same parameters as the estimator. The table
+// is allocated here and released with free().
+flagcxResult_t flagcxCostTableLoadFile(const char *path, uint64_t key,
+                                      struct flagcxCostTable **table);
+
+// Return the calibrated cost between two nics, NULL if the pair is unknown
+const struct flagcxAlphaBeta *
+flagcxCostTableGetNicPair(const struct flagcxCostTable *table,
+                          uint64_t localGuid, uint64_t remoteGuid);
+
+#endif // end include guard
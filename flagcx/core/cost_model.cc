@@ -2,15 +2,27 @@
 #include "topo.h"
 
 constexpr size_t CHUNK_SIZE = 4ULL * 1024 * 1024;
+// default latencies, overridden by the calibrated comm->costTable
 const float flagcxLatMap[FLAGCX_VENDOR_NUM][2] = {
     {0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}, {0.0, 0.0}};
 
-flagcxResult_t flagcxAlgoTimeEstimator::getAlgoTime(float *time) {
+FLAGCX_PARAM(C2cAlgoSelect, "C2C_ALGO_SELECT", 1);
+
+bool flagcxAlgoEstimatorEnabled() {
   const char *enableTopoDetect = flagcxGetEnv("FLAGCX_ENABLE_TOPO_DETECT");
   const char *interServerTopoFile =
       flagcxGetEnv("FLAGCX_INTERSERVER_ROUTE_FILE");
-  if (enableTopoDetect && interServerTopoFile &&
-      strcmp(enableTopoDetect, "TRUE") == 0) {
+  return enableTopoDetect &&
+         (interServerTopoFile || flagcxParamInterServerRouteProbe()) &&
+         strcmp(enableTopoDetect, "TRUE") == 0;
+}
+
+bool flagcxC2cAlgoSelectEnabled() {
+  return flagcxParamC2cAlgoSelect() && flagcxAlgoEstimatorEnabled();
+}
+
+flagcxResult_t flagcxAlgoTimeEstimator::getAlgoTime(float *time) {
+  if (flagcxAlgoEstimatorEnabled()) {
     // algo time estimator depends on cluster level topology detection
     float preHomoTime, heteroTime, postHomoTime;
     INFO(FLAGCX_GRAPH, "COST_MODEL: getting time for prehomo funcs");
@@ -24,14 +36,21 @@ flagcxResult_t flagcxAlgoTimeEstimator::getAlgoTime(float *time) {
   return flagcxSuccess;
 }
 
+flagcxC2cPlanner &flagcxAlgoTimeEstimator::getClusterPlanner(int cluster) {
+  if (clusterPlanners_ != nullptr &&
+      cluster < (int)clusterPlanners_->size()) {
+    return (*clusterPlanners_)[cluster];
+  }
+  return planner_; // assume all clusters perform the same algo
+}
+
 flagcxResult_t flagcxAlgoTimeEstimator::getPreHomoAlgoTime(float *time) {
   flagcxComm_t comm = planner_.comm_;
-  auto &preHomoFuncs =
-      planner_.preHomoFuncList_; // all clusters perform the same algo
   float totalPreHomoTime = 0.0;
   // compute the execution time for all clusters
   // use the max time for all clusters
   for (int i = 0; i < comm->nclusters; i++) {
+    auto &preHomoFuncs = getClusterPlanner(i).preHomoFuncList_;
     int vendor = comm->clusterVendorMap[i];
     int clusterRankSize =
         comm->cluster_sizes[i]; // get how many ranks are in this cluster
@@ -50,11 +69,11 @@ flagcxResult_t flagcxAlgoTimeEstimator::getPreHomoAlgoTime(float *time) {
 
 flagcxResult_t flagcxAlgoTimeEstimator::getPostHomoAlgoTime(float *time) {
   flagcxComm_t comm = planner_.comm_;
-  auto &postHomoFuncs = planner_.postHomoFuncList_;
   float totalPostHomoTime = 0.0;
   // compute the execution time for all clusters
   // use the max time for all clusters
   for (int i = 0; i < comm->nclusters; i++) {
+    auto &postHomoFuncs = getClusterPlanner(i).postHomoFuncList_;
     int vendor = comm->clusterVendorMap[i];
     int clusterRankSize =
         comm->cluster_sizes[i]; // get how many ranks are in this cluster
@@ -71,10 +90,44 @@ flagcxResult_t flagcxAlgoTimeEstimator::getPostHomoAlgoTime(float *time) {
   return flagcxSuccess;
 }
 
+float flagcxAlgoTimeEstimator::getLat(int vendor, int latIdx) {
+  struct flagcxCostTable *table = planner_.comm_->costTable;
+  if (table != NULL) {
+    struct flagcxAlphaBeta &cost = (latIdx == FLAGCX_INTRA_LAT_IDX)
+                                       ? table->homo[vendor]
+                                       : table->p2p[vendor];
+    if (cost.beta > 0) {
+      return cost.alpha;
+    }
+  }
+  return flagcxLatMap[vendor][latIdx];
+}
+
 flagcxResult_t flagcxAlgoTimeEstimator::getHomoAlgoTime(
     flagcxC2cHomoFunc &homoFunc, int rankSize, int vendor, float *time) {
   float defaultTime = 0.0;
   *time = defaultTime;
+  struct flagcxCostTable *table = planner_.comm_->costTable;
+  if (table == NULL || table->homo[vendor].beta <= 0 || rankSize < 2) {
+    return flagcxSuccess;
+  }
+  // ring algorithms over the calibrated per-step latency and link bandwidth
+  float lat = table->homo[vendor].alpha;
+  float bw = table->homo[vendor].beta;
+  float bytes = (float)homoFunc.count_ * getFlagcxDataTypeSize(datatype);
+  int steps = rankSize - 1;
+  switch (homoFunc.commOp_) {
+    case flagcxCommOpAllReduce:
+    case flagcxCommOpReduce:
+      *time = 2 * steps * (lat + bytes / rankSize / (1000 * bw));
+      break;
+    case flagcxCommOpReduceScatter:
+      // count_ is the per-rank count for reducescatter
+      *time = steps * (lat + bytes / (1000 * bw));
+      break;
+    default:
+      break;
+  }
   return flagcxSuccess;
 }
 
@@ -94,7 +147,63 @@ flagcxResult_t flagcxAlgoTimeEstimator::getHomoInterAlgoTime(int loop,
                                 &homoInterTimeForCluster));
     totalHomoInterTime = std::max(totalHomoInterTime, homoInterTimeForCluster);
   }
-  *time = 0.0;
+  *time = totalHomoInterTime;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxAlgoTimeEstimator::getHostCommAlgoTime(float *time) {
+  flagcxComm_t comm = planner_.comm_;
+  size_t typeSize = getFlagcxDataTypeSize(datatype);
+  size_t sendBytes = planner_.totalCount_ * typeSize;
+  size_t recvBytes = (planner_.commOp_ == flagcxCommOpReduceScatter)
+                         ? planner_.recvCount_ * typeSize
+                         : sendBytes;
+  int nranks = comm->nranks;
+
+  // host collectives are bounded by the slowest nic and cluster latency. Only
+  // data every rank holds is used here, otherwise ranks on servers with
+  // different nics could pick different algorithms for the same collective.
+  float lat = 0.0;
+  float bw = NET_BW;
+  int calibrated = 0;
+  for (int i = 0; i < comm->nclusters; i++) {
+    int vendor = comm->clusterVendorMap[i];
+    lat = std::max(lat, getLat(vendor, FLAGCX_INTER_LAT_IDX));
+    if (comm->costTable != NULL && comm->costTable->p2p[vendor].beta > 0) {
+      bw = calibrated ? std::min(bw, comm->costTable->p2p[vendor].beta)
+                      : comm->costTable->p2p[vendor].beta;
+      calibrated = 1;
+    }
+  }
+  struct flagcxHeteroComm *heteroComm = comm->hetero_comm;
+  struct flagcxInterServerTopo *interServer = heteroComm->interServerTopo;
+  if (!calibrated && interServer != NULL) {
+    // slowest nic of any server, as seen in the shared inter-server topology
+    for (int i = 0; i < interServer->numServers; i++) {
+      struct flagcxTopoServer *server =
+          i == heteroComm->topoServer->serverId ? heteroComm->topoServer
+                                                : interServer->servers + i;
+      for (int n = 0; n < server->nodes[NET].count; n++) {
+        bw = std::min(bw, server->nodes[NET].nodes[n].net.bw);
+      }
+    }
+    // and slowest known route between them
+    for (auto &local : interServer->routeMap) {
+      for (auto &remote : local.second) {
+        if (remote.second != NULL && remote.second->interBw > 0) {
+          bw = std::min(bw, remote.second->interBw);
+        }
+      }
+    }
+  }
+
+  // d2h + h2d staging copies
+  float copyTime = (sendBytes + recvBytes) / (1000 * PCI_BW);
+  // ring algorithm: reduce-scatter phase, plus all-gather phase for allreduce
+  int phases = (planner_.commOp_ == flagcxCommOpAllReduce) ? 2 : 1;
+  float commTime = phases * (nranks - 1) *
+                   (lat + (float)sendBytes / nranks / (1000 * bw));
+  *time = copyTime + commTime;
   return flagcxSuccess;
 }
 
@@ -121,11 +230,14 @@ flagcxResult_t flagcxAlgoTimeEstimator::getHeteroAlgoTime(float *time) {
       interRanks.push_back(rank);
       struct flagcxTopoServer *server;
       struct flagcxTopoNode *net;
-      // get server of current rank
-      FLAGCXCHECK(flagcxTopoGetServerFromRank(rank, heteroComm->interServerTopo,
-                                              heteroComm->topoServer, &server));
+      // get server of current rank, the topology is indexed by top parent
+      // ranks when comm was split
+      int topoRank = flagcxTopParentRank(heteroComm, rank);
+      FLAGCXCHECK(flagcxTopoGetServerFromRank(
+          topoRank, heteroComm->interServerTopo, heteroComm->topoServer,
+          &server));
       // get local nic used by current rank
-      FLAGCXCHECK(flagcxTopoGetLocalNetNode(server, rank, &net));
+      FLAGCXCHECK(flagcxTopoGetLocalNetNode(server, topoRank, &net));
       INFO(FLAGCX_GRAPH, "COST_MODEL: nicRankMap[%lx] = %d", net->net.guid,
            rank);
       nicRankMap[net->net.guid].push_back(rank);
@@ -200,7 +312,7 @@ void flagcxAlgoTimeEstimator::generateHeteroFuncForSingleNic(
   int clusterId = comm->cluster_ids[rank];
   int homoMyRank = comm->globalrank2homorank[rank];
   int homoRanks = comm->cluster_sizes[clusterId];
-  int totalCount = planner_.totalCount_;
+  size_t totalCount = planner_.totalCount_;
   for (size_t j = 0; j < clusterInterRankList.size(); ++j) {
     if (clusterId == j) {
       continue;
@@ -244,34 +356,54 @@ float flagcxAlgoTimeEstimator::getP2pTimePerNic(
     int vendor = comm->clusterVendorMap[clusterId]; // {clusterId: vendor}
     // get cluster lat and bw
     float curClusterLat =
-        flagcxLatMap[vendor][FLAGCX_INTER_LAT_IDX]; // {clusterId: lat}
+        getLat(vendor, FLAGCX_INTER_LAT_IDX); // {clusterId: lat}
     for (auto &func : funcList) {
       for (auto &p2pOp : func.p2pOps_) {
         int remoteRank = p2pOp.peerRank_;
         int remoteClusterId = comm->cluster_ids[remoteRank];
         int remoteVendor = comm->clusterVendorMap[remoteClusterId];
-        float remoteClusterLat =
-            flagcxLatMap[remoteVendor][FLAGCX_INTER_LAT_IDX];
+        float remoteClusterLat = getLat(remoteVendor, FLAGCX_INTER_LAT_IDX);
         // get nic of remote rank
         struct flagcxTopoServer *remoteServer;
         struct flagcxTopoNode *remoteNet;
         // get server of current rank
-        FLAGCXCHECK(
-            flagcxTopoGetServerFromRank(remoteRank, heteroComm->interServerTopo,
-                                        heteroComm->topoServer, &remoteServer));
+        int remoteTopoRank = flagcxTopParentRank(heteroComm, remoteRank);
+        FLAGCXCHECK(flagcxTopoGetServerFromRank(
+            remoteTopoRank, heteroComm->interServerTopo,
+            heteroComm->topoServer, &remoteServer));
         // get local nic used by current rank
-        FLAGCXCHECK(
-            flagcxTopoGetLocalNetNode(remoteServer, remoteRank, &remoteNet));
+        FLAGCXCHECK(flagcxTopoGetLocalNetNode(remoteServer, remoteTopoRank,
+                                              &remoteNet));
         INFO(FLAGCX_GRAPH, "COST_MODEL: localNet = %lx, remoteNet = %lx",
              remoteNet->net.guid, netGuid);
-        float routeBw =
-            heteroComm->interServerTopo->routeMap[netGuid][remoteNet->net.guid]
-                ->interBw; // we haven't recorded all route for all servers yet
+        // we haven't recorded all route for all servers yet, fall back to
+        // the nic bandwidth when the route is unknown
+        float routeBw = remoteNet->net.bw;
+        // look up without operator[] so the shared route map is not modified
+        auto &routeMap = heteroComm->interServerTopo->routeMap;
+        auto routesIt = routeMap.find(netGuid);
+        float localLat = curClusterLat;
+        if (routesIt != routeMap.end()) {
+          auto routeIt = routesIt->second.find(remoteNet->net.guid);
+          if (routeIt != routesIt->second.end() && routeIt->second != NULL) {
+            routeBw = routeIt->second->interBw;
+            if (routeIt->second->interLat > 0) {
+              localLat = remoteClusterLat = routeIt->second->interLat;
+            }
+          }
+        }
+        // prefer the calibrated cost of this nic pair
+        const struct flagcxAlphaBeta *pairCost = flagcxCostTableGetNicPair(
+            comm->costTable, netGuid, remoteNet->net.guid);
+        if (pairCost != NULL) {
+          localLat = remoteClusterLat = pairCost->alpha;
+          routeBw = pairCost->beta;
+        }
         if (p2pOp.isRecv_) {
-          recvTime += getSendRecvTime(curClusterLat, remoteClusterLat, routeBw,
+          recvTime += getSendRecvTime(localLat, remoteClusterLat, routeBw,
                                       p2pOp.count_, CHUNK_SIZE);
         } else {
-          sendTime += getSendRecvTime(curClusterLat, remoteClusterLat, routeBw,
+          sendTime += getSendRecvTime(localLat, remoteClusterLat, routeBw,
                                       p2pOp.count_, CHUNK_SIZE);
         }
       }
@@ -282,20 +414,103 @@ float flagcxAlgoTimeEstimator::getP2pTimePerNic(
 
 float flagcxAlgoTimeEstimator::getSendRecvTime(float curClusterLat,
                                                float remoteClusterLat, float bw,
-                                               int totalCount,
+                                               size_t totalCount,
                                                size_t chunkSize) {
-  // in the current implementation, chunks are sent in serial order
+  // in the current implementation, chunks are sent in serial order, so each
+  // chunk pays the latency once and the payload is bandwidth bound
   float lat =
       std::max(curClusterLat,
                remoteClusterLat); // use the higher latency between two clusters
   size_t bytes = totalCount * getFlagcxDataTypeSize(datatype);
-  int steps = (bytes + chunkSize - 1) / chunkSize;
-  float time = 0.0;
-  int sizeSent = 0;
-  for (int s = 0; s < steps; s++) {
-    size_t sendSize = std::min(chunkSize, bytes - sizeSent);
-    time += lat + sendSize / (1000 * bw); // convert to us (bw in GB/s)
-    sizeSent += sendSize;
+  size_t steps = (bytes + chunkSize - 1) / chunkSize;
+  // convert to us (bw in GB/s)
+  return (float)steps * lat + (float)((double)bytes / (1000.0 * bw));
+}
+// Copy of comm as seen by another rank, with the per-rank fields the planner
+// reads set for that rank
+static void flagcxC2cCommViewAsRank(flagcxComm_t comm, int rank,
+                                    struct flagcxComm *view) {
+  *view = *comm;
+  int cluster = comm->cluster_ids[rank];
+  auto &interRanks = comm->clusterInterRankList[cluster];
+  view->rank = rank;
+  view->homo_rank = comm->globalrank2homorank[rank];
+  view->homo_root_rank = rank - view->homo_rank;
+  view->homo_ranks = comm->cluster_sizes[cluster];
+  view->homoInterMyRank = -1;
+  view->homoInterRootRank = -1;
+  view->homoInterRanks = -1;
+  for (size_t i = 0; i < interRanks.size(); i++) {
+    if (interRanks[i] == rank) {
+      view->homoInterMyRank = i;
+      view->homoInterRootRank = interRanks[0];
+      view->homoInterRanks = interRanks.size();
+    }
+  }
+}
+
+flagcxResult_t flagcxC2cAlgoSelect(flagcxC2cPlanner *planner, size_t totalCount,
+                                   size_t recvCount, flagcxComm_t comm,
+                                   flagcxCommOp_t commOp, flagcxRedOp_t redOp,
+                                   flagcxDataType_t datatype) {
+  if (!flagcxC2cAlgoSelectEnabled()) {
+    *planner = flagcxC2cPlanner(totalCount, recvCount, comm, commOp, redOp);
+    FLAGCXCHECK(planner->findStrategy());
+    return flagcxSuccess;
   }
-  return time;
-}
\ No newline at end of file
+
+  // The homo functions of a plan depend on the cluster of the rank that
+  // builds it. Every candidate is therefore also built as seen by the first
+  // inter rank of each cluster, so that all ranks score it identically.
+  std::vector<struct flagcxComm> clusterViews(comm->nclusters);
+  for (int c = 0; c < comm->nclusters; c++) {
+    flagcxC2cCommViewAsRank(comm, comm->clusterInterRankList[c][0],
+                            &clusterViews[c]);
+  }
+
+  float bestTime = -1.0;
+  for (int algo = flagcxC2cAlgoMultiNicBfs; algo < flagcxC2cAlgoNum; algo++) {
+    flagcxC2cPlanner candidate(totalCount, recvCount, comm, commOp, redOp);
+    if ((algo == flagcxC2cAlgoMultiNicBfs ||
+         algo == flagcxC2cAlgoMultiNicDfs) &&
+        !candidate.isMultiNic()) {
+      continue;
+    }
+    if (algo == flagcxC2cAlgoHostComm) {
+      // host comm is only set up on demand, and gloo lacks reduceScatter
+      if (comm->host_comm == NULL ||
+          (commOp == flagcxCommOpReduceScatter &&
+           strcmp(cclAdaptors[flagcxCCLAdaptorHost]->name, "GLOO") == 0)) {
+        continue;
+      }
+    }
+    FLAGCXCHECK(candidate.setAlgo((flagcxC2cAlgo_t)algo));
+    std::vector<flagcxC2cPlanner> clusterPlanners;
+    flagcxAlgoTimeEstimator estimator(candidate, datatype, &clusterPlanners);
+    float time = 0.0;
+    if (algo == flagcxC2cAlgoHostComm) {
+      FLAGCXCHECK(estimator.getHostCommAlgoTime(&time));
+    } else {
+      FLAGCXCHECK(candidate.findStrategy());
+      for (int c = 0; c < comm->nclusters; c++) {
+        clusterPlanners.emplace_back(totalCount, recvCount, &clusterViews[c],
+                                     commOp, redOp);
+        FLAGCXCHECK(clusterPlanners[c].setAlgo((flagcxC2cAlgo_t)algo));
+        FLAGCXCHECK(clusterPlanners[c].findStrategy());
+      }
+      FLAGCXCHECK(estimator.getAlgoTime(&time));
+    }
+    INFO(FLAGCX_TUNING,
+         "COST_MODEL: commOp %d count %zu algo %s predicted time %.2f us",
+         commOp, totalCount, flagcxC2cAlgoStr[algo], time);
+    if (bestTime < 0 || time < bestTime) {
+      bestTime = time;
+      candidate.setPredictedTime(time);
+      *planner = candidate;
+    }
+  }
+  INFO(FLAGCX_TUNING,
+       "COST_MODEL: commOp %d count %zu selected algo %s (%.2f us)", commOp,
+       totalCount, flagcxC2cAlgoStr[planner->getAlgo()], bestTime);
+  return flagcxSuccess;
+}
@@ -2,6 +2,7 @@
 #define FLAGCX_COST_MODEL_H
 
 #include "c2c_algo.h"
+#include "cost_calib.h"
 #include "flagcx.h"
 #include <vector>
 
@@ -20,15 +21,21 @@
 constexpr int FLAGCX_INTRA_LAT_IDX = 0;
 constexpr int FLAGCX_INTER_LAT_IDX = 1;
 
-#define FLAGCX_VENDOR_NUM 4
-
 class flagcxAlgoTimeEstimator {
 public:
-  flagcxAlgoTimeEstimator(flagcxC2cPlanner &planner, flagcxDataType_t dtype)
-      : planner_(planner), datatype(dtype) {}
+  // clusterPlanners optionally holds the same plan as seen by a rank of each
+  // cluster, so that the homo phases of every cluster are priced with their
+  // own functions instead of those of the local cluster
+  flagcxAlgoTimeEstimator(
+      flagcxC2cPlanner &planner, flagcxDataType_t dtype,
+      std::vector<flagcxC2cPlanner> *clusterPlanners = nullptr)
+      : planner_(planner), datatype(dtype), clusterPlanners_(clusterPlanners) {}
 
   flagcxResult_t getAlgoTime(float *time);
 
+  // time of staging through host memory and running the host CCL
+  flagcxResult_t getHostCommAlgoTime(float *time);
+
 private:
   flagcxResult_t getPreHomoAlgoTime(float *time);
 
@@ -54,11 +61,32 @@ private:
 
   float getRefreshTime();
 
+  // calibrated latency if available, flagcxLatMap otherwise
+  float getLat(int vendor, int latIdx);
+
   float getSendRecvTime(float curClusterLat, float remoteClusterLat, float bw,
-                        int totalCount, size_t chunkSize);
+                        size_t totalCount, size_t chunkSize);
+
+  // planner whose homo functions apply to cluster
+  flagcxC2cPlanner &getClusterPlanner(int cluster);
 
   flagcxC2cPlanner &planner_;
   flagcxDataType_t datatype;
+  std::vector<flagcxC2cPlanner> *clusterPlanners_;
 };
 
+// Whether the inputs required by flagcxAlgoTimeEstimator are available
+bool flagcxAlgoEstimatorEnabled();
+
+// Whether C2C strategies are picked by the estimator (FLAGCX_C2C_ALGO_SELECT)
+bool flagcxC2cAlgoSelectEnabled();
+
+// Build plans for all candidate C2C strategies of a communication pattern,
+// score them with flagcxAlgoTimeEstimator and return the cheapest one. The
+// decision only depends on data every rank shares, so all ranks agree on it.
+flagcxResult_t flagcxC2cAlgoSelect(flagcxC2cPlanner *planner, size_t totalCount,
+                                   size_t recvCount, flagcxComm_t comm,
+                                   flagcxCommOp_t commOp, flagcxRedOp_t redOp,
+                                   flagcxDataType_t datatype);
+
 #endif
\ No newline at end of file
@@ -19,8 +19,16 @@ flagcxResult_t flagcxHeteroGetUniqueId(flagcxUniqueId* out);
 
 flagcxResult_t flagcxHeteroCommInitRank(flagcxHeteroComm_t* newcomm, int nranks, flagcxUniqueId commId, int myrank);
 
+// Collective over all ranks of comm, the new communicator shares the proxy,
+// connections and topology of comm
+flagcxResult_t flagcxHeteroCommSplit(flagcxHeteroComm_t comm, int color, int key, flagcxHeteroComm_t* newcomm);
+
 flagcxResult_t flagcxHeteroCommCount(const flagcxHeteroComm_t comm, int* count);
 
 flagcxResult_t flagcxHeteroCommUserRank(const flagcxHeteroComm_t comm, int* rank);
 
+// First error of the asynchronous operations of comm, e.g. a proxy transfer
+// that failed or timed out
+flagcxResult_t flagcxHeteroCommGetAsyncError(flagcxHeteroComm_t comm, flagcxResult_t* asyncError);
+
 flagcxResult_t flagcxHeteroCommDestroy(flagcxHeteroComm_t comm);
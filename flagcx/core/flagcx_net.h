@@ -21,6 +21,9 @@
 // Maximum number of requests per comm object
 #define FLAGCX_NET_MAX_REQUESTS 32
 
+// Largest transfer a v9 plugin is expected to accept in a single request
+#define FLAGCX_MAX_NET_SIZE_BYTES (1*1024*1024*1024*1024L) // 1TB
+
 typedef struct {
   char* name;                      // Used mostly for logging.
   char* pciPath;                   // Path to the PCI device in /sys.
@@ -35,9 +38,86 @@ typedef struct {
   int maxRecvs;                    // Maximum number of grouped receives.
   flagcxNetDeviceType netDeviceType; // Network offload type
   int netDeviceVersion;            // Version number for network offload
-} flagcxNetProperties_v8_t;
+  size_t maxP2pBytes;              // Max transfer size for point-to-point operations
+} flagcxNetProperties_v9_t;
 
-typedef flagcxNetProperties_v8_t flagcxNetProperties_t;
+typedef flagcxNetProperties_v9_t flagcxNetProperties_t;
+
+typedef struct {
+  // Name of the network (mainly for logs)
+  const char* name;
+  // Initialize the network.
+  flagcxResult_t (*init)(flagcxDebugLogger_t logFunction);
+  // Return the number of adapters.
+  flagcxResult_t (*devices)(int* ndev);
+  // Get various device properties.
+  flagcxResult_t (*getProperties)(int dev, flagcxNetProperties_v9_t* props);
+  // Create a receiving object and provide a handle to connect to it. The
+  // handle can be up to FLAGCX_NET_HANDLE_MAXSIZE bytes and will be exchanged
+  // between ranks to create a connection.
+  flagcxResult_t (*listen)(int dev, void* handle, void** listenComm);
+  // Connect to a handle and return a sending comm object for that peer.
+  // This call must not block for the connection to be established, and instead
+  // should return successfully with sendComm == NULL with the expectation that
+  // it will be called again until sendComm != NULL.
+  // If *sendDevComm points to a valid object, then FLAGCX is requesting device offload for this connection
+  flagcxResult_t (*connect)(int dev, void* handle, void** sendComm, flagcxNetDeviceHandle_v9_t** sendDevComm);
+  // Finalize connection establishment after remote peer has called connect.
+  // This call must not block for the connection to be established, and instead
+  // should return successfully with recvComm == NULL with the expectation that
+  // it will be called again until recvComm != NULL.
+  // If *recvDevComm points to a valid object, then FLAGCX is requesting device offload for this connection
+  flagcxResult_t (*accept)(void* listenComm, void** recvComm, flagcxNetDeviceHandle_v9_t** recvDevComm);
+  // Register/Deregister memory. Comm can be either a sendComm or a recvComm.
+  // Type is either FLAGCX_PTR_HOST or FLAGCX_PTR_CUDA.
+  flagcxResult_t (*regMr)(void* comm, void* data, size_t size, int type, void** mhandle);
+  /* DMA-BUF support */
+  flagcxResult_t (*regMrDmaBuf)(void* comm, void* data, size_t size, int type, uint64_t offset, int fd, void** mhandle);
+  flagcxResult_t (*deregMr)(void* comm, void* mhandle);
+  // Asynchronous send to a peer. Sizes are 64-bit, up to maxP2pBytes.
+  // May return request == NULL if the call cannot be performed (or would block)
+  flagcxResult_t (*isend)(void* sendComm, void* data, size_t size, int tag, void* mhandle, void** request);
+  // Asynchronous recv from a peer.
+  // May return request == NULL if the call cannot be performed (or would block)
+  flagcxResult_t (*irecv)(void* recvComm, int n, void** data, size_t* sizes, int* tags, void** mhandles, void** request);
+  // Perform a flush/fence to make sure all data received with FLAGCX_PTR_CUDA is
+  // visible to the GPU
+  flagcxResult_t (*iflush)(void* recvComm, int n, void** data, size_t* sizes, void** mhandles, void** request);
+  // Test whether a request is complete. If size is not NULL, it returns the
+  // number of bytes sent/received.
+  flagcxResult_t (*test)(void* request, int* done, size_t* sizes);
+  // Close and free send/recv comm objects
+  flagcxResult_t (*closeSend)(void* sendComm);
+  flagcxResult_t (*closeRecv)(void* recvComm);
+  flagcxResult_t (*closeListen)(void* listenComm);
+
+  // Copy the given mhandle to a dptr in a format usable by this plugin's device code
+  flagcxResult_t (*getDeviceMr)(void* comm, void* mhandle, void** dptr_mhandle);
+
+  // Notify the plugin that a recv has completed by the device
+  flagcxResult_t (*irecvConsumed)(void* recvComm, int n, void* request);
+  flagcxResult_t (*getDevFromName)(char *name, int *dev);
+} flagcxNet_v9_t;
+
+typedef flagcxNet_v9_t flagcxNet_t;
+
+#define FLAGCX_NET_PLUGIN_SYMBOL flagcxNetPlugin_v9
+
+typedef struct {
+  char* name;                      // Used mostly for logging.
+  char* pciPath;                   // Path to the PCI device in /sys.
+  uint64_t guid;                   // Unique identifier for the NIC chip. Important for
+                                   // cards with multiple PCI functions (Physical or virtual).
+  int ptrSupport;                  // [FLAGCX_PTR_HOST|FLAGCX_PTR_CUDA|FLAGCX_PTR_DMABUF]
+  int regIsGlobal;                 // regMr is not tied to a particular comm
+  int speed;                       // Port speed in Mbps.
+  int port;                        // Port number.
+  float latency;                   // Network latency
+  int maxComms;                    // Maximum number of comms we can create
+  int maxRecvs;                    // Maximum number of grouped receives.
+  flagcxNetDeviceType netDeviceType; // Network offload type
+  int netDeviceVersion;            // Version number for network offload
+} flagcxNetProperties_v8_t;
 
 typedef struct {
   // Name of the network (mainly for logs)
@@ -96,10 +176,6 @@ typedef struct {
   
 } flagcxNet_v8_t;
 
-typedef flagcxNet_v8_t flagcxNet_t;
-
-#define FLAGCX_NET_PLUGIN_SYMBOL flagcxNetPlugin_v8
-
 typedef struct {
   void* mhandle;
   void* address;
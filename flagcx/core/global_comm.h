@@ -2,7 +2,9 @@
 #define FLAGCX_GLOBAL_COMM_H_
 
 #include "bootstrap.h"
+#include "cost_calib.h"
 #include "flagcx.h"
+#include "scratch.h"
 
 #include <vector>
 
@@ -47,6 +49,10 @@ struct flagcxComm {
   std::vector<std::vector<int>> clusterInterRankList;
   flagcxInnerComm_t homoInterComm;
   std::vector<flagcxVendorType> clusterVendorMap;
+  // persistent device scratch for C2C algorithms
+  struct flagcxScratchArena scratchArena;
+  // calibrated cost model parameters, NULL if unavailable
+  struct flagcxCostTable *costTable;
 };
 
 #endif // end include guard
\ No newline at end of file
@@ -56,9 +56,10 @@ int flagcxPxnDisable(struct flagcxHeteroComm *comm);
 flagcxResult_t flagcxTopoGetPxnRanks(struct flagcxHeteroComm *comm,
                                      int **intermediateRanks, int *nranks);
 
-// Find CPU affinity
+// Find CPU affinity: cpus of the NUMA domain closest to net netDev that the
+// process may run on, empty when the topology is unknown
 flagcxResult_t flagcxTopoGetCpuAffinity(struct flagcxTopoServer *topoServer,
-                                        int rank, cpu_set_t *affinity);
+                                        int netDev, cpu_set_t *affinity);
 
 #define FLAGCX_TOPO_CPU_ARCH_X86 1
 #define FLAGCX_TOPO_CPU_ARCH_POWER 2
@@ -81,6 +82,11 @@ flagcxResult_t flagcxTopoGetNvsCount(struct flagcxTopoServer *topoServer,
 // change function signature
 flagcxResult_t flagcxGetLocalNetFromGpu(int apu, int *dev,
                                         struct flagcxHeteroComm *comm);
+// Local net used by the connection to peer. With a detected topology, every
+// (sender, receiver) pair gets the net pair with the best path bandwidth and
+// pairs tied on bandwidth are spread across the rails; comm->netDev otherwise.
+flagcxResult_t flagcxTopoGetP2pNet(struct flagcxHeteroComm *comm, int peer,
+                                   int isSend, int *netDev);
 flagcxResult_t flagcxTopoGetLocalGpu(struct flagcxTopoServer *topoServer,
                                      int64_t netId, int *gpuIndex);
 flagcxResult_t getLocalNetCountByBw(struct flagcxTopoServer *topoServer,
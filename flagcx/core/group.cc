@@ -52,7 +52,9 @@ flagcxResult_t flagcxPreconnectFunc(struct flagcxAsyncJob *job_) {
   struct flagcxPreconnectJob *job = (struct flagcxPreconnectJob *)job_;
   struct flagcxHeteroComm *comm = job->comm;
   if (comm->proxyState->initialized == 0) {
-    FLAGCXCHECK(flagcxProxyInit(comm));
+    // a split communicator runs the proxy of the communicator it shares
+    FLAGCXCHECK(
+        flagcxProxyInit(comm->sharedRes ? comm->sharedRes->owner : comm));
   }
   FLAGCXCHECK(flagcxTransportP2pSetup(comm, NULL, 0));
   return flagcxSuccess;
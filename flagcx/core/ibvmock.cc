@@ -0,0 +1,848 @@
+/*************************************************************************
+ * Software IB verbs provider, selected with FLAGCX_IB_MOCK=1.
+ *
+ * Emulates RoCE devices so that the IB transport can run and be benchmarked
+ * without a NIC. RC QPs of local processes are linked through unix sockets:
+ * RDMA writes and reads are carried as messages, and a thread per incoming
+ * connection applies them to registered memory and generates completions.
+ ************************************************************************/
+
+#include "core.h"
+#include "ibvsymbols.h"
+#include "param.h"
+#include "utils.h"
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+FLAGCX_PARAM(IbMockDevices, "IB_MOCK_DEVICES", 1);
+
+#define FLAGCX_IBV_MOCK_MAX_DEVS 16
+#define FLAGCX_IBV_MOCK_MAX_SGE 8
+#define FLAGCX_IBV_MOCK_MAGIC 0x4d4f434bU
+
+enum flagcxIbvMockMsgType {
+  flagcxIbvMockMsgWrite = 0,
+  flagcxIbvMockMsgWriteImm = 1,
+  flagcxIbvMockMsgRead = 2,
+  flagcxIbvMockMsgReadResp = 3,
+  flagcxIbvMockMsgNak = 4,
+  flagcxIbvMockMsgSend = 5,
+  flagcxIbvMockMsgSendImm = 6
+};
+
+// Header of every message, followed by length bytes of payload for writes,
+// sends and read responses
+struct flagcxIbvMockMsg {
+  uint32_t type;
+  uint32_t imm;
+  uint32_t rkey;
+  uint32_t length;
+  uint64_t remoteAddr;
+  uint64_t localAddr; // where a read response lands on the requester
+  uint64_t wrId;
+  uint32_t signaled;
+  uint32_t status; // for naks
+};
+
+// First message on a connection, names the destination QP
+struct flagcxIbvMockHello {
+  uint32_t magic;
+  uint32_t qpn;
+};
+
+struct flagcxIbvMockContext {
+  struct ibv_context context; // must be first
+  int refs;
+  bool closed;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+struct flagcxIbvMockMr {
+  struct ibv_mr mr; // must be first
+  int access;
+};
+
+struct flagcxIbvMockCq {
+  struct ibv_cq cq; // must be first
+  std::mutex mutex;
+  std::deque<struct ibv_wc> wcs;
+  std::atomic<int> count{0};
+};
+
+// A posted receive, sends land in its single buffer
+struct flagcxIbvMockRecv {
+  uint64_t wrId;
+  uint64_t addr;
+  uint32_t length;
+};
+
+// An immediate write or a send that came before any receive was posted
+struct flagcxIbvMockArrival {
+  struct ibv_wc wc;
+  std::vector<char> payload;
+};
+
+struct flagcxIbvMockQp {
+  struct ibv_qp qp; // must be first
+  // outgoing connection, shared by the poster and the receive thread that
+  // answers reads
+  std::mutex sendMutex;
+  int sendFd = -1;
+  // incoming connection, drained by recvThread
+  int recvFd = -1;
+  pthread_t recvThread;
+  bool hasRecvThread = false;
+  // posted receives and immediate writes or sends waiting for one
+  std::mutex recvMutex;
+  std::deque<struct flagcxIbvMockRecv> recvs;
+  std::deque<struct flagcxIbvMockArrival> arrived;
+};
+
+static struct ibv_device flagcxIbvMockDevs[FLAGCX_IBV_MOCK_MAX_DEVS];
+static struct flagcxIbvMockContext
+    flagcxIbvMockContexts[FLAGCX_IBV_MOCK_MAX_DEVS];
+static int flagcxIbvMockNDevs = 0;
+static pthread_mutex_t flagcxIbvMockLock = PTHREAD_MUTEX_INITIALIZER;
+
+static std::mutex flagcxIbvMockMrLock;
+static std::map<uint32_t, struct flagcxIbvMockMr *> flagcxIbvMockMrs;
+static std::atomic<uint32_t> flagcxIbvMockNextKey{1};
+
+static std::mutex flagcxIbvMockQpLock;
+static std::map<uint32_t, struct flagcxIbvMockQp *> flagcxIbvMockQps;
+static std::atomic<uint32_t> flagcxIbvMockNextQpn{0x100};
+
+static pthread_once_t flagcxIbvMockListenOnce = PTHREAD_ONCE_INIT;
+static int flagcxIbvMockListenFd = -1;
+
+static socklen_t flagcxIbvMockAddr(pid_t pid, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  // abstract namespace, nothing to clean up on exit
+  int len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+                     "flagcx-ibmock-%d", (int)pid);
+  return offsetof(struct sockaddr_un, sun_path) + 1 + len;
+}
+
+static int flagcxIbvMockReadFull(int fd, void *buff, size_t size) {
+  char *ptr = (char *)buff;
+  while (size > 0) {
+    ssize_t n = read(fd, ptr, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    ptr += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static int flagcxIbvMockWriteFull(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    // the peer may go away first, report it instead of raising SIGPIPE
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return -1;
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+static int flagcxIbvMockSendMsg(struct flagcxIbvMockQp *qp,
+                                struct flagcxIbvMockMsg *msg,
+                                struct iovec *data, int ndata) {
+  struct iovec iov[FLAGCX_IBV_MOCK_MAX_SGE + 1];
+  iov[0].iov_base = msg;
+  iov[0].iov_len = sizeof(*msg);
+  for (int i = 0; i < ndata; i++)
+    iov[i + 1] = data[i];
+  std::lock_guard<std::mutex> lock(qp->sendMutex);
+  if (qp->sendFd < 0)
+    return EINVAL;
+  return flagcxIbvMockWriteFull(qp->sendFd, iov, ndata + 1) ? EIO : 0;
+}
+
+static void flagcxIbvMockCqPush(struct ibv_cq *cq, struct ibv_wc *wc) {
+  struct flagcxIbvMockCq *mcq = (struct flagcxIbvMockCq *)cq;
+  std::lock_guard<std::mutex> lock(mcq->mutex);
+  mcq->wcs.push_back(*wc);
+  mcq->count.fetch_add(1, std::memory_order_release);
+}
+
+static void flagcxIbvMockComplete(struct ibv_cq *cq, struct ibv_qp *qp,
+                                  uint64_t wrId, enum ibv_wc_opcode opcode,
+                                  enum ibv_wc_status status, uint32_t len) {
+  struct ibv_wc wc;
+  memset(&wc, 0, sizeof(wc));
+  wc.wr_id = wrId;
+  wc.status = status;
+  wc.opcode = opcode;
+  wc.byte_len = len;
+  wc.qp_num = qp->qp_num;
+  flagcxIbvMockCqPush(cq, &wc);
+}
+
+// Resolve a remote access against the registered memory, NULL if not allowed
+static void *flagcxIbvMockRemoteAddr(uint32_t rkey, uint64_t addr,
+                                     uint32_t length, int access) {
+  std::lock_guard<std::mutex> lock(flagcxIbvMockMrLock);
+  auto it = flagcxIbvMockMrs.find(rkey);
+  if (it == flagcxIbvMockMrs.end() || !(it->second->access & access))
+    return NULL;
+  uint64_t base = (uint64_t)it->second->mr.addr;
+  if (addr < base || addr + length > base + it->second->mr.length)
+    return NULL;
+  return (void *)addr;
+}
+
+static void flagcxIbvMockNak(struct flagcxIbvMockQp *qp,
+                             struct flagcxIbvMockMsg *req) {
+  struct flagcxIbvMockMsg nak;
+  memset(&nak, 0, sizeof(nak));
+  nak.type = flagcxIbvMockMsgNak;
+  nak.wrId = req->wrId;
+  nak.status = IBV_WC_REM_ACCESS_ERR;
+  WARN("NET/IB/MOCK : qpn %u denied remote access rkey 0x%x addr 0x%lx len %u",
+       qp->qp.qp_num, req->rkey, req->remoteAddr, req->length);
+  flagcxIbvMockSendMsg(qp, &nak, NULL, 0);
+}
+
+static int flagcxIbvMockDrain(int fd, uint32_t length) {
+  char scratch[4096];
+  while (length > 0) {
+    uint32_t n = std::min<uint32_t>(length, sizeof(scratch));
+    if (flagcxIbvMockReadFull(fd, scratch, n))
+      return -1;
+    length -= n;
+  }
+  return 0;
+}
+
+// Complete a posted receive with an arrival, copying a send payload into
+// the receive buffer
+static void flagcxIbvMockConsume(struct flagcxIbvMockQp *qp,
+                                 struct flagcxIbvMockRecv *recv,
+                                 struct flagcxIbvMockArrival *arrival) {
+  struct ibv_wc *wc = &arrival->wc;
+  wc->wr_id = recv->wrId;
+  if (wc->opcode == IBV_WC_RECV) {
+    if (arrival->payload.size() > recv->length) {
+      wc->status = IBV_WC_LOC_LEN_ERR;
+      wc->byte_len = 0;
+    } else if (arrival->payload.size() > 0) {
+      memcpy((void *)recv->addr, arrival->payload.data(),
+             arrival->payload.size());
+    }
+  }
+  flagcxIbvMockCqPush(qp->qp.recv_cq, wc);
+}
+
+// Match an immediate write or a send with a posted receive, or keep it until
+// one is posted, as a real HCA would retry on RNR
+static void flagcxIbvMockDeliver(struct flagcxIbvMockQp *qp,
+                                 struct flagcxIbvMockArrival *arrival) {
+  struct ibv_wc *wc = &arrival->wc;
+  wc->status = IBV_WC_SUCCESS;
+  wc->qp_num = qp->qp.qp_num;
+  std::lock_guard<std::mutex> lock(qp->recvMutex);
+  if (qp->recvs.empty()) {
+    qp->arrived.push_back(std::move(*arrival));
+    return;
+  }
+  flagcxIbvMockConsume(qp, &qp->recvs.front(), arrival);
+  qp->recvs.pop_front();
+}
+
+static void *flagcxIbvMockRecvThreadMain(void *args) {
+  struct flagcxIbvMockQp *qp = (struct flagcxIbvMockQp *)args;
+  struct flagcxIbvMockMsg msg;
+  while (flagcxIbvMockReadFull(qp->recvFd, &msg, sizeof(msg)) == 0) {
+    if (msg.type == flagcxIbvMockMsgWrite ||
+        msg.type == flagcxIbvMockMsgWriteImm) {
+      void *dst = NULL;
+      if (msg.length > 0) {
+        dst = flagcxIbvMockRemoteAddr(msg.rkey, msg.remoteAddr, msg.length,
+                                      IBV_ACCESS_REMOTE_WRITE);
+        if (dst == NULL) {
+          if (flagcxIbvMockDrain(qp->recvFd, msg.length))
+            break;
+          flagcxIbvMockNak(qp, &msg);
+          continue;
+        }
+        if (flagcxIbvMockReadFull(qp->recvFd, dst, msg.length))
+          break;
+      }
+      if (msg.type == flagcxIbvMockMsgWriteImm) {
+        struct flagcxIbvMockArrival arrival;
+        memset(&arrival.wc, 0, sizeof(arrival.wc));
+        arrival.wc.opcode = IBV_WC_RECV_RDMA_WITH_IMM;
+        arrival.wc.wc_flags = IBV_WC_WITH_IMM;
+        arrival.wc.imm_data = msg.imm;
+        arrival.wc.byte_len = msg.length;
+        flagcxIbvMockDeliver(qp, &arrival);
+      }
+    } else if (msg.type == flagcxIbvMockMsgSend ||
+               msg.type == flagcxIbvMockMsgSendImm) {
+      struct flagcxIbvMockArrival arrival;
+      arrival.payload.resize(msg.length);
+      if (msg.length > 0 && flagcxIbvMockReadFull(qp->recvFd,
+                                                  arrival.payload.data(),
+                                                  msg.length))
+        break;
+      memset(&arrival.wc, 0, sizeof(arrival.wc));
+      arrival.wc.opcode = IBV_WC_RECV;
+      if (msg.type == flagcxIbvMockMsgSendImm) {
+        arrival.wc.wc_flags = IBV_WC_WITH_IMM;
+        arrival.wc.imm_data = msg.imm;
+      }
+      arrival.wc.byte_len = msg.length;
+      flagcxIbvMockDeliver(qp, &arrival);
+    } else if (msg.type == flagcxIbvMockMsgRead) {
+      void *src = flagcxIbvMockRemoteAddr(msg.rkey, msg.remoteAddr, msg.length,
+                                          IBV_ACCESS_REMOTE_READ);
+      if (src == NULL && msg.length > 0) {
+        flagcxIbvMockNak(qp, &msg);
+        continue;
+      }
+      struct iovec data = {src, msg.length};
+      msg.type = flagcxIbvMockMsgReadResp;
+      flagcxIbvMockSendMsg(qp, &msg, &data, msg.length > 0 ? 1 : 0);
+    } else if (msg.type == flagcxIbvMockMsgReadResp) {
+      if (msg.length > 0 &&
+          flagcxIbvMockReadFull(qp->recvFd, (void *)msg.localAddr, msg.length))
+        break;
+      if (msg.signaled)
+        flagcxIbvMockComplete(qp->qp.send_cq, &qp->qp, msg.wrId,
+                              IBV_WC_RDMA_READ, IBV_WC_SUCCESS, msg.length);
+    } else if (msg.type == flagcxIbvMockMsgNak) {
+      // errors complete even when the request was unsignaled
+      flagcxIbvMockComplete(qp->qp.send_cq, &qp->qp, msg.wrId,
+                            IBV_WC_RDMA_WRITE, (enum ibv_wc_status)msg.status,
+                            0);
+    } else {
+      WARN("NET/IB/MOCK : qpn %u got unknown message type %u", qp->qp.qp_num,
+           msg.type);
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Hand incoming connections to the QP they name
+static void *flagcxIbvMockListenThreadMain(void *) {
+  while (1) {
+    int fd = accept(flagcxIbvMockListenFd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      WARN("NET/IB/MOCK : accept failed: %s", strerror(errno));
+      return NULL;
+    }
+    struct flagcxIbvMockHello hello;
+    if (flagcxIbvMockReadFull(fd, &hello, sizeof(hello)) ||
+        hello.magic != FLAGCX_IBV_MOCK_MAGIC) {
+      close(fd);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(flagcxIbvMockQpLock);
+    auto it = flagcxIbvMockQps.find(hello.qpn);
+    if (it == flagcxIbvMockQps.end() || it->second->hasRecvThread) {
+      WARN("NET/IB/MOCK : connection for unknown or connected qpn %u",
+           hello.qpn);
+      close(fd);
+      continue;
+    }
+    struct flagcxIbvMockQp *qp = it->second;
+    qp->recvFd = fd;
+    qp->hasRecvThread = true;
+    pthread_create(&qp->recvThread, NULL, flagcxIbvMockRecvThreadMain, qp);
+    flagcxSetThreadName(qp->recvThread, "FLAGCX IbMock %u", hello.qpn);
+  }
+  return NULL;
+}
+
+static void flagcxIbvMockListen() {
+  struct sockaddr_un addr;
+  socklen_t len = flagcxIbvMockAddr(getpid(), &addr);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&addr, len) ||
+      listen(fd, SOMAXCONN)) {
+    WARN("NET/IB/MOCK : unable to listen on %s: %s", addr.sun_path + 1,
+         strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return;
+  }
+  flagcxIbvMockListenFd = fd;
+  pthread_t thread;
+  pthread_create(&thread, NULL, flagcxIbvMockListenThreadMain, NULL);
+  flagcxSetThreadName(thread, "FLAGCX IbMockListen");
+  pthread_detach(thread);
+}
+
+// The GID of a mock port names its process and device
+static void flagcxIbvMockGid(int dev, union ibv_gid *gid) {
+  memset(gid, 0, sizeof(*gid));
+  gid->raw[0] = 0xfe;
+  gid->raw[1] = 0x80;
+  uint32_t pid = htonl(getpid());
+  uint32_t devId = htonl(dev);
+  memcpy(gid->raw + 8, &pid, sizeof(pid));
+  memcpy(gid->raw + 12, &devId, sizeof(devId));
+}
+
+static int flagcxIbvMockForkInit(void) { return 0; }
+
+static struct ibv_device **flagcxIbvMockGetDeviceList(int *numDevices) {
+  pthread_mutex_lock(&flagcxIbvMockLock);
+  if (flagcxIbvMockNDevs == 0) {
+    flagcxIbvMockNDevs = std::min<int64_t>(
+        std::max<int64_t>(flagcxParamIbMockDevices(), 0),
+        FLAGCX_IBV_MOCK_MAX_DEVS);
+    for (int d = 0; d < flagcxIbvMockNDevs; d++) {
+      struct ibv_device *dev = flagcxIbvMockDevs + d;
+      dev->node_type = IBV_NODE_CA;
+      dev->transport_type = IBV_TRANSPORT_IB;
+      snprintf(dev->name, sizeof(dev->name), "mock_%d", d);
+      snprintf(dev->dev_name, sizeof(dev->dev_name), "uverbs_mock%d", d);
+    }
+  }
+  pthread_mutex_unlock(&flagcxIbvMockLock);
+  struct ibv_device **list = (struct ibv_device **)calloc(
+      flagcxIbvMockNDevs + 1, sizeof(struct ibv_device *));
+  if (list == NULL)
+    return NULL;
+  for (int d = 0; d < flagcxIbvMockNDevs; d++)
+    list[d] = flagcxIbvMockDevs + d;
+  *numDevices = flagcxIbvMockNDevs;
+  return list;
+}
+
+static void flagcxIbvMockFreeDeviceList(struct ibv_device **list) {
+  free(list);
+}
+
+static const char *flagcxIbvMockGetDeviceName(struct ibv_device *device) {
+  return device->name;
+}
+
+static int flagcxIbvMockPollCq(struct ibv_cq *cq, int numEntries,
+                               struct ibv_wc *wc);
+static int flagcxIbvMockPostSend(struct ibv_qp *qp, struct ibv_send_wr *wr,
+                                 struct ibv_send_wr **badWr);
+static int flagcxIbvMockPostRecv(struct ibv_qp *qp, struct ibv_recv_wr *wr,
+                                 struct ibv_recv_wr **badWr);
+
+static struct ibv_context *flagcxIbvMockOpenDevice(struct ibv_device *device) {
+  int d = device - flagcxIbvMockDevs;
+  if (d < 0 || d >= flagcxIbvMockNDevs) {
+    errno = ENODEV;
+    return NULL;
+  }
+  pthread_once(&flagcxIbvMockListenOnce, flagcxIbvMockListen);
+  if (flagcxIbvMockListenFd < 0) {
+    errno = EADDRINUSE;
+    return NULL;
+  }
+  struct flagcxIbvMockContext *ctx = flagcxIbvMockContexts + d;
+  pthread_mutex_lock(&flagcxIbvMockLock);
+  if (ctx->refs++ == 0) {
+    // contexts are kept for the process lifetime, the async thread may still
+    // wait on one after it is closed
+    if (ctx->context.device == NULL) {
+      pthread_mutex_init(&ctx->lock, NULL);
+      pthread_cond_init(&ctx->cond, NULL);
+    }
+    ctx->context.device = device;
+    ctx->context.ops.poll_cq = flagcxIbvMockPollCq;
+    ctx->context.ops.post_send = flagcxIbvMockPostSend;
+    ctx->context.ops.post_recv = flagcxIbvMockPostRecv;
+    ctx->context.num_comp_vectors = 1;
+    ctx->context.cmd_fd = ctx->context.async_fd = -1;
+    ctx->closed = false;
+  }
+  pthread_mutex_unlock(&flagcxIbvMockLock);
+  return &ctx->context;
+}
+
+static int flagcxIbvMockCloseDevice(struct ibv_context *context) {
+  struct flagcxIbvMockContext *ctx = (struct flagcxIbvMockContext *)context;
+  pthread_mutex_lock(&flagcxIbvMockLock);
+  if (--ctx->refs == 0) {
+    pthread_mutex_lock(&ctx->lock);
+    ctx->closed = true;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+  }
+  pthread_mutex_unlock(&flagcxIbvMockLock);
+  return 0;
+}
+
+// No asynchronous events are ever raised, wait until the device is closed
+static int flagcxIbvMockGetAsyncEvent(struct ibv_context *context,
+                                      struct ibv_async_event *event) {
+  struct flagcxIbvMockContext *ctx = (struct flagcxIbvMockContext *)context;
+  pthread_mutex_lock(&ctx->lock);
+  while (!ctx->closed)
+    pthread_cond_wait(&ctx->cond, &ctx->lock);
+  pthread_mutex_unlock(&ctx->lock);
+  return -1;
+}
+
+static void flagcxIbvMockAckAsyncEvent(struct ibv_async_event *event) {}
+
+static int flagcxIbvMockQueryDevice(struct ibv_context *context,
+                                    struct ibv_device_attr *attr) {
+  int d = (struct flagcxIbvMockContext *)context - flagcxIbvMockContexts;
+  memset(attr, 0, sizeof(*attr));
+  snprintf(attr->fw_ver, sizeof(attr->fw_ver), "mock");
+  attr->node_guid = attr->sys_image_guid =
+      ((uint64_t)FLAGCX_IBV_MOCK_MAGIC << 32) | ((uint64_t)getpid() << 8) | d;
+  attr->max_mr_size = UINT64_MAX;
+  attr->max_qp = 1 << 16;
+  attr->max_qp_wr = 1 << 15;
+  attr->max_sge = FLAGCX_IBV_MOCK_MAX_SGE;
+  attr->max_cq = 1 << 16;
+  attr->max_cqe = 1 << 20;
+  attr->max_mr = 1 << 20;
+  attr->max_pd = 1 << 16;
+  attr->max_qp_rd_atom = attr->max_qp_init_rd_atom = 16;
+  attr->phys_port_cnt = 1;
+  return 0;
+}
+
+static int flagcxIbvMockQueryPort(struct ibv_context *context,
+                                  uint8_t portNum,
+                                  struct ibv_port_attr *attr) {
+  if (portNum != 1)
+    return EINVAL;
+  memset(attr, 0, sizeof(*attr));
+  attr->state = IBV_PORT_ACTIVE;
+  attr->max_mtu = attr->active_mtu = IBV_MTU_4096;
+  attr->gid_tbl_len = 1;
+  attr->max_msg_sz = 1U << 31;
+  attr->pkey_tbl_len = 1;
+  attr->active_width = 2;  // 4x
+  attr->active_speed = 32; // EDR, 100 Gb/s in total
+  attr->phys_state = 5;    // LinkUp
+  // RoCE addressing carries the peer process in the GID
+  attr->link_layer = IBV_LINK_LAYER_ETHERNET;
+  return 0;
+}
+
+static int flagcxIbvMockQueryGid(struct ibv_context *context, uint8_t portNum,
+                                 int index, union ibv_gid *gid) {
+  if (portNum != 1 || index != 0)
+    return EINVAL;
+  flagcxIbvMockGid(
+      (struct flagcxIbvMockContext *)context - flagcxIbvMockContexts, gid);
+  return 0;
+}
+
+static int flagcxIbvMockQueryQp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
+                                int attrMask,
+                                struct ibv_qp_init_attr *initAttr) {
+  memset(attr, 0, sizeof(*attr));
+  attr->qp_state = attr->cur_qp_state = qp->state;
+  memset(initAttr, 0, sizeof(*initAttr));
+  initAttr->send_cq = qp->send_cq;
+  initAttr->recv_cq = qp->recv_cq;
+  initAttr->qp_type = qp->qp_type;
+  return 0;
+}
+
+static struct ibv_pd *flagcxIbvMockAllocPd(struct ibv_context *context) {
+  struct ibv_pd *pd = (struct ibv_pd *)calloc(1, sizeof(struct ibv_pd));
+  if (pd == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  pd->context = context;
+  return pd;
+}
+
+static int flagcxIbvMockDeallocPd(struct ibv_pd *pd) {
+  free(pd);
+  return 0;
+}
+
+static struct ibv_mr *flagcxIbvMockRegMr(struct ibv_pd *pd, void *addr,
+                                         size_t length, int access) {
+  struct flagcxIbvMockMr *mr = new struct flagcxIbvMockMr();
+  mr->mr.context = pd->context;
+  mr->mr.pd = pd;
+  mr->mr.addr = addr;
+  mr->mr.length = length;
+  mr->mr.lkey = mr->mr.rkey = flagcxIbvMockNextKey++;
+  mr->access = access;
+  std::lock_guard<std::mutex> lock(flagcxIbvMockMrLock);
+  flagcxIbvMockMrs[mr->mr.rkey] = mr;
+  return &mr->mr;
+}
+
+static int flagcxIbvMockDeregMr(struct ibv_mr *mr) {
+  {
+    std::lock_guard<std::mutex> lock(flagcxIbvMockMrLock);
+    flagcxIbvMockMrs.erase(mr->rkey);
+  }
+  delete (struct flagcxIbvMockMr *)mr;
+  return 0;
+}
+
+static struct ibv_cq *flagcxIbvMockCreateCq(struct ibv_context *context,
+                                            int cqe, void *cqContext,
+                                            struct ibv_comp_channel *channel,
+                                            int compVector) {
+  struct flagcxIbvMockCq *cq = new struct flagcxIbvMockCq();
+  cq->cq.context = context;
+  cq->cq.cq_context = cqContext;
+  cq->cq.cqe = cqe;
+  return &cq->cq;
+}
+
+static int flagcxIbvMockDestroyCq(struct ibv_cq *cq) {
+  delete (struct flagcxIbvMockCq *)cq;
+  return 0;
+}
+
+static int flagcxIbvMockPollCq(struct ibv_cq *cq, int numEntries,
+                               struct ibv_wc *wc) {
+  struct flagcxIbvMockCq *mcq = (struct flagcxIbvMockCq *)cq;
+  // empty polls are the common case, skip the lock for them
+  if (mcq->count.load(std::memory_order_acquire) == 0)
+    return 0;
+  std::lock_guard<std::mutex> lock(mcq->mutex);
+  int n = 0;
+  while (n < numEntries && !mcq->wcs.empty()) {
+    wc[n++] = mcq->wcs.front();
+    mcq->wcs.pop_front();
+  }
+  mcq->count.fetch_sub(n, std::memory_order_relaxed);
+  return n;
+}
+
+static struct ibv_qp *flagcxIbvMockCreateQp(struct ibv_pd *pd,
+                                            struct ibv_qp_init_attr *attr) {
+  if (attr->qp_type != IBV_QPT_RC ||
+      attr->cap.max_send_sge > FLAGCX_IBV_MOCK_MAX_SGE) {
+    errno = EINVAL;
+    return NULL;
+  }
+  struct flagcxIbvMockQp *qp = new struct flagcxIbvMockQp();
+  qp->qp.context = pd->context;
+  qp->qp.qp_context = attr->qp_context;
+  qp->qp.pd = pd;
+  qp->qp.send_cq = attr->send_cq;
+  qp->qp.recv_cq = attr->recv_cq;
+  qp->qp.qp_num = flagcxIbvMockNextQpn++;
+  qp->qp.state = IBV_QPS_RESET;
+  qp->qp.qp_type = attr->qp_type;
+  std::lock_guard<std::mutex> lock(flagcxIbvMockQpLock);
+  flagcxIbvMockQps[qp->qp.qp_num] = qp;
+  return &qp->qp;
+}
+
+// Moving to RTR connects to the destination QP named by the GID and QPN
+static int flagcxIbvMockConnectQp(struct flagcxIbvMockQp *qp,
+                                  struct ibv_qp_attr *attr) {
+  if (!attr->ah_attr.is_global)
+    return EINVAL;
+  uint32_t pid;
+  memcpy(&pid, attr->ah_attr.grh.dgid.raw + 8, sizeof(pid));
+  struct sockaddr_un addr;
+  socklen_t len = flagcxIbvMockAddr(ntohl(pid), &addr);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return errno;
+  struct flagcxIbvMockHello hello = {FLAGCX_IBV_MOCK_MAGIC,
+                                     attr->dest_qp_num};
+  struct iovec iov = {&hello, sizeof(hello)};
+  if (connect(fd, (struct sockaddr *)&addr, len) ||
+      flagcxIbvMockWriteFull(fd, &iov, 1)) {
+    int err = errno;
+    WARN("NET/IB/MOCK : qpn %u unable to reach qpn %u of pid %u: %s",
+         qp->qp.qp_num, attr->dest_qp_num, ntohl(pid), strerror(err));
+    close(fd);
+    return err;
+  }
+  std::lock_guard<std::mutex> lock(qp->sendMutex);
+  if (qp->sendFd >= 0)
+    close(qp->sendFd);
+  qp->sendFd = fd;
+  return 0;
+}
+
+static int flagcxIbvMockModifyQp(struct ibv_qp *qp, struct ibv_qp_attr *attr,
+                                 int attrMask) {
+  struct flagcxIbvMockQp *mqp = (struct flagcxIbvMockQp *)qp;
+  if (!(attrMask & IBV_QP_STATE))
+    return 0;
+  if (attr->qp_state == IBV_QPS_RTR) {
+    if ((attrMask & (IBV_QP_AV | IBV_QP_DEST_QPN)) !=
+        (IBV_QP_AV | IBV_QP_DEST_QPN))
+      return EINVAL;
+    int ret = flagcxIbvMockConnectQp(mqp, attr);
+    if (ret)
+      return ret;
+  }
+  qp->state = attr->qp_state;
+  return 0;
+}
+
+static int flagcxIbvMockDestroyQp(struct ibv_qp *qp) {
+  struct flagcxIbvMockQp *mqp = (struct flagcxIbvMockQp *)qp;
+  {
+    std::lock_guard<std::mutex> lock(flagcxIbvMockQpLock);
+    flagcxIbvMockQps.erase(qp->qp_num);
+  }
+  // stop answering the peer before the send side goes away
+  if (mqp->hasRecvThread) {
+    shutdown(mqp->recvFd, SHUT_RDWR);
+    pthread_join(mqp->recvThread, NULL);
+    close(mqp->recvFd);
+  }
+  if (mqp->sendFd >= 0)
+    close(mqp->sendFd);
+  delete mqp;
+  return 0;
+}
+
+static int flagcxIbvMockPostSend(struct ibv_qp *qp, struct ibv_send_wr *wr,
+                                 struct ibv_send_wr **badWr) {
+  struct flagcxIbvMockQp *mqp = (struct flagcxIbvMockQp *)qp;
+  for (; wr; wr = wr->next) {
+    int ret = 0;
+    if (qp->state != IBV_QPS_RTS || wr->num_sge > FLAGCX_IBV_MOCK_MAX_SGE ||
+        (wr->opcode == IBV_WR_RDMA_READ && wr->num_sge > 1))
+      ret = EINVAL;
+
+    struct flagcxIbvMockMsg msg;
+    memset(&msg, 0, sizeof(msg));
+    struct iovec data[FLAGCX_IBV_MOCK_MAX_SGE];
+    uint32_t length = 0;
+    for (int i = 0; ret == 0 && i < wr->num_sge; i++) {
+      data[i].iov_base = (void *)wr->sg_list[i].addr;
+      data[i].iov_len = wr->sg_list[i].length;
+      length += wr->sg_list[i].length;
+    }
+    msg.imm = wr->imm_data;
+    msg.rkey = wr->wr.rdma.rkey;
+    msg.length = length;
+    msg.remoteAddr = wr->wr.rdma.remote_addr;
+    msg.wrId = wr->wr_id;
+    msg.signaled = (wr->send_flags & IBV_SEND_SIGNALED) ? 1 : 0;
+
+    if (ret == 0 && (wr->opcode == IBV_WR_RDMA_WRITE ||
+                     wr->opcode == IBV_WR_RDMA_WRITE_WITH_IMM)) {
+      msg.type = wr->opcode == IBV_WR_RDMA_WRITE ? flagcxIbvMockMsgWrite
+                                                 : flagcxIbvMockMsgWriteImm;
+      // the payload is copied out before returning, as with inline sends
+      ret = flagcxIbvMockSendMsg(mqp, &msg, data, wr->num_sge);
+      if (ret == 0 && msg.signaled)
+        flagcxIbvMockComplete(qp->send_cq, qp, wr->wr_id, IBV_WC_RDMA_WRITE,
+                              IBV_WC_SUCCESS, length);
+    } else if (ret == 0 && (wr->opcode == IBV_WR_SEND ||
+                            wr->opcode == IBV_WR_SEND_WITH_IMM)) {
+      msg.type = wr->opcode == IBV_WR_SEND ? flagcxIbvMockMsgSend
+                                           : flagcxIbvMockMsgSendImm;
+      ret = flagcxIbvMockSendMsg(mqp, &msg, data, wr->num_sge);
+      if (ret == 0 && msg.signaled)
+        flagcxIbvMockComplete(qp->send_cq, qp, wr->wr_id, IBV_WC_SEND,
+                              IBV_WC_SUCCESS, length);
+    } else if (ret == 0 && wr->opcode == IBV_WR_RDMA_READ) {
+      // completes when the response is received
+      msg.type = flagcxIbvMockMsgRead;
+      msg.localAddr = wr->num_sge ? wr->sg_list[0].addr : 0;
+      ret = flagcxIbvMockSendMsg(mqp, &msg, NULL, 0);
+    } else if (ret == 0) {
+      ret = EOPNOTSUPP;
+    }
+    if (ret) {
+      *badWr = wr;
+      return ret;
+    }
+  }
+  return 0;
+}
+
+static int flagcxIbvMockPostRecv(struct ibv_qp *qp, struct ibv_recv_wr *wr,
+                                 struct ibv_recv_wr **badWr) {
+  struct flagcxIbvMockQp *mqp = (struct flagcxIbvMockQp *)qp;
+  std::lock_guard<std::mutex> lock(mqp->recvMutex);
+  for (; wr; wr = wr->next) {
+    if (wr->num_sge > 1) {
+      *badWr = wr;
+      return EINVAL;
+    }
+    struct flagcxIbvMockRecv recv = {wr->wr_id, 0, 0};
+    if (wr->num_sge == 1) {
+      recv.addr = wr->sg_list[0].addr;
+      recv.length = wr->sg_list[0].length;
+    }
+    if (mqp->arrived.empty()) {
+      mqp->recvs.push_back(recv);
+      continue;
+    }
+    flagcxIbvMockConsume(mqp, &recv, &mqp->arrived.front());
+    mqp->arrived.pop_front();
+  }
+  return 0;
+}
+
+static const char *flagcxIbvMockEventTypeStr(enum ibv_event_type event) {
+  return "mock event";
+}
+
+flagcxResult_t buildIbvMockSymbols(struct flagcxIbvSymbols *ibvSymbols) {
+  memset(ibvSymbols, 0, sizeof(*ibvSymbols));
+  ibvSymbols->ibv_internal_fork_init = flagcxIbvMockForkInit;
+  ibvSymbols->ibv_internal_get_device_list = flagcxIbvMockGetDeviceList;
+  ibvSymbols->ibv_internal_free_device_list = flagcxIbvMockFreeDeviceList;
+  ibvSymbols->ibv_internal_get_device_name = flagcxIbvMockGetDeviceName;
+  ibvSymbols->ibv_internal_open_device = flagcxIbvMockOpenDevice;
+  ibvSymbols->ibv_internal_close_device = flagcxIbvMockCloseDevice;
+  ibvSymbols->ibv_internal_get_async_event = flagcxIbvMockGetAsyncEvent;
+  ibvSymbols->ibv_internal_ack_async_event = flagcxIbvMockAckAsyncEvent;
+  ibvSymbols->ibv_internal_query_device = flagcxIbvMockQueryDevice;
+  ibvSymbols->ibv_internal_query_port = flagcxIbvMockQueryPort;
+  ibvSymbols->ibv_internal_query_gid = flagcxIbvMockQueryGid;
+  ibvSymbols->ibv_internal_query_qp = flagcxIbvMockQueryQp;
+  ibvSymbols->ibv_internal_alloc_pd = flagcxIbvMockAllocPd;
+  ibvSymbols->ibv_internal_dealloc_pd = flagcxIbvMockDeallocPd;
+  ibvSymbols->ibv_internal_reg_mr = flagcxIbvMockRegMr;
+  ibvSymbols->ibv_internal_dereg_mr = flagcxIbvMockDeregMr;
+  ibvSymbols->ibv_internal_create_cq = flagcxIbvMockCreateCq;
+  ibvSymbols->ibv_internal_destroy_cq = flagcxIbvMockDestroyCq;
+  ibvSymbols->ibv_internal_create_qp = flagcxIbvMockCreateQp;
+  ibvSymbols->ibv_internal_modify_qp = flagcxIbvMockModifyQp;
+  ibvSymbols->ibv_internal_destroy_qp = flagcxIbvMockDestroyQp;
+  ibvSymbols->ibv_internal_event_type_str = flagcxIbvMockEventTypeStr;
+  // reg_mr_iova2, dmabuf and ECE stay unsupported
+  INFO(FLAGCX_INIT | FLAGCX_NET, "NET/IB : Using the mock verbs provider");
+  return flagcxSuccess;
+}
@@ -47,5 +47,7 @@ struct flagcxIbvSymbols {
 
 /* Constructs IB verbs symbols per rdma-core linking or dynamic loading mode */
 flagcxResult_t buildIbvSymbols(struct flagcxIbvSymbols* ibvSymbols);
+/* Constructs the software verbs provider emulating NICs between local processes */
+flagcxResult_t buildIbvMockSymbols(struct flagcxIbvSymbols* ibvSymbols);
 
 #endif  // FLAGCX_IBV_SYMBOLS_H_
\ No newline at end of file
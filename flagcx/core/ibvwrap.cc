@@ -9,14 +9,17 @@
 #include <unistd.h>
 
 #include "ibvsymbols.h"
+#include "param.h"
 
 static pthread_once_t initOnceControl = PTHREAD_ONCE_INIT;
 static flagcxResult_t initResult;
 struct flagcxIbvSymbols ibvSymbols;
 
+FLAGCX_PARAM(IbMock, "IB_MOCK", 0);
+
 flagcxResult_t wrap_ibv_symbols(void) {
   pthread_once(&initOnceControl,
-               [](){ initResult = buildIbvSymbols(&ibvSymbols); });
+               [](){ initResult = flagcxParamIbMock() ? buildIbvMockSymbols(&ibvSymbols) : buildIbvSymbols(&ibvSymbols); });
   return initResult;
 }
 
@@ -28,6 +28,8 @@ typedef enum ibv_return_enum
 } ibv_return_t;
 
 flagcxResult_t wrap_ibv_symbols(void);
+/* Set when the software verbs provider is used instead of libibverbs */
+int64_t flagcxParamIbMock();
 /* FLAGCX wrappers of IB verbs functions */
 flagcxResult_t wrap_ibv_fork_init(void);
 flagcxResult_t wrap_ibv_get_device_list(struct ibv_device ***ret, int *num_devices);
@@ -129,6 +129,10 @@ static flagcxResult_t initTransportsRank(flagcxHeteroComm_t comm,
   INFO(FLAGCX_INIT, "start getting local net from gpu");
   FLAGCXCHECKGOTO(flagcxGetLocalNetFromGpu(comm->cudaDev, &comm->netDev, comm),
                   ret, fail);
+  FLAGCXCHECKGOTO(flagcxTopoGetCpuAffinity(comm->topoServer, comm->netDev,
+                                           &comm->cpuAffinity),
+                  ret, fail);
+  FLAGCXCHECKGOTO(flagcxProxySetAffinity(comm), ret, fail);
 
   INFO(FLAGCX_INIT, "start getting topoServer from other servers");
   FLAGCXCHECKGOTO(
@@ -140,6 +144,67 @@ fail:
   return flagcxInternalError;
 }
 
+// Hook comm, split from parent, to the proxy thread and topology of the
+// communicator owning them. The channel peers, and so the net connections,
+// belong to comm alone, so that the send and recv of communicators of the
+// same family never match each other.
+static flagcxResult_t
+flagcxCommShareParentResources(flagcxHeteroComm_t comm,
+                               flagcxHeteroComm_t parent, int color) {
+  int nranks = comm->nRanks;
+  uint64_t splitId[2] = {parent->commHash, (uint64_t)color};
+  comm->commHash = getHash((const char *)splitId, sizeof(splitId));
+  struct flagcxSharedResources *sharedRes = parent->sharedRes;
+  if (sharedRes == NULL) {
+    FLAGCXCHECK(flagcxCalloc(&sharedRes, 1));
+    sharedRes->refCount = 1;
+    sharedRes->owner = parent;
+    sharedRes->proxyState = parent->proxyState;
+    sharedRes->tpNRanks = parent->nRanks;
+    sharedRes->magic = parent->magic;
+    parent->sharedRes = sharedRes;
+  }
+  __atomic_add_fetch(&sharedRes->refCount, 1, __ATOMIC_RELAXED);
+  comm->sharedRes = sharedRes;
+
+  // topParentRanks holds the parent ranks given by the split so far
+  if (parent->peerInfo) {
+    FLAGCXCHECK(flagcxCalloc(&comm->peerInfo, nranks));
+    for (int r = 0; r < nranks; r++) {
+      comm->peerInfo[r] = parent->peerInfo[comm->topParentRanks[r]];
+      comm->peerInfo[r].rank = r;
+      comm->peerInfo[r].comm = comm;
+      comm->peerInfo[r].hostHash += comm->commHash - parent->commHash;
+      comm->peerInfo[r].pidHash += comm->commHash - parent->commHash;
+    }
+  }
+  if (parent->topParentRanks) {
+    for (int r = 0; r < nranks; r++) {
+      comm->topParentRanks[r] = parent->topParentRanks[comm->topParentRanks[r]];
+    }
+  }
+
+  for (int i = 0; i < MAXCHANNELS; i++) {
+    FLAGCXCHECK(flagcxCalloc(&comm->channels[i].peers, nranks));
+    for (int r = 0; r < nranks; r++)
+      FLAGCXCHECK(flagcxCalloc(&comm->channels[i].peers[r], 1));
+  }
+  FLAGCXCHECK(flagcxCalloc(&comm->connectSend, nranks));
+  FLAGCXCHECK(flagcxCalloc(&comm->connectRecv, nranks));
+  FLAGCXCHECK(flagcxCalloc(&comm->tasks.peers, nranks));
+  FLAGCXCHECK(flagcxCalloc(&comm->tasks.p2pOrder, nranks));
+  comm->proxyState = sharedRes->proxyState;
+  comm->groupNext = reinterpret_cast<struct flagcxHeteroComm *>(0x1);
+  comm->preconnectNext = reinterpret_cast<struct flagcxHeteroComm *>(0x1);
+
+  comm->topoServer = parent->topoServer;
+  comm->interServerTopo = parent->interServerTopo;
+  comm->netDev = parent->netDev;
+  comm->cpuAffinity = parent->cpuAffinity;
+  comm->busId = parent->busId;
+  return flagcxSuccess;
+}
+
 static flagcxResult_t flagcxCommInitRankFunc(struct flagcxAsyncJob *job_) {
   struct flagcxCommInitRankAsyncJob *job =
       (struct flagcxCommInitRankAsyncJob *)job_;
@@ -147,6 +212,15 @@ static flagcxResult_t flagcxCommInitRankFunc(struct flagcxAsyncJob *job_) {
   flagcxResult_t res = flagcxSuccess;
   const char *env = flagcxGetEnv("FLAGCX_ENABLE_TOPO_DETECT");
 
+  if (job->parent) {
+    // The bootstrap was split from the parent one, the proxy and topology
+    // are shared and the connections are made on first use
+    FLAGCXCHECKGOTO(
+        flagcxCommShareParentResources(comm, job->parent, job->color), res,
+        fail);
+    goto exit;
+  }
+
   if (!job->parent) {
     // New version of calling bootstrapInit
     struct bootstrapState *state;
@@ -295,6 +369,57 @@ flagcxResult_t flagcxHeteroCommInitRank(flagcxHeteroComm_t *newcomm, int nranks,
   return flagcxSuccess;
 }
 
+flagcxResult_t flagcxHeteroCommSplit(flagcxHeteroComm_t comm, int color,
+                                     int key, flagcxHeteroComm_t *newcomm) {
+  flagcxResult_t res = flagcxSuccess;
+  flagcxHeteroComm_t child = NULL;
+  struct flagcxCommInitRankAsyncJob *job = NULL;
+  struct bootstrapState *state = NULL;
+  int *parentRanks = NULL;
+
+  *newcomm = NULL;
+  FLAGCXCHECK(
+      bootstrapSplit(comm->bootstrap, color, key, &state, &parentRanks));
+  if (state == NULL) {
+    return flagcxSuccess;
+  }
+
+  FLAGCXCHECKGOTO(flagcxCalloc(&child, 1), res, fail);
+  child->startMagic = child->endMagic = FLAGCX_MAGIC;
+  FLAGCXCHECKGOTO(flagcxCalloc((uint32_t **)&child->abortFlagRefCount, 1), res,
+                  fail);
+  *child->abortFlagRefCount = 1;
+  child->initState = flagcxInternalError;
+  child->nRanks = state->nranks;
+  child->rank = state->rank;
+  child->cudaDev = comm->cudaDev;
+  child->bootstrap = state;
+  child->magic = state->magic;
+  child->topParentRanks = parentRanks;
+
+  FLAGCXCHECKGOTO(flagcxCalloc(&job, 1), res, fail);
+  job->comm = child;
+  job->nranks = child->nRanks;
+  job->myrank = child->rank;
+  job->cudaDev = child->cudaDev;
+  job->parent = comm;
+  job->color = color;
+  job->key = key;
+  FLAGCXCHECKGOTO(flagcxCommInitRankFunc(&job->base), res, fail);
+  free(job);
+  *newcomm = child;
+  return flagcxSuccess;
+fail:
+  free(job);
+  if (child) {
+    free(child->abortFlagRefCount);
+    free(child);
+  }
+  free(parentRanks);
+  bootstrapAbort(state);
+  return res;
+}
+
 flagcxResult_t flagcxHeteroCommCount(const flagcxHeteroComm_t comm,
                                      int *count) {
   *count = comm->nRanks;
@@ -307,7 +432,49 @@ flagcxResult_t flagcxHeteroCommUserRank(const flagcxHeteroComm_t comm,
   return flagcxSuccess;
 }
 
+flagcxResult_t flagcxHeteroCommGetAsyncError(flagcxHeteroComm_t comm,
+                                             flagcxResult_t *asyncError) {
+  // the proxy records the errors of the transfers it progresses, they stay
+  // on the communicator once seen
+  if (comm->asyncResult == flagcxSuccess && comm->proxyState) {
+    comm->asyncResult =
+        __atomic_load_n(&comm->proxyState->asyncResult, __ATOMIC_ACQUIRE);
+  }
+  *asyncError = comm->asyncResult;
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxHeteroCommDestroy(flagcxHeteroComm_t comm) {
+  struct flagcxSharedResources *sharedRes = comm->sharedRes;
+  if (sharedRes != NULL) {
+    if (comm != sharedRes->owner) {
+      if (comm->proxyState->initialized == 1) {
+        flagcxProxyFree(comm);
+      }
+      for (int i = 0; i < MAXCHANNELS; i++) {
+        for (int r = 0; r < comm->nRanks; r++) {
+          free(comm->channels[i].peers[r]);
+        }
+        free(comm->channels[i].peers);
+      }
+      free(comm->connectSend);
+      free(comm->connectRecv);
+      free(comm->tasks.peers);
+      free(comm->tasks.p2pOrder);
+      free(comm->abortFlagRefCount);
+      free(comm->topParentRanks);
+      free(comm->peerInfo);
+      bootstrapClose(comm->bootstrap);
+      free(comm);
+    }
+    // The owner is only torn down once no split communicator uses it
+    if (__atomic_sub_fetch(&sharedRes->refCount, 1, __ATOMIC_ACQ_REL) > 0) {
+      return flagcxSuccess;
+    }
+    comm = sharedRes->owner;
+    comm->sharedRes = NULL;
+    free(sharedRes);
+  }
   flagcxProxyDestroy(comm);
   for (int i = 0; i < MAXCHANNELS; i++) {
     for (int r = 0; r < comm->nRanks; r++) {
@@ -332,6 +499,9 @@ flagcxResult_t flagcxHeteroCommDestroy(flagcxHeteroComm_t comm) {
     flagcxInterServerTopoFree(comm->interServerTopo);
   }
   free(comm->peerInfo);
+  if (comm->bootstrap) {
+    bootstrapClose(comm->bootstrap);
+  }
   free(comm);
 
   return flagcxSuccess;
@@ -3,9 +3,96 @@
 #include "device.h"
 #include "proxy.h"
 
+// Small ops skip the staging buffers: the payload is copied to a host buffer
+// and sent eagerly, inline when it fits
+static flagcxResult_t flagcxProxySendEager(sendNetResources *resources,
+                                           void *data, size_t size,
+                                           flagcxProxyArgs *args) {
+  if (args->waitCopy == 0) {
+    deviceAdaptor->deviceMemcpy(resources->eagerBuff, data, size,
+                                flagcxMemcpyDeviceToHost, resources->cpStream,
+                                args->subs[0].copyArgs);
+    args->waitCopy++;
+  }
+
+  if (args->copied < args->waitCopy) {
+    if (deviceAdaptor->streamQuery(resources->cpStream) == flagcxSuccess) {
+      args->copied++;
+    }
+  }
+
+  if (args->posted < args->copied) {
+    void *req = NULL;
+    FLAGCXCHECK(flagcxNetIb.isend(resources->netSendComm, resources->eagerBuff,
+                                  size, 0, resources->eagerMhandle, &req));
+    if (req) {
+      args->subs[0].requests[0] = req;
+      args->posted++;
+    }
+  }
+
+  if (args->transmitted < args->posted) {
+    int done = 0;
+    size_t sizes;
+    FLAGCXCHECK(flagcxNetIb.test(args->subs[0].requests[0], &done, &sizes));
+    if (done) {
+      args->transmitted++;
+      __atomic_store_n(args->hlArgs, 1, __ATOMIC_RELAXED);
+      args->done = true;
+    }
+  }
+  return flagcxSuccess;
+}
+
+static flagcxResult_t flagcxProxyRecvEager(recvNetResources *resources,
+                                           void *data, size_t size,
+                                           flagcxProxyArgs *args) {
+  if (args->posted == 0) {
+    int tag = 0;
+    void *req = NULL;
+    void *eagerData = resources->eagerBuff;
+    args->subs[0].stepSize = size;
+    FLAGCXCHECK(flagcxNetIb.irecv(resources->netRecvComm, 1, &eagerData,
+                                  &args->subs[0].stepSize, &tag,
+                                  &resources->eagerMhandle, &req));
+    if (req) {
+      args->subs[0].requests[0] = req;
+      args->posted++;
+    }
+  }
+
+  if (args->transmitted < args->posted) {
+    int done = 0;
+    size_t sizes;
+    FLAGCXCHECK(flagcxNetIb.test(args->subs[0].requests[0], &done, &sizes));
+    if (done) {
+      args->transmitted++;
+    }
+  }
+
+  if (args->waitCopy < args->transmitted) {
+    deviceAdaptor->deviceMemcpy(data, resources->eagerBuff, size,
+                                flagcxMemcpyHostToDevice, resources->cpStream,
+                                args->subs[0].copyArgs);
+    args->waitCopy++;
+  }
+
+  if (args->copied < args->waitCopy) {
+    if (deviceAdaptor->streamQuery(resources->cpStream) == flagcxSuccess) {
+      args->copied++;
+      __atomic_store_n(args->hlArgs, 1, __ATOMIC_RELAXED);
+      args->done = true;
+    }
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxProxySend(sendNetResources *resources, void *data,
                                size_t size, flagcxProxyArgs *args) {
   if(!__atomic_load_n(&args->eventReady, __ATOMIC_RELAXED)) return flagcxSuccess;
+  if (resources->eagerMhandle && size > 0 &&
+      size <= (size_t)flagcxParamIbEagerThreshold())
+    return flagcxProxySendEager(resources, data, size, args);
   if (args->transmitted < args->chunkSteps) {
     int stepMask = args->sendStepMask;
 
@@ -30,10 +117,10 @@ flagcxResult_t flagcxProxySend(sendNetResources *resources, void *data,
 
     if (args->posted < args->copied) {
       void *req = NULL;
-      flagcxNetIb.isend(resources->netSendComm,
-                        args->subs[args->posted & stepMask].stepBuff,
-                        args->subs[args->posted & stepMask].stepSize, 0,
-                        resources->mhandles[0], &req);
+      FLAGCXCHECK(flagcxNetIb.isend(
+          resources->netSendComm, args->subs[args->posted & stepMask].stepBuff,
+          args->subs[args->posted & stepMask].stepSize, 0,
+          resources->mhandles[0], &req));
       if (req) {
         args->subs[args->posted++ & stepMask].requests[0] = req;
       }
@@ -41,8 +128,9 @@ flagcxResult_t flagcxProxySend(sendNetResources *resources, void *data,
 
     if (args->transmitted < args->posted) {
       void *req = args->subs[args->transmitted & stepMask].requests[0];
-      int done = 0, sizes;
-      flagcxNetIb.test(req, &done, &sizes);
+      int done = 0;
+      size_t sizes;
+      FLAGCXCHECK(flagcxNetIb.test(req, &done, &sizes));
       if (done) {
         args->transmitted++;
       }
@@ -59,6 +147,9 @@ flagcxResult_t flagcxProxySend(sendNetResources *resources, void *data,
 flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
                                size_t size, flagcxProxyArgs *args) {
   if(!__atomic_load_n(&args->eventReady, __ATOMIC_RELAXED)) return flagcxSuccess;
+  if (resources->eagerMhandle && size > 0 &&
+      size <= (size_t)flagcxParamIbEagerThreshold())
+    return flagcxProxyRecvEager(resources, data, size, args);
   if (args->copied < args->chunkSteps) {
     int stepMask = args->sendStepMask;
     if (args->posted < args->chunkSteps &&
@@ -69,10 +160,11 @@ flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
           std::min(args->chunkSize, size - args->totalPostSize);
       args->subs[args->posted & stepMask].stepBuff =
           resources->buffers[0] + CHUNCKSIZE * (args->posted & stepMask);
-      flagcxNetIb.irecv(resources->netRecvComm, 1,
-                        &args->subs[args->posted & stepMask].stepBuff,
-                        (int *)&args->subs[args->posted & stepMask].stepSize,
-                        tags, resources->mhandles, &req);
+      FLAGCXCHECK(flagcxNetIb.irecv(
+          resources->netRecvComm, 1,
+          &args->subs[args->posted & stepMask].stepBuff,
+          &args->subs[args->posted & stepMask].stepSize, tags,
+          resources->mhandles, &req));
       if (req) {
         args->subs[args->posted & stepMask].requests[0] = req;
         args->totalPostSize += args->subs[args->posted++ & stepMask].stepSize;
@@ -81,8 +173,9 @@ flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
 
     if (args->transmitted < args->posted) {
       void *req = args->subs[args->transmitted & stepMask].requests[0];
-      int done = 0, sizes;
-      flagcxNetIb.test(req, &done, &sizes);
+      int done = 0;
+      size_t sizes;
+      FLAGCXCHECK(flagcxNetIb.test(req, &done, &sizes));
       if (done) {
         args->transmitted++;
       }
@@ -91,9 +184,10 @@ flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
     if (args->postFlush < args->transmitted) {
       void *req = NULL;
       void *allData[] = {args->subs[args->postFlush & stepMask].stepBuff};
-      flagcxNetIb.iflush(resources->netRecvComm, 1, allData,
-                         &args->subs[args->postFlush & stepMask].stepSize,
-                         resources->mhandles, &req);
+      FLAGCXCHECK(flagcxNetIb.iflush(
+          resources->netRecvComm, 1, allData,
+          &args->subs[args->postFlush & stepMask].stepSize,
+          resources->mhandles, &req));
       if (req) {
         args->subs[args->postFlush++ & stepMask].requests[0] = req;
       }
@@ -101,8 +195,9 @@ flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
 
     if (args->flushed < args->postFlush) {
       void *req = args->subs[args->flushed & stepMask].requests[0];
-      int done = 0, sizes;
-      flagcxNetIb.test(req, &done, &sizes);
+      int done = 0;
+      size_t sizes;
+      FLAGCXCHECK(flagcxNetIb.test(req, &done, &sizes));
       if (done) {
         args->flushed++;
       }
@@ -134,17 +229,25 @@ flagcxResult_t flagcxProxyRecv(recvNetResources *resources, void *data,
 
 flagcxResult_t flagcxSendProxyFree(sendNetResources *resources) {
   flagcxNetIb.deregMr(resources->netSendComm, resources->mhandles[0]);
+  if (resources->eagerMhandle)
+    flagcxNetIb.deregMr(resources->netSendComm, resources->eagerMhandle);
   flagcxNetIb.closeSend(resources->netSendComm);
   deviceAdaptor->gdrMemFree(resources->buffers[0], NULL);
+  if (resources->eagerBuff)
+    deviceAdaptor->deviceFree(resources->eagerBuff, flagcxMemHost, NULL);
   deviceAdaptor->streamDestroy(resources->cpStream);
   return flagcxSuccess;
 }
 
 flagcxResult_t flagcxRecvProxyFree(recvNetResources *resources) {
   flagcxNetIb.deregMr(resources->netRecvComm, resources->mhandles[0]);
+  if (resources->eagerMhandle)
+    flagcxNetIb.deregMr(resources->netRecvComm, resources->eagerMhandle);
   flagcxNetIb.closeRecv(resources->netRecvComm);
   flagcxNetIb.closeListen(resources->netListenComm);
   deviceAdaptor->gdrMemFree(resources->buffers[0], NULL);
+  if (resources->eagerBuff)
+    deviceAdaptor->deviceFree(resources->eagerBuff, flagcxMemHost, NULL);
   deviceAdaptor->streamDestroy(resources->cpStream);
   return flagcxSuccess;
 }
@@ -29,6 +29,9 @@ flagcxResult_t flagcxGpuGdrSupport(struct flagcxHeteroComm* comm, int* gdrSuppor
 extern flagcxNet_t flagcxNetIb;
 extern flagcxNet_t flagcxNetSocket;
 
+// Ops up to this size go through a host buffer and are sent eagerly
+int64_t flagcxParamIbEagerThreshold();
+
 struct sendNetResources {
   void* netSendComm;
   struct flagcxSendMem* sendMem;
@@ -49,6 +52,8 @@ struct sendNetResources {
   char* buffers[FLAGCX_NUM_PROTOCOLS];
   int buffSizes[FLAGCX_NUM_PROTOCOLS];
   void* mhandles[1];/*just one for memory copy from device to gdr buffer*/
+  char* eagerBuff; /*host buffer for ops sent eagerly*/
+  void* eagerMhandle;
   uint64_t step;
   uint64_t llLastCleaning;
   int netDeviceVersion;
@@ -81,6 +86,8 @@ struct recvNetResources {
   char* buffers[FLAGCX_NUM_PROTOCOLS];
   int buffSizes[FLAGCX_NUM_PROTOCOLS];
   void* mhandles[FLAGCX_NUM_PROTOCOLS];
+  char* eagerBuff; /*host buffer for ops received eagerly*/
+  void* eagerMhandle;
   uint64_t step;
   uint64_t llLastCleaning;
   int netDeviceVersion;
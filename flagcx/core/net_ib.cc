@@ -87,6 +87,14 @@ FLAGCX_PARAM(IbUseInline, "IB_USE_INLINE", 0);
 FLAGCX_PARAM(IbSl, "IB_SL", 0);
 FLAGCX_PARAM(IbTc, "IB_TC", 0);
 FLAGCX_PARAM(IbArThreshold, "IB_AR_THRESHOLD", 8192);
+// Single receives of at most this many bytes on host buffers are sent
+// eagerly, without waiting for the receiver's fifo entry. The sender picks
+// the protocol from the size it sends and the receiver from the size it
+// posts, so both sides must use host buffers and the same size for such
+// messages. Eager messages carry their sequence number, so that a message
+// whose two sides took different protocols is reported as an error as soon
+// as an eager message reaches the receiver.
+FLAGCX_PARAM(IbEagerThreshold, "IB_EAGER_THRESHOLD", 4096);
 FLAGCX_PARAM(IbPciRelaxedOrdering, "IB_PCI_RELAXED_ORDERING", 2);
 FLAGCX_PARAM(IbAdaptiveRouting, "IB_ADAPTIVE_ROUTING", -2);
 
@@ -411,7 +419,8 @@ int flagcxIbFindMatchingDev(int dev) {
   for (int i = 0; i < flagcxNMergedIbDevs; i++) {
     if (flagcxIbMergedDevs[i].ndevs < FLAGCX_IB_MAX_DEVS_PER_NIC) {
       int compareDev = flagcxIbMergedDevs[i].devs[0];
-      if (strcmp(flagcxIbDevs[dev].pciPath, flagcxIbDevs[compareDev].pciPath) ==
+      if (flagcxIbDevs[dev].pciPath && flagcxIbDevs[compareDev].pciPath &&
+          strcmp(flagcxIbDevs[dev].pciPath, flagcxIbDevs[compareDev].pciPath) ==
               0 &&
           (flagcxIbDevs[dev].guid == flagcxIbDevs[compareDev].guid) &&
           (flagcxIbDevs[dev].link == flagcxIbDevs[compareDev].link)) {
@@ -526,10 +535,15 @@ flagcxResult_t flagcxIbInit(flagcxDebugLogger_t logFunction) {
           flagcxIbDevs[flagcxNIbDevs].pd = NULL;
           strncpy(flagcxIbDevs[flagcxNIbDevs].devName, devices[d]->name,
                   MAXNAMESIZE);
-          FLAGCXCHECK(
-              flagcxIbGetPciPath(flagcxIbDevs[flagcxNIbDevs].devName,
-                                 &flagcxIbDevs[flagcxNIbDevs].pciPath,
-                                 &flagcxIbDevs[flagcxNIbDevs].realPort));
+          // Mock devices have no sysfs entry and show up as virtual NICs
+          flagcxIbDevs[flagcxNIbDevs].pciPath = NULL;
+          flagcxIbDevs[flagcxNIbDevs].realPort = 0;
+          if (!flagcxParamIbMock()) {
+            FLAGCXCHECK(
+                flagcxIbGetPciPath(flagcxIbDevs[flagcxNIbDevs].devName,
+                                   &flagcxIbDevs[flagcxNIbDevs].pciPath,
+                                   &flagcxIbDevs[flagcxNIbDevs].realPort));
+          }
           flagcxIbDevs[flagcxNIbDevs].maxQp = devAttr.max_qp;
           flagcxIbDevs[flagcxNIbDevs].mrCache.capacity = 0;
           flagcxIbDevs[flagcxNIbDevs].mrCache.population = 0;
@@ -715,6 +729,22 @@ failure:
 static_assert(MAX_REQUESTS <= 256, "request id are encoded in wr_id and we "
                                    "need up to 8 requests ids per completion");
 
+// A single WR carries at most this many bytes, larger per-QP chunks are
+// split into several RDMA writes chained in the same post
+#define FLAGCX_IB_MAX_WR_SIZE (1ULL << 30)
+// Number of data WRs we chain before posting, the last one carries the imm
+#define FLAGCX_NET_IB_MAX_WRS (4 * FLAGCX_NET_IB_MAX_RECVS)
+// Immediate data telling the receiver to read a single size from the sizes
+// fifo, because it does not fit in 32 bits
+#define FLAGCX_IB_IMM_SIZES_FIFO 0xffffffffU
+
+// Eager messages land in this many pre-posted host slots per connection
+#define FLAGCX_NET_IB_EAGER_SLOTS FLAGCX_NET_MAX_REQUESTS
+// Largest eager payload we ask the HCA to carry inline in the WQE
+#define FLAGCX_IB_EAGER_MAX_INLINE 256
+// Receive completions of eager slots have this bit set in their wr_id
+#define FLAGCX_IB_EAGER_WRID (1ULL << 63)
+
 #define FLAGCX_IB_MAX_QPS 128
 
 // Per-QP connection metatdata
@@ -750,6 +780,9 @@ struct flagcxIbConnectionMetadata {
   char devName[MAX_MERGED_DEV_NAME];
   uint64_t fifoAddr;
   int ndevs;
+  // Eager QP on the first device, qpn 0 when eager messages are disabled
+  struct flagcxIbQpInfo eagerQpInfo;
+  uint32_t eagerSize;
 };
 
 // Retain local RoCE address for error logging
@@ -774,13 +807,17 @@ struct flagcxIbRequest {
   int nreqs;
   union {
     struct {
-      int size;
+      size_t size;
       void *data;
       uint32_t lkeys[FLAGCX_IB_MAX_DEVS_PER_NIC];
-      int offset;
+      size_t offset;
     } send;
     struct {
-      int *sizes;
+      size_t *sizes;
+      // Eager receives are copied out of the slot they arrived in
+      void *eagerData;
+      size_t eagerSize;
+      uint32_t eagerSeq;
     } recv;
   };
 };
@@ -801,7 +838,7 @@ struct flagcxIbListenComm {
 
 struct flagcxIbSendFifo {
   uint64_t addr;
-  int size;
+  uint64_t size;
   uint32_t rkeys[FLAGCX_IB_MAX_DEVS_PER_NIC];
   uint32_t nreqs;
   uint32_t tag;
@@ -816,7 +853,7 @@ struct flagcxIbQp {
 };
 
 struct flagcxIbRemSizesFifo {
-  int elems[MAX_REQUESTS][FLAGCX_NET_IB_MAX_RECVS];
+  size_t elems[MAX_REQUESTS][FLAGCX_NET_IB_MAX_RECVS];
   uint64_t fifoTail;
   uint64_t addr;
   uint32_t rkeys[FLAGCX_IB_MAX_DEVS_PER_NIC];
@@ -834,6 +871,7 @@ struct alignas(8) flagcxIbSendCommDev {
 // Wrapper to track an MR per-device, if needed
 struct flagcxIbMrHandle {
   ibv_mr *mrs[FLAGCX_IB_MAX_DEVS_PER_NIC];
+  int type; // FLAGCX_PTR_HOST buffers can be read and written by the CPU
 };
 
 struct alignas(32) flagcxIbNetCommBase {
@@ -857,11 +895,16 @@ struct flagcxIbSendComm {
   // Each dev correlates to a mergedIbDev
   struct flagcxIbSendCommDev devs[FLAGCX_IB_MAX_DEVS_PER_NIC];
   struct flagcxIbRequest *fifoReqs[MAX_REQUESTS][FLAGCX_NET_IB_MAX_RECVS];
-  struct ibv_sge sges[FLAGCX_NET_IB_MAX_RECVS];
-  struct ibv_send_wr wrs[FLAGCX_NET_IB_MAX_RECVS + 1];
+  struct ibv_sge sges[FLAGCX_NET_IB_MAX_WRS];
+  struct ibv_send_wr wrs[FLAGCX_NET_IB_MAX_WRS + 1];
   struct flagcxIbRemSizesFifo remSizesFifo;
   uint64_t fifoHead;
   int ar; // Use adaptive routing when all merged devices have it enabled
+  // Eager messages go out on their own QP, sizes are 0 when disabled
+  struct flagcxIbQp eagerQp;
+  uint32_t eagerSize;
+  uint32_t eagerInline;
+  uint32_t msgSeq; // messages sent so far, eager or not
 };
 // The SendFifo needs to be 32-byte aligned and each element needs
 // to be a 32-byte multiple, so that an entry does not get split and
@@ -900,13 +943,30 @@ struct alignas(16) flagcxIbRecvCommDev {
   struct ibv_mr *sizesFifoMr;
 };
 
+// Eager messages arrive in order in pre-posted host slots and are matched
+// with the eager receives in the order those were posted
+struct flagcxIbRecvEager {
+  struct flagcxIbQp qp;
+  uint32_t size; // bytes per slot, 0 when disabled
+  char *slots;
+  struct ibv_mr *mr;
+  struct ibv_wc arrived[FLAGCX_NET_IB_EAGER_SLOTS];
+  uint64_t arrivedHead;
+  uint64_t arrivedTail;
+  struct flagcxIbRequest *pending[MAX_REQUESTS];
+  uint64_t pendingHead;
+  uint64_t pendingTail;
+  uint32_t recvSeq; // messages received so far, eager or not
+};
+
 struct flagcxIbRecvComm {
   struct flagcxIbNetCommBase base;
   struct flagcxIbRecvCommDev devs[FLAGCX_IB_MAX_DEVS_PER_NIC];
   struct flagcxIbRemFifo remFifo;
-  int sizesFifo[MAX_REQUESTS][FLAGCX_NET_IB_MAX_RECVS];
+  size_t sizesFifo[MAX_REQUESTS][FLAGCX_NET_IB_MAX_RECVS];
   int gpuFlushHostMem;
   int flushEnabled;
+  struct flagcxIbRecvEager eager;
 };
 static_assert((offsetof(struct flagcxIbRecvComm, remFifo) % 32) == 0,
               "flagcxIbRecvComm fifo must be 32-byte aligned");
@@ -938,9 +998,10 @@ flagcxResult_t flagcxIbInitCommDevBase(int ibDevN,
   pthread_mutex_unlock(&ibDev->lock);
 
   // Recv requests can generate 2 completions (one for the post FIFO, one for
-  // the Recv).
+  // the Recv), plus one per eager slot.
   FLAGCXCHECK(wrap_ibv_create_cq(&base->cq, ibDev->context,
-                                 2 * MAX_REQUESTS * flagcxParamIbQpsPerConn(),
+                                 2 * MAX_REQUESTS * flagcxParamIbQpsPerConn() +
+                                     FLAGCX_NET_IB_EAGER_SLOTS,
                                  NULL, NULL, 0));
 
   return flagcxSuccess;
@@ -961,22 +1022,21 @@ returning:
   return res;
 }
 
-flagcxResult_t flagcxIbCreateQp(uint8_t ib_port,
-                                struct flagcxIbNetCommDevBase *base,
-                                int access_flags, struct flagcxIbQp *qp) {
+// Create a QP with the given capabilities, which are updated with the ones
+// actually granted
+static flagcxResult_t flagcxIbCreateQpCap(uint8_t ib_port,
+                                          struct flagcxIbNetCommDevBase *base,
+                                          int access_flags,
+                                          struct ibv_qp_cap *cap,
+                                          struct flagcxIbQp *qp) {
   struct ibv_qp_init_attr qpInitAttr;
   memset(&qpInitAttr, 0, sizeof(struct ibv_qp_init_attr));
   qpInitAttr.send_cq = base->cq;
   qpInitAttr.recv_cq = base->cq;
   qpInitAttr.qp_type = IBV_QPT_RC;
-  // We might send 2 messages per send (RDMA and RDMA_WITH_IMM)
-  qpInitAttr.cap.max_send_wr = 2 * MAX_REQUESTS;
-  qpInitAttr.cap.max_recv_wr = MAX_REQUESTS;
-  qpInitAttr.cap.max_send_sge = 1;
-  qpInitAttr.cap.max_recv_sge = 1;
-  qpInitAttr.cap.max_inline_data =
-      flagcxParamIbUseInline() ? sizeof(struct flagcxIbSendFifo) : 0;
+  qpInitAttr.cap = *cap;
   FLAGCXCHECK(wrap_ibv_create_qp(&qp->qp, base->pd, &qpInitAttr));
+  *cap = qpInitAttr.cap;
   struct ibv_qp_attr qpAttr;
   memset(&qpAttr, 0, sizeof(struct ibv_qp_attr));
   qpAttr.qp_state = IBV_QPS_INIT;
@@ -989,6 +1049,44 @@ flagcxResult_t flagcxIbCreateQp(uint8_t ib_port,
   return flagcxSuccess;
 }
 
+flagcxResult_t flagcxIbCreateQp(uint8_t ib_port,
+                                struct flagcxIbNetCommDevBase *base,
+                                int access_flags, struct flagcxIbQp *qp) {
+  struct ibv_qp_cap cap;
+  memset(&cap, 0, sizeof(cap));
+  // We might send 2 messages per send (RDMA and RDMA_WITH_IMM)
+  cap.max_send_wr = 2 * MAX_REQUESTS;
+  cap.max_recv_wr = MAX_REQUESTS;
+  cap.max_send_sge = 1;
+  cap.max_recv_sge = 1;
+  cap.max_inline_data =
+      flagcxParamIbUseInline() ? sizeof(struct flagcxIbSendFifo) : 0;
+  return flagcxIbCreateQpCap(ib_port, base, access_flags, &cap, qp);
+}
+
+// The eager QP of a send comm only sends, the one of a recv comm only
+// receives into its slots
+static flagcxResult_t flagcxIbCreateEagerQp(uint8_t ib_port,
+                                            struct flagcxIbNetCommDevBase *base,
+                                            bool isSend, uint32_t size,
+                                            struct flagcxIbQp *qp,
+                                            uint32_t *maxInline) {
+  struct ibv_qp_cap cap;
+  memset(&cap, 0, sizeof(cap));
+  cap.max_send_wr = isSend ? MAX_REQUESTS : 1;
+  cap.max_recv_wr = isSend ? 1 : FLAGCX_NET_IB_EAGER_SLOTS;
+  cap.max_send_sge = 1;
+  cap.max_recv_sge = 1;
+  cap.max_inline_data =
+      isSend ? std::min<uint32_t>(size, FLAGCX_IB_EAGER_MAX_INLINE) : 0;
+  FLAGCXCHECK(flagcxIbCreateQpCap(ib_port, base, 0, &cap, qp));
+  qp->devIndex = 0;
+  qp->remDevIdx = 0;
+  if (maxInline)
+    *maxInline = std::min<uint32_t>(cap.max_inline_data, size);
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxIbRtrQp(struct ibv_qp *qp, uint8_t sGidIndex,
                              uint32_t dest_qp_num,
                              struct flagcxIbDevInfo *info) {
@@ -1129,6 +1227,16 @@ ib_connect_check:
     devIndex = (devIndex + 1) % comm->base.ndevs;
   }
 
+  memset(&meta.eagerQpInfo, 0, sizeof(meta.eagerQpInfo));
+  meta.eagerSize = 0;
+  if (flagcxParamIbEagerThreshold() > 0) {
+    meta.eagerSize = flagcxParamIbEagerThreshold();
+    FLAGCXCHECK(flagcxIbCreateEagerQp(
+        flagcxIbDevs[comm->devs[0].base.ibDevN].portNum, &comm->devs[0].base,
+        true, meta.eagerSize, &comm->eagerQp, &comm->eagerInline));
+    meta.eagerQpInfo.qpn = comm->eagerQp.qp->qp_num;
+  }
+
   for (int i = 0; i < comm->base.ndevs; i++) {
     flagcxIbSendCommDev *commDev = comm->devs + i;
     flagcxIbDev *ibDev = flagcxIbDevs + commDev->base.ibDevN;
@@ -1260,7 +1368,7 @@ ib_connect:
     FLAGCXCHECK(
         wrap_ibv_reg_mr(comm->remSizesFifo.mrs + i, comm->devs[i].base.pd,
                         &comm->remSizesFifo.elems,
-                        sizeof(int) * MAX_REQUESTS * FLAGCX_NET_IB_MAX_RECVS,
+                        sizeof(size_t) * MAX_REQUESTS * FLAGCX_NET_IB_MAX_RECVS,
                         IBV_ACCESS_REMOTE_WRITE | IBV_ACCESS_LOCAL_WRITE |
                             IBV_ACCESS_REMOTE_READ));
   }
@@ -1285,6 +1393,18 @@ ib_connect:
     FLAGCXCHECK(flagcxIbRtsQp(qp));
   }
 
+  // The receiver answers with the eager size both sides agree on
+  if (comm->eagerQp.qp != NULL && remMeta.eagerQpInfo.qpn != 0) {
+    FLAGCXCHECK(flagcxIbRtrQp(comm->eagerQp.qp,
+                              comm->devs[0].base.gidInfo.localGidIndex,
+                              remMeta.eagerQpInfo.qpn, remMeta.devs));
+    FLAGCXCHECK(flagcxIbRtsQp(comm->eagerQp.qp));
+    comm->eagerSize = remMeta.eagerSize;
+    comm->eagerInline = std::min(comm->eagerInline, comm->eagerSize);
+  } else {
+    comm->eagerInline = 0;
+  }
+
   if (link_layer == IBV_LINK_LAYER_ETHERNET) { // RoCE
     for (int q = 0; q < comm->base.nqps; q++) {
       struct flagcxIbQp *qp = comm->base.qps + q;
@@ -1319,6 +1439,46 @@ ib_send_ready:
 
 FLAGCX_PARAM(IbGdrFlushDisable, "GDR_FLUSH_DISABLE", 0);
 
+static flagcxResult_t flagcxIbEagerPostRecv(struct flagcxIbRecvComm *comm,
+                                            int slot) {
+  struct flagcxIbRecvEager *eager = &comm->eager;
+  struct ibv_sge sge;
+  sge.addr = (uint64_t)(eager->slots + (size_t)slot * eager->size);
+  sge.length = eager->size;
+  sge.lkey = eager->mr->lkey;
+  struct ibv_recv_wr wr;
+  memset(&wr, 0, sizeof(wr));
+  wr.wr_id = FLAGCX_IB_EAGER_WRID | slot;
+  wr.sg_list = &sge;
+  wr.num_sge = 1;
+  struct ibv_recv_wr *bad_wr;
+  FLAGCXCHECK(wrap_ibv_post_recv(eager->qp.qp, &wr, &bad_wr));
+  return flagcxSuccess;
+}
+
+// Register the eager slots and post them all before the sender can reach
+// the QP
+static flagcxResult_t
+flagcxIbRecvEagerInit(struct flagcxIbRecvComm *comm,
+                      struct flagcxIbConnectionMetadata *remMeta) {
+  struct flagcxIbRecvEager *eager = &comm->eager;
+  struct flagcxIbRecvCommDev *commDev = comm->devs;
+  struct flagcxIbDev *ibDev = flagcxIbDevs + commDev->base.ibDevN;
+  FLAGCXCHECK(flagcxIbCreateEagerQp(ibDev->portNum, &commDev->base, false,
+                                    eager->size, &eager->qp, NULL));
+  FLAGCXCHECK(flagcxIbMalloc((void **)&eager->slots,
+                             (size_t)eager->size * FLAGCX_NET_IB_EAGER_SLOTS));
+  FLAGCXCHECK(wrap_ibv_reg_mr(&eager->mr, commDev->base.pd, eager->slots,
+                              (size_t)eager->size * FLAGCX_NET_IB_EAGER_SLOTS,
+                              IBV_ACCESS_LOCAL_WRITE));
+  for (int slot = 0; slot < FLAGCX_NET_IB_EAGER_SLOTS; slot++)
+    FLAGCXCHECK(flagcxIbEagerPostRecv(comm, slot));
+  FLAGCXCHECK(flagcxIbRtrQp(eager->qp.qp, commDev->base.gidInfo.localGidIndex,
+                            remMeta->eagerQpInfo.qpn, remMeta->devs));
+  FLAGCXCHECK(flagcxIbRtsQp(eager->qp.qp));
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxIbAccept(void *listenComm, void **recvComm,
                               flagcxNetDeviceHandle_t ** /*recvDevComm*/) {
   struct flagcxIbListenComm *lComm = (struct flagcxIbListenComm *)listenComm;
@@ -1512,13 +1672,23 @@ ib_recv:
     // Prepare sizes fifo
     FLAGCXCHECK(wrap_ibv_reg_mr(
         &rComm->devs[i].sizesFifoMr, rComm->devs[i].base.pd, rComm->sizesFifo,
-        sizeof(int) * MAX_REQUESTS * FLAGCX_NET_IB_MAX_RECVS,
+        sizeof(size_t) * MAX_REQUESTS * FLAGCX_NET_IB_MAX_RECVS,
         IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE |
             IBV_ACCESS_REMOTE_READ));
     meta.devs[i].fifoRkey = rComm->devs[i].sizesFifoMr->rkey;
   }
   meta.fifoAddr = (uint64_t)rComm->sizesFifo;
 
+  memset(&meta.eagerQpInfo, 0, sizeof(meta.eagerQpInfo));
+  meta.eagerSize = 0;
+  if (remMeta.eagerQpInfo.qpn != 0 && flagcxParamIbEagerThreshold() > 0) {
+    rComm->eager.size = std::min<int64_t>(flagcxParamIbEagerThreshold(),
+                                          remMeta.eagerSize);
+    FLAGCXCHECK(flagcxIbRecvEagerInit(rComm, &remMeta));
+    meta.eagerQpInfo.qpn = rComm->eager.qp.qp->qp_num;
+    meta.eagerSize = rComm->eager.size;
+  }
+
   for (int q = 0; q < rComm->base.nqps; q++) {
     meta.qpInfo[q].qpn = rComm->base.qps[q].qp->qp_num;
     meta.qpInfo[q].devIndex = rComm->base.qps[q].devIndex;
@@ -1690,6 +1860,7 @@ flagcxResult_t flagcxIbRegMrDmaBuf(void *comm, void *data, size_t size,
     FLAGCXCHECK(flagcxIbRegMrDmaBufInternal(devComm, data, size, type, offset,
                                             fd, mhandleWrapper->mrs + i));
   }
+  mhandleWrapper->type = type;
   *mhandle = (void *)mhandleWrapper;
   return flagcxSuccess;
 }
@@ -1765,53 +1936,31 @@ flagcxResult_t flagcxIbMultiSend(struct flagcxIbSendComm *comm, int slot) {
 
   uint64_t wr_id = 0ULL;
   for (int r = 0; r < nreqs; r++) {
-    struct ibv_send_wr *wr = comm->wrs + r;
-    memset(wr, 0, sizeof(struct ibv_send_wr));
-
-    struct ibv_sge *sge = comm->sges + r;
-    sge->addr = (uintptr_t)reqs[r]->send.data;
-    wr->opcode = IBV_WR_RDMA_WRITE;
-    wr->send_flags = 0;
-    wr->wr.rdma.remote_addr = slots[r].addr;
-    wr->next = wr + 1;
     wr_id += (reqs[r] - comm->base.reqs) << (r * 8);
   }
 
-  // Write size as immediate data. In the case of multi-send, only write
-  // 0 or 1 as size to indicate whether there was data sent or received.
+  // Write size as immediate data. In the case of multi-send, or when the size
+  // does not fit in 32 bits, write sizes to the remote sizes fifo instead.
   uint32_t immData = 0;
-  if (nreqs == 1) {
+  bool useSizesFifo =
+      nreqs > 1 || reqs[0]->send.size >= FLAGCX_IB_IMM_SIZES_FIFO;
+  if (!useSizesFifo) {
     immData = reqs[0]->send.size;
   } else {
-    int *sizes = comm->remSizesFifo.elems[slot];
+    size_t *sizes = comm->remSizesFifo.elems[slot];
     for (int r = 0; r < nreqs; r++)
       sizes[r] = reqs[r]->send.size;
     comm->remSizesFifo.sge.addr = (uint64_t)sizes;
-    comm->remSizesFifo.sge.length = nreqs * sizeof(int);
-  }
-
-  struct ibv_send_wr *lastWr = comm->wrs + nreqs - 1;
-  if (nreqs > 1 ||
-      (comm->ar && reqs[0]->send.size > flagcxParamIbArThreshold())) {
-    // When using ADAPTIVE_ROUTING, send the bulk of the data first as an
-    // RDMA_WRITE, then a 0-byte RDMA_WRITE_WITH_IMM to trigger a remote
-    // completion.
-    lastWr++;
-    memset(lastWr, 0, sizeof(struct ibv_send_wr));
-    if (nreqs > 1) {
-      // Write remote sizes Fifo
-      lastWr->wr.rdma.remote_addr =
-          comm->remSizesFifo.addr +
-          slot * FLAGCX_NET_IB_MAX_RECVS * sizeof(int);
-      lastWr->num_sge = 1;
-      lastWr->sg_list = &comm->remSizesFifo.sge;
-    }
+    comm->remSizesFifo.sge.length = nreqs * sizeof(size_t);
+    if (nreqs == 1)
+      immData = FLAGCX_IB_IMM_SIZES_FIFO;
   }
-  lastWr->wr_id = wr_id;
-  lastWr->opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
-  lastWr->imm_data = immData;
-  lastWr->next = NULL;
-  lastWr->send_flags = IBV_SEND_SIGNALED;
+  // When using ADAPTIVE_ROUTING, send the bulk of the data first as
+  // RDMA_WRITEs, then a 0-byte RDMA_WRITE_WITH_IMM to trigger a remote
+  // completion.
+  bool immOnlyWr =
+      useSizesFifo ||
+      (comm->ar && reqs[0]->send.size > (size_t)flagcxParamIbArThreshold());
 
   // Multi-QP: make sure IB writes are multiples of 128B so that LL and LL128
   // protocols still work
@@ -1821,44 +1970,67 @@ flagcxResult_t flagcxIbMultiSend(struct flagcxIbSendComm *comm, int slot) {
     int qpIndex = comm->base.qpIndex;
     flagcxIbQp *qp = comm->base.qps + qpIndex;
     int devIndex = qp->devIndex;
+    struct ibv_send_wr *bad_wr;
+    int nwrs = 0;
     for (int r = 0; r < nreqs; r++) {
-      // Track this event for completion
-      // flagcxIbAddEvent(reqs[r], devIndex, &comm->devs[devIndex].base);
-
-      // Select proper rkey (needed even for 0-size send)
-      comm->wrs[r].wr.rdma.rkey = slots[r].rkeys[qp->remDevIdx];
-
-      int chunkSize = DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
-      int length =
-          std::min(reqs[r]->send.size - reqs[r]->send.offset, chunkSize);
-      if (length <= 0) {
-        comm->wrs[r].sg_list = NULL;
-        comm->wrs[r].num_sge = 0;
-      } else {
-        // Select proper lkey
-        comm->sges[r].lkey = reqs[r]->send.lkeys[devIndex];
-        comm->sges[r].length = length;
-        comm->wrs[r].sg_list = comm->sges + r;
-        comm->wrs[r].num_sge = 1;
-      }
+      size_t chunkSize = DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
+      size_t offset = reqs[r]->send.offset;
+      size_t length = 0;
+      if (offset < reqs[r]->send.size)
+        length = std::min(reqs[r]->send.size - offset, chunkSize);
+      // Chunks above the max WR size become several WRs. A 0-size send still
+      // posts one WR with the proper rkey.
+      do {
+        if (nwrs == FLAGCX_NET_IB_MAX_WRS) {
+          comm->wrs[nwrs - 1].next = NULL;
+          FLAGCXCHECK(wrap_ibv_post_send(qp->qp, comm->wrs, &bad_wr));
+          nwrs = 0;
+        }
+        struct ibv_send_wr *wr = comm->wrs + nwrs;
+        struct ibv_sge *sge = comm->sges + nwrs;
+        memset(wr, 0, sizeof(struct ibv_send_wr));
+        wr->opcode = IBV_WR_RDMA_WRITE;
+        wr->wr.rdma.remote_addr = slots[r].addr + offset;
+        wr->wr.rdma.rkey = slots[r].rkeys[qp->remDevIdx];
+        wr->next = wr + 1;
+        size_t wrSize = std::min(length, (size_t)FLAGCX_IB_MAX_WR_SIZE);
+        if (wrSize > 0) {
+          sge->addr = (uintptr_t)reqs[r]->send.data + offset;
+          sge->lkey = reqs[r]->send.lkeys[devIndex];
+          sge->length = wrSize;
+          wr->sg_list = sge;
+          wr->num_sge = 1;
+        }
+        offset += wrSize;
+        length -= wrSize;
+        nwrs++;
+      } while (length > 0);
+      reqs[r]->send.offset += chunkSize;
     }
 
-    if (nreqs > 1) {
-      // Also make sure lastWr writes remote sizes using the right lkey
-      comm->remSizesFifo.sge.lkey = comm->remSizesFifo.mrs[devIndex]->lkey;
-      lastWr->wr.rdma.rkey = comm->remSizesFifo.rkeys[devIndex];
+    struct ibv_send_wr *lastWr = comm->wrs + nwrs - 1;
+    if (immOnlyWr) {
+      lastWr++;
+      memset(lastWr, 0, sizeof(struct ibv_send_wr));
+      if (useSizesFifo) {
+        // Write remote sizes Fifo using the right lkey
+        comm->remSizesFifo.sge.lkey = comm->remSizesFifo.mrs[devIndex]->lkey;
+        lastWr->wr.rdma.remote_addr =
+            comm->remSizesFifo.addr +
+            slot * FLAGCX_NET_IB_MAX_RECVS * sizeof(size_t);
+        lastWr->wr.rdma.rkey = comm->remSizesFifo.rkeys[devIndex];
+        lastWr->num_sge = 1;
+        lastWr->sg_list = &comm->remSizesFifo.sge;
+      }
     }
+    lastWr->wr_id = wr_id;
+    lastWr->opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+    lastWr->imm_data = immData;
+    lastWr->next = NULL;
+    lastWr->send_flags = IBV_SEND_SIGNALED;
 
-    struct ibv_send_wr *bad_wr;
     FLAGCXCHECK(wrap_ibv_post_send(qp->qp, comm->wrs, &bad_wr));
 
-    for (int r = 0; r < nreqs; r++) {
-      int chunkSize = DIVUP(DIVUP(reqs[r]->send.size, nqps), align) * align;
-      reqs[r]->send.offset += chunkSize;
-      comm->sges[r].addr += chunkSize;
-      comm->wrs[r].wr.rdma.remote_addr += chunkSize;
-    }
-
     // Select the next qpIndex
     comm->base.qpIndex = (comm->base.qpIndex + 1) % comm->base.nqps;
   }
@@ -1866,7 +2038,49 @@ flagcxResult_t flagcxIbMultiSend(struct flagcxIbSendComm *comm, int slot) {
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxIbIsend(void *sendComm, void *data, int size, int tag,
+// Send a small message right away into one of the receiver's eager slots,
+// carrying its sequence number as immediate data
+static flagcxResult_t flagcxIbEagerSend(struct flagcxIbSendComm *comm,
+                                        void *data, size_t size,
+                                        struct flagcxIbMrHandle *mhandle,
+                                        void **request) {
+  struct flagcxIbRequest *req;
+  FLAGCXCHECK(flagcxIbGetRequest(&comm->base, &req));
+  req->type = FLAGCX_NET_IB_REQ_SEND;
+  req->sock = &comm->base.sock;
+  req->nreqs = 1;
+  req->send.size = size;
+  req->send.data = data;
+  req->send.offset = 0;
+  struct flagcxIbQp *qp = &comm->eagerQp;
+  flagcxIbAddEvent(req, qp->devIndex, &comm->devs[qp->devIndex].base);
+
+  struct ibv_sge sge;
+  struct ibv_send_wr wr;
+  memset(&wr, 0, sizeof(wr));
+  wr.wr_id = req - comm->base.reqs;
+  wr.opcode = IBV_WR_SEND_WITH_IMM;
+  wr.imm_data = comm->msgSeq;
+  wr.send_flags = IBV_SEND_SIGNALED;
+  if (size > 0) {
+    sge.addr = (uintptr_t)data;
+    sge.length = size;
+    sge.lkey = mhandle->mrs[qp->devIndex]->lkey;
+    wr.sg_list = &sge;
+    wr.num_sge = 1;
+    // The HCA takes the payload from the WQE instead of reading it back
+    if (size <= comm->eagerInline)
+      wr.send_flags |= IBV_SEND_INLINE;
+  }
+
+  struct ibv_send_wr *bad_wr;
+  FLAGCXCHECK(wrap_ibv_post_send(qp->qp, &wr, &bad_wr));
+  comm->msgSeq++;
+  *request = req;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxIbIsend(void *sendComm, void *data, size_t size, int tag,
                              void *mhandle, void **request) {
   struct flagcxIbSendComm *comm = (struct flagcxIbSendComm *)sendComm;
   if (comm->base.ready == 0) {
@@ -1879,6 +2093,9 @@ flagcxResult_t flagcxIbIsend(void *sendComm, void *data, int size, int tag,
   }
 
   struct flagcxIbMrHandle *mhandleWrapper = (struct flagcxIbMrHandle *)mhandle;
+  if (comm->eagerSize > 0 && size <= comm->eagerSize &&
+      mhandleWrapper != NULL && mhandleWrapper->type == FLAGCX_PTR_HOST)
+    return flagcxIbEagerSend(comm, data, size, mhandleWrapper, request);
 
   // Wait for the receiver to have posted the corresponding receive
   int nreqs = 0;
@@ -1906,12 +2123,12 @@ flagcxResult_t flagcxIbIsend(void *sendComm, void *data, int size, int tag,
     if (size > slots[r].size)
       size = slots[r].size;
     // Sanity checks
-    if (slots[r].size < 0 || slots[r].addr == 0 || slots[r].rkeys[0] == 0) {
+    if (slots[r].addr == 0 || slots[r].rkeys[0] == 0) {
       char line[SOCKET_NAME_MAXLEN + 1];
       union flagcxSocketAddress addr;
       flagcxSocketGetAddr(&comm->base.sock, &addr);
       WARN("NET/IB : req %d/%d tag %x peer %s posted incorrect receive info: "
-           "size %d addr %lx rkeys[0]=%x",
+           "size %lu addr %lx rkeys[0]=%x",
            r, nreqs, tag, flagcxSocketToString(&addr, line), slots[r].size,
            slots[r].addr, slots[r].rkeys[0]);
       return flagcxInternalError;
@@ -1950,6 +2167,7 @@ flagcxResult_t flagcxIbIsend(void *sendComm, void *data, int size, int tag,
     }
 
     *request = reqs[r] = req;
+    comm->msgSeq++;
 
     // If this is a multi-recv, send only when all requests have matched.
     for (int r = 0; r < nreqs; r++) {
@@ -1974,7 +2192,7 @@ flagcxResult_t flagcxIbIsend(void *sendComm, void *data, int size, int tag,
 }
 
 flagcxResult_t flagcxIbPostFifo(struct flagcxIbRecvComm *comm, int n,
-                                void **data, int *sizes, int *tags,
+                                void **data, size_t *sizes, int *tags,
                                 void **mhandles, struct flagcxIbRequest *req) {
   struct ibv_send_wr wr;
   memset(&wr, 0, sizeof(wr));
@@ -2061,8 +2279,75 @@ flagcxResult_t flagcxIbPostFifo(struct flagcxIbRecvComm *comm, int n,
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxIbIrecv(void *recvComm, int n, void **data, int *sizes,
-                             int *tags, void **mhandles, void **request) {
+// Hand arrived eager messages to the pending eager receives, both in order.
+// Their sequence numbers tell when the sender and the receiver picked
+// different protocols for a message, which happens when the receive was not
+// posted with the size that was sent.
+static flagcxResult_t flagcxIbEagerMatch(struct flagcxIbRecvComm *comm) {
+  struct flagcxIbRecvEager *eager = &comm->eager;
+  while (eager->pendingHead < eager->pendingTail &&
+         eager->arrivedHead < eager->arrivedTail) {
+    struct flagcxIbRequest *req =
+        eager->pending[eager->pendingHead++ % MAX_REQUESTS];
+    struct ibv_wc *wc =
+        eager->arrived + eager->arrivedHead++ % FLAGCX_NET_IB_EAGER_SLOTS;
+    int slot = wc->wr_id & ~FLAGCX_IB_EAGER_WRID;
+    if (wc->imm_data != req->recv.eagerSeq ||
+        wc->byte_len > req->recv.eagerSize) {
+      WARN("NET/IB : eager message %u of %u bytes does not match receive %u "
+           "of %lu bytes, sends and receives must post the same sizes",
+           wc->imm_data, wc->byte_len, req->recv.eagerSeq,
+           req->recv.eagerSize);
+      return flagcxInternalError;
+    }
+    memcpy(req->recv.eagerData, eager->slots + (size_t)slot * eager->size,
+           wc->byte_len);
+    req->recv.eagerSize = wc->byte_len;
+    req->events[eager->qp.devIndex]--;
+    FLAGCXCHECK(flagcxIbEagerPostRecv(comm, slot));
+  }
+  // Every eager receive before recvSeq has been matched, so an eager message
+  // older than that was received through the fifo
+  if (eager->arrivedHead < eager->arrivedTail) {
+    struct ibv_wc *wc =
+        eager->arrived + eager->arrivedHead % FLAGCX_NET_IB_EAGER_SLOTS;
+    if ((int32_t)(wc->imm_data - eager->recvSeq) < 0) {
+      WARN("NET/IB : eager message %u of %u bytes was received without the "
+           "eager protocol, sends and receives must post the same sizes",
+           wc->imm_data, wc->byte_len);
+      return flagcxInternalError;
+    }
+  }
+  return flagcxSuccess;
+}
+
+static flagcxResult_t flagcxIbEagerRecv(struct flagcxIbRecvComm *comm,
+                                        void *data, size_t size,
+                                        void **request) {
+  struct flagcxIbRequest *req;
+  FLAGCXCHECK(flagcxIbGetRequest(&comm->base, &req));
+  req->type = FLAGCX_NET_IB_REQ_RECV;
+  req->sock = &comm->base.sock;
+  req->nreqs = 1;
+  for (int i = 0; i < comm->base.ndevs; i++) {
+    req->devBases[i] = &comm->devs[i].base;
+  }
+  req->recv.sizes = &req->recv.eagerSize;
+  req->recv.eagerData = data;
+  req->recv.eagerSize = size;
+  req->recv.eagerSeq = comm->eager.recvSeq++;
+  int devIndex = comm->eager.qp.devIndex;
+  flagcxIbAddEvent(req, devIndex, &comm->devs[devIndex].base);
+  comm->eager.pending[comm->eager.pendingTail++ % MAX_REQUESTS] = req;
+  // The message may already be there
+  FLAGCXCHECK(flagcxIbEagerMatch(comm));
+  *request = req;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxIbIrecv(void *recvComm, int n, void **data,
+                             size_t *sizes, int *tags, void **mhandles,
+                             void **request) {
   struct flagcxIbRecvComm *comm = (struct flagcxIbRecvComm *)recvComm;
   if (comm->base.ready == 0) {
     WARN("NET/IB: flagcxIbIrecv() called when comm->base.ready == 0");
@@ -2074,6 +2359,10 @@ flagcxResult_t flagcxIbIrecv(void *recvComm, int n, void **data, int *sizes,
   }
   if (n > FLAGCX_NET_IB_MAX_RECVS)
     return flagcxInternalError;
+  if (n == 1 && comm->eager.size > 0 && sizes[0] <= comm->eager.size &&
+      mhandles[0] != NULL &&
+      ((struct flagcxIbMrHandle *)mhandles[0])->type == FLAGCX_PTR_HOST)
+    return flagcxIbEagerRecv(comm, data[0], sizes[0], request);
 
   struct flagcxIbRequest *req;
   FLAGCXCHECK(flagcxIbGetRequest(&comm->base, &req));
@@ -2111,13 +2400,15 @@ flagcxResult_t flagcxIbIrecv(void *recvComm, int n, void **data, int *sizes,
   TIME_START(2);
   FLAGCXCHECK(flagcxIbPostFifo(comm, n, data, sizes, tags, mhandles, req));
   TIME_STOP(2);
+  comm->eager.recvSeq += n;
+  FLAGCXCHECK(flagcxIbEagerMatch(comm));
 
   *request = req;
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxIbIflush(void *recvComm, int n, void **data, int *sizes,
-                              void **mhandles, void **request) {
+flagcxResult_t flagcxIbIflush(void *recvComm, int n, void **data,
+                              size_t *sizes, void **mhandles, void **request) {
   struct flagcxIbRecvComm *comm = (struct flagcxIbRecvComm *)recvComm;
   int last = -1;
   for (int i = 0; i < n; i++)
@@ -2158,114 +2449,125 @@ flagcxResult_t flagcxIbIflush(void *recvComm, int n, void **data, int *sizes,
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxIbTest(void *request, int *done, int *sizes) {
-  struct flagcxIbRequest *r = (struct flagcxIbRequest *)request;
-  *done = 0;
-  while (1) {
-    if (r->events[0] == 0 && r->events[1] == 0) {
-      TRACE(FLAGCX_NET, "r=%p done", r);
-      *done = 1;
-      if (sizes && r->type == FLAGCX_NET_IB_REQ_RECV) {
-        for (int i = 0; i < r->nreqs; i++)
-          sizes[i] = r->recv.sizes[i];
-      }
-      if (sizes && r->type == FLAGCX_NET_IB_REQ_SEND) {
-        sizes[0] = r->send.size;
-      }
-      FLAGCXCHECK(flagcxIbFreeRequest(r));
-      return flagcxSuccess;
+// Completions are drained from a CQ in batches of this size
+#define FLAGCX_IB_POLL_BATCH 64
+
+// Drain the CQ of device i and account each completion to the request it
+// belongs to, whichever request is being tested. Requests completed here are
+// then found done by their next test without polling.
+static flagcxResult_t flagcxIbProgress(struct flagcxIbNetCommBase *base, int i,
+                                       struct flagcxIbNetCommDevBase *devBase) {
+  struct ibv_wc wcs[FLAGCX_IB_POLL_BATCH];
+  int wrDone = 0;
+  do {
+    TIME_START(3);
+    FLAGCXCHECK(
+        wrap_ibv_poll_cq(devBase->cq, FLAGCX_IB_POLL_BATCH, wcs, &wrDone));
+    if (wrDone == 0) {
+      TIME_CANCEL(3);
+    } else {
+      TIME_STOP(3);
     }
-
-    int totalWrDone = 0;
-    int wrDone = 0;
-    struct ibv_wc wcs[4];
-
-    for (int i = 0; i < FLAGCX_IB_MAX_DEVS_PER_NIC; i++) {
-      TIME_START(3);
-      // If we expect any completions from this device's CQ
-      if (r->events[i]) {
-        FLAGCXCHECK(wrap_ibv_poll_cq(r->devBases[i]->cq, 4, wcs, &wrDone));
-        totalWrDone += wrDone;
-        if (wrDone == 0) {
-          TIME_CANCEL(3);
-        } else {
-          TIME_STOP(3);
+    for (int w = 0; w < wrDone; w++) {
+      struct ibv_wc *wc = wcs + w;
+      struct flagcxIbRequest *req = base->reqs + (wc->wr_id & 0xff);
+      if (wc->status != IBV_WC_SUCCESS) {
+        union flagcxSocketAddress addr;
+        flagcxSocketGetAddr(&base->sock, &addr);
+        char localGidString[INET6_ADDRSTRLEN] = "";
+        char remoteGidString[INET6_ADDRSTRLEN] = "";
+        const char *localGidStr = NULL, *remoteGidStr = NULL;
+        if (devBase->gidInfo.link_layer == IBV_LINK_LAYER_ETHERNET) {
+          localGidStr = inet_ntop(AF_INET6, &devBase->gidInfo.localGid,
+                                  localGidString, sizeof(localGidString));
+          remoteGidStr = inet_ntop(AF_INET6, &base->remDevs[i].remoteGid,
+                                   remoteGidString, sizeof(remoteGidString));
         }
-        if (wrDone == 0)
-          continue;
-        for (int w = 0; w < wrDone; w++) {
-          struct ibv_wc *wc = wcs + w;
-          if (wc->status != IBV_WC_SUCCESS) {
-            union flagcxSocketAddress addr;
-            flagcxSocketGetAddr(r->sock, &addr);
-            char localGidString[INET6_ADDRSTRLEN] = "";
-            char remoteGidString[INET6_ADDRSTRLEN] = "";
-            const char *localGidStr = NULL, *remoteGidStr = NULL;
-            if (r->devBases[i]->gidInfo.link_layer == IBV_LINK_LAYER_ETHERNET) {
-              localGidStr =
-                  inet_ntop(AF_INET6, &r->devBases[i]->gidInfo.localGid,
-                            localGidString, sizeof(localGidString));
-              remoteGidStr =
-                  inet_ntop(AF_INET6, &r->base->remDevs[i].remoteGid,
-                            remoteGidString, sizeof(remoteGidString));
-            }
-
-            char line[SOCKET_NAME_MAXLEN + 1];
-            WARN("NET/IB : Got completion from peer %s with status=%d "
-                 "opcode=%d len=%d vendor err %d (%s)%s%s%s%s",
-                 flagcxSocketToString(&addr, line), wc->status, wc->opcode,
-                 wc->byte_len, wc->vendor_err, reqTypeStr[r->type],
-                 localGidStr ? " localGid " : "", localGidString,
-                 remoteGidStr ? " remoteGids" : "", remoteGidString);
-            return flagcxRemoteError;
-          }
 
-          union flagcxSocketAddress addr;
-          flagcxSocketGetAddr(r->sock, &addr);
-          struct flagcxIbRequest *req = r->base->reqs + (wc->wr_id & 0xff);
+        char line[SOCKET_NAME_MAXLEN + 1];
+        WARN("NET/IB : Got completion from peer %s with status=%d "
+             "opcode=%d len=%d vendor err %d (%s)%s%s%s%s",
+             flagcxSocketToString(&addr, line), wc->status, wc->opcode,
+             wc->byte_len, wc->vendor_err, reqTypeStr[req->type],
+             localGidStr ? " localGid " : "", localGidString,
+             remoteGidStr ? " remoteGids" : "", remoteGidString);
+        return flagcxRemoteError;
+      }
 
 #ifdef ENABLE_TRACE
-          char line[SOCKET_NAME_MAXLEN + 1];
-          TRACE(FLAGCX_NET,
-                "Got completion from peer %s with status=%d opcode=%d len=%d "
-                "wr_id=%ld r=%p type=%d events={%d,%d}, i=%d",
-                flagcxSocketToString(&addr, line), wc->status, wc->opcode,
-                wc->byte_len, wc->wr_id, req, req->type, req->events[0],
-                req->events[1], i);
+      union flagcxSocketAddress addr;
+      flagcxSocketGetAddr(&base->sock, &addr);
+      char line[SOCKET_NAME_MAXLEN + 1];
+      TRACE(FLAGCX_NET,
+            "Got completion from peer %s with status=%d opcode=%d len=%d "
+            "wr_id=%ld r=%p type=%d events={%d,%d}, i=%d",
+            flagcxSocketToString(&addr, line), wc->status, wc->opcode,
+            wc->byte_len, wc->wr_id, req, req->type, req->events[0],
+            req->events[1], i);
 #endif
-          if (req->type == FLAGCX_NET_IB_REQ_SEND) {
-            for (int j = 0; j < req->nreqs; j++) {
-              struct flagcxIbRequest *sendReq =
-                  r->base->reqs + ((wc->wr_id >> (j * 8)) & 0xff);
-              if ((sendReq->events[i] <= 0)) {
-                WARN("NET/IB: sendReq(%p)->events={%d,%d}, i=%d, j=%d <= 0",
-                     sendReq, sendReq->events[0], sendReq->events[1], i, j);
-                return flagcxInternalError;
-              }
-              sendReq->events[i]--;
-            }
-          } else {
-            if (req && wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
-              if (req->type != FLAGCX_NET_IB_REQ_RECV) {
-                WARN("NET/IB: wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM and "
-                     "req->type=%d",
-                     req->type);
-                return flagcxInternalError;
-              }
-              if (req->nreqs == 1) {
-                req->recv.sizes[0] = wc->imm_data;
-              }
-            }
-            req->events[i]--;
+      if (!base->isSend && (wc->wr_id & FLAGCX_IB_EAGER_WRID)) {
+        struct flagcxIbRecvComm *comm = (struct flagcxIbRecvComm *)base;
+        struct flagcxIbRecvEager *eager = &comm->eager;
+        eager->arrived[eager->arrivedTail++ % FLAGCX_NET_IB_EAGER_SLOTS] = *wc;
+        FLAGCXCHECK(flagcxIbEagerMatch(comm));
+        continue;
+      }
+      if (req->type == FLAGCX_NET_IB_REQ_SEND) {
+        for (int j = 0; j < req->nreqs; j++) {
+          struct flagcxIbRequest *sendReq =
+              base->reqs + ((wc->wr_id >> (j * 8)) & 0xff);
+          if ((sendReq->events[i] <= 0)) {
+            WARN("NET/IB: sendReq(%p)->events={%d,%d}, i=%d, j=%d <= 0",
+                 sendReq, sendReq->events[0], sendReq->events[1], i, j);
+            return flagcxInternalError;
           }
+          sendReq->events[i]--;
         }
+      } else {
+        if (req && wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+          if (req->type != FLAGCX_NET_IB_REQ_RECV) {
+            WARN("NET/IB: wc->opcode == IBV_WC_RECV_RDMA_WITH_IMM and "
+                 "req->type=%d",
+                 req->type);
+            return flagcxInternalError;
+          }
+          // Otherwise the sizes were written to the sizes fifo
+          if (req->nreqs == 1 && wc->imm_data != FLAGCX_IB_IMM_SIZES_FIFO) {
+            req->recv.sizes[0] = wc->imm_data;
+          }
+        }
+        req->events[i]--;
       }
     }
+  } while (wrDone == FLAGCX_IB_POLL_BATCH);
+  return flagcxSuccess;
+}
 
-    // If no CQEs found on any device, return and come back later
-    if (totalWrDone == 0)
+flagcxResult_t flagcxIbTest(void *request, int *done, size_t *sizes) {
+  struct flagcxIbRequest *r = (struct flagcxIbRequest *)request;
+  *done = 0;
+  if (r->events[0] || r->events[1]) {
+    for (int i = 0; i < FLAGCX_IB_MAX_DEVS_PER_NIC; i++) {
+      // If we expect any completions from this device's CQ
+      if (r->events[i]) {
+        FLAGCXCHECK(flagcxIbProgress(r->base, i, r->devBases[i]));
+      }
+    }
+    if (r->events[0] || r->events[1])
       return flagcxSuccess;
   }
+
+  TRACE(FLAGCX_NET, "r=%p done", r);
+  *done = 1;
+  if (sizes && r->type == FLAGCX_NET_IB_REQ_RECV) {
+    for (int i = 0; i < r->nreqs; i++)
+      sizes[i] = r->recv.sizes[i];
+  }
+  if (sizes && r->type == FLAGCX_NET_IB_REQ_SEND) {
+    sizes[0] = r->send.size;
+  }
+  FLAGCXCHECK(flagcxIbFreeRequest(r));
+  return flagcxSuccess;
 }
 
 flagcxResult_t flagcxIbCloseSend(void *sendComm) {
@@ -2276,6 +2578,8 @@ flagcxResult_t flagcxIbCloseSend(void *sendComm) {
     for (int q = 0; q < comm->base.nqps; q++)
       if (comm->base.qps[q].qp != NULL)
         FLAGCXCHECK(wrap_ibv_destroy_qp(comm->base.qps[q].qp));
+    if (comm->eagerQp.qp != NULL)
+      FLAGCXCHECK(wrap_ibv_destroy_qp(comm->eagerQp.qp));
 
     for (int i = 0; i < comm->base.ndevs; i++) {
       struct flagcxIbSendCommDev *commDev = comm->devs + i;
@@ -2299,6 +2603,11 @@ flagcxResult_t flagcxIbCloseRecv(void *recvComm) {
     for (int q = 0; q < comm->base.nqps; q++)
       if (comm->base.qps[q].qp != NULL)
         FLAGCXCHECK(wrap_ibv_destroy_qp(comm->base.qps[q].qp));
+    if (comm->eager.qp.qp != NULL)
+      FLAGCXCHECK(wrap_ibv_destroy_qp(comm->eager.qp.qp));
+    if (comm->eager.mr != NULL)
+      FLAGCXCHECK(wrap_ibv_dereg_mr(comm->eager.mr));
+    free(comm->eager.slots);
 
     for (int i = 0; i < comm->base.ndevs; i++) {
       struct flagcxIbRecvCommDev *commDev = comm->devs + i;
@@ -2363,6 +2672,7 @@ flagcxResult_t flagcxIbGetProperties(int dev, flagcxNetProperties_t *props) {
   props->maxRecvs = FLAGCX_NET_IB_MAX_RECVS;
   props->netDeviceType = FLAGCX_NET_DEVICE_HOST;
   props->netDeviceVersion = FLAGCX_NET_DEVICE_INVALID_VERSION;
+  props->maxP2pBytes = FLAGCX_MAX_NET_SIZE_BYTES;
   return flagcxSuccess;
 }
 
@@ -17,17 +17,27 @@ struct flagcxTopoNodeList {
   int count;
 };
 
-static flagcxResult_t getPath(struct flagcxTopoServer *topoServer,
-                              struct flagcxTopoNode *node, int t, int64_t id,
-                              struct flagcxTopoPath **path) {
-  for (int i = 0; i < topoServer->nodes[t].count; i++) {
-    if (topoServer->nodes[t].nodes[i].id == id) {
-      *path = node->paths[t] + i;
-      return flagcxSuccess;
-    }
+// Store the hops of remPath, i.e. link followed by the hops of path
+static flagcxResult_t flagcxTopoPathSetHops(struct flagcxTopoServer *topoServer,
+                                            struct flagcxTopoPath *remPath,
+                                            struct flagcxTopoLink *link,
+                                            struct flagcxTopoPath *path) {
+  int need = topoServer->nPathHops + path->count + 1;
+  if (need > topoServer->maxPathHops) {
+    int maxPathHops = std::max(need, std::max(2 * topoServer->maxPathHops,
+                                              FLAGCX_TOPO_MAX_NODES));
+    FLAGCXCHECK(flagcxRealloc(&topoServer->pathHops, topoServer->maxPathHops,
+                              maxPathHops));
+    topoServer->maxPathHops = maxPathHops;
   }
-  WARN("Could not find node of type %d id %lx", t, id);
-  return flagcxInternalError;
+  struct flagcxTopoLink **hops = topoServer->pathHops + topoServer->nPathHops;
+  hops[0] = link;
+  memcpy(hops + 1, topoServer->pathHops + path->hops,
+         path->count * sizeof(struct flagcxTopoLink *));
+  remPath->hops = topoServer->nPathHops;
+  remPath->count = path->count + 1;
+  topoServer->nPathHops = need;
+  return flagcxSuccess;
 }
 
 static flagcxResult_t flagcxTopoSetPaths(struct flagcxTopoNode *baseNode,
@@ -44,9 +54,10 @@ static flagcxResult_t flagcxTopoSetPaths(struct flagcxTopoNode *baseNode,
   struct flagcxTopoNodeList nextNodeList = {{0}, 0};
   nodeList.count = 1;
   nodeList.list[0] = baseNode;
-  struct flagcxTopoPath *basePath;
-  FLAGCXCHECK(
-      getPath(topoServer, baseNode, baseNode->type, baseNode->id, &basePath));
+  // paths to baseNode are stored at its index in its node set
+  int baseIdx = baseNode - topoServer->nodes[baseNode->type].nodes;
+  struct flagcxTopoPath *basePath = baseNode->paths[baseNode->type] + baseIdx;
+  basePath->hops = 0;
   basePath->count = 0;
   basePath->bw = LOC_BW;
   basePath->type = PATH_LOC;
@@ -55,9 +66,7 @@ static flagcxResult_t flagcxTopoSetPaths(struct flagcxTopoNode *baseNode,
     nextNodeList.count = 0;
     for (int n = 0; n < nodeList.count; n++) {
       struct flagcxTopoNode *node = nodeList.list[n];
-      struct flagcxTopoPath *path;
-      FLAGCXCHECK(
-          getPath(topoServer, node, baseNode->type, baseNode->id, &path));
+      struct flagcxTopoPath *path = node->paths[baseNode->type] + baseIdx;
       for (int l = 0; l < node->nlinks; l++) {
         struct flagcxTopoLink *link = node->links + l;
         struct flagcxTopoNode *remNode = link->remNode;
@@ -67,9 +76,8 @@ static flagcxResult_t flagcxTopoSetPaths(struct flagcxTopoNode *baseNode,
           for (int i = 0; i < topoServer->nodes[baseNode->type].count; i++)
             remNode->paths[baseNode->type][i].type = PATH_DIS;
         }
-        struct flagcxTopoPath *remPath;
-        FLAGCXCHECK(getPath(topoServer, remNode, baseNode->type, baseNode->id,
-                            &remPath));
+        struct flagcxTopoPath *remPath =
+            remNode->paths[baseNode->type] + baseIdx;
         float bw = std::min(path->bw, link->bw);
 
         // allow routing through a APU only as 1 hop (not supported)
@@ -77,14 +85,15 @@ static flagcxResult_t flagcxTopoSetPaths(struct flagcxTopoNode *baseNode,
         if ((remPath->bw == 0 || remPath->count > path->count) &&
             remPath->bw < bw) {
           // Find reverse link
+          struct flagcxTopoLink *revLink = NULL;
           for (int l = 0; l < remNode->nlinks; l++) {
             if (remNode->links[l].remNode == node &&
                 remNode->links[l].type == link->type) {
-              remPath->list[0] = remNode->links + l;
+              revLink = remNode->links + l;
               break;
             }
           }
-          if (remPath->list[0] == NULL) {
+          if (revLink == NULL) {
             WARN("Failed to find reverse path from remNode %d/%lx nlinks %d to "
                  "node %d/%lx",
                  remNode->type, remNode->id, remNode->nlinks, node->type,
@@ -92,9 +101,8 @@ static flagcxResult_t flagcxTopoSetPaths(struct flagcxTopoNode *baseNode,
             return flagcxInternalError;
           }
           // Copy the rest of the path
-          for (int i = 0; i < path->count; i++)
-            remPath->list[i + 1] = path->list[i];
-          remPath->count = path->count + 1;
+          FLAGCXCHECK(
+              flagcxTopoPathSetHops(topoServer, remPath, revLink, path));
           remPath->bw = bw;
 
           // Start with path type = link type. PATH and LINK types are supposed
@@ -141,6 +149,10 @@ static void flagcxTopoRemovePaths(struct flagcxTopoServer *topoServer) {
       }
     }
   }
+  free(topoServer->pathHops);
+  topoServer->pathHops = NULL;
+  topoServer->nPathHops = 0;
+  topoServer->maxPathHops = 0;
 }
 
 // This is a tailored version of the original one.
@@ -199,7 +211,8 @@ static void printNodePaths(struct flagcxTopoServer *topoServer,
       line[0] = 0;
       int offset = 0;
       for (int i = 0; i < node->paths[t][n].count; i++) {
-        struct flagcxTopoLink *link = node->paths[t][n].list[i];
+        struct flagcxTopoLink *link =
+            flagcxTopoPathHop(topoServer, node->paths[t] + n, i);
         struct flagcxTopoNode *remNode = link->remNode;
         snprintf(line + offset, linesize - offset, "--%s(%g)->%s/%lx-%lx",
                  topoLinkTypeStr[link->type], link->bw,
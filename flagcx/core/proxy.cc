@@ -123,6 +123,8 @@ flagcxResult_t flagcxProxySaveOp(struct flagcxHeteroComm *comm,
     case flagcxPatternRecv: {
       if (op->root == comm->rank)
         return flagcxSuccess;
+      // the proxy queues are indexed by the ranks of the owner of the proxy
+      op->root = flagcxTopParentRank(comm, op->root);
       FLAGCXCHECK(
           SaveProxy(comm, channel,
                     op->pattern == flagcxPatternSend ? proxySend : proxyRecv,
@@ -156,6 +158,97 @@ static void flagcxProgressQueEmptyCheck(struct flagcxProxyState *proxyState) {
     INFO(FLAGCX_INIT, "progress queue is not empty");
 }
 
+FLAGCX_PARAM(ProxyTimeout, "PROXY_TIMEOUT", 0);
+
+static bool flagcxProxyOpTimedOut(struct flagcxProxyArgs *args) {
+  int64_t timeout = flagcxParamProxyTimeout();
+  if (timeout <= 0) {
+    return false;
+  }
+  int mark = args->waitCopy + args->copied + args->posted + args->transmitted +
+             args->postFlush + args->flushed;
+  uint64_t now = clockNano();
+  if (args->progressTime == 0 || mark != args->progressMark) {
+    args->progressMark = mark;
+    args->progressTime = now;
+    return false;
+  }
+  return now - args->progressTime > (uint64_t)timeout * 1000000000ULL;
+}
+
+// Advance op, then complete it with an error when the transport failed,
+// when it made no progress for FLAGCX_PROXY_TIMEOUT seconds (if set), or
+// when an earlier op of the proxy failed. The stream waiting on op is released
+// and the first error is kept in proxyState->asyncResult for
+// flagcxCommGetAsyncError.
+static void flagcxProxyAdvanceOp(struct flagcxProxyState *proxyState,
+                                 struct flagcxProxyOp *op) {
+  struct flagcxProxyArgs *args = &op->args;
+  bool isSend = op->pattern == flagcxPatternSend;
+  flagcxResult_t res = flagcxSuccess;
+  if (__atomic_load_n(&proxyState->asyncResult, __ATOMIC_ACQUIRE) ==
+      flagcxSuccess) {
+    res = isSend ? flagcxProxySend(
+                       (sendNetResources *)op->connection->transportResources,
+                       op->recvbuff, op->nbytes, args)
+                 : flagcxProxyRecv(
+                       (recvNetResources *)op->connection->transportResources,
+                       op->recvbuff, op->nbytes, args);
+  }
+  // the stream still has to reach the op and signal eventReady
+  if (args->done || !__atomic_load_n(&args->eventReady, __ATOMIC_RELAXED)) {
+    return;
+  }
+  if (res != flagcxSuccess) {
+    WARN("Proxy %s with rank %d of %zd bytes failed: %s",
+         isSend ? "send" : "recv", op->root, op->nbytes,
+         flagcxGetErrorString(res));
+  } else if (flagcxProxyOpTimedOut(args)) {
+    WARN("Proxy %s with rank %d of %zd bytes made no progress for %ld "
+         "seconds",
+         isSend ? "send" : "recv", op->root, op->nbytes,
+         flagcxParamProxyTimeout());
+    res = flagcxRemoteError;
+  } else if (__atomic_load_n(&proxyState->asyncResult, __ATOMIC_ACQUIRE) ==
+             flagcxSuccess) {
+    return;
+  }
+  if (res != flagcxSuccess) {
+    flagcxResult_t expected = flagcxSuccess;
+    __atomic_compare_exchange_n(&proxyState->asyncResult, &expected, res,
+                                false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(args->hlArgs, 1, __ATOMIC_RELAXED);
+  args->done = true;
+}
+
+// Advance the oldest op of every connection queued for a peer. The ops of
+// one connection complete in order, while communicators split from the same
+// parent each have their own connections to the peer and must not wait on
+// each other.
+static void flagcxProxyAdvanceQueue(
+    struct flagcxProxyState *proxyState,
+    struct flagcxIntruQueue<struct flagcxProxyOp, &flagcxProxyOp::next>
+        *queue) {
+  struct flagcxProxyOp *op = flagcxIntruQueueHead(queue);
+  while (op != NULL) {
+    struct flagcxProxyOp *next = op->next;
+    bool oldest = true;
+    for (struct flagcxProxyOp *prev = flagcxIntruQueueHead(queue);
+         prev != op && oldest; prev = prev->next) {
+      oldest = prev->connection != op->connection;
+    }
+    if (oldest) {
+      flagcxProxyAdvanceOp(proxyState, op);
+      if (op->args.done) {
+        flagcxIntruQueueDelete(queue, op);
+        free(op);
+      }
+    }
+    op = next;
+  }
+}
+
 inline void *flagcxProxyProgress(void *proxyState_) {
   struct flagcxProxyState *proxyState = (flagcxProxyState *)proxyState_;
   bool commplete = false;
@@ -174,31 +267,13 @@ inline void *flagcxProxyProgress(void *proxyState_) {
           struct flagcxProxyOps::consPeer *peer = proxyOps->consProgPeerHead;
           do {
             struct flagcxProxyOps::consPeer *next = peer->nextPeer;
-            struct flagcxIntruQueue<struct flagcxProxyOp, &flagcxProxyOp::next>
-                *queue;
-            queue = &peer->sendQueue;
-            if (!flagcxIntruQueueEmpty(queue)) {
+            if (!flagcxIntruQueueEmpty(&peer->sendQueue)) {
               commplete = false;
-              struct flagcxProxyOp *op = flagcxIntruQueueHead(queue);
-              struct sendNetResources *resources =
-                  (sendNetResources *)op->connection->transportResources;
-              flagcxProxySend(resources, op->recvbuff, op->nbytes, &op->args);
-              if (op->args.done) {
-                flagcxIntruQueueDelete(queue, op);
-                free(op);
-              }
+              flagcxProxyAdvanceQueue(proxyState, &peer->sendQueue);
             }
-            queue = &peer->recvQueue;
-            if (!flagcxIntruQueueEmpty(queue)) {
+            if (!flagcxIntruQueueEmpty(&peer->recvQueue)) {
               commplete = false;
-              struct flagcxProxyOp *op = flagcxIntruQueueHead(queue);
-              struct recvNetResources *resources =
-                  (recvNetResources *)op->connection->transportResources;
-              flagcxProxyRecv(resources, op->recvbuff, op->nbytes, &op->args);
-              if (op->args.done) {
-                flagcxIntruQueueDelete(queue, op);
-                free(op);
-              }
+              flagcxProxyAdvanceQueue(proxyState, &peer->recvQueue);
             }
             if (flagcxIntruQueueEmpty(&peer->sendQueue) &&
                 flagcxIntruQueueEmpty(&peer->recvQueue)) {
@@ -428,6 +503,11 @@ static flagcxResult_t proxyProgressAsync(flagcxProxyAsyncOp **opHead,
         FLAGCXCHECK(flagcxNetIb.regMr(
             resources->netSendComm, resources->buffers[0],
             resources->buffSizes[0], 2, &resources->mhandles[0]));
+        if (resources->eagerBuff)
+          FLAGCXCHECK(flagcxNetIb.regMr(
+              resources->netSendComm, resources->eagerBuff,
+              flagcxParamIbEagerThreshold(), FLAGCX_PTR_HOST,
+              &resources->eagerMhandle));
         done = 1;
       }
     } else {
@@ -440,6 +520,11 @@ static flagcxResult_t proxyProgressAsync(flagcxProxyAsyncOp **opHead,
         FLAGCXCHECK(flagcxNetIb.regMr(
             resources->netRecvComm, resources->buffers[0],
             resources->buffSizes[0], 2, &resources->mhandles[0]));
+        if (resources->eagerBuff)
+          FLAGCXCHECK(flagcxNetIb.regMr(
+              resources->netRecvComm, resources->eagerBuff,
+              flagcxParamIbEagerThreshold(), FLAGCX_PTR_HOST,
+              &resources->eagerMhandle));
         done = 1;
       }
     }
@@ -582,6 +667,27 @@ flagcxResult_t flagcxProxyInit(struct flagcxHeteroComm *comm) {
   pthread_create(&comm->proxyState->progressState.thread, NULL,
                  flagcxProxyProgress, comm->proxyState);
   comm->proxyState->initialized = 1;
+  FLAGCXCHECK(flagcxProxySetAffinity(comm));
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxProxySetAffinity(struct flagcxHeteroComm *comm) {
+  // The proxy usually starts before the topology is known, so its threads
+  // are moved next to the net once comm->cpuAffinity is set
+  if (!comm->proxyState->initialized || CPU_COUNT(&comm->cpuAffinity) == 0) {
+    return flagcxSuccess;
+  }
+  pthread_t threads[2] = {comm->proxyState->thread,
+                          comm->proxyState->progressState.thread};
+  for (int t = 0; t < 2; t++) {
+    int err = pthread_setaffinity_np(threads[t], sizeof(cpu_set_t),
+                                     &comm->cpuAffinity);
+    if (err != 0) {
+      WARN("Could not set the affinity of proxy thread %d: %s", t,
+           strerror(err));
+      return flagcxSystemError;
+    }
+  }
   return flagcxSuccess;
 }
 
@@ -42,7 +42,7 @@ struct flagcxProxySubArgs {
   int reg;
   // p2p mhandle
   void *mhandle;
-  int stepSize;
+  size_t stepSize;
   void *stepBuff;
   void *stream;
   // kernel copy
@@ -117,6 +117,10 @@ struct flagcxProxyArgs {
 
   /*for launch*/
   bool *volatile hlArgs;
+  // Sum of the step counters and the time it last changed, to detect ops
+  // that stopped progressing
+  int progressMark;
+  uint64_t progressTime;
 
   union flagcxProxyOpSpecifics specifics;
 };
@@ -372,6 +376,10 @@ flagcxResult_t flagcxProxyComputeP2p(struct flagcxInfo *info,
                                      struct flagcxProxyOp *proxyOp, int reg);
 flagcxResult_t flagcxProxyStart(struct flagcxHeteroComm *comm);
 flagcxResult_t flagcxProxyInit(struct flagcxHeteroComm *comm);
+// Release the net resources of the connections of comm
+flagcxResult_t flagcxProxyFree(struct flagcxHeteroComm *comm);
+// Pin the proxy threads to comm->cpuAffinity, if any
+flagcxResult_t flagcxProxySetAffinity(struct flagcxHeteroComm *comm);
 flagcxResult_t flagcxProxyCreate(struct flagcxHeteroComm *comm);
 flagcxResult_t flagcxProxyConnect(struct flagcxHeteroComm *comm, int transport,
                                   int send, int proxyRank,
@@ -0,0 +1,274 @@
+#include "bootstrap.h"
+#include "comm.h"
+#include "core.h"
+#include "net.h"
+#include "param.h"
+#include "topo.h"
+#include "utils.h"
+
+#include <vector>
+
+// Measure inter-server routes when no route file is given
+FLAGCX_PARAM(InterServerRouteProbe, "INTERSERVER_ROUTE_PROBE", 0);
+FLAGCX_PARAM(InterServerRouteProbeBytes, "INTERSERVER_ROUTE_PROBE_BYTES",
+             4 << 20);
+FLAGCX_PARAM(InterServerRouteProbeIters, "INTERSERVER_ROUTE_PROBE_ITERS", 8);
+
+#define FLAGCX_ROUTE_PROBE_TAG (-0x20001)
+#define FLAGCX_ROUTE_PROBE_PING_BYTES 8
+
+struct flagcxRouteProbeConn {
+  void *listenComm;
+  void *sendComm;
+  void *recvComm;
+  void *sendMhandle;
+  void *recvMhandle;
+};
+
+struct flagcxRouteProbeResult {
+  uint64_t localGuid;
+  uint64_t remoteGuid;
+  float bw;  // GB/s
+  float lat; // us
+};
+
+// Connect both directions with peer, the handles go through bootstrap
+static flagcxResult_t
+flagcxRouteProbeConnect(struct flagcxHeteroComm *comm, int dev, int peer,
+                        void *buff, size_t size,
+                        struct flagcxRouteProbeConn *conn) {
+  char handle[FLAGCX_NET_HANDLE_MAXSIZE] = {0};
+  char peerHandle[FLAGCX_NET_HANDLE_MAXSIZE];
+  FLAGCXCHECK(flagcxNetIb.listen(dev, handle, &conn->listenComm));
+  FLAGCXCHECK(bootstrapSend(comm->bootstrap, peer, FLAGCX_ROUTE_PROBE_TAG,
+                            handle, sizeof(handle)));
+  FLAGCXCHECK(bootstrapRecv(comm->bootstrap, peer, FLAGCX_ROUTE_PROBE_TAG,
+                            peerHandle, sizeof(peerHandle)));
+  while (conn->sendComm == NULL || conn->recvComm == NULL) {
+    if (conn->sendComm == NULL) {
+      FLAGCXCHECK(flagcxNetIb.connect(dev, peerHandle, &conn->sendComm, NULL));
+    }
+    if (conn->recvComm == NULL) {
+      FLAGCXCHECK(flagcxNetIb.accept(conn->listenComm, &conn->recvComm, NULL));
+    }
+  }
+  FLAGCXCHECK(flagcxNetIb.regMr(conn->sendComm, buff, size, FLAGCX_PTR_HOST,
+                                &conn->sendMhandle));
+  FLAGCXCHECK(flagcxNetIb.regMr(conn->recvComm, buff, size, FLAGCX_PTR_HOST,
+                                &conn->recvMhandle));
+  return flagcxSuccess;
+}
+
+static void flagcxRouteProbeClose(struct flagcxRouteProbeConn *conn) {
+  if (conn->sendMhandle)
+    flagcxNetIb.deregMr(conn->sendComm, conn->sendMhandle);
+  if (conn->recvMhandle)
+    flagcxNetIb.deregMr(conn->recvComm, conn->recvMhandle);
+  if (conn->sendComm)
+    flagcxNetIb.closeSend(conn->sendComm);
+  if (conn->recvComm)
+    flagcxNetIb.closeRecv(conn->recvComm);
+  if (conn->listenComm)
+    flagcxNetIb.closeListen(conn->listenComm);
+}
+
+static flagcxResult_t flagcxRouteProbeWait(void *request) {
+  int done = 0;
+  size_t size;
+  while (!done) {
+    FLAGCXCHECK(flagcxNetIb.test(request, &done, &size));
+  }
+  return flagcxSuccess;
+}
+
+static flagcxResult_t flagcxRouteProbeSend(struct flagcxRouteProbeConn *conn,
+                                           void *data, size_t size) {
+  void *request = NULL;
+  while (request == NULL) {
+    FLAGCXCHECK(flagcxNetIb.isend(conn->sendComm, data, size, 0,
+                                  conn->sendMhandle, &request));
+  }
+  return flagcxRouteProbeWait(request);
+}
+
+static flagcxResult_t flagcxRouteProbeRecv(struct flagcxRouteProbeConn *conn,
+                                           void *data, size_t size) {
+  void *request = NULL;
+  int tag = 0;
+  while (request == NULL) {
+    FLAGCXCHECK(flagcxNetIb.irecv(conn->recvComm, 1, &data, &size, &tag,
+                                  &conn->recvMhandle, &request));
+  }
+  return flagcxRouteProbeWait(request);
+}
+
+// Ping-pong small messages for the latency, then stream large messages from
+// the sender to the receiver for the bandwidth. Both sides must call this.
+static flagcxResult_t flagcxRouteProbePair(struct flagcxHeteroComm *comm,
+                                           int dev, int peer, bool sender,
+                                           char *buff, int bytes, int iters,
+                                           float *lat, float *bw) {
+  flagcxResult_t ret = flagcxSuccess;
+  struct flagcxRouteProbeConn conn = {};
+  int64_t start = 0;
+  double elapsed;
+  FLAGCXCHECKGOTO(flagcxRouteProbeConnect(comm, dev, peer, buff, bytes, &conn),
+                  ret, exit);
+
+  // the first round trip warms up the connection
+  for (int i = -1; i < iters; i++) {
+    if (i == 0)
+      start = clockNano();
+    if (sender) {
+      FLAGCXCHECKGOTO(
+          flagcxRouteProbeSend(&conn, buff, FLAGCX_ROUTE_PROBE_PING_BYTES),
+          ret, exit);
+      FLAGCXCHECKGOTO(
+          flagcxRouteProbeRecv(&conn, buff, FLAGCX_ROUTE_PROBE_PING_BYTES),
+          ret, exit);
+    } else {
+      FLAGCXCHECKGOTO(
+          flagcxRouteProbeRecv(&conn, buff, FLAGCX_ROUTE_PROBE_PING_BYTES),
+          ret, exit);
+      FLAGCXCHECKGOTO(
+          flagcxRouteProbeSend(&conn, buff, FLAGCX_ROUTE_PROBE_PING_BYTES),
+          ret, exit);
+    }
+  }
+  *lat = (clockNano() - start) / 1e3 / (2.0 * iters);
+
+  start = clockNano();
+  for (int i = 0; i < iters; i++) {
+    if (sender) {
+      FLAGCXCHECKGOTO(flagcxRouteProbeSend(&conn, buff, bytes), ret, exit);
+    } else {
+      FLAGCXCHECKGOTO(flagcxRouteProbeRecv(&conn, buff, bytes), ret, exit);
+    }
+  }
+  // the sender stops the clock once the receiver got everything
+  if (sender) {
+    FLAGCXCHECKGOTO(
+        flagcxRouteProbeRecv(&conn, buff, FLAGCX_ROUTE_PROBE_PING_BYTES), ret,
+        exit);
+  } else {
+    FLAGCXCHECKGOTO(
+        flagcxRouteProbeSend(&conn, buff, FLAGCX_ROUTE_PROBE_PING_BYTES), ret,
+        exit);
+  }
+  elapsed = (clockNano() - start) / 1e3 - *lat;
+  *bw = (double)bytes * iters / (1000.0 * std::max(elapsed, 1.0));
+
+exit:
+  flagcxRouteProbeClose(&conn);
+  return ret;
+}
+
+// Circle method: over n - 1 rounds every index meets every other index once,
+// and the pairs of a round are disjoint
+static int flagcxRouteProbePeer(int idx, int round, int n) {
+  if (idx == n - 1)
+    return round;
+  if (idx == round)
+    return n - 1;
+  return ((2 * round - idx) % (n - 1) + (n - 1)) % (n - 1);
+}
+
+flagcxResult_t flagcxGetInterServerRouteFromProbe(
+    struct flagcxHeteroComm *comm,
+    struct flagcxInterServerTopo *interServerTopo,
+    struct flagcxTopoServer *topoServer) {
+  int rank = comm->rank;
+  int nRanks = comm->nRanks;
+  int64_t startTime = clockNano();
+
+  struct flagcxTopoNode *net;
+  FLAGCXCHECK(flagcxTopoGetLocalNetNode(topoServer, rank, &net));
+  std::vector<uint64_t> guids(nRanks);
+  guids[rank] = net->net.guid;
+  FLAGCXCHECK(
+      bootstrapAllGather(comm->bootstrap, guids.data(), sizeof(uint64_t)));
+
+  // the lowest rank using a net probes on its behalf
+  std::vector<int> owners;
+  int myIdx = -1;
+  for (int r = 0; r < nRanks; r++) {
+    bool seen = false;
+    for (int o : owners) {
+      seen |= guids[o] == guids[r];
+    }
+    if (!seen) {
+      if (r == rank) {
+        myIdx = owners.size();
+      }
+      owners.push_back(r);
+    }
+  }
+  int nOwners = owners.size();
+
+  std::vector<struct flagcxRouteProbeResult> results;
+  if (myIdx >= 0) {
+    auto &netToServer = interServerTopo->netToServerMap;
+    int bytes = std::max<int64_t>(flagcxParamInterServerRouteProbeBytes(),
+                                  FLAGCX_ROUTE_PROBE_PING_BYTES);
+    int iters = std::max<int64_t>(flagcxParamInterServerRouteProbeIters(), 1);
+    char *buff;
+    FLAGCXCHECK(flagcxIbMalloc((void **)&buff, bytes));
+    // pairs of the same round probe concurrently
+    int n = nOwners + (nOwners & 1);
+    for (int round = 0; round < n - 1; round++) {
+      int peerIdx = flagcxRouteProbePeer(myIdx, round, n);
+      if (peerIdx >= nOwners) {
+        continue;
+      }
+      int peer = owners[peerIdx];
+      auto localServer = netToServer.find(guids[rank]);
+      auto remoteServer = netToServer.find(guids[peer]);
+      if (localServer == netToServer.end() ||
+          remoteServer == netToServer.end() ||
+          localServer->second == remoteServer->second) {
+        continue;
+      }
+      bool sender = rank < peer;
+      float lat, bw;
+      flagcxResult_t res = flagcxRouteProbePair(
+          comm, net->net.dev, peer, sender, buff, bytes, iters, &lat, &bw);
+      if (res != flagcxSuccess) {
+        free(buff);
+        return res;
+      }
+      if (sender) {
+        results.push_back({guids[rank], guids[peer], bw, lat});
+      }
+    }
+    free(buff);
+  }
+
+  // share the measurements with all ranks
+  std::vector<int> sizes(nRanks);
+  sizes[rank] = results.size() * sizeof(struct flagcxRouteProbeResult);
+  FLAGCXCHECK(bootstrapAllGather(comm->bootstrap, sizes.data(), sizeof(int)));
+  size_t offset = 0, total = 0;
+  for (int r = 0; r < nRanks; r++) {
+    offset += r < rank ? sizes[r] : 0;
+    total += sizes[r];
+  }
+  std::vector<struct flagcxRouteProbeResult> allResults(
+      total / sizeof(struct flagcxRouteProbeResult));
+  memcpy((char *)allResults.data() + offset, results.data(), sizes[rank]);
+  FLAGCXCHECK(bootstrapIntraNodeAllGatherV(comm->bootstrap, NULL, rank, nRanks,
+                                           allResults.data(), sizes.data()));
+  for (auto &result : allResults) {
+    FLAGCXCHECK(flagcxInterServerTopoAddRoute(
+        interServerTopo, topoServer, result.localGuid, result.remoteGuid,
+        result.bw, result.lat));
+  }
+  INFO(FLAGCX_INIT,
+       "INTERSERVER_ROUTE: probed %zu net pairs between %d nets in %.2f ms",
+       allResults.size(), nOwners, (clockNano() - startTime) / 1e6);
+
+  const char *dumpFile = flagcxGetEnv("FLAGCX_INTERSERVER_ROUTE_DUMP_FILE");
+  if (dumpFile && rank == 0) {
+    FLAGCXCHECK(flagcxDumpInterServerRouteToFile(dumpFile, interServerTopo));
+  }
+  return flagcxSuccess;
+}
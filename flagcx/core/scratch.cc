@@ -0,0 +1,90 @@
+#include "scratch.h"
+#include "adaptor.h"
+#include "align.h"
+#include "param.h"
+
+FLAGCX_PARAM(ScratchHighWaterMark, "SCRATCH_HIGH_WATER_MARK", 0);
+FLAGCX_PARAM(ScratchStreamOrdered, "SCRATCH_STREAM_ORDERED", 1);
+
+// Stream-ordered free is only safe on the stream the buffer was last used on;
+// otherwise fall back to a blocking free.
+static flagcxResult_t flagcxScratchArenaFree(struct flagcxScratchArena *arena,
+                                             flagcxStream_t stream) {
+  if (arena->buff == NULL) {
+    return flagcxSuccess;
+  }
+  if (arena->streamOrdered && stream != NULL && stream == arena->lastStream) {
+    FLAGCXCHECK(
+        deviceAdaptor->deviceFree(arena->buff, flagcxMemDevice, stream));
+  } else {
+    FLAGCXCHECK(deviceAdaptor->deviceFree(arena->buff, flagcxMemDevice, NULL));
+  }
+  INFO(FLAGCX_ALLOC, "Scratch arena freed %zu bytes", arena->size);
+  arena->buff = NULL;
+  arena->size = 0;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxScratchArenaInit(struct flagcxScratchArena *arena) {
+  arena->buff = NULL;
+  arena->size = 0;
+  arena->highWaterMark = flagcxParamScratchHighWaterMark();
+  arena->streamOrdered = flagcxParamScratchStreamOrdered();
+  arena->inUse = 0;
+  arena->lastStream = NULL;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxScratchArenaGet(struct flagcxScratchArena *arena,
+                                     size_t size, flagcxStream_t stream,
+                                     void **ptr) {
+  if (arena->inUse) {
+    WARN("Scratch arena is already in use");
+    return flagcxInvalidUsage;
+  }
+  if (size > arena->size) {
+    FLAGCXCHECK(flagcxScratchArenaFree(arena, stream));
+    size_t allocSize = ROUNDUP(size, FLAGCX_SCRATCH_ALIGN);
+    FLAGCXCHECK(deviceAdaptor->deviceMalloc(
+        &arena->buff, allocSize, flagcxMemDevice,
+        arena->streamOrdered ? stream : NULL));
+    arena->size = allocSize;
+    INFO(FLAGCX_ALLOC, "Scratch arena grown to %zu bytes", allocSize);
+  } else if (arena->lastStream != NULL && arena->lastStream != stream) {
+    // the previous user may still be working on the buffer
+    FLAGCXCHECK(deviceAdaptor->streamSynchronize(arena->lastStream));
+  }
+  arena->lastStream = stream;
+  arena->inUse = 1;
+  *ptr = arena->buff;
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxScratchArenaRelease(struct flagcxScratchArena *arena,
+                                         flagcxStream_t stream) {
+  arena->inUse = 0;
+  arena->lastStream = stream;
+  if (arena->highWaterMark > 0 && arena->size > arena->highWaterMark) {
+    FLAGCXCHECK(flagcxScratchArenaFree(arena, stream));
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxScratchArenaTrim(struct flagcxScratchArena *arena,
+                                      size_t maxSize) {
+  if (arena->inUse) {
+    WARN("Cannot trim scratch arena while it is in use");
+    return flagcxInvalidUsage;
+  }
+  if (arena->size > maxSize) {
+    FLAGCXCHECK(flagcxScratchArenaFree(arena, NULL));
+  }
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxScratchArenaDestroy(struct flagcxScratchArena *arena) {
+  arena->inUse = 0;
+  FLAGCXCHECK(flagcxScratchArenaFree(arena, NULL));
+  arena->lastStream = NULL;
+  return flagcxSuccess;
+}
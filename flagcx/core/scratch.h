@@ -0,0 +1,40 @@
+#ifndef FLAGCX_SCRATCH_H_
+#define FLAGCX_SCRATCH_H_
+
+#include "flagcx.h"
+
+// Granularity used when growing the scratch arena
+#define FLAGCX_SCRATCH_ALIGN (1UL << 20)
+
+// Per-communicator grow-only device scratch buffer. It replaces the
+// deviceMalloc/deviceFree pairs that used to be issued on every C2C
+// collective. The buffer is only released when it exceeds highWaterMark at
+// release time or when it is trimmed explicitly.
+struct flagcxScratchArena {
+  void *buff;
+  size_t size;
+  size_t highWaterMark; // 0: keep whatever has been allocated
+  int streamOrdered;    // 1: alloc/free on the user stream
+  int inUse;
+  flagcxStream_t lastStream; // stream of the last user of buff
+};
+
+flagcxResult_t flagcxScratchArenaInit(struct flagcxScratchArena *arena);
+
+// Return a device buffer of at least size bytes, growing the arena if needed
+flagcxResult_t flagcxScratchArenaGet(struct flagcxScratchArena *arena,
+                                     size_t size, flagcxStream_t stream,
+                                     void **ptr);
+
+// Mark the buffer returned by flagcxScratchArenaGet as free again and shrink
+// the arena if it grew beyond its high-water mark
+flagcxResult_t flagcxScratchArenaRelease(struct flagcxScratchArena *arena,
+                                         flagcxStream_t stream);
+
+// Free the backing buffer if it is larger than maxSize bytes
+flagcxResult_t flagcxScratchArenaTrim(struct flagcxScratchArena *arena,
+                                      size_t maxSize);
+
+flagcxResult_t flagcxScratchArenaDestroy(struct flagcxScratchArena *arena);
+
+#endif // end include guard
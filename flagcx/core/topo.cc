@@ -16,7 +16,12 @@
 #include "xml.h"
 #include <fcntl.h>
 #include <fstream>
+#include <atomic>
 #include <map>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #define BUSID_SIZE (sizeof("0000:00:00.0"))
 #define BUSID_REDUCED_SIZE (sizeof("0000:00"))
@@ -544,6 +549,95 @@ flagcxResult_t flagcxGetLocalNetFromGpu(int apu, int *dev,
   return flagcxSuccess;
 }
 
+FLAGCX_PARAM(NetRailBalance, "NET_RAIL_BALANCE", 1);
+
+// Bandwidth between two nets, from the measured or configured route when
+// there is one, otherwise bounded by the slower nic
+static float flagcxTopoNetPairBw(struct flagcxInterServerTopo *interServer,
+                                 struct flagcxTopoNode *sendNet,
+                                 struct flagcxTopoNode *recvNet) {
+  float bw = std::min(sendNet->net.bw, recvNet->net.bw);
+  auto localIt = interServer->routeMap.find(sendNet->net.guid);
+  if (localIt == interServer->routeMap.end()) {
+    return bw;
+  }
+  auto remoteIt = localIt->second.find(recvNet->net.guid);
+  if (remoteIt == localIt->second.end() || remoteIt->second == NULL) {
+    return bw;
+  }
+  return remoteIt->second->interBw;
+}
+
+flagcxResult_t flagcxTopoGetP2pNet(struct flagcxHeteroComm *comm, int peer,
+                                   int isSend, int *netDev) {
+  *netDev = comm->netDev;
+  if (comm->topoServer == NULL || comm->interServerTopo == NULL ||
+      !flagcxParamNetRailBalance()) {
+    return flagcxSuccess;
+  }
+  int myRank = flagcxTopParentRank(comm, comm->rank);
+  int peerRank = flagcxTopParentRank(comm, peer);
+  int sendRank = isSend ? myRank : peerRank;
+  int recvRank = isSend ? peerRank : myRank;
+  struct flagcxTopoServer *sendServer, *recvServer;
+  int sendApu, recvApu;
+  if (flagcxTopoGetServerFromRank(sendRank, comm->interServerTopo,
+                                  comm->topoServer, &sendServer) !=
+          flagcxSuccess ||
+      flagcxTopoGetServerFromRank(recvRank, comm->interServerTopo,
+                                  comm->topoServer, &recvServer) !=
+          flagcxSuccess ||
+      flagcxTopoRankToIndex(sendServer, sendRank, &sendApu) != flagcxSuccess ||
+      flagcxTopoRankToIndex(recvServer, recvRank, &recvApu) != flagcxSuccess) {
+    return flagcxSuccess;
+  }
+
+  // Both ends evaluate the same (sender, receiver) pair on the same data, so
+  // they agree on the nets without exchanging anything. A pair is limited by
+  // the path from each apu to its net and by the route between the nets.
+  struct flagcxTopoPath *sendPaths =
+      sendServer->nodes[APU].nodes[sendApu].paths[NET];
+  struct flagcxTopoPath *recvPaths =
+      recvServer->nodes[APU].nodes[recvApu].paths[NET];
+  std::vector<std::pair<int, int>> best;
+  float bestBw = 0;
+  for (int s = 0; s < sendServer->nodes[NET].count; s++) {
+    if (sendPaths[s].type == PATH_DIS) {
+      continue;
+    }
+    for (int r = 0; r < recvServer->nodes[NET].count; r++) {
+      if (recvPaths[r].type == PATH_DIS) {
+        continue;
+      }
+      float bw = std::min(sendPaths[s].bw, recvPaths[r].bw);
+      bw = std::min(bw, flagcxTopoNetPairBw(comm->interServerTopo,
+                                            sendServer->nodes[NET].nodes + s,
+                                            recvServer->nodes[NET].nodes + r));
+      if (bw > bestBw) {
+        bestBw = bw;
+        best.clear();
+      }
+      if (bw == bestBw && bw > 0) {
+        best.emplace_back(s, r);
+      }
+    }
+  }
+  if (best.empty()) {
+    return flagcxSuccess;
+  }
+  // Spread the peers of a rank over the rails that are equally good
+  std::pair<int, int> pick = best[(sendRank + recvRank) % best.size()];
+  *netDev = isSend ? sendServer->nodes[NET].nodes[pick.first].net.dev
+                   : recvServer->nodes[NET].nodes[pick.second].net.dev;
+  INFO(FLAGCX_GRAPH,
+       "P2P net for rank %d -> rank %d: net %lx -> net %lx, bw %f GB/s, "
+       "%zu equal rails, local dev %d",
+       sendRank, recvRank, sendServer->nodes[NET].nodes[pick.first].net.guid,
+       recvServer->nodes[NET].nodes[pick.second].net.guid, bestBw, best.size(),
+       *netDev);
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxGetNicDistance(struct flagcxTopoServer *topoServer,
                                     int rank,
                                     struct flagcxNicDistance *distInfo) {
@@ -563,6 +657,54 @@ flagcxResult_t flagcxGetNicDistance(struct flagcxTopoServer *topoServer,
   return flagcxInternalError;
 }
 
+FLAGCX_PARAM(IgnoreCpuAffinity, "IGNORE_CPU_AFFINITY", 0);
+
+flagcxResult_t flagcxTopoGetCpuAffinity(struct flagcxTopoServer *topoServer,
+                                        int netDev, cpu_set_t *affinity) {
+  CPU_ZERO_S(sizeof(cpu_set_t), affinity);
+  if (topoServer == NULL) {
+    return flagcxSuccess;
+  }
+  struct flagcxTopoNode *net = NULL;
+  for (int n = 0; n < topoServer->nodes[NET].count; n++) {
+    if (topoServer->nodes[NET].nodes[n].net.dev == netDev) {
+      net = topoServer->nodes[NET].nodes + n;
+      break;
+    }
+  }
+  if (net == NULL || net->paths[CPU] == NULL) {
+    return flagcxSuccess;
+  }
+  // Closest NUMA domain to the net, the first one wins ties
+  int cpu = -1;
+  for (int c = 0; c < topoServer->nodes[CPU].count; c++) {
+    if (cpu == -1 || net->paths[CPU][c].type < net->paths[CPU][cpu].type) {
+      cpu = c;
+    }
+  }
+  if (cpu == -1) {
+    return flagcxSuccess;
+  }
+
+  // Stay within the cpuset of the process unless told otherwise
+  cpu_set_t mask;
+  SYSCHECK(sched_getaffinity(0, sizeof(cpu_set_t), &mask),
+           "sched_getaffinity");
+  cpu_set_t cpuMask = topoServer->nodes[CPU].nodes[cpu].cpu.affinity;
+  if (flagcxParamIgnoreCpuAffinity()) {
+    *affinity = cpuMask;
+  } else {
+    CPU_AND(affinity, &mask, &cpuMask);
+  }
+  if (CPU_COUNT(affinity)) {
+    char affinityStr[sizeof(cpu_set_t) * 2];
+    FLAGCXCHECK(flagcxCpusetToStr(affinity, affinityStr));
+    INFO(FLAGCX_INIT, "Setting affinity for net %d to %s", netDev,
+         affinityStr);
+  }
+  return flagcxSuccess;
+}
+
 /****************************/
 /* External query functions */
 /****************************/
@@ -575,8 +717,6 @@ flagcxResult_t flagcxGetNicDistance(struct flagcxTopoServer *topoServer,
 //   return flagcxSuccess;
 // }
 
-// FLAGCX_PARAM(IgnoreCpuAffinity, "IGNORE_CPU_AFFINITY", 0);
-
 // flagcxResult_t flagcxTopoGetGpuCount(struct flagcxTopoServer* system, int*
 // count) {
 //   *count = system->nodes[GPU].count;
@@ -1055,220 +1195,447 @@ flagcxResult_t flagcxTopoPrint(struct flagcxTopoServer *topoServer) {
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxTopoGetServerTopo(struct flagcxHeteroComm *comm,
-                                       struct flagcxTopoServer **topoServer) {
-  // TODO: first try to acquire topo from xml file
-  struct flagcxXml *xml;
-  INFO(FLAGCX_INIT, "allocing flagcxXml");
-  FLAGCXCHECK(xmlAlloc(&xml, FLAGCX_TOPO_XML_MAX_NODES));
+// Compact topology encoding
+//
+// Only the populated nodes and links are written. Integers are LEB128 varints
+// (zigzag encoded when they may be negative), floats are written as their 4
+// raw bytes. A link refers to its remote node by (type, index in the node
+// set), node ids are stored without their server id. A CPU affinity is
+// written as its number of 64-bit words up to the last non empty one, then
+// the words.
+#define FLAGCX_TOPO_BLOB_VERSION 2
+#define FLAGCX_TOPO_BLOB_CPUSET_WORDS (CPU_SETSIZE / 64)
+
+static void topoBlobPutU64(std::vector<uint8_t> &blob, uint64_t v) {
+  while (v >= 0x80) {
+    blob.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  blob.push_back((uint8_t)v);
+}
 
-  FLAGCXCHECK(flagcxTopoGetXmlTopo(comm, xml));
-  INFO(FLAGCX_INIT, "start converting xml to serverTopo");
-  uint64_t localHostHash = comm->peerInfo[comm->rank].hostHash -
-                           comm->commHash; // do not consider commHash here
-  FLAGCXCHECK(flagcxTopoGetServerTopoFromXml(xml, topoServer, localHostHash));
+static void topoBlobPutInt(std::vector<uint8_t> &blob, int64_t v) {
+  topoBlobPutU64(blob, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
 
-  free(xml);
-  return flagcxSuccess;
+static void topoBlobPutFloat(std::vector<uint8_t> &blob, float v) {
+  uint32_t u;
+  memcpy(&u, &v, sizeof(u));
+  for (int i = 0; i < 4; i++) {
+    blob.push_back((uint8_t)(u >> (8 * i)));
+  }
 }
 
-static flagcxResult_t flattenLink(struct flagcxTopoServer *topoServer,
-                                  struct flagcxTopoLink *link,
-                                  struct flatTopoLink *flatLink) {
-  flatLink->type = link->type;
-  flatLink->bw = link->bw;
-  flagcxTopoNode *remNode = link->remNode;
-  int remNodeIdx;
-  FLAGCXCHECK(
-      flagcxTopoIdToIndex(topoServer, remNode->type, remNode->id, &remNodeIdx));
-  flatLink->remNodeIdx = remNodeIdx;
-  flatLink->remNodeType = remNode->type;
-  return flagcxSuccess;
+static void topoBlobPutCpuset(std::vector<uint8_t> &blob, cpu_set_t *set) {
+  uint64_t words[FLAGCX_TOPO_BLOB_CPUSET_WORDS] = {0};
+  int nWords = 0;
+  for (int c = 0; c < CPU_SETSIZE; c++) {
+    if (CPU_ISSET(c, set)) {
+      words[c / 64] |= 1ULL << (c % 64);
+      nWords = c / 64 + 1;
+    }
+  }
+  topoBlobPutU64(blob, nWords);
+  for (int w = 0; w < nWords; w++) {
+    topoBlobPutU64(blob, words[w]);
+  }
 }
 
-static flagcxResult_t unflattenLink(struct flagcxTopoServer *topoServer,
-                                    struct flagcxTopoLink *link,
-                                    struct flatTopoLink *flatLink) {
-  link->type = flatLink->type;
-  link->bw = flatLink->bw;
-  int remNodeIdx = flatLink->remNodeIdx;
-  int remNodeType = flatLink->remNodeType;
-  flagcxTopoNode *remNode = &(topoServer->nodes[remNodeType].nodes[remNodeIdx]);
-  link->remNode = remNode;
+struct topoBlobReader {
+  const uint8_t *ptr;
+  const uint8_t *end;
+};
+
+static flagcxResult_t topoBlobGetU64(struct topoBlobReader *r, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (r->ptr == r->end) {
+      WARN("Topology blob is truncated");
+      return flagcxInternalError;
+    }
+    uint8_t byte = *r->ptr++;
+    *v |= (uint64_t)(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return flagcxSuccess;
+    }
+  }
+  WARN("Topology blob holds a malformed varint");
+  return flagcxInternalError;
+}
+
+static flagcxResult_t topoBlobGetInt(struct topoBlobReader *r, int *v) {
+  uint64_t u;
+  FLAGCXCHECK(topoBlobGetU64(r, &u));
+  *v = (int)(int64_t)((u >> 1) ^ (~(u & 1) + 1));
   return flagcxSuccess;
 }
 
-static flagcxResult_t flattenNode(struct flagcxTopoServer *topoServer,
-                                  struct flagcxTopoNode *node,
-                                  struct flatTopoNode *flatNode) {
-  flatNode->type = node->type;
-  flatNode->id = node->id;
-  flatNode->nlinks = node->nlinks;
-  if (node->type == APU) {
-    flatNode->apu.dev = node->apu.dev;
-    flatNode->apu.rank = node->apu.rank;
-    flatNode->apu.vendor = node->apu.vendor;
-  } else if (node->type == CPU) {
-    flatNode->cpu.arch = node->cpu.arch;
-    flatNode->cpu.vendor = node->cpu.vendor;
-    flatNode->cpu.model = node->cpu.model;
-  } else if (node->type == PCI) {
-    flatNode->pci.device = node->pci.device;
-  } else if (node->type == NET) {
-    flatNode->net.dev = node->net.dev;
-    // flatNode->net.asic = node->net.asic;
-    flatNode->net.guid = node->net.guid;
-    flatNode->net.port = node->net.port;
-    flatNode->net.bw = node->net.bw;
-    flatNode->net.latency = node->net.latency;
-    flatNode->net.maxConn = node->net.maxConn;
+static flagcxResult_t topoBlobGetFloat(struct topoBlobReader *r, float *v) {
+  if (r->end - r->ptr < 4) {
+    WARN("Topology blob is truncated");
+    return flagcxInternalError;
+  }
+  uint32_t u = 0;
+  for (int i = 0; i < 4; i++) {
+    u |= (uint32_t)(*r->ptr++) << (8 * i);
   }
+  memcpy(v, &u, sizeof(u));
   return flagcxSuccess;
 }
 
-static flagcxResult_t unflattenNode(struct flagcxTopoServer *topoServer,
-                                    struct flagcxTopoNode *node,
-                                    struct flatTopoNode *flatNode) {
-  node->type = flatNode->type;
-  node->id = flatNode->id;
-  node->nlinks = flatNode->nlinks;
-  if (node->type == APU) {
-    node->apu.dev = flatNode->apu.dev;
-    node->apu.rank = flatNode->apu.rank;
-    node->apu.vendor = flatNode->apu.vendor;
-  } else if (node->type == CPU) {
-    node->cpu.arch = flatNode->cpu.arch;
-    node->cpu.vendor = flatNode->cpu.vendor;
-    node->cpu.model = flatNode->cpu.model;
-  } else if (node->type == PCI) {
-    node->pci.device = flatNode->pci.device;
-  } else if (node->type == NET) {
-    node->net.dev = flatNode->net.dev;
-    node->net.guid = flatNode->net.guid;
-    node->net.port = flatNode->net.port;
-    node->net.bw = flatNode->net.bw;
-    node->net.latency = flatNode->net.latency;
-    node->net.maxConn = flatNode->net.maxConn;
+static flagcxResult_t topoBlobGetCount(struct topoBlobReader *r, int *v,
+                                       int max) {
+  uint64_t u;
+  FLAGCXCHECK(topoBlobGetU64(r, &u));
+  if (u > (uint64_t)max) {
+    WARN("Topology blob holds %lu entries, at most %d are supported", u, max);
+    return flagcxInternalError;
   }
+  *v = (int)u;
   return flagcxSuccess;
 }
 
-static flagcxResult_t flattenNodeSet(struct flagcxTopoServer *topoServer,
-                                     struct flagcxTopoNodeSet *nodeSet,
-                                     struct flatTopoNodeSet *flatNodeSet) {
-  flatNodeSet->count = nodeSet->count;
-  for (int n = 0; n < flatNodeSet->count; n++) {
-    FLAGCXCHECK(
-        flattenNode(topoServer, &nodeSet->nodes[n], &flatNodeSet->nodes[n]));
+static flagcxResult_t topoBlobGetCpuset(struct topoBlobReader *r,
+                                        cpu_set_t *set) {
+  int nWords;
+  FLAGCXCHECK(topoBlobGetCount(r, &nWords, FLAGCX_TOPO_BLOB_CPUSET_WORDS));
+  CPU_ZERO(set);
+  for (int w = 0; w < nWords; w++) {
+    uint64_t word;
+    FLAGCXCHECK(topoBlobGetU64(r, &word));
+    for (int b = 0; b < 64; b++) {
+      if (word & (1ULL << b)) {
+        CPU_SET(w * 64 + b, set);
+      }
+    }
   }
   return flagcxSuccess;
 }
 
-static flagcxResult_t unflattenNodeSet(struct flagcxTopoServer *topoServer,
-                                       struct flagcxTopoNodeSet *nodeSet,
-                                       struct flatTopoNodeSet *flatNodeSet) {
-  nodeSet->count = flatNodeSet->count;
-  for (int n = 0; n < nodeSet->count; n++) {
-    FLAGCXCHECK(
-        unflattenNode(topoServer, &nodeSet->nodes[n], &flatNodeSet->nodes[n]));
+flagcxResult_t flagcxTopoServerEncode(struct flagcxTopoServer *topoServer,
+                                      std::vector<uint8_t> &blob) {
+  blob.clear();
+  topoBlobPutU64(blob, FLAGCX_TOPO_BLOB_VERSION);
+  topoBlobPutU64(blob, topoServer->hostHashes[topoServer->serverId]);
+  for (int t = 0; t < FLAGCX_TOPO_NODE_TYPES; t++) {
+    struct flagcxTopoNodeSet *nodeSet = &topoServer->nodes[t];
+    topoBlobPutU64(blob, nodeSet->count);
+    for (int n = 0; n < nodeSet->count; n++) {
+      struct flagcxTopoNode *node = &nodeSet->nodes[n];
+      topoBlobPutU64(blob, FLAGCX_TOPO_ID_LOCAL_ID(node->id));
+      if (t == APU) {
+        topoBlobPutInt(blob, node->apu.dev);
+        topoBlobPutInt(blob, node->apu.rank);
+        topoBlobPutInt(blob, node->apu.vendor);
+        topoBlobPutInt(blob, node->apu.gdrSupport);
+      } else if (t == CPU) {
+        topoBlobPutInt(blob, node->cpu.arch);
+        topoBlobPutInt(blob, node->cpu.vendor);
+        topoBlobPutInt(blob, node->cpu.model);
+        topoBlobPutCpuset(blob, &node->cpu.affinity);
+      } else if (t == PCI) {
+        topoBlobPutU64(blob, node->pci.device);
+      } else if (t == NET) {
+        topoBlobPutInt(blob, node->net.dev);
+        topoBlobPutU64(blob, node->net.guid);
+        topoBlobPutInt(blob, node->net.port);
+        topoBlobPutInt(blob, node->net.ip);
+        topoBlobPutFloat(blob, node->net.bw);
+        topoBlobPutFloat(blob, node->net.latency);
+        topoBlobPutInt(blob, node->net.gdrSupport);
+        topoBlobPutInt(blob, node->net.maxConn);
+      }
+      topoBlobPutU64(blob, node->nlinks);
+      for (int l = 0; l < node->nlinks; l++) {
+        struct flagcxTopoLink *link = &node->links[l];
+        struct flagcxTopoNode *remNode = link->remNode;
+        topoBlobPutInt(blob, link->type);
+        topoBlobPutFloat(blob, link->bw);
+        topoBlobPutU64(blob, remNode->type);
+        topoBlobPutU64(blob, remNode - topoServer->nodes[remNode->type].nodes);
+      }
+    }
   }
   return flagcxSuccess;
 }
 
-static flagcxResult_t flattenTopoServer(struct flagcxTopoServer *topoServer,
-                                        struct flatTopoServer *flatTopo) {
-  flatTopo->serverId = topoServer->serverId;
-  INFO(FLAGCX_GRAPH, "FLATTEN_SERVER: serverId = [%d]", flatTopo->serverId);
-  flatTopo->nHosts = topoServer->nHosts;
-  INFO(FLAGCX_GRAPH, "FLATTEN_SERVER: nHosts = [%d]", flatTopo->nHosts);
-  for (int h = 0; h < topoServer->nHosts; h++) {
-    flatTopo->hostHashes[h] = topoServer->hostHashes[h];
+flagcxResult_t flagcxTopoServerDecode(const uint8_t *blob, size_t size,
+                                      struct flagcxTopoServer *topoServer,
+                                      uint64_t *hostHash) {
+  struct topoBlobReader r = {blob, blob + size};
+  uint64_t u;
+  FLAGCXCHECK(topoBlobGetU64(&r, &u));
+  if (u != FLAGCX_TOPO_BLOB_VERSION) {
+    WARN("Topology blob version %lu, expected %d", u,
+         FLAGCX_TOPO_BLOB_VERSION);
+    return flagcxInternalError;
   }
-
-  // flatten node set
+  FLAGCXCHECK(topoBlobGetU64(&r, hostHash));
+  // read all nodes first, links may point to nodes of any type so their
+  // remote (type, index) pairs are only resolved once every count is known
+  std::vector<std::pair<int, int>> remRefs;
   for (int t = 0; t < FLAGCX_TOPO_NODE_TYPES; t++) {
-    INFO(FLAGCX_GRAPH, "FLATTEN_SERVER: start flattening node set of type [%d]",
-         t);
-    FLAGCXCHECK(
-        flattenNodeSet(topoServer, &topoServer->nodes[t], &flatTopo->nodes[t]));
+    struct flagcxTopoNodeSet *nodeSet = &topoServer->nodes[t];
+    FLAGCXCHECK(topoBlobGetCount(&r, &nodeSet->count, FLAGCX_TOPO_MAX_NODES));
+    for (int n = 0; n < nodeSet->count; n++) {
+      struct flagcxTopoNode *node = &nodeSet->nodes[n];
+      node->type = t;
+      FLAGCXCHECK(topoBlobGetU64(&r, &u));
+      node->id = u;
+      if (t == APU) {
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->apu.dev));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->apu.rank));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->apu.vendor));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->apu.gdrSupport));
+      } else if (t == CPU) {
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->cpu.arch));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->cpu.vendor));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->cpu.model));
+        FLAGCXCHECK(topoBlobGetCpuset(&r, &node->cpu.affinity));
+      } else if (t == PCI) {
+        FLAGCXCHECK(topoBlobGetU64(&r, &node->pci.device));
+      } else if (t == NET) {
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->net.dev));
+        FLAGCXCHECK(topoBlobGetU64(&r, &node->net.guid));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->net.port));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->net.ip));
+        FLAGCXCHECK(topoBlobGetFloat(&r, &node->net.bw));
+        FLAGCXCHECK(topoBlobGetFloat(&r, &node->net.latency));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->net.gdrSupport));
+        FLAGCXCHECK(topoBlobGetInt(&r, &node->net.maxConn));
+      }
+      FLAGCXCHECK(
+          topoBlobGetCount(&r, &node->nlinks, FLAGCX_TOPO_MAX_LINKS));
+      for (int l = 0; l < node->nlinks; l++) {
+        struct flagcxTopoLink *link = &node->links[l];
+        int remType, remIdx;
+        FLAGCXCHECK(topoBlobGetInt(&r, &link->type));
+        FLAGCXCHECK(topoBlobGetFloat(&r, &link->bw));
+        FLAGCXCHECK(
+            topoBlobGetCount(&r, &remType, FLAGCX_TOPO_NODE_TYPES - 1));
+        FLAGCXCHECK(topoBlobGetCount(&r, &remIdx, FLAGCX_TOPO_MAX_NODES - 1));
+        remRefs.push_back(std::make_pair(remType, remIdx));
+      }
+    }
   }
-  // need to flatten all nodes first before flattening links
+  if (r.ptr != r.end) {
+    WARN("Topology blob has %ld trailing bytes", (long)(r.end - r.ptr));
+    return flagcxInternalError;
+  }
+  size_t ref = 0;
   for (int t = 0; t < FLAGCX_TOPO_NODE_TYPES; t++) {
     for (int n = 0; n < topoServer->nodes[t].count; n++) {
-      for (int l = 0; l < topoServer->nodes[t].nodes[n].nlinks; l++) {
-        struct flagcxTopoLink *link = &topoServer->nodes[t].nodes[n].links[l];
-        struct flatTopoLink *flatLink = &flatTopo->nodes[t].nodes[n].links[l];
-        FLAGCXCHECK(flattenLink(topoServer, link, flatLink));
+      struct flagcxTopoNode *node = &topoServer->nodes[t].nodes[n];
+      for (int l = 0; l < node->nlinks; l++, ref++) {
+        int remType = remRefs[ref].first;
+        int remIdx = remRefs[ref].second;
+        if (remIdx >= topoServer->nodes[remType].count) {
+          WARN("Topology blob links to missing %s node %d",
+               topoNodeTypeStr[remType], remIdx);
+          return flagcxInternalError;
+        }
+        node->links[l].remNode = &topoServer->nodes[remType].nodes[remIdx];
       }
     }
   }
   return flagcxSuccess;
 }
 
-static flagcxResult_t unflattenTopoServer(struct flagcxTopoServer *topoServer,
-                                          struct flatTopoServer *flatTopo) {
-  topoServer->serverId = flatTopo->serverId;
-  topoServer->nHosts = flatTopo->nHosts;
-  INFO(FLAGCX_GRAPH, "UNFLATTEN_SERVER: assigning host hashes");
-  for (int h = 0; h < topoServer->nHosts; h++) {
-    topoServer->hostHashes[h] = flatTopo->hostHashes[h];
+// On-disk topology cache
+//
+// Discovering the server topology walks sysfs for every APU and NIC. When
+// FLAGCX_TOPO_CACHE_DIR is set, the topology is stored there as an encoded
+// blob keyed by a fingerprint of the local hardware, and later inits map the
+// file and decode it instead of rebuilding the xml.
+#define FLAGCX_TOPO_CACHE_MAGIC 0x464c4147544f504fULL // "FLAGTOPO"
+
+struct flagcxTopoCacheHeader {
+  uint64_t magic;
+  uint64_t fingerprint;
+  uint64_t blobHash;
+  uint32_t version;
+  uint32_t blobSize;
+};
+
+// The fingerprint covers the kernel boot id, the bus ids of the local ranks
+// and the properties of every NIC, so a reboot or any hardware change picks a
+// different cache file
+static flagcxResult_t flagcxTopoCacheFingerprint(struct flagcxHeteroComm *comm,
+                                                 uint64_t *fingerprint) {
+  std::string desc;
+  char buf[PATH_MAX + 64];
+  snprintf(buf, sizeof(buf), "v%d;", FLAGCX_TOPO_BLOB_VERSION);
+  desc += buf;
+  FILE *file = fopen("/proc/sys/kernel/random/boot_id", "r");
+  if (file != NULL) {
+    if (fgets(buf, sizeof(buf), file) != NULL) {
+      desc += buf;
+    }
+    fclose(file);
+  }
+  std::vector<int64_t> busIds;
+  for (int r = 0; r < comm->nRanks; r++) {
+    if (comm->peerInfo[r].hostHash == comm->peerInfo[comm->rank].hostHash) {
+      busIds.push_back(comm->peerInfo[r].busId);
+    }
   }
+  std::sort(busIds.begin(), busIds.end());
+  busIds.erase(std::unique(busIds.begin(), busIds.end()), busIds.end());
+  for (auto busId : busIds) {
+    snprintf(buf, sizeof(buf), "a%lx;", busId);
+    desc += buf;
+  }
+  int netDevCount = 0;
+  FLAGCXCHECK(flagcxNetIb.devices(&netDevCount));
+  for (int n = 0; n < netDevCount; n++) {
+    flagcxNetProperties_t props;
+    FLAGCXCHECK(flagcxNetIb.getProperties(n, &props));
+    snprintf(buf, sizeof(buf), "n%lx/%d/%d/%s;", props.guid, props.port,
+             props.speed, props.pciPath ? props.pciPath : "");
+    desc += buf;
+  }
+  *fingerprint = getHash(desc.c_str(), desc.size());
+  return flagcxSuccess;
+}
 
-  // unflatten node set
-  INFO(FLAGCX_GRAPH, "UNFLATTEN_SERVER: start unflattening node set");
-  for (int t = 0; t < FLAGCX_TOPO_NODE_TYPES; t++) {
-    FLAGCXCHECK(unflattenNodeSet(topoServer, &topoServer->nodes[t],
-                                 &flatTopo->nodes[t]));
+static void flagcxTopoCachePath(const char *dir, uint64_t fingerprint,
+                                char *path, size_t len) {
+  snprintf(path, len, "%s/flagcx_topo_%016lx.bin", dir, fingerprint);
+}
+
+flagcxResult_t flagcxTopoCacheLoad(const char *path, uint64_t fingerprint,
+                                   struct flagcxTopoServer *topoServer) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return flagcxInternalError;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      st.st_size >= (off_t)sizeof(struct flagcxTopoCacheHeader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return flagcxInternalError;
+  }
+  flagcxResult_t ret = flagcxInternalError;
+  const struct flagcxTopoCacheHeader *header =
+      (const struct flagcxTopoCacheHeader *)map;
+  const uint8_t *blob = (const uint8_t *)(header + 1);
+  uint64_t hostHash;
+  if (header->magic == FLAGCX_TOPO_CACHE_MAGIC &&
+      header->version == FLAGCX_TOPO_BLOB_VERSION &&
+      header->fingerprint == fingerprint &&
+      sizeof(*header) + header->blobSize == (size_t)st.st_size &&
+      getHash((const char *)blob, header->blobSize) == header->blobHash) {
+    ret = flagcxTopoServerDecode(blob, header->blobSize, topoServer, &hostHash);
+  }
+  munmap(map, st.st_size);
+  if (ret != flagcxSuccess) {
+    WARN("Ignoring invalid topology cache %s", path);
+    return ret;
   }
+  topoServer->serverId = 0;
+  topoServer->nHosts = 1;
+  topoServer->hostHashes[0] = hostHash;
+  return flagcxSuccess;
+}
 
-  // need to unflatten all nodes first before flattening links
-  INFO(FLAGCX_GRAPH, "UNFLATTEN_SERVER: start unflattening links");
-  for (int t = 0; t < FLAGCX_TOPO_NODE_TYPES; t++) {
-    for (int n = 0; n < flatTopo->nodes[t].count; n++) {
-      for (int l = 0; l < flatTopo->nodes[t].nodes[n].nlinks; l++) {
-        struct flagcxTopoLink *link = &topoServer->nodes[t].nodes[n].links[l];
-        struct flatTopoLink *flatLink = &flatTopo->nodes[t].nodes[n].links[l];
-        FLAGCXCHECK(unflattenLink(topoServer, link, flatLink));
+// Write to a private file first so that concurrent ranks never observe a
+// partial cache
+flagcxResult_t flagcxTopoCacheSave(const char *path, uint64_t fingerprint,
+                                   struct flagcxTopoServer *topoServer) {
+  std::vector<uint8_t> blob;
+  FLAGCXCHECK(flagcxTopoServerEncode(topoServer, blob));
+  struct flagcxTopoCacheHeader header;
+  header.magic = FLAGCX_TOPO_CACHE_MAGIC;
+  header.fingerprint = fingerprint;
+  header.blobHash = getHash((const char *)blob.data(), blob.size());
+  header.version = FLAGCX_TOPO_BLOB_VERSION;
+  header.blobSize = blob.size();
+
+  char tmpPath[PATH_MAX + 32];
+  snprintf(tmpPath, sizeof(tmpPath), "%s.tmp.%d", path, getpid());
+  FILE *file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    WARN("Unable to write topology cache %s", tmpPath);
+    return flagcxSystemError;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(blob.data(), 1, blob.size(), file) == blob.size();
+  ok &= fclose(file) == 0;
+  if (!ok || rename(tmpPath, path) != 0) {
+    WARN("Unable to write topology cache %s", path);
+    unlink(tmpPath);
+    return flagcxSystemError;
+  }
+  return flagcxSuccess;
+}
+
+// Rank and device index of an APU are not hardware properties, refresh them
+// for the current communicator after loading a cached topology
+static flagcxResult_t flagcxTopoCacheSetApuRanks(struct flagcxHeteroComm *comm,
+                                                 struct flagcxTopoServer *s) {
+  for (int n = 0; n < s->nodes[APU].count; n++) {
+    struct flagcxTopoNode *apu = &s->nodes[APU].nodes[n];
+    int64_t busId = FLAGCX_TOPO_ID_LOCAL_ID(apu->id);
+    for (int r = 0; r < comm->nRanks; r++) {
+      if (comm->peerInfo[r].hostHash == comm->peerInfo[comm->rank].hostHash &&
+          comm->peerInfo[r].busId == busId) {
+        apu->apu.rank = r;
       }
     }
+    char busIdStr[FLAGCX_DEVICE_PCI_BUSID_BUFFER_SIZE];
+    FLAGCXCHECK(int64ToBusId(busId, busIdStr));
+    int devLogicalIdx = 0;
+    deviceAdaptor->getDeviceByPciBusId(&devLogicalIdx, busIdStr);
+    apu->apu.dev = devLogicalIdx;
   }
-
   return flagcxSuccess;
 }
 
-static flagcxResult_t
-flagcxTopoReorderServerId(struct flatTopoServer *flatTopoServer, int nRanks) {
-  // get all host hashes
-  std::map<uint64_t, int> hostHashToServerId;
-  int serverId = 0;
-  int nHosts = 0;
-  for (int i = 0; i < nRanks; i++) {
-    // get host hash of server
-    uint64_t hostHash =
-        flatTopoServer[i].hostHashes[flatTopoServer[i].serverId];
-    auto it = hostHashToServerId.find(hostHash);
-    if (it == hostHashToServerId.end()) {
-      // assign new serverId
-      flatTopoServer[i].serverId = serverId;
-      // if we haven't seen this host hash before, add it to the map
-      hostHashToServerId[hostHash] = serverId;
-      serverId++;
-      nHosts++;
-    } else {
-      // if we have seen this host hash before, reorder serverId
-      flatTopoServer[i].serverId = it->second;
+flagcxResult_t flagcxTopoGetServerTopo(struct flagcxHeteroComm *comm,
+                                       struct flagcxTopoServer **topoServer) {
+  // dumping the topology needs the xml, skip the cache in that case
+  const char *cacheDir = flagcxGetEnv("FLAGCX_TOPO_CACHE_DIR");
+  if (flagcxGetEnv("FLAGCX_TOPO_DUMP_FILE") != NULL) {
+    cacheDir = NULL;
+  }
+  uint64_t fingerprint = 0;
+  char cachePath[PATH_MAX];
+  if (cacheDir != NULL) {
+    int64_t startTime = clockNano();
+    FLAGCXCHECK(flagcxTopoCacheFingerprint(comm, &fingerprint));
+    flagcxTopoCachePath(cacheDir, fingerprint, cachePath, sizeof(cachePath));
+    FLAGCXCHECK(flagcxCalloc(topoServer, 1));
+    if (flagcxTopoCacheLoad(cachePath, fingerprint, *topoServer) ==
+        flagcxSuccess) {
+      FLAGCXCHECK(flagcxTopoCacheSetApuRanks(comm, *topoServer));
+      INFO(FLAGCX_INIT, "Loaded server topology from cache %s in %.2f ms",
+           cachePath, (clockNano() - startTime) / 1e6);
+      return flagcxSuccess;
     }
+    free(*topoServer);
+    *topoServer = NULL;
   }
-  for (int i = 0; i < nRanks; i++) {
-    // clear original host hash array
-    memset(flatTopoServer[i].hostHashes, 0,
-           sizeof(uint64_t) * FLAGCX_TOPO_MAX_NODES);
-    flatTopoServer[i].nHosts = nHosts;
-    for (auto it = hostHashToServerId.begin(); it != hostHashToServerId.end();
-         ++it) {
-      // reorder host hashes
-      flatTopoServer[i].hostHashes[it->second] = it->first;
-    }
+
+  // TODO: first try to acquire topo from xml file
+  struct flagcxXml *xml;
+  INFO(FLAGCX_INIT, "allocing flagcxXml");
+  FLAGCXCHECK(xmlAlloc(&xml, FLAGCX_TOPO_XML_MAX_NODES));
+
+  FLAGCXCHECK(flagcxTopoGetXmlTopo(comm, xml));
+  INFO(FLAGCX_INIT, "start converting xml to serverTopo");
+  uint64_t localHostHash = comm->peerInfo[comm->rank].hostHash -
+                           comm->commHash; // do not consider commHash here
+  FLAGCXCHECK(flagcxTopoGetServerTopoFromXml(xml, topoServer, localHostHash));
+
+  free(xml);
+  if (cacheDir != NULL &&
+      flagcxTopoCacheSave(cachePath, fingerprint, *topoServer) ==
+          flagcxSuccess) {
+    INFO(FLAGCX_INIT, "Saved server topology to cache %s", cachePath);
   }
   return flagcxSuccess;
 }
@@ -1336,7 +1703,7 @@ static flagcxResult_t getEffectiveBw(struct flagcxInterServerRoute *route,
   return flagcxSuccess;
 }
 
-static flagcxResult_t
+flagcxResult_t
 flagcxGetInterServerRouteFromFile(const char *xmlFile,
                                   struct flagcxInterServerTopo *interServerTopo,
                                   struct flagcxTopoServer *topoServer) {
@@ -1408,6 +1775,11 @@ flagcxGetInterServerRouteFromFile(const char *xmlFile,
     route->remoteNic = net2;
     reverseRoute->localNic = net2;
     reverseRoute->remoteNic = net1;
+    rapidxml::xml_attribute<> *latAttr = pairNode->first_attribute("lat");
+    if (latAttr) {
+      route->interLat = strtof(latAttr->value(), NULL);
+      reverseRoute->interLat = route->interLat;
+    }
 
     // parse interswitch
     rapidxml::xml_node<> *interSwitchNode = pairNode->first_node("interSwitch");
@@ -1471,6 +1843,125 @@ flagcxGetInterServerRouteFromFile(const char *xmlFile,
   return flagcxSuccess;
 }
 
+flagcxResult_t
+flagcxInterServerTopoAddRoute(struct flagcxInterServerTopo *interServerTopo,
+                              struct flagcxTopoServer *topoServer,
+                              uint64_t guid1, uint64_t guid2, float bw,
+                              float lat) {
+  struct flagcxTopoNode *net1 = nullptr, *net2 = nullptr;
+  FLAGCXCHECK(getNetNodeFromServers(interServerTopo, topoServer, guid1, &net1));
+  FLAGCXCHECK(getNetNodeFromServers(interServerTopo, topoServer, guid2, &net2));
+  struct flagcxTopoNode *nets[2] = {net1, net2};
+  for (int d = 0; d < 2; d++) {
+    struct flagcxTopoNode *localNic = nets[d];
+    struct flagcxTopoNode *remoteNic = nets[1 - d];
+    auto &route = interServerTopo->routeMap[localNic->net.guid]
+                                           [remoteNic->net.guid];
+    if (route == NULL) {
+      // remember to free this when destroying comm
+      FLAGCXCHECK(flagcxCalloc(&route, 1));
+    }
+    route->localNic = localNic;
+    route->remoteNic = remoteNic;
+    route->switchCount = 0;
+    route->interBw = bw;
+    route->interLat = lat;
+  }
+  INFO(FLAGCX_GRAPH,
+       "INTERSERVER_ROUTE: net %lx <-> net %lx, bw = %f GB/s, lat = %f us",
+       guid1, guid2, bw, lat);
+  return flagcxSuccess;
+}
+
+flagcxResult_t flagcxDumpInterServerRouteToFile(
+    const char *xmlFile, struct flagcxInterServerTopo *interServerTopo) {
+  FILE *file = fopen(xmlFile, "w");
+  if (file == NULL) {
+    WARN("Unable to open %s, not dumping interserver routes", xmlFile);
+    return flagcxSuccess;
+  }
+  fprintf(file, "<interserver_route>\n  <nic_pairs>\n");
+  for (auto &localIt : interServerTopo->routeMap) {
+    for (auto &remoteIt : localIt.second) {
+      struct flagcxInterServerRoute *route = remoteIt.second;
+      // each route is stored in both directions, write it once
+      if (route == NULL || localIt.first > remoteIt.first) {
+        continue;
+      }
+      // a single top switch limits the route to the recorded bandwidth
+      fprintf(file, "    <pair lat=\"%f\">\n", route->interLat);
+      fprintf(file, "      <nic1 guid=\"0x%lx\"/>\n", localIt.first);
+      fprintf(file, "      <nic2 guid=\"0x%lx\"/>\n", remoteIt.first);
+      fprintf(file, "      <interSwitch count=\"1\">\n");
+      fprintf(file,
+              "        <switch downBw=\"%f\" upBw=\"%f\" upLink=\"1\" "
+              "downLink=\"1\" isTop=\"1\"/>\n",
+              route->interBw, route->interBw);
+      fprintf(file, "      </interSwitch>\n    </pair>\n");
+    }
+  }
+  fprintf(file, "  </nic_pairs>\n</interserver_route>\n");
+  fclose(file);
+  INFO(FLAGCX_GRAPH, "INTERSERVER_ROUTE: routes dumped to %s", xmlFile);
+  return flagcxSuccess;
+}
+
+FLAGCX_PARAM(TopoPathThreads, "TOPO_PATH_THREADS", 8);
+
+struct flagcxTopoPathsJob {
+  struct flagcxHeteroComm *comm;
+  struct flagcxTopoServer *servers;
+  int nServers;
+  int skip;
+  std::atomic<int> next;
+  std::atomic<int> result;
+};
+
+static void *flagcxTopoComputePathsWorker(void *arg) {
+  struct flagcxTopoPathsJob *job = (struct flagcxTopoPathsJob *)arg;
+  int s;
+  while ((s = job->next++) < job->nServers) {
+    if (s == job->skip) {
+      continue;
+    }
+    flagcxResult_t res = flagcxTopoComputePaths(job->servers + s, job->comm);
+    if (res != flagcxSuccess) {
+      job->result = res;
+    }
+  }
+  return NULL;
+}
+
+// Compute the paths of all servers but skip, the servers are independent so
+// they are spread over a few threads
+static flagcxResult_t
+flagcxTopoComputeServerPaths(struct flagcxHeteroComm *comm,
+                             struct flagcxTopoServer *servers, int nServers,
+                             int skip) {
+  struct flagcxTopoPathsJob job;
+  job.comm = comm;
+  job.servers = servers;
+  job.nServers = nServers;
+  job.skip = skip;
+  job.next = 0;
+  job.result = flagcxSuccess;
+  int nThreads = std::min<int64_t>(flagcxParamTopoPathThreads(), nServers - 1);
+  std::vector<pthread_t> threads;
+  for (int t = 1; t < nThreads; t++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, flagcxTopoComputePathsWorker, &job) !=
+        0) {
+      break;
+    }
+    threads.push_back(thread);
+  }
+  flagcxTopoComputePathsWorker(&job);
+  for (auto thread : threads) {
+    pthread_join(thread, NULL);
+  }
+  return (flagcxResult_t)job.result.load();
+}
+
 flagcxResult_t
 flagcxGetInterServerTopo(struct flagcxHeteroComm *comm,
                          struct flagcxInterServerTopo **interServerTopo,
@@ -1478,56 +1969,114 @@ flagcxGetInterServerTopo(struct flagcxHeteroComm *comm,
   auto ret = flagcxSuccess;
   int rank = comm->rank;
   int nRanks = comm->nRanks;
-  uint64_t currRankHostHash = topoServer->hostHashes[topoServer->serverId];
+  uint64_t myHostHash = comm->peerInfo[rank].hostHash;
   // FLAGCXCHECK(flagcxCalloc(interServerTopo, 1));
   *interServerTopo = new flagcxInterServerTopo(); // remember to delete this
                                                   // when destroying comm
   flagcxInterServerTopo *interServer = *interServerTopo;
-  flatTopoServer *flatServerData;
-  FLAGCXCHECK(flagcxCalloc(&flatServerData, nRanks));
-  // we need to flatten topoServer first to remove all pointer types in the
-  // structure before copying and trasferring it to other ranks
-  FLAGCXCHECK(flattenTopoServer(topoServer, flatServerData + rank));
-  FLAGCXCHECK(bootstrapAllGather(comm->bootstrap, (void *)flatServerData,
-                                 sizeof(flatTopoServer)));
-  FLAGCXCHECK(bootstrapBarrier(comm->bootstrap, rank, nRanks, 0));
-
-  // reorder serverId
-  FLAGCXCHECK(flagcxTopoReorderServerId(flatServerData, nRanks));
-
-  // get unique flatServers
-  std::map<int, flatTopoServer *> flatServerMap;
-  flatServerMap[flatServerData[0].serverId] = &flatServerData[0];
-  int serverCount = 1;
-  for (int i = 1; i < nRanks; i++) {
-    auto it = flatServerMap.find(flatServerData[i].serverId);
-    if (it != flatServerMap.end()) {
-      continue;
+  int64_t startTime = clockNano();
+
+  // one leader per host, the lowest rank on it; server ids follow the order
+  // of the leaders
+  std::vector<int> leaders;
+  std::vector<int> localRanks;
+  int serverId = -1;
+  for (int r = 0; r < nRanks; r++) {
+    uint64_t hostHash = comm->peerInfo[r].hostHash;
+    if (hostHash == myHostHash) {
+      localRanks.push_back(r);
+    }
+    bool seen = false;
+    for (int l : leaders) {
+      seen |= comm->peerInfo[l].hostHash == hostHash;
+    }
+    if (!seen) {
+      if (hostHash == myHostHash) {
+        serverId = leaders.size();
+      }
+      leaders.push_back(r);
+    }
+  }
+  int serverCount = leaders.size();
+  if (serverCount > FLAGCX_TOPO_MAX_NODES) {
+    WARN("Number of servers %d exceeds the supported maximum %d", serverCount,
+         FLAGCX_TOPO_MAX_NODES);
+    return flagcxInternalError;
+  }
+  bool isLeader = localRanks[0] == rank;
+  int localRank = std::find(localRanks.begin(), localRanks.end(), rank) -
+                  localRanks.begin();
+
+  // only the leaders encode and exchange their server topology, the other
+  // ranks of a host receive the full set from their leader
+  std::vector<int> blobSizes(serverCount);
+  std::vector<uint8_t> blob;
+  if (isLeader) {
+    FLAGCXCHECK(flagcxTopoServerEncode(topoServer, blob));
+    blobSizes[serverId] = blob.size();
+    if (serverCount > 1) {
+      std::vector<int> intSizes(serverCount, sizeof(int));
+      FLAGCXCHECK(bootstrapIntraNodeAllGatherV(
+          comm->bootstrap, leaders.data(), serverId, serverCount,
+          blobSizes.data(), intSizes.data()));
+    }
+  }
+  if (localRanks.size() > 1) {
+    FLAGCXCHECK(bootstrapIntraNodeBroadcast(
+        comm->bootstrap, localRanks.data(), localRank, localRanks.size(), 0,
+        blobSizes.data(), serverCount * sizeof(int)));
+  }
+  size_t totalBytes = 0;
+  std::vector<size_t> blobOffsets(serverCount);
+  for (int s = 0; s < serverCount; s++) {
+    blobOffsets[s] = totalBytes;
+    totalBytes += blobSizes[s];
+  }
+  std::vector<uint8_t> allBlobs(totalBytes);
+  if (isLeader) {
+    memcpy(allBlobs.data() + blobOffsets[serverId], blob.data(), blob.size());
+    if (serverCount > 1) {
+      FLAGCXCHECK(bootstrapIntraNodeAllGatherV(
+          comm->bootstrap, leaders.data(), serverId, serverCount,
+          allBlobs.data(), blobSizes.data()));
     }
-    flatServerMap[flatServerData[i].serverId] = &flatServerData[i];
-    serverCount++;
   }
-  // unflatten the flatServers to topoServers
+  if (localRanks.size() > 1) {
+    FLAGCXCHECK(bootstrapIntraNodeBroadcast(
+        comm->bootstrap, localRanks.data(), localRank, localRanks.size(), 0,
+        allBlobs.data(), totalBytes));
+  }
+
   flagcxTopoServer *topoServers;
   FLAGCXCHECK(flagcxCalloc(&topoServers, serverCount));
-  int i = 0;
-  for (auto it = flatServerMap.begin(); it != flatServerMap.end(); ++it, i++) {
-    flatTopoServer *server = it->second;
-    if (server->hostHashes[server->serverId] == currRankHostHash) {
-      // this is the current server, no need to flatten, but neet to change
-      // serverId, and node ids
-      topoServer->serverId = server->serverId;
-      topoServer->nHosts = server->nHosts;
-      memcpy(topoServer->hostHashes, server->hostHashes,
-             sizeof(uint64_t) * FLAGCX_TOPO_MAX_NODES);
-      FLAGCXCHECK(flagcxModifyNodeIds(topoServer, server->serverId));
+  std::vector<uint64_t> hostHashes(serverCount);
+  for (int s = 0; s < serverCount; s++) {
+    if (s == serverId) {
+      hostHashes[s] = topoServer->hostHashes[topoServer->serverId];
       continue;
     }
-    FLAGCXCHECK(unflattenTopoServer(topoServers + i, server));
-    FLAGCXCHECK(flagcxModifyNodeIds(topoServers + i, server->serverId));
-    // reconstruct paths because we didn't send path info in allgather
-    FLAGCXCHECK(flagcxTopoComputePaths(topoServers + i, comm));
+    FLAGCXCHECK(flagcxTopoServerDecode(allBlobs.data() + blobOffsets[s],
+                                       blobSizes[s], topoServers + s,
+                                       &hostHashes[s]));
   }
+  for (int s = 0; s < serverCount; s++) {
+    struct flagcxTopoServer *server =
+        s == serverId ? topoServer : topoServers + s;
+    server->serverId = s;
+    server->nHosts = serverCount;
+    memset(server->hostHashes, 0, sizeof(server->hostHashes));
+    memcpy(server->hostHashes, hostHashes.data(),
+           serverCount * sizeof(uint64_t));
+    FLAGCXCHECK(flagcxModifyNodeIds(server, s));
+  }
+  // reconstruct paths because they are not part of the blob
+  FLAGCXCHECK(
+      flagcxTopoComputeServerPaths(comm, topoServers, serverCount, serverId));
+  INFO(FLAGCX_INIT,
+       "INTERSERVER_TOPO: exchanged %d server topologies, %zu bytes "
+       "(%zu bytes local) in %.2f ms",
+       serverCount, totalBytes, (size_t)blobSizes[serverId],
+       (clockNano() - startTime) / 1e6);
   interServer->numServers = serverCount;
   INFO(FLAGCX_GRAPH, "INTERSERVER_TOPO: numServers = %d", serverCount);
   interServer->servers = topoServers;
@@ -1545,18 +2094,17 @@ flagcxGetInterServerTopo(struct flagcxHeteroComm *comm,
   //   }
   // }
   const char *interserverFile = flagcxGetEnv("FLAGCX_INTERSERVER_ROUTE_FILE");
-  if (!interserverFile) {
+  if (interserverFile) {
+    // parse the interserver route file
+    FLAGCXCHECK(flagcxGetInterServerRouteFromFile(interserverFile, interServer,
+                                                  topoServer));
+  } else if (flagcxParamInterServerRouteProbe()) {
+    // measure the routes between the nets in use
+    FLAGCXCHECK(
+        flagcxGetInterServerRouteFromProbe(comm, interServer, topoServer));
+  } else {
     INFO(FLAGCX_ENV, "FLAGCX_INTERSERVER_ROUTE_FILE is not set");
-    goto exit; // TODO: need to find a way to determine interserver bw if no
-               // file is provided
   }
-  // parse the interserver route file
-  FLAGCXCHECK(flagcxGetInterServerRouteFromFile(interserverFile, interServer,
-                                                topoServer));
-
-  // record all net guid and serverId mappings
-exit:
-  free(flatServerData);
   return ret;
 }
 
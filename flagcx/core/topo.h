@@ -11,6 +11,7 @@
 #include "graph.h"
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #define LOC_BW 5000.0
 #define SM60_NVLINK_BW 18.0
@@ -102,7 +103,7 @@ struct flagcxTopoLink {
   16 // TODO: decide on a decent number for this variable
 
 struct flagcxTopoPath {
-  struct flagcxTopoLink *list[FLAGCX_TOPO_MAX_HOPS];
+  int hops; // offset of the first hop in the pathHops arena of the server
   int count;
   float bw;
   int type;
@@ -171,8 +172,18 @@ struct flagcxTopoServer {
   struct flagcxTopoNodeSet nodes[FLAGCX_TOPO_NODE_TYPES];
   float maxBw;
   float totalBw;
+  // links of all computed paths, each path is a contiguous range
+  struct flagcxTopoLink **pathHops;
+  int nPathHops;
+  int maxPathHops;
 };
 
+static inline struct flagcxTopoLink *
+flagcxTopoPathHop(struct flagcxTopoServer *topoServer,
+                  struct flagcxTopoPath *path, int i) {
+  return topoServer->pathHops[path->hops + i];
+}
+
 struct flagcxSwitch {
   float downBw;
   float upBw;
@@ -188,6 +199,7 @@ struct flagcxInterServerRoute {
   struct flagcxTopoNode *remoteNic;
   int remoteRank;
   float interBw;
+  float interLat; // one-way latency in us, 0 when unknown
   struct flagcxSwitch switchInfos[FLAGCX_MAX_INTER_SERVER_HOPS];
 };
 
@@ -220,56 +232,6 @@ struct flagcxDevProps {
   // int gdrSupported;
 };
 
-struct flatTopoLink {
-  int type;
-  float bw;
-  int remNodeIdx;
-  int remNodeType;
-};
-
-struct flatTopoNode {
-  int type;
-  int64_t id;
-  // Type specific data
-  union {
-    struct {
-      int dev; // NVML dev number
-      int rank;
-      int vendor;
-    } apu;
-    struct {
-      int dev; // Plugin dev number
-      int port;
-      float bw;
-      float latency;
-      int maxConn;
-      uint64_t guid;
-    } net;
-    struct {
-      int arch;
-      int vendor;
-      int model;
-    } cpu;
-    struct {
-      uint64_t device;
-    } pci;
-  };
-  int nlinks;
-  struct flatTopoLink links[FLAGCX_TOPO_MAX_LINKS];
-};
-
-struct flatTopoNodeSet {
-  int count;
-  struct flatTopoNode nodes[FLAGCX_TOPO_MAX_NODES];
-};
-
-struct flatTopoServer {
-  int serverId;
-  uint64_t hostHashes[FLAGCX_TOPO_MAX_NODES];
-  int nHosts;
-  struct flatTopoNodeSet nodes[FLAGCX_TOPO_NODE_TYPES];
-};
-
 struct flagcxNicDistance {
   int distance;
   uint64_t netGuid;
@@ -302,6 +264,23 @@ flagcxGetInterServerTopo(struct flagcxHeteroComm *comm,
                          struct flagcxInterServerTopo **interServerTopo,
                          struct flagcxTopoServer *topoServer);
 
+// Serialize the nodes and links of a server topology into a compact blob.
+// Paths are not encoded, they have to be recomputed after decoding.
+flagcxResult_t flagcxTopoServerEncode(struct flagcxTopoServer *topoServer,
+                                      std::vector<uint8_t> &blob);
+// Rebuild the nodes and links of a server topology from a blob. Node ids are
+// local ids, hostHash receives the host hash of the encoding server.
+flagcxResult_t flagcxTopoServerDecode(const uint8_t *blob, size_t size,
+                                      struct flagcxTopoServer *topoServer,
+                                      uint64_t *hostHash);
+// Store the server topology in the cache file at path, and map it back.
+// Loading returns flagcxSuccess only when the file holds a valid blob
+// written for the same fingerprint.
+flagcxResult_t flagcxTopoCacheSave(const char *path, uint64_t fingerprint,
+                                   struct flagcxTopoServer *topoServer);
+flagcxResult_t flagcxTopoCacheLoad(const char *path, uint64_t fingerprint,
+                                   struct flagcxTopoServer *topoServer);
+
 #define FLAGCX_TOPO_XML_MAX_NODES 256
 #define FLAGCX_GRAPH_XML_MAX_NODES 4096
 flagcxResult_t
@@ -336,6 +315,33 @@ flagcxTopoGetServerFromRank(int rank, struct flagcxInterServerTopo *interServer,
                             struct flagcxTopoServer *currServer,
                             struct flagcxTopoServer **retServer);
 
+// Fill interServerTopo->routeMap from an interserver_route xml file, the nets
+// it refers to must already be in interServerTopo->netToServerMap
+flagcxResult_t
+flagcxGetInterServerRouteFromFile(const char *xmlFile,
+                                  struct flagcxInterServerTopo *interServerTopo,
+                                  struct flagcxTopoServer *topoServer);
+
+// Record the route between two nets of different servers in both directions
+flagcxResult_t
+flagcxInterServerTopoAddRoute(struct flagcxInterServerTopo *interServerTopo,
+                              struct flagcxTopoServer *topoServer,
+                              uint64_t guid1, uint64_t guid2, float bw,
+                              float lat);
+
+// Write interServerTopo->routeMap as an interserver_route xml file that can
+// be passed back through FLAGCX_INTERSERVER_ROUTE_FILE
+flagcxResult_t flagcxDumpInterServerRouteToFile(
+    const char *xmlFile, struct flagcxInterServerTopo *interServerTopo);
+
+// Fill interServerTopo->routeMap by measuring latency and bandwidth between
+// the nets used by the ranks of comm. Collective over all ranks of comm.
+flagcxResult_t flagcxGetInterServerRouteFromProbe(
+    struct flagcxHeteroComm *comm,
+    struct flagcxInterServerTopo *interServerTopo,
+    struct flagcxTopoServer *topoServer);
+int64_t flagcxParamInterServerRouteProbe();
+
 // static flagcxResult_t flagcxTopoIdToIndex(struct flagcxTopoServer*
 // serverTopo, int type, int64_t id, int* index) {
 //   *index = -1;
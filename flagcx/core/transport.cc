@@ -1,6 +1,7 @@
 #include "adaptor.h"
 #include "bootstrap.h"
 #include "comm.h"
+#include "graph.h"
 #include "info.h"
 #include "net.h"
 #include "proxy.h"
@@ -8,24 +9,70 @@
 #define ENABLE_TIMER 0
 #include "timer.h"
 
+// Move the calling thread to the cpus next to netDev. Each peer may use a
+// different rail, so the affinity is looked up per net, from the cpuset the
+// caller had on entry.
+static flagcxResult_t flagcxTransportPinToNet(struct flagcxHeteroComm *comm,
+                                              int netDev,
+                                              cpu_set_t *callerAffinity,
+                                              int *pinnedNetDev) {
+  if (netDev == *pinnedNetDev) {
+    return flagcxSuccess;
+  }
+  cpu_set_t affinity;
+  if (netDev == comm->netDev) {
+    affinity = comm->cpuAffinity;
+  } else {
+    SYSCHECK(sched_setaffinity(0, sizeof(cpu_set_t), callerAffinity),
+             "sched_setaffinity");
+    FLAGCXCHECK(flagcxTopoGetCpuAffinity(comm->topoServer, netDev, &affinity));
+  }
+  SYSCHECK(sched_setaffinity(0, sizeof(cpu_set_t),
+                             CPU_COUNT(&affinity) ? &affinity : callerAffinity),
+           "sched_setaffinity");
+  *pinnedNetDev = netDev;
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxTransportP2pSetup(struct flagcxHeteroComm *comm,
                                        struct flagcxTopoGraph *graph,
                                        int connIndex,
                                        int *highestTransportType /*=NULL*/) {
+  flagcxResult_t ret = flagcxSuccess;
   flagcxIbHandle *handle = NULL;
 
+  // Allocate the staging buffers and create the copy streams of each
+  // connection from the cpus next to its net, so that host memory and host
+  // stream workers are local to that NUMA domain. The caller's affinity is
+  // restored on every exit below.
+  cpu_set_t callerAffinity;
+  int pinAffinity = comm->topoServer != NULL;
+  int pinnedNetDev = -1;
+  if (pinAffinity) {
+    SYSCHECK(sched_getaffinity(0, sizeof(cpu_set_t), &callerAffinity),
+             "sched_getaffinity");
+  }
+
   for (int peer = 0; peer < comm->nRanks; peer++) {
     for (int c = 0; c < MAXCHANNELS; c++) {
       if (comm->connectRecv[peer] & (1UL << c)) {
         struct flagcxConnector *conn =
             comm->channels[c].peers[peer]->recv + connIndex;
-        FLAGCXCHECK(flagcxCalloc(&conn->proxyConn.connection, 1));
+        FLAGCXCHECKGOTO(flagcxCalloc(&conn->proxyConn.connection, 1), ret,
+                        out);
         struct recvNetResources *resources;
-        FLAGCXCHECK(flagcxCalloc(&resources, 1));
-        FLAGCXCHECK(flagcxCalloc(&handle, 1));
+        FLAGCXCHECKGOTO(flagcxCalloc(&resources, 1), ret, out);
+        FLAGCXCHECKGOTO(flagcxCalloc(&handle, 1), ret, out);
         conn->proxyConn.connection->send = 0;
         conn->proxyConn.connection->transportResources = (void *)resources;
-        resources->netDev = comm->netDev;
+        FLAGCXCHECKGOTO(
+            flagcxTopoGetP2pNet(comm, peer, 0, &resources->netDev), ret, out);
+        if (pinAffinity) {
+          FLAGCXCHECKGOTO(flagcxTransportPinToNet(comm, resources->netDev,
+                                                  &callerAffinity,
+                                                  &pinnedNetDev),
+                          ret, out);
+        }
         flagcxNetIb.listen(resources->netDev, (void *)handle,
                            &resources->netListenComm);
         bootstrapSend(comm->bootstrap, peer, 1001 + c, handle,
@@ -34,9 +81,14 @@ flagcxResult_t flagcxTransportP2pSetup(struct flagcxHeteroComm *comm,
         resources->buffSizes[0] = REGMRBUFFERSIZE;
         deviceAdaptor->gdrMemAlloc((void **)&resources->buffers[0],
                                    resources->buffSizes[0], NULL);
-        FLAGCXCHECK(flagcxProxyCallAsync(comm, &conn->proxyConn,
-                                         flagcxProxyMsgConnect, handle,
-                                         sizeof(flagcxIbHandle), 0, conn));
+        if (flagcxParamIbEagerThreshold() > 0)
+          deviceAdaptor->deviceMalloc((void **)&resources->eagerBuff,
+                                      flagcxParamIbEagerThreshold(),
+                                      flagcxMemHost, NULL);
+        FLAGCXCHECKGOTO(flagcxProxyCallAsync(comm, &conn->proxyConn,
+                                             flagcxProxyMsgConnect, handle,
+                                             sizeof(flagcxIbHandle), 0, conn),
+                        ret, out);
 
         free(handle);
       }
@@ -44,13 +96,21 @@ flagcxResult_t flagcxTransportP2pSetup(struct flagcxHeteroComm *comm,
       if (comm->connectSend[peer] & (1UL << c)) {
         struct flagcxConnector *conn =
             comm->channels[c].peers[peer]->send + connIndex;
-        FLAGCXCHECK(flagcxCalloc(&conn->proxyConn.connection, 1));
+        FLAGCXCHECKGOTO(flagcxCalloc(&conn->proxyConn.connection, 1), ret,
+                        out);
         struct sendNetResources *resources;
-        FLAGCXCHECK(flagcxCalloc(&resources, 1));
-        FLAGCXCHECK(flagcxCalloc(&handle, 1));
+        FLAGCXCHECKGOTO(flagcxCalloc(&resources, 1), ret, out);
+        FLAGCXCHECKGOTO(flagcxCalloc(&handle, 1), ret, out);
         conn->proxyConn.connection->send = 1;
         conn->proxyConn.connection->transportResources = (void *)resources;
-        resources->netDev = comm->netDev;
+        FLAGCXCHECKGOTO(
+            flagcxTopoGetP2pNet(comm, peer, 1, &resources->netDev), ret, out);
+        if (pinAffinity) {
+          FLAGCXCHECKGOTO(flagcxTransportPinToNet(comm, resources->netDev,
+                                                  &callerAffinity,
+                                                  &pinnedNetDev),
+                          ret, out);
+        }
         bootstrapRecv(comm->bootstrap, peer, 1001 + c, handle,
                       sizeof(flagcxIbHandle));
         handle->stage.comm = comm;
@@ -58,14 +118,30 @@ flagcxResult_t flagcxTransportP2pSetup(struct flagcxHeteroComm *comm,
         resources->buffSizes[0] = REGMRBUFFERSIZE;
         deviceAdaptor->gdrMemAlloc((void **)&resources->buffers[0],
                                    resources->buffSizes[0], NULL);
-        FLAGCXCHECK(flagcxProxyCallAsync(comm, &conn->proxyConn,
-                                         flagcxProxyMsgConnect, handle,
-                                         sizeof(flagcxIbHandle), 0, conn));
+        if (flagcxParamIbEagerThreshold() > 0)
+          deviceAdaptor->deviceMalloc((void **)&resources->eagerBuff,
+                                      flagcxParamIbEagerThreshold(),
+                                      flagcxMemHost, NULL);
+        FLAGCXCHECKGOTO(flagcxProxyCallAsync(comm, &conn->proxyConn,
+                                             flagcxProxyMsgConnect, handle,
+                                             sizeof(flagcxIbHandle), 0, conn),
+                        ret, out);
 
         free(handle);
       }
     }
   }
+out:
+  if (pinnedNetDev != -1 &&
+      sched_setaffinity(0, sizeof(cpu_set_t), &callerAffinity) != 0) {
+    WARN("Call to sched_setaffinity failed : %s", strerror(errno));
+    if (ret == flagcxSuccess) {
+      ret = flagcxSystemError;
+    }
+  }
+  if (ret != flagcxSuccess) {
+    return ret;
+  }
 
   for (int peer = 0; peer < comm->nRanks; peer++) {
     for (int c = 0; c < MAXCHANNELS; c++) {
@@ -6,6 +6,7 @@
 #include <float.h>
 #include <map>
 #include <queue>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -16,11 +17,18 @@
 /*******************/
 /* XML File Parser */
 /*******************/
-flagcxResult_t xmlGetChar(FILE *file, char *c) {
-  if (fread(c, 1, 1, file) == 0) {
+// The whole file is mapped and parsed in place
+struct xmlStream {
+  const char *ptr;
+  const char *end;
+};
+
+flagcxResult_t xmlGetChar(struct xmlStream *stream, char *c) {
+  if (stream->ptr == stream->end) {
     WARN("XML Parse : Unexpected EOF");
     return flagcxInternalError;
   }
+  *c = *stream->ptr++;
   return flagcxSuccess;
 }
 
@@ -44,15 +52,15 @@ static flagcxResult_t getPciPath(const char *busId, char **path) {
   return flagcxSuccess;
 }
 
-flagcxResult_t xmlGetValue(FILE *file, char *value, char *last) {
+flagcxResult_t xmlGetValue(struct xmlStream *stream, char *value, char *last) {
   char c;
-  FLAGCXCHECK(xmlGetChar(file, &c));
+  FLAGCXCHECK(xmlGetChar(stream, &c));
   if (c != '"' && c != '\'') {
 #if INT_OK
     int o = 0;
     do {
       value[o++] = c;
-      FLAGCXCHECK(xmlGetChar(file, &c));
+      FLAGCXCHECK(xmlGetChar(stream, &c));
     } while (c >= '0' && c <= '9');
     value[o] = '\0';
     *last = c;
@@ -64,27 +72,28 @@ flagcxResult_t xmlGetValue(FILE *file, char *value, char *last) {
   }
   int o = 0;
   do {
-    FLAGCXCHECK(xmlGetChar(file, &c));
+    FLAGCXCHECK(xmlGetChar(stream, &c));
     value[o++] = c;
   } while (c != '"');
   value[o - 1] = '\0';
-  FLAGCXCHECK(xmlGetChar(file, last));
+  FLAGCXCHECK(xmlGetChar(stream, last));
   return flagcxSuccess;
 }
 
-flagcxResult_t xmlGetToken(FILE *file, char *name, char *value, char *last) {
+flagcxResult_t xmlGetToken(struct xmlStream *stream, char *name, char *value,
+                           char *last) {
   char c;
   char *ptr = name;
   int o = 0;
   do {
-    FLAGCXCHECK(xmlGetChar(file, &c));
+    FLAGCXCHECK(xmlGetChar(stream, &c));
     if (c == '=') {
       ptr[o] = '\0';
       if (value == NULL) {
         WARN("XML Parse : Unexpected value with name %s", ptr);
         return flagcxInternalError;
       }
-      return xmlGetValue(file, value, last);
+      return xmlGetValue(stream, value, last);
     }
     ptr[o] = c;
     if (o == MAX_STR_LEN - 1) {
@@ -106,7 +115,8 @@ flagcxResult_t xmlGetToken(FILE *file, char *name, char *value, char *last) {
     s[1] = s[2];                                                               \
     s[2] = c;                                                                  \
   } while (0)
-flagcxResult_t xmlSkipComment(FILE *file, char *start, char next) {
+flagcxResult_t xmlSkipComment(struct xmlStream *stream, char *start,
+                              char next) {
   // Start from something neutral with \0 at the end.
   char end[4] = "...";
 
@@ -118,41 +128,42 @@ flagcxResult_t xmlSkipComment(FILE *file, char *start, char next) {
 
   // Stop when we find "-->"
   while (strcmp(end, "-->") != 0) {
-    int c;
-    if (fread(&c, 1, 1, file) != 1) {
+    if (stream->ptr == stream->end) {
       WARN("XML Parse error : unterminated comment");
       return flagcxInternalError;
     }
-    SHIFT_APPEND(end, c);
+    SHIFT_APPEND(end, *stream->ptr++);
   }
   return flagcxSuccess;
 }
 
-flagcxResult_t xmlGetNode(FILE *file, struct flagcxXmlNode *node) {
+flagcxResult_t xmlGetNode(struct xmlStream *stream,
+                          struct flagcxXmlNode *node) {
   node->type = NODE_TYPE_NONE;
   char c = ' ';
   while (c == ' ' || c == '\n' || c == '\r') {
-    if (fread(&c, 1, 1, file) == 0)
+    if (stream->ptr == stream->end)
       return flagcxSuccess;
+    c = *stream->ptr++;
   }
   if (c != '<') {
     WARN("XML Parse error : expecting '<', got '%c'", c);
     return flagcxInternalError;
   }
   // Read XML element name
-  FLAGCXCHECK(xmlGetToken(file, node->name, NULL, &c));
+  FLAGCXCHECK(xmlGetToken(stream, node->name, NULL, &c));
 
   // Check for comments
   if (strncmp(node->name, "!--", 3) == 0) {
-    FLAGCXCHECK(xmlSkipComment(file, node->name + 3, c));
-    return xmlGetNode(file, node);
+    FLAGCXCHECK(xmlSkipComment(stream, node->name + 3, c));
+    return xmlGetNode(stream, node);
   }
 
   // Check for closing tag
   if (node->name[0] == '\0' && c == '/') {
     node->type = NODE_TYPE_CLOSE;
     // Re-read the name, we got '/' in the first call
-    FLAGCXCHECK(xmlGetToken(file, node->name, NULL, &c));
+    FLAGCXCHECK(xmlGetToken(stream, node->name, NULL, &c));
     if (c != '>') {
       WARN("XML Parse error : unexpected trailing %c in closing tag %s", c,
            node->name);
@@ -167,7 +178,7 @@ flagcxResult_t xmlGetNode(FILE *file, struct flagcxXmlNode *node) {
   int a = 0;
   while (c == ' ') {
     FLAGCXCHECK(
-        xmlGetToken(file, node->attrs[a].key, node->attrs[a].value, &c));
+        xmlGetToken(stream, node->attrs[a].key, node->attrs[a].value, &c));
     if (a == MAX_ATTR_COUNT) {
       INFO(FLAGCX_GRAPH, "XML Parse : Ignoring extra attributes (max %d)",
            MAX_ATTR_COUNT);
@@ -180,7 +191,7 @@ flagcxResult_t xmlGetNode(FILE *file, struct flagcxXmlNode *node) {
   if (c == '/') {
     node->type = NODE_TYPE_SINGLE;
     char str[MAX_STR_LEN];
-    FLAGCXCHECK(xmlGetToken(file, str, NULL, &c));
+    FLAGCXCHECK(xmlGetToken(stream, str, NULL, &c));
   }
   if (c != '>') {
     WARN("XML Parse : expected >, got '%c'", c);
@@ -575,7 +586,8 @@ flagcxResult_t flagcxTopoDumpXmlRec(int indent, FILE *file,
   return flagcxSuccess;
 }
 
-typedef flagcxResult_t (*xmlHandlerFunc_t)(FILE *, struct flagcxXml *,
+typedef flagcxResult_t (*xmlHandlerFunc_t)(struct xmlStream *,
+                                           struct flagcxXml *,
                                            struct flagcxXmlNode *);
 
 struct xmlHandler {
@@ -583,7 +595,7 @@ struct xmlHandler {
   xmlHandlerFunc_t func;
 };
 
-flagcxResult_t xmlLoadSub(FILE *file, struct flagcxXml *xml,
+flagcxResult_t xmlLoadSub(struct xmlStream *stream, struct flagcxXml *xml,
                           struct flagcxXmlNode *head,
                           struct xmlHandler handlers[], int nHandlers) {
   if (head && head->type == NODE_TYPE_SINGLE)
@@ -595,7 +607,7 @@ flagcxResult_t xmlLoadSub(FILE *file, struct flagcxXml *xml,
     }
     struct flagcxXmlNode *node = xml->nodes + xml->maxIndex;
     memset(node, 0, sizeof(struct flagcxXmlNode));
-    FLAGCXCHECK(xmlGetNode(file, node));
+    FLAGCXCHECK(xmlGetNode(stream, node));
     if (node->type == NODE_TYPE_NONE) {
       if (head) {
         WARN("XML Parse : unterminated %s", head->name);
@@ -625,7 +637,7 @@ flagcxResult_t xmlLoadSub(FILE *file, struct flagcxXml *xml,
         node->parent = head;
         node->nSubs = 0;
         xml->maxIndex++;
-        FLAGCXCHECK(handlers[h].func(file, xml, node));
+        FLAGCXCHECK(handlers[h].func(stream, xml, node));
         found = 1;
         break;
       }
@@ -633,7 +645,7 @@ flagcxResult_t xmlLoadSub(FILE *file, struct flagcxXml *xml,
     if (!found) {
       if (nHandlers)
         INFO(FLAGCX_GRAPH, "Ignoring element %s", node->name);
-      FLAGCXCHECK(xmlLoadSub(file, xml, node, NULL, 0));
+      FLAGCXCHECK(xmlLoadSub(stream, xml, node, NULL, 0));
     }
   }
 }
@@ -641,13 +653,15 @@ flagcxResult_t xmlLoadSub(FILE *file, struct flagcxXml *xml,
 /****************************************/
 /* Parser rules for our specific format */
 /****************************************/
-flagcxResult_t flagcxTopoXmlLoadGpu(FILE *file, struct flagcxXml *xml,
+flagcxResult_t flagcxTopoXmlLoadGpu(struct xmlStream *stream,
+                                    struct flagcxXml *xml,
                                     struct flagcxXmlNode *head) {
-  FLAGCXCHECK(xmlLoadSub(file, xml, head, NULL, 0));
+  FLAGCXCHECK(xmlLoadSub(stream, xml, head, NULL, 0));
   return flagcxSuccess;
 }
 
-flagcxResult_t flagcxTopoXmlLoadSystem(FILE *file, struct flagcxXml *xml,
+flagcxResult_t flagcxTopoXmlLoadSystem(struct xmlStream *stream,
+                                       struct flagcxXml *xml,
                                        struct flagcxXmlNode *head) {
   int version;
   FLAGCXCHECK(xmlGetAttrInt(head, "version", &version));
@@ -664,26 +678,44 @@ flagcxResult_t flagcxTopoXmlLoadSystem(FILE *file, struct flagcxXml *xml,
     INFO(FLAGCX_GRAPH, "Loading unnamed topology");
 
   struct xmlHandler handlers[] = {{"gpu", flagcxTopoXmlLoadGpu}};
-  FLAGCXCHECK(xmlLoadSub(file, xml, head, handlers, 1));
+  FLAGCXCHECK(xmlLoadSub(stream, xml, head, handlers, 1));
   return flagcxSuccess;
 }
 
 flagcxResult_t flagcxTopoGetXmlFromFile(const char *xmlTopoFile,
                                         struct flagcxXml *xml, int warn) {
-  FILE *file = fopen(xmlTopoFile, "r");
-  if (file == NULL) {
+  flagcxResult_t ret = flagcxSuccess;
+  int fd = open(xmlTopoFile, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
     if (warn) {
       WARN("Could not open XML topology file %s : %s", xmlTopoFile,
            strerror(errno));
     }
+    if (fd >= 0)
+      close(fd);
     return flagcxSuccess;
   }
+  void *map = NULL;
+  if (st.st_size > 0) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    WARN("Could not map XML topology file %s : %s", xmlTopoFile,
+         strerror(errno));
+    return flagcxSystemError;
+  }
   INFO(FLAGCX_GRAPH, "Loading topology file %s", xmlTopoFile);
+  struct xmlStream stream = {(const char *)map,
+                             (const char *)map + (map ? st.st_size : 0)};
   struct xmlHandler handlers[] = {{"system", flagcxTopoXmlLoadSystem}};
   xml->maxIndex = 0;
-  FLAGCXCHECK(xmlLoadSub(file, xml, NULL, handlers, 1));
-  fclose(file);
-  return flagcxSuccess;
+  FLAGCXCHECKGOTO(xmlLoadSub(&stream, xml, NULL, handlers, 1), ret, exit);
+exit:
+  if (map != NULL)
+    munmap(map, st.st_size);
+  return ret;
 }
 
 flagcxResult_t flagcxTopoDumpXmlToFile(const char *xmlTopoFile,
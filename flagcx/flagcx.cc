@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <unordered_map>
+#include <vector>
 
 #define FLAGCX_CACHE_CAPACITY 16
 static flagcxLRUCache<size_t, flagcxC2cPlanner>
@@ -77,6 +78,123 @@ static struct flagcxDeviceHandle globalDeviceHandle {
       deviceAdaptor->eventQuery,
 };
 
+// A freshly built plan whose first execution is still in flight on a stream
+struct flagcxC2cPlanTiming {
+  flagcxComm_t comm;
+  flagcxCommOp_t commOp;
+  size_t count;
+  flagcxC2cAlgo_t algo;
+  float predictedTime;
+  uint64_t startTime;
+  flagcxEvent_t event;
+};
+static std::vector<struct flagcxC2cPlanTiming> pendingPlanTimings;
+
+static bool flagcxC2cPlanTimeLogEnabled() {
+  return flagcxDebugLevel >= FLAGCX_LOG_INFO &&
+         (flagcxDebugMask & FLAGCX_TUNING);
+}
+
+static void flagcxC2cPrintPlanTime(struct flagcxC2cPlanTiming *timing,
+                                   uint64_t endTime) {
+  INFO(FLAGCX_TUNING,
+       "COST_MODEL: commOp %d count %zu algo %s predicted time %.2f us, "
+       "measured time %.2f us",
+       timing->commOp, timing->count, flagcxC2cAlgoStr[timing->algo],
+       timing->predictedTime, (endTime - timing->startTime) / 1e3);
+}
+
+// Log the plans of comm whose end event has completed. The measured time is
+// taken when the completion is observed, so it is an upper bound that gets
+// tighter the more often collectives are issued. Events that cannot be
+// queried (e.g. recorded during stream capture) are dropped silently, as are
+// all events of comm when drop is set.
+static void flagcxC2cPollPlanTimes(flagcxComm_t comm, int drop) {
+  uint64_t now = clockNano();
+  for (size_t i = 0; i < pendingPlanTimings.size();) {
+    struct flagcxC2cPlanTiming *timing = &pendingPlanTimings[i];
+    if (timing->comm != comm) {
+      i++;
+      continue;
+    }
+    flagcxResult_t res =
+        drop ? flagcxInternalError : deviceAdaptor->eventQuery(timing->event);
+    if (res == flagcxInProgress) {
+      i++;
+      continue;
+    }
+    if (res == flagcxSuccess) {
+      flagcxC2cPrintPlanTime(timing, now);
+    }
+    deviceAdaptor->eventDestroy(timing->event);
+    pendingPlanTimings.erase(pendingPlanTimings.begin() + i);
+  }
+}
+
+// Log the predicted time of a freshly built plan next to its measured time.
+// Only done when the TUNING subsystem is logged; the end of the plan is
+// tracked with an event so that the caller is never blocked.
+static flagcxResult_t flagcxC2cLogPlanTime(flagcxC2cPlanner *planner,
+                                           flagcxCommOp_t commOp, size_t count,
+                                           uint64_t startTime,
+                                           flagcxComm_t comm,
+                                           flagcxStream_t stream) {
+  if (!flagcxC2cPlanTimeLogEnabled() || planner->getPredictedTime() < 0) {
+    return flagcxSuccess;
+  }
+  struct flagcxC2cPlanTiming timing = {comm,
+                                       commOp,
+                                       count,
+                                       planner->getAlgo(),
+                                       planner->getPredictedTime(),
+                                       startTime,
+                                       NULL};
+  if (stream == NULL) {
+    // the host comm path has already completed
+    flagcxC2cPrintPlanTime(&timing, clockNano());
+    return flagcxSuccess;
+  }
+  FLAGCXCHECK(deviceAdaptor->eventCreate(&timing.event));
+  FLAGCXCHECK(deviceAdaptor->eventRecord(timing.event, stream));
+  pendingPlanTimings.push_back(timing);
+  return flagcxSuccess;
+}
+
+// Look up the plan of a C2C communication pattern in planCache, building and
+// scoring a new one on a miss. newPlan is set when the plan was just built.
+static flagcxResult_t flagcxC2cGetPlan(size_t count, size_t totalCount,
+                                       size_t recvCount, flagcxCommOp_t commOp,
+                                       flagcxRedOp_t op,
+                                       flagcxDataType_t datatype,
+                                       flagcxComm_t comm,
+                                       flagcxC2cPlanner *planner,
+                                       int *newPlan) {
+  auto hashValue = getC2cCommPatternHash(count, commOp, op, datatype, comm);
+  *newPlan = 0;
+  if (!pendingPlanTimings.empty()) {
+    flagcxC2cPollPlanTimes(comm, 0);
+  }
+  if (!planCache.get(hashValue, *planner)) {
+    INFO(FLAGCX_COLL,
+         "No available plan is found, create a new one with "
+         "communication pattern "
+         "(count, commOp, redOp, datatype, comm) = (%ld, %d, %d, %d, %ld), "
+         "hashValue = %ld",
+         count, commOp, op, datatype, (size_t)((uintptr_t)comm), hashValue);
+    FLAGCXCHECK(flagcxC2cAlgoSelect(planner, totalCount, recvCount, comm,
+                                    commOp, op, datatype));
+    planCache.put(hashValue, *planner);
+    *newPlan = 1;
+  } else {
+    INFO(FLAGCX_COLL,
+         "Found available plan with communication pattern "
+         "(count, commOp, redOp, datatype, comm) = (%ld, %d, %d, %d, %ld), "
+         "hashValue = %ld",
+         count, commOp, op, datatype, (size_t)((uintptr_t)comm), hashValue);
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t flagcxEnsureCommReady(flagcxComm_t comm) {
   if (comm == NULL) {
     return flagcxInternalError;
@@ -180,13 +298,8 @@ const char *flagcxGetLastError(flagcxComm_t comm) {
   return "Not implemented.";
 }
 
-flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
-                                  flagcxUniqueId_t commId, int rank) {
-  if (nranks < 1 || rank < 0 || rank >= nranks) {
-    WARN("Invalid rank requested : %d/%d", rank, nranks);
-    return flagcxInvalidArgument;
-  }
-
+static flagcxResult_t flagcxCommAlloc(flagcxComm_t *comm, int nranks,
+                                      int rank) {
   (*comm) = NULL;
   flagcxCalloc(comm, 1);
   (*comm)->rank = rank;
@@ -212,59 +325,51 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
   (*comm)->homoInterMyRank = -1;
   (*comm)->homoInterRanks = -1;
   (*comm)->homoInterComm = NULL;
+  (*comm)->costTable = NULL;
+  FLAGCXCHECK(flagcxScratchArenaInit(&(*comm)->scratchArena));
+  return flagcxSuccess;
+}
 
-  struct bootstrapState *state = NULL;
-  FLAGCXCHECK(flagcxCalloc(&state, 1));
-  state->rank = rank;
-  state->nranks = nranks;
-  state->abortFlag = (*comm)->abortFlag;
-  (*comm)->bootstrap = state;
-  state->magic = ((struct flagcxBootstrapHandle *)commId)->magic;
-  (*comm)->magic = ((struct flagcxBootstrapHandle *)commId)->magic;
-
-  // Init bootstrap net
-  FLAGCXCHECK(bootstrapNetInit());
-
-  // Init bootstrap state
-  FLAGCXCHECK(bootstrapInit((struct flagcxBootstrapHandle *)commId, state));
-
-  // Ready to detect heterogeneous/homogeneous communicator
-  // Use bootstrap allgather to exchange Device info
-  flagcxVendor *vendorData =
-      NULL; // temp data used for device vendor gather operation.
-
-  // Get current gpu vendor
-  flagcxVendor vendor;
-  deviceAdaptor->getVendor(vendor.internal);
-  FLAGCXCHECK(flagcxCalloc(&vendorData, nranks));
-  memcpy(vendorData + rank, &vendor, sizeof(flagcxVendor));
-  FLAGCXCHECK(
-      bootstrapAllGather(state, (void *)vendorData, sizeof(flagcxVendor)));
-  FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, 0));
+// Init the cluster layout and the underlying communicators of comm once its
+// bootstrap is up. heteroComm is the hetero communicator split from the
+// parent of comm, NULL to create a new one.
+static flagcxResult_t
+flagcxCommInitFromBootstrap(flagcxComm_t *comm, flagcxHeteroComm_t heteroComm) {
+  int rank = (*comm)->rank;
+  int nranks = (*comm)->nranks;
+  struct bootstrapState *state = (*comm)->bootstrap;
+  // scratch space for the unique ids of the underlying communicators
+  flagcxUniqueId uniqueId;
+  flagcxUniqueId_t commId = &uniqueId;
+
+  // Exchange the metadata of all ranks in a single allgather, everything
+  // else about the cluster layout is derived locally from it
+  struct flagcxRankInfo *rankInfoData;
+  FLAGCXCHECK(flagcxCalloc(&rankInfoData, nranks));
+  FLAGCXCHECK(flagcxFillRankInfo(rankInfoData + rank, rank));
+  FLAGCXCHECK(bootstrapAllGather(state, (void *)rankInfoData,
+                                 sizeof(struct flagcxRankInfo)));
 
   // Init cluster info
   int *globalRankToHomoRankData;
+  int *homoRootRankData;
   int *clusterIdData;
   int *clusterInterRankData;
   FLAGCXCHECK(flagcxCalloc(&globalRankToHomoRankData, nranks));
+  FLAGCXCHECK(flagcxCalloc(&homoRootRankData, nranks));
   FLAGCXCHECK(flagcxCalloc(&clusterIdData, nranks));
   FLAGCXCHECK(flagcxCalloc(&clusterInterRankData, nranks));
   FLAGCXCHECK(flagcxCollectClusterInfos(
-      vendorData, &(*comm)->comm_type, globalRankToHomoRankData + rank,
-      &(*comm)->homo_root_rank, &(*comm)->homo_ranks, clusterIdData + rank,
-      clusterInterRankData + rank, &(*comm)->nclusters, rank, nranks));
-  FLAGCXCHECK(
-      bootstrapAllGather(state, (void *)globalRankToHomoRankData, sizeof(int)));
-  FLAGCXCHECK(bootstrapAllGather(state, (void *)clusterIdData, sizeof(int)));
-  FLAGCXCHECK(
-      bootstrapAllGather(state, (void *)clusterInterRankData, sizeof(int)));
-  FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, 0));
+      rankInfoData, &(*comm)->comm_type, globalRankToHomoRankData,
+      homoRootRankData, clusterIdData, clusterInterRankData,
+      &(*comm)->nclusters, nranks));
   (*comm)->homo_rank = globalRankToHomoRankData[rank];
+  (*comm)->homo_root_rank = homoRootRankData[rank];
   (*comm)->cluster_ids = clusterIdData;
   (*comm)->globalrank2homorank = globalRankToHomoRankData;
 
   // fill clusterVendorMap
-  FLAGCXCHECK(flagcxFillClusterVendorInfo(vendorData, (*comm), clusterIdData,
+  FLAGCXCHECK(flagcxFillClusterVendorInfo(rankInfoData, (*comm), clusterIdData,
                                           nranks, (*comm)->nclusters));
 
   int *clusterSizes;
@@ -286,6 +391,7 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
   }
   clusterSizes[cid] = nranks - sum;
   (*comm)->cluster_sizes = clusterSizes;
+  (*comm)->homo_ranks = clusterSizes[clusterIdData[rank]];
 
   for (int i = 0; i < nranks; ++i) {
     if (clusterInterRankData[i] != -1) {
@@ -317,45 +423,42 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
   }
 
   // Reset commId and homo root rank calls underlying GetUniqueId function for
-  // initialization of homo communicator
+  // initialization of homo communicator, the id is only sent to the ranks of
+  // its cluster
+  std::vector<int> clusterRanks((*comm)->homo_ranks);
+  for (int i = 0; i < (*comm)->homo_ranks; ++i) {
+    clusterRanks[i] = (*comm)->homo_root_rank + i;
+  }
   memset((void *)commId, 0, sizeof(*commId));
   if ((*comm)->homo_rank == 0) {
     cclAdaptors[flagcxCCLAdaptorDevice]->getUniqueId(&commId);
   }
-  flagcxUniqueId *uniqueIdData;
-  FLAGCXCHECK(flagcxCalloc(&uniqueIdData, nranks));
-  if ((*comm)->homo_rank == 0) {
-    memcpy((void *)&uniqueIdData[rank], (void *)commId, sizeof(flagcxUniqueId));
-  }
-  FLAGCXCHECK(
-      bootstrapAllGather(state, (void *)uniqueIdData, sizeof(flagcxUniqueId)));
-  FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, 0));
-
-  memcpy((void *)commId, (void *)&uniqueIdData[(*comm)->homo_root_rank],
-         sizeof(flagcxUniqueId));
+  FLAGCXCHECK(bootstrapIntraNodeBroadcast(
+      state, clusterRanks.data(), (*comm)->homo_rank, (*comm)->homo_ranks, 0,
+      (void *)commId, sizeof(flagcxUniqueId)));
   FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->commInitRank(
       &(*comm)->homo_comm, (*comm)->homo_ranks, commId, (*comm)->homo_rank,
       NULL));
 
   if (!is_homo_comm(*comm)) {
     // Reset commId and hetero root rank calls flagcxHeteroGetUniqueId
-    memset((void *)commId, 0, sizeof(flagcxUniqueId));
-    memset((void *)uniqueIdData, 0, nranks * sizeof(flagcxUniqueId));
-    if (rank == 0) {
-      flagcxHeteroGetUniqueId(commId);
-      memcpy((void *)&uniqueIdData[0], (void *)commId, sizeof(flagcxUniqueId));
+    if (heteroComm != NULL) {
+      (*comm)->hetero_comm = heteroComm;
+    } else {
+      memset((void *)commId, 0, sizeof(flagcxUniqueId));
+      if (rank == 0) {
+        flagcxHeteroGetUniqueId(commId);
+      }
+      FLAGCXCHECK(bootstrapBroadcast(state, rank, nranks, 0, (void *)commId,
+                                     sizeof(flagcxUniqueId)));
+      // call flagcxHeteroCommInitRank
+      FLAGCXCHECK(flagcxHeteroCommInitRank(&(*comm)->hetero_comm, nranks,
+                                           *commId, rank));
     }
-    FLAGCXCHECK(bootstrapAllGather(state, (void *)uniqueIdData,
-                                   sizeof(flagcxUniqueId)));
-    FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, 0));
-
-    memcpy((void *)commId, (void *)&uniqueIdData[0], sizeof(flagcxUniqueId));
-    // call flagcxHeteroCommInitRank
-    FLAGCXCHECK(
-        flagcxHeteroCommInitRank(&(*comm)->hetero_comm, nranks, *commId, rank));
 
-    // Init host cclAdaptor
-    if (use_host_comm() || (*comm)->has_single_rank_homo_comm) {
+    // Init host cclAdaptor, it is also a candidate of the C2C algo selection
+    if (use_host_comm() || (*comm)->has_single_rank_homo_comm ||
+        flagcxC2cAlgoSelectEnabled()) {
       FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorHost]->commInitRank(
           &(*comm)->host_comm, nranks, commId, rank, state));
     }
@@ -387,15 +490,16 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
     if (enableTopoDetect && strcmp(enableTopoDetect, "TRUE") ==
                                 0) { // safety check nic distance is only
                                      // available after topo detection
-      FLAGCXCHECK(flagcxGetNicDistance((*comm)->hetero_comm->topoServer, rank,
-                                       nicDistanceData + rank));
+      FLAGCXCHECK(flagcxGetNicDistance(
+          (*comm)->hetero_comm->topoServer,
+          flagcxTopParentRank((*comm)->hetero_comm, rank),
+          nicDistanceData + rank));
     } else {
       nicDistanceData[rank].distance = rank % 2 + 1;
       nicDistanceData[rank].netGuid = rank; // give a dummy value
     }
     FLAGCXCHECK(bootstrapAllGather(state, (void *)nicDistanceData,
                                    sizeof(flagcxNicDistance)));
-    FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, 0));
     for (int i = 0; i < (*comm)->nclusters; ++i) {
       int minDistance = INT_MAX;
       std::unordered_map<int, std::vector<int>> nicDistanceToRanks;
@@ -449,36 +553,94 @@ flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
     // Reset commId and homo inter root rank calls underlying GetUniqueId
     // function for initialization of homo inter communicator
     memset((void *)commId, 0, sizeof(flagcxUniqueId));
-    memset((void *)uniqueIdData, 0, nranks * sizeof(flagcxUniqueId));
-    // Let homoInterRootRank call underlying GetUniqueId function
-    // for initialization of homo inter communicator
-    if (rank == (*comm)->homoInterRootRank) {
-      cclAdaptors[flagcxCCLAdaptorDevice]->getUniqueId(&commId);
-      memcpy((void *)&uniqueIdData[rank], (void *)commId,
-             sizeof(flagcxUniqueId));
-    }
-    // Collect uniqueIdData globally
-    FLAGCXCHECK(bootstrapAllGather(state, (void *)uniqueIdData,
-                                   sizeof(flagcxUniqueId)));
-    FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, 0));
-    // Call cclAdaptor->commInitRank
-    if ((*comm)->homoInterRootRank != -1) {
-      memcpy((void *)commId, (void *)&uniqueIdData[(*comm)->homoInterRootRank],
-             sizeof(flagcxUniqueId));
+    // Let homoInterRootRank call underlying GetUniqueId function and send it
+    // to the other homo inter ranks of its cluster
+    if ((*comm)->homoInterMyRank != -1) {
+      if (rank == (*comm)->homoInterRootRank) {
+        cclAdaptors[flagcxCCLAdaptorDevice]->getUniqueId(&commId);
+      }
+      FLAGCXCHECK(bootstrapIntraNodeBroadcast(
+          state, myClusterInterRanks.data(), (*comm)->homoInterMyRank,
+          (*comm)->homoInterRanks, 0, (void *)commId, sizeof(flagcxUniqueId)));
       FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->commInitRank(
           &(*comm)->homoInterComm, (*comm)->homoInterRanks, commId,
           (*comm)->homoInterMyRank, NULL));
     }
     free(nicDistanceData);
+
+    // Load or calibrate the cost model parameters
+    FLAGCXCHECK(flagcxCostTableInit(*comm));
   }
 
   free(clusterInterRankData);
-  free(uniqueIdData);
-  free(vendorData);
+  free(homoRootRankData);
+  free(rankInfoData);
 
   return flagcxSuccess;
 }
 
+flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
+                                  flagcxUniqueId_t commId, int rank) {
+  if (nranks < 1 || rank < 0 || rank >= nranks) {
+    WARN("Invalid rank requested : %d/%d", rank, nranks);
+    return flagcxInvalidArgument;
+  }
+  FLAGCXCHECK(flagcxCommAlloc(comm, nranks, rank));
+
+  struct bootstrapState *state = NULL;
+  FLAGCXCHECK(flagcxCalloc(&state, 1));
+  state->rank = rank;
+  state->nranks = nranks;
+  state->abortFlag = (*comm)->abortFlag;
+  (*comm)->bootstrap = state;
+  state->magic = ((struct flagcxBootstrapHandle *)commId)->magic;
+  (*comm)->magic = ((struct flagcxBootstrapHandle *)commId)->magic;
+
+  // Init bootstrap net
+  FLAGCXCHECK(bootstrapNetInit());
+
+  // Init bootstrap state
+  FLAGCXCHECK(bootstrapInit((struct flagcxBootstrapHandle *)commId, state));
+
+  return flagcxCommInitFromBootstrap(comm, NULL);
+}
+
+flagcxResult_t flagcxCommSplit(flagcxComm_t comm, int color, int key,
+                               flagcxComm_t *newcomm) {
+  FLAGCXCHECK(flagcxEnsureCommReady(comm));
+  struct bootstrapState *state = NULL;
+  int *parentRanks = NULL;
+  flagcxHeteroComm_t heteroComm = NULL;
+
+  *newcomm = NULL;
+  FLAGCXCHECK(
+      bootstrapSplit(comm->bootstrap, color, key, &state, &parentRanks));
+
+  if (!is_homo_comm(comm)) {
+    // The hetero split is collective over all ranks of comm, only the new
+    // communicators spanning several clusters get a hetero communicator
+    bool hybrid = false;
+    for (int i = 0; state != NULL && i < state->nranks; ++i) {
+      if (comm->cluster_ids[parentRanks[i]] !=
+          comm->cluster_ids[parentRanks[0]]) {
+        hybrid = true;
+      }
+    }
+    FLAGCXCHECK(flagcxHeteroCommSplit(comm->hetero_comm,
+                                      hybrid ? color : FLAGCX_SPLIT_NOCOLOR,
+                                      key, &heteroComm));
+  }
+  free(parentRanks);
+  if (state == NULL) {
+    return flagcxSuccess;
+  }
+
+  FLAGCXCHECK(flagcxCommAlloc(newcomm, state->nranks, state->rank));
+  (*newcomm)->bootstrap = state;
+  (*newcomm)->magic = state->magic;
+  return flagcxCommInitFromBootstrap(newcomm, heteroComm);
+}
+
 flagcxResult_t flagcxCommFinalize(flagcxComm_t comm) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
@@ -496,14 +658,23 @@ flagcxResult_t flagcxCommDestroy(flagcxComm_t comm) {
   free(comm->cluster_sizes);
   free(comm->globalrank2homorank);
 
+  // Drop plan timings still in flight
+  flagcxC2cPollPlanTimes(comm, 1);
+
+  // Destroy scratch buffer
+  FLAGCXCHECK(flagcxScratchArenaDestroy(&comm->scratchArena));
+
+  // Destroy cost model parameters
+  FLAGCXCHECK(flagcxCostTableDestroy(comm));
+
   // Destroy bootstrap state and net
   bootstrapClose(comm->bootstrap);
 
   // Destroy hetero comm
   if (!is_homo_comm(comm)) {
     FLAGCXCHECK(flagcxHeteroCommDestroy(comm->hetero_comm));
-    // Destroy homo comm
-    if (use_host_comm()) {
+    // Destroy host comm
+    if (comm->host_comm != NULL) {
       FLAGCXCHECK(
           cclAdaptors[flagcxCCLAdaptorHost]->commDestroy(comm->host_comm));
     }
@@ -562,15 +733,28 @@ flagcxResult_t flagcxCommUserRank(const flagcxComm_t comm, int *rank) {
   return flagcxHeteroCommUserRank(comm->hetero_comm, rank);
 }
 
+flagcxResult_t flagcxCommTrimScratch(flagcxComm_t comm, size_t maxBytes) {
+  FLAGCXCHECK(flagcxEnsureCommReady(comm));
+  return flagcxScratchArenaTrim(&comm->scratchArena, maxBytes);
+}
+
 flagcxResult_t flagcxCommGetAsyncError(flagcxComm_t comm,
-                                       flagcxResult_t asyncError) {
+                                       flagcxResult_t *asyncError) {
   FLAGCXCHECK(flagcxEnsureCommReady(comm));
   if (is_homo_comm(comm)) {
     return cclAdaptors[flagcxCCLAdaptorDevice]->commGetAsyncError(
         comm->homo_comm, asyncError);
   }
-  // TODO: to be implemented.
-  return flagcxNotSupported;
+  FLAGCXCHECK(flagcxHeteroCommGetAsyncError(comm->hetero_comm, asyncError));
+  if (*asyncError == flagcxSuccess && comm->homo_comm != NULL) {
+    // not every device CCL tracks asynchronous errors
+    flagcxResult_t homoError = flagcxSuccess;
+    if (cclAdaptors[flagcxCCLAdaptorDevice]->commGetAsyncError(
+            comm->homo_comm, &homoError) == flagcxSuccess) {
+      *asyncError = homoError;
+    }
+  }
+  return flagcxSuccess;
 }
 
 flagcxResult_t flagcxBarrier(flagcxComm_t comm, flagcxStream_t stream) {
@@ -665,24 +849,32 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
 
       bool is_root_cluster =
           (comm->cluster_ids[comm->rank] == comm->cluster_ids[root]);
+      // the arena stays marked in use until it is released, so every error
+      // path below has to go through the release at out
+      flagcxResult_t res = flagcxSuccess;
+      bool useScratch =
+          is_root_cluster || comm->homo_rank == comm->homo_inter_rank;
+      int cid = 0;
+
       // allocate a bounce buffer for the homo_inter_rank of non-root clusters
       // and homo ranks of root cluster This buffer is used to avoid the
       // overwrite of recvbuffer
       void *fwdbuff;
-      if (is_root_cluster ||
-          (!is_root_cluster && comm->homo_rank == comm->homo_inter_rank)) {
-        deviceAdaptor->deviceMalloc(&fwdbuff,
-                                    getFlagcxDataTypeSize(datatype) * count,
-                                    flagcxMemDevice, stream);
+      if (useScratch) {
+        FLAGCXCHECK(flagcxScratchArenaGet(&comm->scratchArena,
+                                          getFlagcxDataTypeSize(datatype) *
+                                              count,
+                                          stream, &fwdbuff));
         deviceAdaptor->deviceMemset(fwdbuff, 0,
                                     getFlagcxDataTypeSize(datatype) * count,
                                     flagcxMemDevice, stream);
       }
 
       // intra-cluster reduce
-      FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
-          sendbuff, fwdbuff, count, datatype, op, comm->homo_inter_rank,
-          comm->homo_comm, stream));
+      FLAGCXCHECKGOTO(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
+                          sendbuff, fwdbuff, count, datatype, op,
+                          comm->homo_inter_rank, comm->homo_comm, stream),
+                      res, out);
 
       if (is_root_cluster && comm->homo_inter_rank != comm->homo_rank) {
         if (op == flagcxSum) {
@@ -696,7 +888,6 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
       deviceAdaptor->streamSynchronize(stream);
 
       // inter-cluster sendrecv
-      int cid = 0;
       flagcxGroupStart(comm);
       for (int i = 0; i < comm->nclusters; ++i) {
         if (comm->cluster_ids[comm->rank] == i)
@@ -708,9 +899,10 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
               (comm->homo_inter_rank - cid - 1 + comm->homo_ranks) %
               comm->homo_ranks;
           if (comm->homo_rank == homo_rank_to_recv_from_cluster) {
-            FLAGCXCHECK(flagcxHeteroRecv(fwdbuff, count, datatype,
-                                         comm->cluster_inter_ranks[i],
-                                         comm->hetero_comm, stream));
+            FLAGCXCHECKGOTO(flagcxHeteroRecv(fwdbuff, count, datatype,
+                                             comm->cluster_inter_ranks[i],
+                                             comm->hetero_comm, stream),
+                            res, group_out);
           }
         } else {
           int homo_rank_to_send_to_cluster =
@@ -722,14 +914,19 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
               comm->globalrank2homorank[comm->cluster_inter_ranks[i]] +
               comm->cluster_inter_ranks[i];
           if (comm->homo_inter_rank == comm->homo_rank) {
-            FLAGCXCHECK(flagcxHeteroSend(fwdbuff, count, datatype,
-                                         global_rank_to_send_to_cluster,
-                                         comm->hetero_comm, stream));
+            FLAGCXCHECKGOTO(flagcxHeteroSend(fwdbuff, count, datatype,
+                                             global_rank_to_send_to_cluster,
+                                             comm->hetero_comm, stream),
+                            res, group_out);
           }
         }
         cid += 1;
       }
+    group_out:
       flagcxGroupEnd(comm);
+      if (res != flagcxSuccess) {
+        goto out;
+      }
 
       // TODO: use stream wait rather than stream sync to avoid cpu blocking
       deviceAdaptor->streamSynchronize(stream);
@@ -740,15 +937,21 @@ flagcxResult_t flagcxReduce(const void *sendbuff, void *recvbuff, size_t count,
         for (int i = 0; i < comm->cluster_ids[comm->rank]; ++i) {
           offset += comm->cluster_sizes[i];
         }
-        FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
-            fwdbuff, recvbuff, count, datatype, op, root - offset,
-            comm->homo_comm, stream));
+        FLAGCXCHECKGOTO(cclAdaptors[flagcxCCLAdaptorDevice]->reduce(
+                            fwdbuff, recvbuff, count, datatype, op,
+                            root - offset, comm->homo_comm, stream),
+                        res, out);
       }
 
-      if (is_root_cluster ||
-          (!is_root_cluster && comm->homo_rank == comm->homo_inter_rank)) {
-        deviceAdaptor->deviceFree(fwdbuff, flagcxMemDevice, stream);
+    out:
+      if (useScratch) {
+        flagcxResult_t relRes =
+            flagcxScratchArenaRelease(&comm->scratchArena, stream);
+        if (res == flagcxSuccess) {
+          res = relRes;
+        }
       }
+      return res;
     }
   }
   return flagcxSuccess;
@@ -778,13 +981,21 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
         offset += comm->cluster_sizes[i];
       }
 
+      // the arena stays marked in use until it is released, so every error
+      // path below has to go through the release at out
+      flagcxResult_t res = flagcxSuccess;
+      bool useScratch =
+          comm->homo_rank == comm->homo_inter_rank && comm->rank != root;
+      bool fwd_root =
+          comm->cluster_inter_ranks[comm->cluster_ids[root]] != root;
+
       // allocate a bounce buffer for the homo_inter_rank of non-root clusters
       void *fwdbuff;
       if (!is_root_cluster && comm->homo_rank == comm->homo_inter_rank) {
-        deviceAdaptor->deviceMalloc(&fwdbuff,
-                                    getFlagcxDataTypeSize(datatype) *
-                                        comm->homo_ranks * count,
-                                    flagcxMemDevice, stream);
+        FLAGCXCHECK(flagcxScratchArenaGet(&comm->scratchArena,
+                                          getFlagcxDataTypeSize(datatype) *
+                                              comm->homo_ranks * count,
+                                          stream, &fwdbuff));
         deviceAdaptor->deviceMemset(fwdbuff, 0,
                                     getFlagcxDataTypeSize(datatype) *
                                         comm->homo_ranks * count,
@@ -794,9 +1005,10 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
       // homo_inter_rank != root
       if (is_root_cluster && comm->homo_rank == comm->homo_inter_rank &&
           comm->rank != root) {
-        deviceAdaptor->deviceMalloc(
-            &fwdbuff, getFlagcxDataTypeSize(datatype) * comm->nranks * count,
-            flagcxMemDevice, stream);
+        FLAGCXCHECK(flagcxScratchArenaGet(
+            &comm->scratchArena,
+            getFlagcxDataTypeSize(datatype) * comm->nranks * count, stream,
+            &fwdbuff));
         deviceAdaptor->deviceMemset(
             fwdbuff, 0, getFlagcxDataTypeSize(datatype) * comm->nranks * count,
             flagcxMemDevice, stream);
@@ -805,15 +1017,18 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
       // intra-cluster gather
       if (comm->homo_ranks > 1) {
         if (is_root_cluster) {
-          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->gather(
-              sendbuff,
-              (void *)((char *)recvbuff +
-                       getFlagcxDataTypeSize(datatype) * offset * count),
-              count, datatype, root - offset, comm->homo_comm, stream));
+          FLAGCXCHECKGOTO(
+              cclAdaptors[flagcxCCLAdaptorDevice]->gather(
+                  sendbuff,
+                  (void *)((char *)recvbuff +
+                           getFlagcxDataTypeSize(datatype) * offset * count),
+                  count, datatype, root - offset, comm->homo_comm, stream),
+              res, out);
         } else {
-          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->gather(
-              sendbuff, fwdbuff, count, datatype, comm->homo_inter_rank,
-              comm->homo_comm, stream));
+          FLAGCXCHECKGOTO(cclAdaptors[flagcxCCLAdaptorDevice]->gather(
+                              sendbuff, fwdbuff, count, datatype,
+                              comm->homo_inter_rank, comm->homo_comm, stream),
+                          res, out);
         }
       }
 
@@ -821,23 +1036,24 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
       deviceAdaptor->streamSynchronize(stream);
 
       // inter-cluster sendrecv
-      bool fwd_root =
-          comm->cluster_inter_ranks[comm->cluster_ids[root]] != root;
       flagcxGroupStart(comm);
       if (!is_root_cluster && comm->homo_inter_rank == comm->homo_rank) {
-        FLAGCXCHECK(
+        FLAGCXCHECKGOTO(
             flagcxHeteroSend(fwdbuff, comm->homo_ranks * count, datatype,
                              comm->cluster_inter_ranks[comm->cluster_ids[root]],
-                             comm->hetero_comm, stream));
+                             comm->hetero_comm, stream),
+            res, hetero_group_out);
       } else if (!fwd_root && comm->rank == root) {
         int recvoffset = 0;
         for (int i = 0; i < comm->nclusters; i++) {
           if (comm->cluster_ids[comm->rank] != i) {
-            FLAGCXCHECK(flagcxHeteroRecv(
-                (void *)((char *)recvbuff +
-                         getFlagcxDataTypeSize(datatype) * recvoffset * count),
-                comm->cluster_sizes[i] * count, datatype,
-                comm->cluster_inter_ranks[i], comm->hetero_comm, stream));
+            FLAGCXCHECKGOTO(
+                flagcxHeteroRecv(
+                    (void *)((char *)recvbuff + getFlagcxDataTypeSize(datatype) *
+                                                    recvoffset * count),
+                    comm->cluster_sizes[i] * count, datatype,
+                    comm->cluster_inter_ranks[i], comm->hetero_comm, stream),
+                res, hetero_group_out);
           }
           recvoffset += comm->cluster_sizes[i];
         }
@@ -846,16 +1062,22 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
         int recvoffset = 0;
         for (int i = 0; i < comm->nclusters; i++) {
           if (comm->cluster_ids[comm->rank] != i) {
-            FLAGCXCHECK(flagcxHeteroRecv(
-                (void *)((char *)fwdbuff +
-                         getFlagcxDataTypeSize(datatype) * recvoffset * count),
-                comm->cluster_sizes[i] * count, datatype,
-                comm->cluster_inter_ranks[i], comm->hetero_comm, stream));
+            FLAGCXCHECKGOTO(
+                flagcxHeteroRecv(
+                    (void *)((char *)fwdbuff + getFlagcxDataTypeSize(datatype) *
+                                                   recvoffset * count),
+                    comm->cluster_sizes[i] * count, datatype,
+                    comm->cluster_inter_ranks[i], comm->hetero_comm, stream),
+                res, hetero_group_out);
           }
           recvoffset += comm->cluster_sizes[i];
         }
       }
+    hetero_group_out:
       flagcxGroupEnd(comm);
+      if (res != flagcxSuccess) {
+        goto out;
+      }
 
       // TODO: use stream wait rather than stream sync to avoid cpu blocking
       deviceAdaptor->streamSynchronize(stream);
@@ -868,11 +1090,14 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
           int recvoffset = 0;
           for (int i = 0; i < comm->nclusters; ++i) {
             if (i != comm->cluster_ids[root]) {
-              FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->recv(
-                  (void *)((char *)recvbuff + getFlagcxDataTypeSize(datatype) *
-                                                  recvoffset * count),
-                  comm->cluster_sizes[i] * count, datatype,
-                  comm->homo_inter_rank, comm->homo_comm, stream));
+              FLAGCXCHECKGOTO(
+                  cclAdaptors[flagcxCCLAdaptorDevice]->recv(
+                      (void *)((char *)recvbuff +
+                               getFlagcxDataTypeSize(datatype) * recvoffset *
+                                   count),
+                      comm->cluster_sizes[i] * count, datatype,
+                      comm->homo_inter_rank, comm->homo_comm, stream),
+                  res, homo_group_out);
             }
             recvoffset += comm->cluster_sizes[i];
           }
@@ -880,21 +1105,31 @@ flagcxResult_t flagcxGather(const void *sendbuff, void *recvbuff, size_t count,
           int sendoffset = 0;
           for (int i = 0; i < comm->nclusters; ++i) {
             if (i != comm->cluster_ids[root]) {
-              FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->send(
-                  (void *)((char *)fwdbuff + getFlagcxDataTypeSize(datatype) *
-                                                 sendoffset * count),
-                  comm->cluster_sizes[i] * count, datatype, root - offset,
-                  comm->homo_comm, stream));
+              FLAGCXCHECKGOTO(
+                  cclAdaptors[flagcxCCLAdaptorDevice]->send(
+                      (void *)((char *)fwdbuff +
+                               getFlagcxDataTypeSize(datatype) * sendoffset *
+                                   count),
+                      comm->cluster_sizes[i] * count, datatype, root - offset,
+                      comm->homo_comm, stream),
+                  res, homo_group_out);
             }
             sendoffset += comm->cluster_sizes[i];
           }
         }
+      homo_group_out:
         flagcxGroupEnd(comm);
       }
 
-      if (comm->homo_rank == comm->homo_inter_rank && comm->rank != root) {
-        deviceAdaptor->deviceFree(fwdbuff, flagcxMemDevice, stream);
+    out:
+      if (useScratch) {
+        flagcxResult_t relRes =
+            flagcxScratchArenaRelease(&comm->scratchArena, stream);
+        if (res == flagcxSuccess) {
+          res = relRes;
+        }
       }
+      return res;
     }
   }
   return flagcxSuccess;
@@ -926,13 +1161,19 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
         offset += comm->cluster_sizes[i];
       }
 
+      // the arena stays marked in use until it is released, so every error
+      // path below has to go through the release at out
+      flagcxResult_t res = flagcxSuccess;
+      bool useScratch =
+          comm->homo_rank == comm->homo_inter_rank && comm->rank != root;
+
       // allocate a bounce buffer for the homo_inter_rank of non-root clusters
       void *fwdbuff;
       if (!is_root_cluster && comm->homo_rank == comm->homo_inter_rank) {
-        deviceAdaptor->deviceMalloc(&fwdbuff,
-                                    getFlagcxDataTypeSize(datatype) *
-                                        comm->homo_ranks * count,
-                                    flagcxMemDevice, stream);
+        FLAGCXCHECK(flagcxScratchArenaGet(&comm->scratchArena,
+                                          getFlagcxDataTypeSize(datatype) *
+                                              comm->homo_ranks * count,
+                                          stream, &fwdbuff));
         deviceAdaptor->deviceMemset(fwdbuff, 0,
                                     getFlagcxDataTypeSize(datatype) *
                                         comm->homo_ranks * count,
@@ -942,9 +1183,10 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
       // homo_inter_rank != root
       if (is_root_cluster && comm->homo_rank == comm->homo_inter_rank &&
           comm->rank != root) {
-        deviceAdaptor->deviceMalloc(
-            &fwdbuff, getFlagcxDataTypeSize(datatype) * comm->nranks * count,
-            flagcxMemDevice, stream);
+        FLAGCXCHECK(flagcxScratchArenaGet(
+            &comm->scratchArena,
+            getFlagcxDataTypeSize(datatype) * comm->nranks * count, stream,
+            &fwdbuff));
         deviceAdaptor->deviceMemset(
             fwdbuff, 0, getFlagcxDataTypeSize(datatype) * comm->nranks * count,
             flagcxMemDevice, stream);
@@ -958,11 +1200,14 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
           int sendoffset = 0;
           for (int i = 0; i < comm->nclusters; ++i) {
             if (i != comm->cluster_ids[root]) {
-              FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->send(
-                  (void *)((char *)sendbuff + getFlagcxDataTypeSize(datatype) *
-                                                  sendoffset * count),
-                  comm->cluster_sizes[i] * count, datatype,
-                  comm->homo_inter_rank, comm->homo_comm, stream));
+              FLAGCXCHECKGOTO(
+                  cclAdaptors[flagcxCCLAdaptorDevice]->send(
+                      (void *)((char *)sendbuff +
+                               getFlagcxDataTypeSize(datatype) * sendoffset *
+                                   count),
+                      comm->cluster_sizes[i] * count, datatype,
+                      comm->homo_inter_rank, comm->homo_comm, stream),
+                  res, homo_group_out);
             }
             sendoffset += comm->cluster_sizes[i];
           }
@@ -970,16 +1215,23 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
           int recvoffset = 0;
           for (int i = 0; i < comm->nclusters; ++i) {
             if (i != comm->cluster_ids[root]) {
-              FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->recv(
-                  (void *)((char *)fwdbuff + getFlagcxDataTypeSize(datatype) *
-                                                 recvoffset * count),
-                  comm->cluster_sizes[i] * count, datatype, root - offset,
-                  comm->homo_comm, stream));
+              FLAGCXCHECKGOTO(
+                  cclAdaptors[flagcxCCLAdaptorDevice]->recv(
+                      (void *)((char *)fwdbuff +
+                               getFlagcxDataTypeSize(datatype) * recvoffset *
+                                   count),
+                      comm->cluster_sizes[i] * count, datatype, root - offset,
+                      comm->homo_comm, stream),
+                  res, homo_group_out);
             }
             recvoffset += comm->cluster_sizes[i];
           }
         }
+      homo_group_out:
         flagcxGroupEnd(comm);
+        if (res != flagcxSuccess) {
+          goto out;
+        }
       }
 
       // TODO: use stream wait rather than stream sync to avoid cpu blocking
@@ -988,19 +1240,22 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
       // inter-cluster sendrecv
       flagcxGroupStart(comm);
       if (!is_root_cluster && comm->homo_inter_rank == comm->homo_rank) {
-        FLAGCXCHECK(
+        FLAGCXCHECKGOTO(
             flagcxHeteroRecv(fwdbuff, comm->homo_ranks * count, datatype,
                              comm->cluster_inter_ranks[comm->cluster_ids[root]],
-                             comm->hetero_comm, stream));
+                             comm->hetero_comm, stream),
+            res, hetero_group_out);
       } else if (!fwd_root && comm->rank == root) {
         int sendoffset = 0;
         for (int i = 0; i < comm->nclusters; i++) {
           if (comm->cluster_ids[comm->rank] != i) {
-            FLAGCXCHECK(flagcxHeteroSend(
-                (void *)((char *)sendbuff +
-                         getFlagcxDataTypeSize(datatype) * sendoffset * count),
-                comm->cluster_sizes[i] * count, datatype,
-                comm->cluster_inter_ranks[i], comm->hetero_comm, stream));
+            FLAGCXCHECKGOTO(
+                flagcxHeteroSend(
+                    (void *)((char *)sendbuff + getFlagcxDataTypeSize(datatype) *
+                                                    sendoffset * count),
+                    comm->cluster_sizes[i] * count, datatype,
+                    comm->cluster_inter_ranks[i], comm->hetero_comm, stream),
+                res, hetero_group_out);
           }
           sendoffset += comm->cluster_sizes[i];
         }
@@ -1009,16 +1264,22 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
         int sendoffset = 0;
         for (int i = 0; i < comm->nclusters; i++) {
           if (comm->cluster_ids[comm->rank] != i) {
-            FLAGCXCHECK(flagcxHeteroSend(
-                (void *)((char *)fwdbuff +
-                         getFlagcxDataTypeSize(datatype) * sendoffset * count),
-                comm->cluster_sizes[i] * count, datatype,
-                comm->cluster_inter_ranks[i], comm->hetero_comm, stream));
+            FLAGCXCHECKGOTO(
+                flagcxHeteroSend(
+                    (void *)((char *)fwdbuff + getFlagcxDataTypeSize(datatype) *
+                                                   sendoffset * count),
+                    comm->cluster_sizes[i] * count, datatype,
+                    comm->cluster_inter_ranks[i], comm->hetero_comm, stream),
+                res, hetero_group_out);
           }
           sendoffset += comm->cluster_sizes[i];
         }
       }
+    hetero_group_out:
       flagcxGroupEnd(comm);
+      if (res != flagcxSuccess) {
+        goto out;
+      }
 
       // TODO: use stream wait rather than stream sync to avoid cpu blocking
       deviceAdaptor->streamSynchronize(stream);
@@ -1026,21 +1287,30 @@ flagcxResult_t flagcxScatter(const void *sendbuff, void *recvbuff, size_t count,
       // intra-cluster scatter
       if (comm->homo_ranks > 1) {
         if (is_root_cluster) {
-          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->scatter(
-              (void *)((char *)sendbuff +
-                       getFlagcxDataTypeSize(datatype) * offset * count),
-              recvbuff, count, datatype, root - offset, comm->homo_comm,
-              stream));
+          FLAGCXCHECKGOTO(
+              cclAdaptors[flagcxCCLAdaptorDevice]->scatter(
+                  (void *)((char *)sendbuff +
+                           getFlagcxDataTypeSize(datatype) * offset * count),
+                  recvbuff, count, datatype, root - offset, comm->homo_comm,
+                  stream),
+              res, out);
         } else {
-          FLAGCXCHECK(cclAdaptors[flagcxCCLAdaptorDevice]->scatter(
-              fwdbuff, recvbuff, count, datatype, comm->homo_inter_rank,
-              comm->homo_comm, stream));
+          FLAGCXCHECKGOTO(cclAdaptors[flagcxCCLAdaptorDevice]->scatter(
+                              fwdbuff, recvbuff, count, datatype,
+                              comm->homo_inter_rank, comm->homo_comm, stream),
+                          res, out);
         }
       }
 
-      if (comm->homo_rank == comm->homo_inter_rank && comm->rank != root) {
-        deviceAdaptor->deviceFree(fwdbuff, flagcxMemDevice, stream);
+    out:
+      if (useScratch) {
+        flagcxResult_t relRes =
+            flagcxScratchArenaRelease(&comm->scratchArena, stream);
+        if (res == flagcxSuccess) {
+          res = relRes;
+        }
       }
+      return res;
     }
   }
   return flagcxSuccess;
@@ -1125,7 +1395,17 @@ flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
     return cclAdaptors[flagcxCCLAdaptorDevice]->allReduce(
         sendbuff, recvbuff, count, datatype, op, comm->homo_comm, stream);
   } else {
-    if (use_host_comm() || comm->has_single_rank_homo_comm) {
+    // Experimental for multi-nic support
+    // Construct flagcxC2cPlanner and find corresponding strategy
+    flagcxC2cPlanner planner;
+    int newPlan = 0;
+    bool useHostComm = use_host_comm() || comm->has_single_rank_homo_comm;
+    if (!useHostComm) {
+      FLAGCXCHECK(flagcxC2cGetPlan(count, count, count, flagcxCommOpAllReduce,
+                                   op, datatype, comm, &planner, &newPlan));
+      useHostComm = (planner.getAlgo() == flagcxC2cAlgoHostComm);
+    }
+    if (useHostComm) {
       // c2c validation
       if (comm->has_single_rank_homo_comm) {
         WARN("Host comm is required to perform C2C allreduce op when "
@@ -1133,7 +1413,8 @@ flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
       }
 
       uint64_t timers[TIMERS_COLL_COUNT] = {0};
-      timers[TIMER_COLL_TOTAL] = clockNano();
+      uint64_t startTime = clockNano();
+      timers[TIMER_COLL_TOTAL] = startTime;
       void *buff_in;
       void *buff_out;
       size_t size = count * getFlagcxDataTypeSize(datatype);
@@ -1178,37 +1459,17 @@ flagcxResult_t flagcxAllReduce(const void *sendbuff, void *recvbuff,
            timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
            timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
            timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
-    } else {
-      // Experimental for multi-nic support
-      // Construct flagcxC2cPlanner and find corresponding strategy
-      flagcxC2cPlanner planner;
-      auto hashValue =
-          getC2cCommPatternHash(count, flagcxCommOpAllReduce, op, comm);
-      if (!planCache.get(hashValue, planner)) {
-        INFO(FLAGCX_COLL,
-             "No available plan is found, create a new one with "
-             "communication pattern "
-             "(count, commOp, redOp, comm) = (%ld, %d, %d, %ld), hashValue = "
-             "%ld",
-             count, flagcxCommOpAllReduce, op, (size_t)((uintptr_t)comm),
-             hashValue);
-        planner =
-            flagcxC2cPlanner(count, count, comm, flagcxCommOpAllReduce, op);
-        FLAGCXCHECK(planner.findStrategy());
-        planCache.put(hashValue, planner);
-        // TODO: add estimator part
-        // flagcxAlgoTimeEstimator estimator(planner, datatype);
-        // float time = 0.0;
-        // FLAGCXCHECK(estimator.getAlgoTime(&time));
-      } else {
-        INFO(FLAGCX_COLL,
-             "Found available plan with communication pattern "
-             "(count, commOp, redOp, comm) = (%ld, %d, %d, %ld), hashValue = "
-             "%ld",
-             count, flagcxCommOpAllReduce, op, (size_t)((uintptr_t)comm),
-             hashValue);
+      if (newPlan) {
+        FLAGCXCHECK(flagcxC2cLogPlanTime(&planner, flagcxCommOpAllReduce, count,
+                                         startTime, comm, NULL));
       }
+    } else {
+      uint64_t startTime = clockNano();
       FLAGCXCHECK(planner.execute(sendbuff, recvbuff, datatype, -1, stream));
+      if (newPlan) {
+        FLAGCXCHECK(flagcxC2cLogPlanTime(&planner, flagcxCommOpAllReduce, count,
+                                         startTime, comm, stream));
+      }
     }
   }
   return flagcxSuccess;
@@ -1223,7 +1484,18 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
     return cclAdaptors[flagcxCCLAdaptorDevice]->reduceScatter(
         sendbuff, recvbuff, recvcount, datatype, op, comm->homo_comm, stream);
   } else {
-    if (use_host_comm() || comm->has_single_rank_homo_comm) {
+    // Experimental for multi-nic support
+    // Construct flagcxC2cPlanner and find corresponding strategy
+    flagcxC2cPlanner planner;
+    int newPlan = 0;
+    bool useHostComm = use_host_comm() || comm->has_single_rank_homo_comm;
+    if (!useHostComm) {
+      FLAGCXCHECK(flagcxC2cGetPlan(recvcount, comm->nranks * recvcount,
+                                   recvcount, flagcxCommOpReduceScatter, op,
+                                   datatype, comm, &planner, &newPlan));
+      useHostComm = (planner.getAlgo() == flagcxC2cAlgoHostComm);
+    }
+    if (useHostComm) {
       // c2c validation
       if (comm->has_single_rank_homo_comm) {
         WARN("Host comm is required to perform C2C reducescatter op when "
@@ -1231,7 +1503,8 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
       }
 
       uint64_t timers[TIMERS_COLL_COUNT] = {0};
-      timers[TIMER_COLL_TOTAL] = clockNano();
+      uint64_t startTime = clockNano();
+      timers[TIMER_COLL_TOTAL] = startTime;
       void *buff_in;
       void *buff_out;
       size_t recv_size = recvcount * getFlagcxDataTypeSize(datatype);
@@ -1278,33 +1551,17 @@ flagcxResult_t flagcxReduceScatter(const void *sendbuff, void *recvbuff,
            timers[TIMER_COLL_TOTAL] / 1e6, timers[TIMER_COLL_ALLOC] / 1e6,
            timers[TIMER_COLL_FREE] / 1e6, timers[TIMER_COLL_MEM_D2H] / 1e6,
            timers[TIMER_COLL_MEM_H2D] / 1e6, timers[TIMER_COLL_COMM] / 1e6);
-    } else {
-      // Experimental for multi-nic support
-      // Construct flagcxC2cPlanner and find corresponding strategy
-      flagcxC2cPlanner planner;
-      auto hashValue =
-          getC2cCommPatternHash(recvcount, flagcxCommOpReduceScatter, op, comm);
-      if (!planCache.get(hashValue, planner)) {
-        INFO(FLAGCX_COLL,
-             "No available plan is found, create a new one with "
-             "communication pattern "
-             "(count, commOp, redOp, comm) = (%ld, %d, %d, %ld), hashValue = "
-             "%ld",
-             recvcount, flagcxCommOpReduceScatter, op,
-             (size_t)((uintptr_t)comm), hashValue);
-        planner = flagcxC2cPlanner(comm->nranks * recvcount, recvcount, comm,
-                                   flagcxCommOpReduceScatter, op);
-        FLAGCXCHECK(planner.findStrategy());
-        planCache.put(hashValue, planner);
-      } else {
-        INFO(FLAGCX_COLL,
-             "Found available plan with communication pattern "
-             "(count, commOp, redOp, comm) = (%ld, %d, %d, %ld), hashValue = "
-             "%ld",
-             recvcount, flagcxCommOpReduceScatter, op,
-             (size_t)((uintptr_t)comm), hashValue);
+      if (newPlan) {
+        FLAGCXCHECK(flagcxC2cLogPlanTime(&planner, flagcxCommOpReduceScatter,
+                                         recvcount, startTime, comm, NULL));
       }
+    } else {
+      uint64_t startTime = clockNano();
       FLAGCXCHECK(planner.execute(sendbuff, recvbuff, datatype, -1, stream));
+      if (newPlan) {
+        FLAGCXCHECK(flagcxC2cLogPlanTime(&planner, flagcxCommOpReduceScatter,
+                                         recvcount, startTime, comm, stream));
+      }
     }
   }
   return flagcxSuccess;
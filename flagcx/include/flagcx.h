@@ -99,6 +99,9 @@ typedef struct {
 } flagcxUniqueId;
 typedef flagcxUniqueId *flagcxUniqueId_t;
 
+/* Color of the ranks that do not join any communicator in flagcxCommSplit */
+#define FLAGCX_SPLIT_NOCOLOR -1
+
 /* Opaque handle to flagcxComm */
 typedef struct flagcxComm *flagcxComm_t;
 /* Opaque handle to flagcxStream */
@@ -173,6 +176,15 @@ flagcxResult_t flagcxGetUniqueId(flagcxUniqueId_t *uniqueId);
 flagcxResult_t flagcxCommInitRank(flagcxComm_t *comm, int nranks,
                                   flagcxUniqueId_t commId, int rank);
 
+/* Creates a new communicator from the ranks of comm that pass the same color,
+ * ranked by key (ties are broken by the rank in comm). The new communicator
+ * reuses the bootstrap addresses, topology and proxy thread of comm, and sets
+ * up its own net connections on first use, so its operations never match
+ * those of comm or of other split communicators. Must be called by all ranks
+ * of comm, ranks passing FLAGCX_SPLIT_NOCOLOR get a NULL newcomm. */
+flagcxResult_t flagcxCommSplit(flagcxComm_t comm, int color, int key,
+                               flagcxComm_t *newcomm);
+
 /* Finalize a communicator. flagcxCommFinalize flushes all issued
  * communications, and marks communicator state as flagcxInProgress. The state
  * will change to flagcxSuccess when the communicator is globally quiescent and
@@ -201,7 +213,7 @@ const char *flagcxGetLastError(flagcxComm_t comm);
 
 /* Checks whether the comm has encountered any asynchronous errors */
 flagcxResult_t flagcxCommGetAsyncError(flagcxComm_t comm,
-                                       flagcxResult_t asyncError);
+                                       flagcxResult_t *asyncError);
 
 /* Gets the number of ranks in the communicator clique. */
 flagcxResult_t flagcxCommCount(const flagcxComm_t comm, int *count);
@@ -212,6 +224,11 @@ flagcxResult_t flagcxCommGetDeviceNumber(const flagcxComm_t comm, int *device);
 /* Returns the user-ordered "rank" associated with the communicator. */
 flagcxResult_t flagcxCommUserRank(const flagcxComm_t comm, int *rank);
 
+/* Releases the communicator's cached device scratch memory if it is larger
+ * than maxBytes. Pass 0 to release it completely. Must not be called while
+ * operations using the communicator are being enqueued. */
+flagcxResult_t flagcxCommTrimScratch(flagcxComm_t comm, size_t maxBytes);
+
 /*
  * Collective communication operations
  *
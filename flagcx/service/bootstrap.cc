@@ -11,8 +11,12 @@
 #include "bootstrap.h"
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/epoll.h>
 #include "param.h"
 #include "comm.h"
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
 #include <vector>
 
 struct bootstrapRootArgs {
@@ -109,67 +113,198 @@ static flagcxResult_t setFilesLimit() {
   return flagcxSuccess;
 }
 
+// The root progresses all check-ins and replies concurrently through epoll,
+// so thousands of ranks can contact it at once without being staggered.
+#define BOOTSTRAP_ROOT_MAX_EVENTS 256
+#define BOOTSTRAP_ROOT_MAX_INFLIGHT 1024
+
+struct bootstrapRootConn {
+  struct flagcxSocket sock;
+  int offset;
+  int size;
+  char buf[sizeof(int)+sizeof(struct extInfo)];
+};
+
+enum bootstrapRootConnState { rootConnPending = 0, rootConnDone = 1, rootConnDropped = 2 };
+
+static flagcxResult_t bootstrapRootEpollAdd(int epfd, int fd, uint32_t events, void* ptr) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = events;
+  ev.data.ptr = ptr;
+  SYSCHECK(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev), "epoll_ctl");
+  return flagcxSuccess;
+}
+
+// Accept every pending connection on the (non-blocking) listen socket
+static flagcxResult_t bootstrapRootAccept(struct flagcxSocket* listenSock, int epfd, std::vector<struct bootstrapRootConn*>& conns) {
+  while (1) {
+    struct bootstrapRootConn* conn;
+    FLAGCXCHECK(flagcxCalloc(&conn, 1));
+    conns.push_back(conn);
+    conn->size = sizeof(conn->buf);
+    FLAGCXCHECK(flagcxSocketInit(&conn->sock));
+    FLAGCXCHECK(flagcxSocketAccept(&conn->sock, listenSock));
+    if (conn->sock.state == flagcxSocketStateAccepting) {
+      // nothing left to accept
+      conn->sock.fd = -1;
+      return flagcxSuccess;
+    }
+    FLAGCXCHECK(bootstrapRootEpollAdd(epfd, conn->sock.fd, EPOLLIN, conn));
+  }
+}
+
+static flagcxResult_t bootstrapRootProgress(int op, struct bootstrapRootConn* conn, int* state) {
+  int ready;
+  *state = rootConnPending;
+  FLAGCXCHECK(flagcxSocketReady(&conn->sock, &ready));
+  if (conn->sock.state == flagcxSocketStateAccepting) {
+    // spurious connection with a wrong magic, already closed by the socket layer
+    *state = rootConnDropped;
+    return flagcxSuccess;
+  }
+  if (conn->sock.state == flagcxSocketStateConnecting) {
+    // connection refused and retried, start over right away
+    FLAGCXCHECK(flagcxSocketReady(&conn->sock, &ready));
+  }
+  if (!ready) return flagcxSuccess;
+  FLAGCXCHECK(flagcxSocketProgress(op, &conn->sock, conn->buf, conn->size, &conn->offset));
+  if (conn->offset == conn->size) *state = rootConnDone;
+  return flagcxSuccess;
+}
+
+static void bootstrapRootConnClose(struct bootstrapRootConn* conn) {
+  if (conn->sock.fd != -1) {
+    flagcxSocketClose(&conn->sock);
+    conn->sock.fd = -1;
+  }
+}
+
 static void *bootstrapRoot(void* rargs) {
   struct bootstrapRootArgs* args = (struct bootstrapRootArgs*)rargs;
   struct flagcxSocket* listenSock = args->listenSock;
   uint64_t magic = args->magic;
   flagcxResult_t res = flagcxSuccess;
-  int nranks = 0, c = 0;
+  int nranks = 0, c = 0, next = 0, inflight = 0;
+  int epfd = -1;
   struct extInfo info;
   union flagcxSocketAddress *rankAddresses = NULL;
   union flagcxSocketAddress *rankAddressesRoot = NULL; // for initial rank <-> root information exchange
   union flagcxSocketAddress *zero = NULL;
+  std::vector<struct bootstrapRootConn*> conns;
+  struct epoll_event events[BOOTSTRAP_ROOT_MAX_EVENTS];
   FLAGCXCHECKGOTO(flagcxCalloc(&zero, 1), res, out);
   setFilesLimit();
 
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd == -1) {
+    WARN("Bootstrap Root : epoll_create1 failed : %s", strerror(errno));
+    goto out;
+  }
+  FLAGCXCHECKGOTO(bootstrapRootEpollAdd(epfd, listenSock->fd, EPOLLIN, NULL), res, out);
+
   TRACE(FLAGCX_INIT, "BEGIN");
   /* Receive addresses from all ranks */
-  do {
-    struct flagcxSocket sock;
-    FLAGCXCHECKGOTO(flagcxSocketInit(&sock), res, out);
-    FLAGCXCHECKGOTO(flagcxSocketAccept(&sock, listenSock), res, out);
-    FLAGCXCHECKGOTO(bootstrapNetRecv(&sock, &info, sizeof(info)), res, out);
-    FLAGCXCHECKGOTO(flagcxSocketClose(&sock), res, out);
-
-    if (c == 0) {
-      nranks = info.nranks;
-      FLAGCXCHECKGOTO(flagcxCalloc(&rankAddresses, nranks), res, out);
-      FLAGCXCHECKGOTO(flagcxCalloc(&rankAddressesRoot, nranks), res, out);
-    }
-
-    if (nranks != info.nranks) {
-      WARN("Bootstrap Root : mismatch in rank count from procs %d : %d", nranks, info.nranks);
+  while (nranks == 0 || c < nranks) {
+    int nEvents = epoll_wait(epfd, events, BOOTSTRAP_ROOT_MAX_EVENTS, -1);
+    if (nEvents == -1) {
+      if (errno == EINTR) continue;
+      WARN("Bootstrap Root : epoll_wait failed : %s", strerror(errno));
       goto out;
     }
+    for (int e = 0; e < nEvents; e++) {
+      struct bootstrapRootConn* conn = (struct bootstrapRootConn*)events[e].data.ptr;
+      int state;
+      if (conn == NULL) {
+        FLAGCXCHECKGOTO(bootstrapRootAccept(listenSock, epfd, conns), res, out);
+        continue;
+      }
+      if (conn->sock.fd == -1) continue;
+      FLAGCXCHECKGOTO(bootstrapRootProgress(FLAGCX_SOCKET_RECV, conn, &state), res, out);
+      if (state == rootConnDropped) conn->sock.fd = -1;
+      if (state != rootConnDone) continue;
+      bootstrapRootConnClose(conn);
+
+      int size;
+      memcpy(&size, conn->buf, sizeof(int));
+      if (size != sizeof(info)) {
+        WARN("Bootstrap Root : unexpected check-in of %d bytes instead of %zu", size, sizeof(info));
+        goto out;
+      }
+      memcpy(&info, conn->buf+sizeof(int), sizeof(info));
 
-    if (memcmp(zero, &rankAddressesRoot[info.rank], sizeof(union flagcxSocketAddress)) != 0) {
-      WARN("Bootstrap Root : rank %d of %d ranks has already checked in", info.rank, nranks);
-      goto out;
-    }
+      if (c == 0) {
+        nranks = info.nranks;
+        FLAGCXCHECKGOTO(flagcxCalloc(&rankAddresses, nranks), res, out);
+        FLAGCXCHECKGOTO(flagcxCalloc(&rankAddressesRoot, nranks), res, out);
+      }
 
-    INFO(FLAGCX_INIT, "Bootstrap Root : rank %d of %d ranks checked in", info.rank, nranks);
+      if (nranks != info.nranks) {
+        WARN("Bootstrap Root : mismatch in rank count from procs %d : %d", nranks, info.nranks);
+        goto out;
+      }
 
-    // Save the connection handle for that rank
-    memcpy(rankAddressesRoot+info.rank, &info.extAddressListenRoot, sizeof(union flagcxSocketAddress));
-    memcpy(rankAddresses+info.rank, &info.extAddressListen, sizeof(union flagcxSocketAddress));
+      if (memcmp(zero, &rankAddressesRoot[info.rank], sizeof(union flagcxSocketAddress)) != 0) {
+        WARN("Bootstrap Root : rank %d of %d ranks has already checked in", info.rank, nranks);
+        goto out;
+      }
 
-    ++c;
-    TRACE(FLAGCX_INIT, "Received connect from rank %d total %d/%d",  info.rank, c, nranks);
-  } while (c < nranks);
-  TRACE(FLAGCX_INIT, "COLLECTED ALL %d HANDLES", nranks);
+      INFO(FLAGCX_INIT, "Bootstrap Root : rank %d of %d ranks checked in", info.rank, nranks);
 
-  // Send the connect handle for the next rank in the AllGather ring
-  for (int r=0; r<nranks; ++r) {
-    int next = (r+1) % nranks;
-    struct flagcxSocket sock;
-    FLAGCXCHECKGOTO(flagcxSocketInit(&sock, rankAddressesRoot+r, magic, flagcxSocketTypeBootstrap), res, out);
-    FLAGCXCHECKGOTO(flagcxSocketConnect(&sock), res, out);
-    FLAGCXCHECKGOTO(bootstrapNetSend(&sock, rankAddresses+next, sizeof(union flagcxSocketAddress)), res, out);
-    FLAGCXCHECKGOTO(flagcxSocketClose(&sock), res, out);
+      // Save the connection handle for that rank
+      memcpy(rankAddressesRoot+info.rank, &info.extAddressListenRoot, sizeof(union flagcxSocketAddress));
+      memcpy(rankAddresses+info.rank, &info.extAddressListen, sizeof(union flagcxSocketAddress));
+
+      ++c;
+      TRACE(FLAGCX_INIT, "Received connect from rank %d total %d/%d",  info.rank, c, nranks);
+    }
+  }
+  TRACE(FLAGCX_INIT, "COLLECTED ALL %d HANDLES", nranks);
+  SYSCHECKGOTO(epoll_ctl(epfd, EPOLL_CTL_DEL, listenSock->fd, NULL), res, out);
+
+  // Send the connect handle for the next rank in the AllGather ring, with up
+  // to BOOTSTRAP_ROOT_MAX_INFLIGHT connections in progress at a time
+  c = 0;
+  while (c < nranks) {
+    while (next < nranks && inflight < BOOTSTRAP_ROOT_MAX_INFLIGHT) {
+      struct bootstrapRootConn* conn;
+      int size = sizeof(union flagcxSocketAddress);
+      FLAGCXCHECKGOTO(flagcxCalloc(&conn, 1), res, out);
+      conns.push_back(conn);
+      conn->size = sizeof(int)+size;
+      memcpy(conn->buf, &size, sizeof(int));
+      memcpy(conn->buf+sizeof(int), rankAddresses+(next+1)%nranks, size);
+      FLAGCXCHECKGOTO(flagcxSocketInit(&conn->sock, rankAddressesRoot+next, magic, flagcxSocketTypeBootstrap, NULL, 1), res, out);
+      FLAGCXCHECKGOTO(flagcxSocketConnect(&conn->sock), res, out);
+      FLAGCXCHECKGOTO(bootstrapRootEpollAdd(epfd, conn->sock.fd, EPOLLOUT, conn), res, out);
+      next++;
+      inflight++;
+    }
+    int nEvents = epoll_wait(epfd, events, BOOTSTRAP_ROOT_MAX_EVENTS, -1);
+    if (nEvents == -1) {
+      if (errno == EINTR) continue;
+      WARN("Bootstrap Root : epoll_wait failed : %s", strerror(errno));
+      goto out;
+    }
+    for (int e = 0; e < nEvents; e++) {
+      struct bootstrapRootConn* conn = (struct bootstrapRootConn*)events[e].data.ptr;
+      int state;
+      if (conn->sock.fd == -1) continue;
+      FLAGCXCHECKGOTO(bootstrapRootProgress(FLAGCX_SOCKET_SEND, conn, &state), res, out);
+      if (state != rootConnDone) continue;
+      bootstrapRootConnClose(conn);
+      inflight--;
+      c++;
+    }
   }
   INFO(FLAGCX_INIT, "SENT OUT ALL %d HANDLES", nranks);
 
 out:
+  for (auto conn : conns) {
+    bootstrapRootConnClose(conn);
+    free(conn);
+  }
+  if (epfd != -1) close(epfd);
   if (listenSock != NULL) {
     flagcxSocketClose(listenSock);
     free(listenSock);
@@ -189,7 +324,7 @@ flagcxResult_t bootstrapCreateRoot(struct flagcxBootstrapHandle* handle, bool id
   pthread_t thread;
 
   FLAGCXCHECK(flagcxCalloc(&listenSock, 1));
-  FLAGCXCHECK(flagcxSocketInit(listenSock, &handle->addr, handle->magic, flagcxSocketTypeBootstrap, NULL, 0));
+  FLAGCXCHECK(flagcxSocketInit(listenSock, &handle->addr, handle->magic, flagcxSocketTypeBootstrap, NULL, 1));
   FLAGCXCHECK(flagcxSocketListen(listenSock));
   FLAGCXCHECK(flagcxSocketGetAddr(listenSock, &handle->addr));
 
@@ -221,13 +356,121 @@ flagcxResult_t bootstrapGetUniqueId(struct flagcxBootstrapHandle* handle) {
   return flagcxSuccess;
 }
 
-struct unexConn {
-  int peer;
+// Persistent peer connections
+//
+// Each rank lazily opens one connection to every peer it sends to and keeps it
+// open until the communicator is closed. The first message on a connection
+// carries the rank of the sender, every following message is framed as a
+// (tag, size) header followed by the payload. A receiver reads frames from the
+// connection of the peer it expects, frames carrying another tag are buffered
+// in a hash map keyed by (peer, tag) until they are asked for.
+struct bootstrapMsgHeader {
   int tag;
-  struct flagcxSocket sock;
-  struct unexConn* next;
+  int size;
+};
+
+struct bootstrapPeerConns {
+  struct flagcxSocket* sendSocks;
+  struct flagcxSocket* recvSocks;
+  bool* sendConnected;
+  bool* recvConnected;
+  std::unordered_map<uint64_t, std::deque<std::vector<char>>> unexpectedMsgs;
+  size_t nUnexpectedMsgs;
 };
 
+static inline uint64_t bootstrapMsgKey(int peer, int tag) {
+  return ((uint64_t)(uint32_t)peer << 32) | (uint32_t)tag;
+}
+
+static flagcxResult_t bootstrapPeerConnsInit(struct bootstrapState* state) {
+  struct bootstrapPeerConns* conns = new bootstrapPeerConns();
+  conns->nUnexpectedMsgs = 0;
+  state->peerConns = conns;
+  FLAGCXCHECK(flagcxCalloc(&conns->sendSocks, state->nranks));
+  FLAGCXCHECK(flagcxCalloc(&conns->recvSocks, state->nranks));
+  FLAGCXCHECK(flagcxCalloc(&conns->sendConnected, state->nranks));
+  FLAGCXCHECK(flagcxCalloc(&conns->recvConnected, state->nranks));
+  return flagcxSuccess;
+}
+
+static void bootstrapPeerConnsFree(struct bootstrapState* state) {
+  struct bootstrapPeerConns* conns = state->peerConns;
+  if (conns == NULL) return;
+  for (int r = 0; r < state->nranks; r++) {
+    if (conns->sendConnected && conns->sendConnected[r]) flagcxSocketClose(conns->sendSocks+r);
+    if (conns->recvConnected && conns->recvConnected[r]) flagcxSocketClose(conns->recvSocks+r);
+  }
+  free(conns->sendSocks);
+  free(conns->recvSocks);
+  free(conns->sendConnected);
+  free(conns->recvConnected);
+  delete conns;
+  state->peerConns = NULL;
+}
+
+// Host layout used by the hierarchical AllGather and Barrier. Hosts are
+// numbered in the order of their lowest rank, which is the host leader.
+struct bootstrapHier {
+  int nHosts;
+  int myHost;
+  int* hostLeaders; // leader rank of each host
+  int* hostRanks;   // ranks grouped by host, in rank order within a host
+  int* hostOffsets; // nHosts+1 offsets of each host into hostRanks
+};
+
+struct bootstrapPeerInfo {
+  union flagcxSocketAddress addr;
+  uint64_t hostHash;
+};
+
+FLAGCX_PARAM(BootstrapHier, "BOOTSTRAP_HIER", 1);
+
+#define BOOTSTRAP_TAG_HIER_ALLGATHER (-0x10001)
+#define BOOTSTRAP_TAG_SPLIT (-0x10002)
+#define BOOTSTRAP_TAG_ALLGATHERV (-0x10003)
+
+static inline int bootstrapHostNRanks(struct bootstrapHier* hier, int host) {
+  return hier->hostOffsets[host+1] - hier->hostOffsets[host];
+}
+
+static flagcxResult_t bootstrapHierInit(struct bootstrapState* state, struct bootstrapPeerInfo* peerInfo) {
+  int nranks = state->nranks;
+  if (flagcxParamBootstrapHier() == 0 || nranks == 1) return flagcxSuccess;
+
+  struct bootstrapHier* hier;
+  std::unordered_map<uint64_t, int> hostIds;
+  std::vector<int> rankHost(nranks);
+  FLAGCXCHECK(flagcxCalloc(&hier, 1));
+  state->hier = hier;
+  for (int r = 0; r < nranks; r++) {
+    auto it = hostIds.find(peerInfo[r].hostHash);
+    if (it == hostIds.end()) it = hostIds.emplace(peerInfo[r].hostHash, hier->nHosts++).first;
+    rankHost[r] = it->second;
+  }
+  hier->myHost = rankHost[state->rank];
+  FLAGCXCHECK(flagcxCalloc(&hier->hostLeaders, hier->nHosts));
+  FLAGCXCHECK(flagcxCalloc(&hier->hostRanks, nranks));
+  FLAGCXCHECK(flagcxCalloc(&hier->hostOffsets, hier->nHosts+1));
+  for (int r = 0; r < nranks; r++) hier->hostOffsets[rankHost[r]+1]++;
+  for (int h = 0; h < hier->nHosts; h++) hier->hostOffsets[h+1] += hier->hostOffsets[h];
+  std::vector<int> fill(hier->hostOffsets, hier->hostOffsets+hier->nHosts);
+  for (int r = 0; r < nranks; r++) hier->hostRanks[fill[rankHost[r]]++] = r;
+  for (int h = 0; h < hier->nHosts; h++) hier->hostLeaders[h] = hier->hostRanks[hier->hostOffsets[h]];
+
+  if (state->rank == 0) INFO(FLAGCX_INIT, "Bootstrap : %d ranks on %d hosts, using hierarchical AllGather and Barrier", nranks, hier->nHosts);
+  return flagcxSuccess;
+}
+
+static void bootstrapHierFree(struct bootstrapState* state) {
+  struct bootstrapHier* hier = state->hier;
+  if (hier == NULL) return;
+  free(hier->hostLeaders);
+  free(hier->hostRanks);
+  free(hier->hostOffsets);
+  free(hier);
+  state->hier = NULL;
+}
+
 flagcxResult_t bootstrapInit(struct flagcxBootstrapHandle* handle, void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   int rank = state->rank;
@@ -250,16 +493,6 @@ flagcxResult_t bootstrapInit(struct flagcxBootstrapHandle* handle, void* commSta
   FLAGCXCHECK(flagcxSocketListen(&listenSockRoot));
   FLAGCXCHECK(flagcxSocketGetAddr(&listenSockRoot, &info.extAddressListenRoot));
 
-  // stagger connection times to avoid an overload of the root
-  if (nranks > 128) {
-    long msec = rank;
-    struct timespec tv;
-    tv.tv_sec = msec / 1000;
-    tv.tv_nsec = 1000000 * (msec % 1000);
-    TRACE(FLAGCX_INIT, "rank %d delaying connection to root by %ld msec", rank, msec);
-    (void) nanosleep(&tv, NULL);
-  }
-
   // send info on my listening socket to root
   FLAGCXCHECK(flagcxSocketInit(&sock, &handle->addr, state->magic, flagcxSocketTypeBootstrap, state->abortFlag));
   FLAGCXCHECK(flagcxSocketConnect(&sock));
@@ -279,144 +512,239 @@ flagcxResult_t bootstrapInit(struct flagcxBootstrapHandle* handle, void* commSta
   FLAGCXCHECK(flagcxSocketInit(&state->ringRecvSocket));
   FLAGCXCHECK(flagcxSocketAccept(&state->ringRecvSocket, &state->listenSock));
 
-  // AllGather all listen handlers
+  // AllGather all listen handlers, along with the host of each rank
+  struct bootstrapPeerInfo* peerInfo;
+  FLAGCXCHECK(flagcxCalloc(&peerInfo, nranks));
+  FLAGCXCHECK(flagcxSocketGetAddr(&state->listenSock, &peerInfo[rank].addr));
+  peerInfo[rank].hostHash = getHostHash();
+  FLAGCXCHECK(bootstrapAllGather(state, peerInfo, sizeof(struct bootstrapPeerInfo)));
   FLAGCXCHECK(flagcxCalloc(&state->peerCommAddresses, nranks));
-  FLAGCXCHECK(flagcxSocketGetAddr(&state->listenSock, state->peerCommAddresses+rank));
-  FLAGCXCHECK(bootstrapAllGather(state, state->peerCommAddresses, sizeof(union flagcxSocketAddress)));
+  for (int r = 0; r < nranks; r++) memcpy(state->peerCommAddresses+r, &peerInfo[r].addr, sizeof(union flagcxSocketAddress));
+
+  FLAGCXCHECK(bootstrapPeerConnsInit(state));
+  FLAGCXCHECK(bootstrapHierInit(state, peerInfo));
+  free(peerInfo);
 
   INFO(FLAGCX_INIT, "rank %d nranks %d - DONE", rank, nranks);
 
   return flagcxSuccess;
 }
 
-// Bootstrap send/receive functions
+// Split
 //
-// We do not keep connections opened with all ranks at all times, and we have no guarantee
-// that connections to our unique listen socket will arrive in the same order as we need
-// them. Therefore, when establishing a connection, the sender sends a (peer, tag) tuple to
-// allow the receiver to identify the flow, and keep it in an unexpected queue if needed.
+// The ranks of a sub-communicator are known to every rank of the parent after
+// one allgather of (color, key, listen address) over the parent, so the new
+// state is wired without going through a root. Ranks sharing a color are
+// ordered by key, then by parent rank.
+struct bootstrapSplitInfo {
+  int color;
+  int key;
+  struct bootstrapPeerInfo peer;
+};
 
-flagcxResult_t bootstrapConnect(void* commState, int peer, int tag, struct flagcxSocket* sock) {
-  flagcxResult_t ret = flagcxSuccess;
+flagcxResult_t bootstrapSplit(void* commState, int color, int key, struct bootstrapState** newState, int** parentRanks) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
+  struct bootstrapState* newS = NULL;
+  int rank = state->rank;
+  int nranks = state->nranks;
+  std::vector<struct bootstrapSplitInfo> info(nranks);
+  std::vector<int> ranks;
+  std::vector<struct bootstrapPeerInfo> peerInfo;
+  union flagcxSocketAddress nextAddr;
+
+  *newState = NULL;
+  *parentRanks = NULL;
+  if (color != FLAGCX_SPLIT_NOCOLOR) {
+    FLAGCXCHECK(flagcxCalloc(&newS, 1));
+    newS->magic = state->magic;
+    newS->abortFlag = state->abortFlag;
+    FLAGCXCHECK(flagcxSocketInit(&newS->listenSock, &bootstrapNetIfAddr, newS->magic, flagcxSocketTypeBootstrap, newS->abortFlag));
+    FLAGCXCHECK(flagcxSocketListen(&newS->listenSock));
+    FLAGCXCHECK(flagcxSocketGetAddr(&newS->listenSock, &info[rank].peer.addr));
+  }
+  info[rank].color = color;
+  info[rank].key = key;
+  info[rank].peer.hostHash = getHostHash();
+  FLAGCXCHECK(bootstrapAllGather(state, info.data(), sizeof(struct bootstrapSplitInfo)));
+
+  if (newS != NULL) {
+    for (int r = 0; r < nranks; r++) {
+      if (info[r].color == color) ranks.push_back(r);
+    }
+    std::stable_sort(ranks.begin(), ranks.end(), [&info](int a, int b) { return info[a].key < info[b].key; });
+    newS->nranks = ranks.size();
+    newS->rank = std::find(ranks.begin(), ranks.end(), rank) - ranks.begin();
+    FLAGCXCHECK(flagcxCalloc(parentRanks, newS->nranks));
+    FLAGCXCHECK(flagcxCalloc(&newS->peerCommAddresses, newS->nranks));
+    for (int r = 0; r < newS->nranks; r++) {
+      (*parentRanks)[r] = ranks[r];
+      peerInfo.push_back(info[ranks[r]].peer);
+      memcpy(newS->peerCommAddresses+r, &peerInfo[r].addr, sizeof(union flagcxSocketAddress));
+    }
+
+    memcpy(&nextAddr, newS->peerCommAddresses+(newS->rank+1)%newS->nranks, sizeof(union flagcxSocketAddress));
+    FLAGCXCHECK(flagcxSocketInit(&newS->ringSendSocket, &nextAddr, newS->magic, flagcxSocketTypeBootstrap, newS->abortFlag));
+    FLAGCXCHECK(flagcxSocketConnect(&newS->ringSendSocket));
+    FLAGCXCHECK(flagcxSocketInit(&newS->ringRecvSocket));
+    FLAGCXCHECK(flagcxSocketAccept(&newS->ringRecvSocket, &newS->listenSock));
+    FLAGCXCHECK(bootstrapPeerConnsInit(newS));
+    FLAGCXCHECK(bootstrapHierInit(newS, peerInfo.data()));
+  }
+  // The ring connection must be the first one accepted on the new listen
+  // socket, keep peer connections out until every ring is up
+  FLAGCXCHECK(bootstrapBarrier(state, rank, nranks, BOOTSTRAP_TAG_SPLIT));
+
+  if (newS != NULL) INFO(FLAGCX_INIT, "rank %d nranks %d split into rank %d nranks %d color %d", rank, nranks, newS->rank, newS->nranks, color);
+  *newState = newS;
+  return flagcxSuccess;
+}
+
+// Bootstrap send/receive functions
+//
+// We do not know in which order peers will connect to our unique listen
+// socket, so connections are accepted as they come and kept per peer. A
+// message for another tag found on the way is queued as unexpected.
 
-  FLAGCXCHECKGOTO(flagcxSocketInit(sock, state->peerCommAddresses+peer, state->magic, flagcxSocketTypeBootstrap), ret, fail);
-  FLAGCXCHECKGOTO(flagcxSocketConnect(sock), ret, fail);
-  FLAGCXCHECKGOTO(bootstrapNetSend(sock, &state->rank, sizeof(int)), ret, fail);
-  FLAGCXCHECKGOTO(bootstrapNetSend(sock, &tag, sizeof(int)), ret, fail);
+static flagcxResult_t bootstrapConnect(struct bootstrapState* state, int peer, struct flagcxSocket** sock) {
+  struct bootstrapPeerConns* conns = state->peerConns;
+  *sock = conns->sendSocks+peer;
+  if (conns->sendConnected[peer]) return flagcxSuccess;
+
+  flagcxResult_t ret = flagcxSuccess;
+  FLAGCXCHECK(flagcxSocketInit(*sock, state->peerCommAddresses+peer, state->magic, flagcxSocketTypeBootstrap, state->abortFlag));
+  FLAGCXCHECKGOTO(flagcxSocketConnect(*sock), ret, fail);
+  FLAGCXCHECKGOTO(flagcxSocketSend(*sock, &state->rank, sizeof(int)), ret, fail);
+  conns->sendConnected[peer] = true;
+  TRACE(FLAGCX_BOOTSTRAP, "Connected to peer=%d", peer);
   return flagcxSuccess;
 fail:
-  FLAGCXCHECK(flagcxSocketClose(sock));
+  flagcxSocketClose(*sock);
   return ret;
 }
 
-flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
+// Accept one connection on the listen socket and file it under its sender
+static flagcxResult_t bootstrapAcceptPeer(struct bootstrapState* state) {
   flagcxResult_t ret = flagcxSuccess;
+  struct bootstrapPeerConns* conns = state->peerConns;
   struct flagcxSocket sock;
+  int peer;
 
-  TRACE(FLAGCX_BOOTSTRAP, "Sending to peer=%d tag=%d size=%d", peer, tag, size);
-  FLAGCXCHECK(bootstrapConnect(commState, peer, tag, &sock));
-  FLAGCXCHECKGOTO(bootstrapNetSend(&sock, data, size), ret, exit);
-
-  TRACE(FLAGCX_BOOTSTRAP, "Sent to peer=%d tag=%d size=%d", peer, tag, size);
-
-exit:
-  FLAGCXCHECK(flagcxSocketClose(&sock));
+  FLAGCXCHECK(flagcxSocketInit(&sock));
+  FLAGCXCHECKGOTO(flagcxSocketAccept(&sock, &state->listenSock), ret, fail);
+  FLAGCXCHECKGOTO(flagcxSocketRecv(&sock, &peer, sizeof(int)), ret, fail);
+  if (peer < 0 || peer >= state->nranks || conns->recvConnected[peer]) {
+    WARN("Bootstrap : unexpected connection from rank %d", peer);
+    ret = flagcxInternalError;
+    goto fail;
+  }
+  memcpy(conns->recvSocks+peer, &sock, sizeof(struct flagcxSocket));
+  conns->recvConnected[peer] = true;
+  TRACE(FLAGCX_BOOTSTRAP, "Accepted connection from peer=%d", peer);
+  return flagcxSuccess;
+fail:
+  flagcxSocketClose(&sock);
   return ret;
 }
 
-flagcxResult_t unexpectedEnqueue(struct bootstrapState* state, int peer, int tag, struct flagcxSocket* sock) {
-  // New unex
-  struct unexConn* unex;
-  FLAGCXCHECK(flagcxCalloc(&unex, 1));
-  unex->peer = peer;
-  unex->tag = tag;
-  memcpy(&unex->sock, sock, sizeof(struct flagcxSocket));
-
-  // Enqueue
-  struct unexConn* list = state->unexpectedConnections;
-  if (list == NULL) {
-    state->unexpectedConnections = unex;
-    return flagcxSuccess;
+static flagcxResult_t bootstrapAccept(struct bootstrapState* state, int peer, struct flagcxSocket** sock) {
+  struct bootstrapPeerConns* conns = state->peerConns;
+  while (!conns->recvConnected[peer]) {
+    FLAGCXCHECK(bootstrapAcceptPeer(state));
   }
-  while (list->next) list = list->next;
-  list->next = unex;
+  *sock = conns->recvSocks+peer;
+  return flagcxSuccess;
+}
+
+flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  struct flagcxSocket* sock;
+  struct bootstrapMsgHeader header = { tag, size };
+
+  TRACE(FLAGCX_BOOTSTRAP, "Sending to peer=%d tag=%d size=%d", peer, tag, size);
+  FLAGCXCHECK(bootstrapConnect(state, peer, &sock));
+  FLAGCXCHECK(flagcxSocketSend(sock, &header, sizeof(header)));
+  if (size > 0) FLAGCXCHECK(flagcxSocketSend(sock, data, size));
+  TRACE(FLAGCX_BOOTSTRAP, "Sent to peer=%d tag=%d size=%d", peer, tag, size);
   return flagcxSuccess;
 }
 
-flagcxResult_t unexpectedDequeue(struct bootstrapState* state, int peer, int tag, struct flagcxSocket* sock, int* found) {
-  struct unexConn* elem = state->unexpectedConnections;
-  struct unexConn* prev = NULL;
+// Pop a message of (peer, tag) that arrived before it was asked for
+static flagcxResult_t bootstrapUnexpectedDequeue(struct bootstrapPeerConns* conns, int peer, int tag, void* data, int size, int* found) {
+  auto unex = conns->unexpectedMsgs.find(bootstrapMsgKey(peer, tag));
   *found = 0;
-  while (elem) {
-    if (elem->peer == peer && elem->tag == tag) {
-      if (prev == NULL) {
-        state->unexpectedConnections = elem->next;
-      } else {
-        prev->next = elem->next;
-      }
-      memcpy(sock, &elem->sock, sizeof(struct flagcxSocket));
-      free(elem);
-      *found = 1;
-      return flagcxSuccess;
-    }
-    prev = elem;
-    elem = elem->next;
+  if (unex == conns->unexpectedMsgs.end()) return flagcxSuccess;
+  std::vector<char>& msg = unex->second.front();
+  if ((int)msg.size() > size) {
+    WARN("Message truncated : received %zu bytes instead of %d", msg.size(), size);
+    return flagcxInternalError;
   }
+  if (!msg.empty()) memcpy(data, msg.data(), msg.size());
+  unex->second.pop_front();
+  if (unex->second.empty()) conns->unexpectedMsgs.erase(unex);
+  conns->nUnexpectedMsgs--;
+  *found = 1;
   return flagcxSuccess;
 }
 
-static void unexpectedFree(struct bootstrapState* state) {
-  struct unexConn* elem = state->unexpectedConnections;
-  struct unexConn* prev = NULL;
-
-  while (elem) {
-    prev = elem;
-    elem = elem->next;
-    free(prev);
+// Read frames from the connection of peer until one for tag shows up, the
+// payload of that frame is left on the socket for the caller
+static flagcxResult_t bootstrapRecvHeader(struct bootstrapState* state, int peer, int tag, int size, struct flagcxSocket** sock, int* recvSize) {
+  struct bootstrapPeerConns* conns = state->peerConns;
+  FLAGCXCHECK(bootstrapAccept(state, peer, sock));
+  while (1) {
+    struct bootstrapMsgHeader header;
+    FLAGCXCHECK(flagcxSocketRecv(*sock, &header, sizeof(header)));
+    if (header.tag == tag) {
+      if (header.size > size) {
+        WARN("Message truncated : received %d bytes instead of %d", header.size, size);
+        return flagcxInternalError;
+      }
+      *recvSize = header.size;
+      return flagcxSuccess;
+    }
+    std::vector<char> msg(header.size);
+    if (header.size > 0) FLAGCXCHECK(flagcxSocketRecv(*sock, msg.data(), header.size));
+    conns->unexpectedMsgs[bootstrapMsgKey(peer, header.tag)].push_back(std::move(msg));
+    conns->nUnexpectedMsgs++;
   }
-  return;
+  return flagcxSuccess;
 }
 
-// We can't know who we'll receive from, so we need to receive everything at once
-flagcxResult_t bootstrapAccept(void* commState, int peer, int tag, struct flagcxSocket* sock) {
-  flagcxResult_t ret = flagcxSuccess;
+flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
-  int newPeer, newTag;
+  struct flagcxSocket* sock;
+  int found, recvSize;
 
-  // Search unexpected connections first
-  int found;
-  FLAGCXCHECK(unexpectedDequeue(state, peer, tag, sock, &found));
+  TRACE(FLAGCX_BOOTSTRAP, "Receiving tag=%d peer=%d size=%d", tag, peer, size);
+  // Search unexpected messages first
+  FLAGCXCHECK(bootstrapUnexpectedDequeue(state->peerConns, peer, tag, data, size, &found));
   if (found) return flagcxSuccess;
 
-  // Then look for new connections
-  while (1) {
-    FLAGCXCHECKGOTO(flagcxSocketInit(sock), ret, fail);
-    FLAGCXCHECKGOTO(flagcxSocketAccept(sock, &state->listenSock), ret, fail);
-    FLAGCXCHECKGOTO(bootstrapNetRecv(sock, &newPeer, sizeof(int)), ret, fail);
-    FLAGCXCHECKGOTO(bootstrapNetRecv(sock, &newTag, sizeof(int)), ret, fail);
-    if (newPeer == peer && newTag == tag) return flagcxSuccess;
-    FLAGCXCHECKGOTO(unexpectedEnqueue(state, newPeer, newTag, sock), ret, fail);
-  }
+  // Then read frames from the peer until the tag shows up
+  FLAGCXCHECK(bootstrapRecvHeader(state, peer, tag, size, &sock, &recvSize));
+  if (recvSize > 0) FLAGCXCHECK(flagcxSocketRecv(sock, data, recvSize));
   return flagcxSuccess;
-fail:
-  FLAGCXCHECK(flagcxSocketClose(sock));
-  return ret;
 }
 
-// We can't know who we'll receive from, so we need to receive everything at once
-flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size) {
-  flagcxResult_t ret;
-  struct flagcxSocket sock;
-  FLAGCXCHECK(bootstrapAccept(commState, peer, tag, &sock));
-  TRACE(FLAGCX_BOOTSTRAP, "Receiving tag=%d peer=%d size=%d", tag, peer, size);
-  FLAGCXCHECKGOTO(bootstrapNetRecv(&sock, ((char*)data), size), ret, exit);
-exit:
-  FLAGCXCHECK(flagcxSocketClose(&sock));
-  return ret;
+// Send to sendPeer while receiving from recvPeer. Both payloads are progressed
+// together so that exchanges of large buffers along a cycle cannot deadlock.
+static flagcxResult_t bootstrapSendRecv(struct bootstrapState* state, int tag, int sendPeer, void* sendData, int sendSize,
+                                        int recvPeer, void* recvData, int recvSize) {
+  struct flagcxSocket *sendSock, *recvSock;
+  struct bootstrapMsgHeader header = { tag, sendSize };
+  int found;
+
+  FLAGCXCHECK(bootstrapUnexpectedDequeue(state->peerConns, recvPeer, tag, recvData, recvSize, &found));
+  if (found) return bootstrapSend(state, sendPeer, tag, sendData, sendSize);
+
+  FLAGCXCHECK(bootstrapConnect(state, sendPeer, &sendSock));
+  FLAGCXCHECK(flagcxSocketSend(sendSock, &header, sizeof(header)));
+  FLAGCXCHECK(bootstrapRecvHeader(state, recvPeer, tag, recvSize, &recvSock, &recvSize));
+  FLAGCXCHECK(flagcxSocketSendRecv(sendSock, sendData, sendSize, recvSock, recvData, recvSize));
+  return flagcxSuccess;
 }
 
-// Collective algorithms, based on bootstrapSend/Recv, and sometimes bootstrapConnect/Accept
+// Collective algorithms, based on bootstrapSend/Recv
 
 flagcxResult_t bootstrapRingAllGather(struct flagcxSocket* prevSocket, struct flagcxSocket* nextSocket, int rank, int nranks, char* data, int size) {
   /* Simple ring based AllGather
@@ -459,6 +787,70 @@ flagcxResult_t bootstrapRingAllGatherV2(struct flagcxSocket* prevSocket, struct
   return flagcxSuccess;
 
 }
+// Bruck AllGather among host leaders, exchanging whole hosts in
+// ceil(log2(nHosts)) steps. Hosts are packed in tmp in the order myHost,
+// myHost+1, ... and unpacked to their ranks at the end.
+static flagcxResult_t bootstrapLeaderAllGather(struct bootstrapState* state, char* data, int size) {
+  struct bootstrapHier* hier = state->hier;
+  int nHosts = hier->nHosts;
+  int myHost = hier->myHost;
+  flagcxResult_t ret = flagcxSuccess;
+  int used = 0;
+  char* tmp;
+
+  FLAGCXCHECK(flagcxCalloc(&tmp, (size_t)state->nranks*size));
+  for (int i = hier->hostOffsets[myHost]; i < hier->hostOffsets[myHost+1]; i++, used += size) {
+    memcpy(tmp+used, data+(size_t)hier->hostRanks[i]*size, size);
+  }
+  for (int dist = 1; dist < nHosts; dist <<= 1) {
+    int nHostsToSend = std::min(dist, nHosts-dist);
+    int sendSize = 0, recvSize = 0;
+    for (int h = 0; h < nHostsToSend; h++) {
+      sendSize += bootstrapHostNRanks(hier, (myHost+h) % nHosts) * size;
+      recvSize += bootstrapHostNRanks(hier, (myHost+dist+h) % nHosts) * size;
+    }
+    FLAGCXCHECKGOTO(bootstrapSendRecv(state, BOOTSTRAP_TAG_HIER_ALLGATHER,
+                                      hier->hostLeaders[(myHost-dist+nHosts) % nHosts], tmp, sendSize,
+                                      hier->hostLeaders[(myHost+dist) % nHosts], tmp+used, recvSize), ret, exit);
+    used += recvSize;
+  }
+  used = 0;
+  for (int j = 0; j < nHosts; j++) {
+    int h = (myHost+j) % nHosts;
+    for (int i = hier->hostOffsets[h]; i < hier->hostOffsets[h+1]; i++, used += size) {
+      memcpy(data+(size_t)hier->hostRanks[i]*size, tmp+used, size);
+    }
+  }
+exit:
+  free(tmp);
+  return ret;
+}
+
+// Two level AllGather: ranks hand their slice to the leader of their host,
+// leaders gather all hosts among themselves and hand the result back.
+static flagcxResult_t bootstrapHierAllGather(struct bootstrapState* state, char* data, int size) {
+  struct bootstrapHier* hier = state->hier;
+  int rank = state->rank;
+  int* localRanks = hier->hostRanks+hier->hostOffsets[hier->myHost];
+  int nLocalRanks = bootstrapHostNRanks(hier, hier->myHost);
+  int leader = localRanks[0];
+  int allSize = state->nranks*size;
+
+  if (rank != leader) {
+    FLAGCXCHECK(bootstrapSend(state, leader, BOOTSTRAP_TAG_HIER_ALLGATHER, data+(size_t)rank*size, size));
+    FLAGCXCHECK(bootstrapRecv(state, leader, BOOTSTRAP_TAG_HIER_ALLGATHER, data, allSize));
+    return flagcxSuccess;
+  }
+  for (int i = 1; i < nLocalRanks; i++) {
+    FLAGCXCHECK(bootstrapRecv(state, localRanks[i], BOOTSTRAP_TAG_HIER_ALLGATHER, data+(size_t)localRanks[i]*size, size));
+  }
+  if (hier->nHosts > 1) FLAGCXCHECK(bootstrapLeaderAllGather(state, data, size));
+  for (int i = 1; i < nLocalRanks; i++) {
+    FLAGCXCHECK(bootstrapSend(state, localRanks[i], BOOTSTRAP_TAG_HIER_ALLGATHER, data, allSize));
+  }
+  return flagcxSuccess;
+}
+
 flagcxResult_t bootstrapAllGather(void* commState, void* allData, int size) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   int rank = state->rank;
@@ -466,7 +858,11 @@ flagcxResult_t bootstrapAllGather(void* commState, void* allData, int size) {
 
   TRACE(FLAGCX_INIT, "rank %d nranks %d size %d", rank, nranks, size);
 
-  FLAGCXCHECK(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)allData, size));
+  if (state->hier) {
+    FLAGCXCHECK(bootstrapHierAllGather(state, (char*)allData, size));
+  } else {
+    FLAGCXCHECK(bootstrapRingAllGather(&state->ringRecvSocket, &state->ringSendSocket, rank, nranks, (char*)allData, size));
+  }
 
   TRACE(FLAGCX_INIT, "rank %d nranks %d size %d - DONE", rank, nranks, size);
   return flagcxSuccess;
@@ -826,10 +1222,57 @@ flagcxResult_t bootstrapIntraNodeBarrier(void* commState, int *ranks, int rank,
   return flagcxSuccess;
 }
 
+// Two level barrier: ranks check in with the leader of their host, leaders
+// run the dissemination barrier among themselves and release their ranks.
+static flagcxResult_t bootstrapHierBarrier(struct bootstrapState* state, int tag) {
+  struct bootstrapHier* hier = state->hier;
+  int* localRanks = hier->hostRanks+hier->hostOffsets[hier->myHost];
+  int nLocalRanks = bootstrapHostNRanks(hier, hier->myHost);
+  int leader = localRanks[0];
+  int data[1];
+
+  if (state->rank != leader) {
+    FLAGCXCHECK(bootstrapSend(state, leader, tag, data, sizeof(data)));
+    FLAGCXCHECK(bootstrapRecv(state, leader, tag, data, sizeof(data)));
+    return flagcxSuccess;
+  }
+  for (int i = 1; i < nLocalRanks; i++) FLAGCXCHECK(bootstrapRecv(state, localRanks[i], tag, data, sizeof(data)));
+  FLAGCXCHECK(bootstrapIntraNodeBarrier(state, hier->hostLeaders, hier->myHost, hier->nHosts, tag));
+  for (int i = 1; i < nLocalRanks; i++) FLAGCXCHECK(bootstrapSend(state, localRanks[i], tag, data, sizeof(data)));
+  return flagcxSuccess;
+}
+
 flagcxResult_t bootstrapBarrier(void* commState, int rank, int nranks, int tag) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  if (state->hier && rank == state->rank && nranks == state->nranks) {
+    return bootstrapHierBarrier(state, tag);
+  }
   return bootstrapIntraNodeBarrier(commState, NULL, rank, nranks, tag);
 }
 
+// [IntraNode] in-place AllGather of blocks of different sizes, the block of
+// ranks[i] is sizes[i] bytes and blocks are stored back to back in rank order
+flagcxResult_t bootstrapIntraNodeAllGatherV(void* commState, int *ranks, int rank, int nranks, void* allData, const int* sizes) {
+  struct bootstrapState* state = (struct bootstrapState*)commState;
+  char* data = (char*)allData;
+  if (nranks == 1) return flagcxSuccess;
+  TRACE(FLAGCX_INIT, "rank %d nranks %d - ENTER", rank, nranks);
+
+  std::vector<size_t> offsets(nranks+1, 0);
+  for (int i = 0; i < nranks; i++) offsets[i+1] = offsets[i] + sizes[i];
+  int next = (rank + 1) % nranks;
+  int prev = (rank - 1 + nranks) % nranks;
+  for (int i = 0; i < nranks-1; i++) {
+    int sslice = (rank - i + nranks) % nranks;
+    int rslice = (rank - i - 1 + nranks) % nranks;
+    FLAGCXCHECK(bootstrapSendRecv(state, BOOTSTRAP_TAG_ALLGATHERV, ranks ? ranks[next] : next, data+offsets[sslice], sizes[sslice],
+                                  ranks ? ranks[prev] : prev, data+offsets[rslice], sizes[rslice]));
+  }
+
+  TRACE(FLAGCX_INIT, "rank %d nranks %d - DONE", rank, nranks);
+  return flagcxSuccess;
+}
+
 // [IntraNode] in-place Broadcast
 flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank, int nranks, int root, void* bcastData, int size) {
   if (nranks == 1) return flagcxSuccess;
@@ -854,13 +1297,15 @@ flagcxResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int roo
 
 flagcxResult_t bootstrapClose(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
-  if (state->unexpectedConnections != NULL) {
-    unexpectedFree(state);
+  if (state->peerConns != NULL && state->peerConns->nUnexpectedMsgs != 0) {
+    bootstrapPeerConnsFree(state);
     if (__atomic_load_n(state->abortFlag, __ATOMIC_RELAXED) == 0) {
-      WARN("Unexpected connections are not empty");
+      WARN("Unexpected messages are not empty");
       return flagcxInternalError;
     }
   }
+  bootstrapPeerConnsFree(state);
+  bootstrapHierFree(state);
 
   FLAGCXCHECK(flagcxSocketClose(&state->listenSock));
   FLAGCXCHECK(flagcxSocketClose(&state->ringSendSocket));
@@ -875,6 +1320,8 @@ flagcxResult_t bootstrapClose(void* commState) {
 flagcxResult_t bootstrapAbort(void* commState) {
   struct bootstrapState* state = (struct bootstrapState*)commState;
   if (commState == NULL) return flagcxSuccess;
+  bootstrapPeerConnsFree(state);
+  bootstrapHierFree(state);
   FLAGCXCHECK(flagcxSocketClose(&state->listenSock));
   FLAGCXCHECK(flagcxSocketClose(&state->ringSendSocket));
   FLAGCXCHECK(flagcxSocketClose(&state->ringRecvSocket));
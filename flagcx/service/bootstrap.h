@@ -26,7 +26,8 @@ struct bootstrapState {
   struct flagcxSocket ringSendSocket;
   union flagcxSocketAddress* peerCommAddresses;
   union flagcxSocketAddress* peerProxyAddresses;
-  struct unexConn* unexpectedConnections;
+  struct bootstrapPeerConns* peerConns;
+  struct bootstrapHier* hier; // NULL when collectives run on the flat ring
   int rank;
   int nranks;
   uint64_t magic;
@@ -38,6 +39,10 @@ flagcxResult_t bootstrapCreateRoot(struct flagcxBootstrapHandle* handle, bool id
 flagcxResult_t bootstrapGetUniqueId(struct flagcxBootstrapHandle* handle);
 flagcxResult_t bootstrapInit(struct flagcxBootstrapHandle* handle, void* commState);
 flagcxResult_t bootstrapAllGather(void* commState, void* allData, int size);
+// Collective over all ranks of commState. Ranks passing FLAGCX_SPLIT_NOCOLOR get
+// no new state, the others get the state of their color and the parent rank of
+// each of its ranks in parentRanks (to be freed by the caller).
+flagcxResult_t bootstrapSplit(void* commState, int color, int key, struct bootstrapState** newState, int** parentRanks);
 
 flagcxResult_t bootstrapSend(void* commState, int peer, int tag, void* data, int size);
 flagcxResult_t bootstrapRecv(void* commState, int peer, int tag, void* data, int size);
@@ -45,6 +50,7 @@ flagcxResult_t bootstrapBarrier(void* commState, int rank, int nranks, int tag);
 flagcxResult_t bootstrapBroadcast(void* commState, int rank, int nranks, int root, void* bcastData, int size);
 flagcxResult_t bootstrapIntraNodeBarrier(void* commState, int *ranks, int rank, int nranks, int tag);
 flagcxResult_t bootstrapIntraNodeBroadcast(void* commState, int *ranks, int rank, int nranks, int root, void* bcastData, int size);
+flagcxResult_t bootstrapIntraNodeAllGatherV(void* commState, int *ranks, int rank, int nranks, void* allData, const int* sizes);
 flagcxResult_t bootstrapClose(void* commState);
 flagcxResult_t bootstrapAbort(void* commState);
 
@@ -0,0 +1,148 @@
+/*************************************************************************
+ * Local multi-process benchmark of the bootstrap.
+ *
+ * Forks nranks processes on this host for a sweep of rank counts and
+ * measures the time it takes them to check in with the root, build the
+ * bootstrap ring and pass a first barrier.
+ ************************************************************************/
+
+#include "bootstrap.h"
+
+#include <algorithm>
+#include <chrono>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static void usage(const char *prog) {
+  printf("Usage: %s [-b minRanks] [-e maxRanks] [-f stepFactor]\n", prog);
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+// Body of a forked rank, reports its bootstrap time through fd
+static int runRank(struct flagcxBootstrapHandle *handle, int rank, int nranks,
+                   int fd) {
+  static uint32_t abortFlag = 0;
+  struct bootstrapState *state =
+      (struct bootstrapState *)calloc(1, sizeof(struct bootstrapState));
+  state->rank = rank;
+  state->nranks = nranks;
+  state->magic = handle->magic;
+  state->abortFlag = &abortFlag;
+
+  auto start = std::chrono::steady_clock::now();
+  if (bootstrapInit(handle, state) != flagcxSuccess ||
+      bootstrapBarrier(state, rank, nranks, 0) != flagcxSuccess) {
+    return 1;
+  }
+  double time = elapsedMs(start);
+  if (write(fd, &time, sizeof(time)) != sizeof(time)) {
+    return 1;
+  }
+  return bootstrapClose(state) == flagcxSuccess ? 0 : 1;
+}
+
+static int runBench(int nranks, double *wallTime, double *maxTime,
+                    double *avgTime) {
+  struct flagcxBootstrapHandle handle;
+  int fds[2];
+  if (bootstrapGetUniqueId(&handle) != flagcxSuccess || pipe(fds) != 0) {
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<pid_t> pids;
+  for (int r = 0; r < nranks; r++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      close(fds[0]);
+      _exit(runRank(&handle, r, nranks, fds[1]));
+    }
+    if (pid < 0) {
+      perror("fork");
+      break;
+    }
+    pids.push_back(pid);
+  }
+  close(fds[1]);
+
+  std::vector<double> times;
+  double time;
+  while (read(fds[0], &time, sizeof(time)) == sizeof(time)) {
+    times.push_back(time);
+    if ((int)times.size() == nranks) {
+      *wallTime = elapsedMs(start);
+    }
+  }
+  close(fds[0]);
+
+  int errors = (int)pids.size() == nranks ? 0 : 1;
+  for (pid_t pid : pids) {
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      errors++;
+    }
+  }
+  if (errors || (int)times.size() != nranks) {
+    return 1;
+  }
+  *maxTime = *std::max_element(times.begin(), times.end());
+  *avgTime = 0.0;
+  for (double t : times) {
+    *avgTime += t / nranks;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int minRanks = 2;
+  int maxRanks = 64;
+  int stepFactor = 2;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:e:f:h")) != -1) {
+    switch (opt) {
+      case 'b':
+        minRanks = atoi(optarg);
+        break;
+      case 'e':
+        maxRanks = atoi(optarg);
+        break;
+      case 'f':
+        stepFactor = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (minRanks < 1 || maxRanks < minRanks || stepFactor < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (bootstrapNetInit() != flagcxSuccess) {
+    printf("Unable to find a bootstrap interface\n");
+    return 1;
+  }
+
+  printf("%8s %14s %14s %14s\n", "nranks", "wall(ms)", "max rank(ms)",
+         "avg rank(ms)");
+  for (int nranks = minRanks; nranks <= maxRanks; nranks *= stepFactor) {
+    double wallTime = 0.0, maxTime = 0.0, avgTime = 0.0;
+    fflush(stdout);
+    if (runBench(nranks, &wallTime, &maxTime, &avgTime)) {
+      printf("%8d bootstrap failed\n", nranks);
+      return 1;
+    }
+    printf("%8d %14.2f %14.2f %14.2f\n", nranks, wallTime, maxTime, avgTime);
+  }
+  return 0;
+}
@@ -0,0 +1,391 @@
+/*************************************************************************
+ * Offline simulator of the C2C planner and cost model.
+ *
+ * Builds a fake communicator from a synthetic cluster layout and runs
+ * flagcxC2cAlgoSelect for a sweep of ops and sizes on every rank, without
+ * touching any device or network.
+ ************************************************************************/
+
+#include "comm.h"
+#include "cost_model.h"
+#include "topo.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+struct simCluster {
+  int vendor;
+  int servers;
+  int ranksPerServer;
+  int nicsPerServer;
+  float nicBw;
+};
+
+struct simLayout {
+  std::vector<simCluster> clusters;
+  std::vector<int> rankServer; // server of each rank
+  std::vector<int> rankNic;    // nic index of each rank on its server
+  std::vector<uint64_t> rankNicGuid;
+  int nranks = 0;
+  int nservers = 0;
+};
+
+static void usage(const char *prog) {
+  printf("Usage: %s -l layout [-r route.xml] [-c calib] [-k key] "
+         "[-b minBytes] [-e maxBytes] [-f stepFactor] "
+         "[-o allreduce|reducescatter|all] [-p rank] [-H]\n"
+         "  layout lines: cluster <vendor> <servers> <ranksPerServer> "
+         "<nicsPerServer> [nicBw GB/s]\n"
+         "  -c loads a FLAGCX_COST_CALIB_FILE, -k picks its section by key "
+         "instead of the key of the layout\n"
+         "  -p prints the plan of the given rank, -H adds the host comm "
+         "candidate\n",
+         prog);
+}
+
+// Same size syntax as the perf tests: 128, 4K, 16M, 2G
+static size_t parseSize(const char *value) {
+  double size;
+  char unit = 0;
+  if (sscanf(value, "%lf %c", &size, &unit) < 1 || size < 0) {
+    return 0;
+  }
+  switch (unit) {
+    case 'G':
+    case 'g':
+      return (size_t)(size * 1024 * 1024 * 1024);
+    case 'M':
+    case 'm':
+      return (size_t)(size * 1024 * 1024);
+    case 'K':
+    case 'k':
+      return (size_t)(size * 1024);
+    case 0:
+      break;
+    default:
+      return 0;
+  }
+  return (size_t)size;
+}
+
+static uint64_t simNicGuid(int server, int nic) {
+  return ((uint64_t)(server + 1) << 16) + nic;
+}
+
+static int parseLayout(const char *path, simLayout *layout) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    printf("Unable to open layout file %s\n", path);
+    return 1;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL) {
+    simCluster cluster = {0, 0, 0, 0, NET_BW};
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "cluster %d %d %d %d %f", &cluster.vendor,
+               &cluster.servers, &cluster.ranksPerServer,
+               &cluster.nicsPerServer, &cluster.nicBw) < 4 ||
+        cluster.vendor < 0 || cluster.vendor >= FLAGCX_VENDOR_NUM ||
+        cluster.servers < 1 || cluster.ranksPerServer < 1 ||
+        cluster.nicsPerServer < 1) {
+      printf("Invalid layout line: %s", line);
+      fclose(file);
+      return 1;
+    }
+    layout->clusters.push_back(cluster);
+  }
+  fclose(file);
+  if (layout->clusters.size() < 2) {
+    printf("Layout needs at least two clusters\n");
+    return 1;
+  }
+  // ranks are numbered cluster by cluster, then server by server
+  for (auto &cluster : layout->clusters) {
+    for (int s = 0; s < cluster.servers; s++) {
+      for (int r = 0; r < cluster.ranksPerServer; r++) {
+        int nic = r * cluster.nicsPerServer / cluster.ranksPerServer;
+        layout->rankServer.push_back(layout->nservers);
+        layout->rankNic.push_back(nic);
+        layout->rankNicGuid.push_back(simNicGuid(layout->nservers, nic));
+      }
+      layout->nservers++;
+    }
+  }
+  layout->nranks = layout->rankServer.size();
+  return 0;
+}
+
+static void buildTopo(simLayout *layout, flagcxHeteroComm *heteroComm) {
+  flagcxInterServerTopo *interServer = new flagcxInterServerTopo();
+  flagcxCalloc(&interServer->servers, layout->nservers);
+  interServer->numServers = layout->nservers;
+  int serverId = 0;
+  int rank = 0;
+  for (auto &cluster : layout->clusters) {
+    for (int s = 0; s < cluster.servers; s++, serverId++) {
+      flagcxTopoServer *server = interServer->servers + serverId;
+      server->serverId = serverId;
+      server->nodes[NET].count = cluster.nicsPerServer;
+      for (int n = 0; n < cluster.nicsPerServer; n++) {
+        flagcxTopoNode *net = server->nodes[NET].nodes + n;
+        net->type = NET;
+        net->id = FLAGCX_TOPO_ID(serverId, n);
+        net->net.dev = n;
+        net->net.guid = simNicGuid(serverId, n);
+        net->net.bw = cluster.nicBw;
+        interServer->netToServerMap[net->net.guid] = serverId;
+      }
+      server->nodes[APU].count = cluster.ranksPerServer;
+      for (int r = 0; r < cluster.ranksPerServer; r++, rank++) {
+        flagcxTopoNode *apu = server->nodes[APU].nodes + r;
+        apu->type = APU;
+        apu->id = FLAGCX_TOPO_ID(serverId, r);
+        apu->apu.dev = r;
+        apu->apu.rank = rank;
+        apu->apu.vendor = cluster.vendor;
+        // only the nic assigned to the rank is reachable
+        flagcxCalloc(&apu->paths[NET], cluster.nicsPerServer);
+        for (int n = 0; n < cluster.nicsPerServer; n++) {
+          apu->paths[NET][n].type =
+              (n == layout->rankNic[rank]) ? PATH_PIX : PATH_DIS;
+          apu->paths[NET][n].bw =
+              (n == layout->rankNic[rank]) ? cluster.nicBw : 0;
+        }
+      }
+    }
+  }
+  heteroComm->topoServer = interServer->servers;
+  heteroComm->interServerTopo = interServer;
+}
+
+static void buildComm(simLayout *layout, flagcxComm *comm) {
+  int nranks = layout->nranks;
+  comm->nranks = nranks;
+  comm->nclusters = layout->clusters.size();
+  flagcxCalloc(&comm->cluster_ids, nranks);
+  flagcxCalloc(&comm->cluster_sizes, comm->nclusters);
+  flagcxCalloc(&comm->globalrank2homorank, nranks);
+  comm->clusterInterRankList.resize(comm->nclusters);
+  int rank = 0;
+  for (int c = 0; c < comm->nclusters; c++) {
+    simCluster &cluster = layout->clusters[c];
+    comm->clusterVendorMap.push_back((flagcxVendorType)cluster.vendor);
+    comm->cluster_sizes[c] = cluster.servers * cluster.ranksPerServer;
+    std::vector<uint64_t> seenNics;
+    for (int r = 0; r < comm->cluster_sizes[c]; r++, rank++) {
+      comm->cluster_ids[rank] = c;
+      comm->globalrank2homorank[rank] = r;
+      // the first rank of every nic is an inter rank, as in flagcxCommInitRank
+      uint64_t guid = layout->rankNicGuid[rank];
+      bool seen = false;
+      for (auto g : seenNics) {
+        seen |= (g == guid);
+      }
+      if (!seen) {
+        seenNics.push_back(guid);
+        comm->clusterInterRankList[c].push_back(rank);
+      }
+    }
+  }
+  flagcxCalloc(&comm->hetero_comm, 1);
+  comm->hetero_comm->nRanks = nranks;
+}
+
+// Update the per-rank fields the planner reads. Each rank only has the
+// detailed topology of its own server, as in a real run, so estimates that
+// depend on local data show up as disagreeing ranks.
+static void setCommRank(simLayout *layout, flagcxComm *comm, int rank) {
+  flagcxHeteroComm *heteroComm = comm->hetero_comm;
+  heteroComm->topoServer =
+      heteroComm->interServerTopo->servers + layout->rankServer[rank];
+  int c = comm->cluster_ids[rank];
+  auto &interRanks = comm->clusterInterRankList[c];
+  comm->rank = rank;
+  comm->homo_rank = comm->globalrank2homorank[rank];
+  comm->homo_root_rank = rank - comm->homo_rank;
+  comm->homo_ranks = comm->cluster_sizes[c];
+  comm->homoInterMyRank = -1;
+  comm->homoInterRootRank = -1;
+  comm->homoInterRanks = -1;
+  for (size_t i = 0; i < interRanks.size(); i++) {
+    if (interRanks[i] == rank) {
+      comm->homoInterMyRank = i;
+      comm->homoInterRootRank = interRanks[0];
+      comm->homoInterRanks = interRanks.size();
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *layoutFile = NULL;
+  const char *routeFile = NULL;
+  const char *calibFile = NULL;
+  uint64_t calibKey = 0;
+  size_t minBytes = 1024;
+  size_t maxBytes = 1UL << 30;
+  size_t stepFactor = 4;
+  std::string ops = "all";
+  int printRank = -1;
+  int hostComm = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "l:r:c:k:b:e:f:o:p:Hh")) != -1) {
+    switch (opt) {
+      case 'l':
+        layoutFile = optarg;
+        break;
+      case 'r':
+        routeFile = optarg;
+        break;
+      case 'c':
+        calibFile = optarg;
+        break;
+      case 'k':
+        calibKey = strtoull(optarg, NULL, 16);
+        break;
+      case 'b':
+        minBytes = parseSize(optarg);
+        break;
+      case 'e':
+        maxBytes = parseSize(optarg);
+        break;
+      case 'f':
+        stepFactor = strtoull(optarg, NULL, 0);
+        break;
+      case 'o':
+        ops = optarg;
+        break;
+      case 'p':
+        printRank = atoi(optarg);
+        break;
+      case 'H':
+        hostComm = 1;
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : 1;
+    }
+  }
+  if (layoutFile == NULL || minBytes == 0 || stepFactor < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // the estimator is gated on cluster level topology detection, routes that
+  // are not in the route file fall back to the nic bandwidth
+  setenv("FLAGCX_ENABLE_TOPO_DETECT", "TRUE", 1);
+  setenv("FLAGCX_INTERSERVER_ROUTE_FILE", routeFile ? routeFile : "", 1);
+
+  simLayout layout;
+  if (parseLayout(layoutFile, &layout)) {
+    return 1;
+  }
+  flagcxComm *comm = new flagcxComm();
+  buildComm(&layout, comm);
+  buildTopo(&layout, comm->hetero_comm);
+  if (routeFile != NULL &&
+      flagcxGetInterServerRouteFromFile(routeFile,
+                                        comm->hetero_comm->interServerTopo,
+                                        comm->hetero_comm->topoServer) !=
+          flagcxSuccess) {
+    printf("Unable to load route file %s\n", routeFile);
+    return 1;
+  }
+  // same parameters as the estimator would load at init. The section of a
+  // real cluster can be picked with -k, only its per-vendor entries apply
+  // since the nic guids of the layout are synthetic.
+  if (calibFile != NULL) {
+    if (calibKey == 0) {
+      calibKey = flagcxCostTableKey(comm, layout.rankNicGuid.data());
+    }
+    if (flagcxCostTableLoadFile(calibFile, calibKey, &comm->costTable) !=
+        flagcxSuccess) {
+      printf("No parameters with key %lx in calibration file %s\n", calibKey,
+             calibFile);
+      return 1;
+    }
+  }
+  // the host comm candidate only needs a non-null handle to be considered
+  static char hostCommHandle;
+  comm->host_comm = hostComm ? (flagcxInnerComm_t)&hostCommHandle : NULL;
+
+  printf("# nranks = %d, nclusters = %d, nservers = %d\n", layout.nranks,
+         comm->nclusters, layout.nservers);
+  for (int r = 0; r < layout.nranks; r++) {
+    printf("# rank %d: cluster %d, server %d, nic %lx\n", r,
+           comm->cluster_ids[r], layout.rankServer[r], layout.rankNicGuid[r]);
+  }
+  if (comm->costTable != NULL) {
+    printf("# cost parameters %lx loaded from %s\n", calibKey, calibFile);
+  } else {
+    printf("# no calibration file (-c): latencies are 0 and homo phases are "
+           "not priced, times only reflect inter-server bandwidth\n");
+  }
+  printf("%-14s %14s %14s %14s\n", "op", "bytes", "algo", "time(us)");
+
+  std::vector<flagcxCommOp_t> commOps;
+  if (ops == "all" || ops == "allreduce") {
+    commOps.push_back(flagcxCommOpAllReduce);
+  }
+  if (ops == "all" || ops == "reducescatter") {
+    commOps.push_back(flagcxCommOpReduceScatter);
+  }
+  int errors = 0;
+  for (auto commOp : commOps) {
+    const char *opName =
+        commOp == flagcxCommOpAllReduce ? "allreduce" : "reducescatter";
+    float prevTime = 0.0;
+    for (size_t bytes = minBytes; bytes <= maxBytes; bytes *= stepFactor) {
+      size_t count = bytes / sizeof(float);
+      size_t recvCount = count;
+      if (commOp == flagcxCommOpReduceScatter) {
+        recvCount = count / layout.nranks;
+        count = recvCount * layout.nranks;
+      }
+      if (count == 0) {
+        continue;
+      }
+      // every rank has to reach the same decision
+      flagcxC2cAlgo_t algo = flagcxC2cAlgoDefault;
+      float time = 0.0;
+      for (int r = 0; r < layout.nranks; r++) {
+        setCommRank(&layout, comm, r);
+        flagcxC2cPlanner planner;
+        if (flagcxC2cAlgoSelect(&planner, count, recvCount, comm, commOp,
+                                flagcxSum, flagcxFloat) != flagcxSuccess) {
+          printf("%s %zu bytes: planning failed on rank %d\n", opName, bytes,
+                 r);
+          errors++;
+          break;
+        }
+        if (r == 0) {
+          algo = planner.getAlgo();
+          time = planner.getPredictedTime();
+        } else if (planner.getAlgo() != algo) {
+          printf("%s %zu bytes: rank %d selected %s, rank 0 selected %s\n",
+                 opName, bytes, r, flagcxC2cAlgoStr[planner.getAlgo()],
+                 flagcxC2cAlgoStr[algo]);
+          errors++;
+        }
+        if (r == printRank && planner.getAlgo() != flagcxC2cAlgoHostComm) {
+          planner.printStrategy(stdout);
+        }
+      }
+      printf("%-14s %14zu %14s %14.2f\n", opName, count * sizeof(float),
+             flagcxC2cAlgoStr[algo], time);
+      // a truncated count shows up as a prediction that shrinks with size
+      if (time >= 0.0 && time < prevTime) {
+        printf("%s %zu bytes: predicted time %.2f us below %.2f us of the "
+               "previous size\n",
+               opName, bytes, time, prevTime);
+        errors++;
+      }
+      prevTime = time;
+    }
+  }
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,210 @@
+/*************************************************************************
+ * Round-trip checks of the compact server topology encoding.
+ *
+ * Builds a small server topology by hand, encodes it, decodes the blob and
+ * compares both, does the same through the on-disk cache, then makes sure
+ * malformed blobs are rejected.
+ ************************************************************************/
+
+#include "topo.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+static int failures = 0;
+
+#define EXPECT(cond)                                                           \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      printf("%s:%d: expected %s\n", __FILE__, __LINE__, #cond);               \
+      failures++;                                                              \
+    }                                                                          \
+  } while (0)
+
+// One CPU with two PCI switches, an APU and a NIC on each, the NIC of the
+// first switch also reaches the network
+static void buildServer(struct flagcxTopoServer *server) {
+  struct flagcxTopoNode *cpu, *net;
+  struct flagcxTopoNode *pci[2], *apu[2], *nic[2];
+  server->serverId = 0;
+  server->nHosts = 1;
+  server->hostHashes[0] = 0x1234abcdULL;
+  flagcxTopoCreateNode(server, &cpu, CPU, 0);
+  cpu->cpu.arch = 1;
+  cpu->cpu.vendor = 2;
+  cpu->cpu.model = FLAGCX_TOPO_CPU_INTEL_SKL;
+  CPU_ZERO(&cpu->cpu.affinity);
+  for (int c = 0; c < 24; c++) {
+    CPU_SET(c, &cpu->cpu.affinity);
+  }
+  CPU_SET(97, &cpu->cpu.affinity);
+  for (int i = 0; i < 2; i++) {
+    flagcxTopoCreateNode(server, &pci[i], PCI, 0x10 + i);
+    pci[i]->pci.device = 0x15b3101bULL + i;
+    flagcxTopoCreateNode(server, &apu[i], APU, 0x100 + i);
+    apu[i]->apu.dev = i;
+    apu[i]->apu.rank = 4 + i;
+    apu[i]->apu.vendor = 1;
+    apu[i]->apu.gdrSupport = 1 - i;
+    flagcxTopoCreateNode(server, &nic[i], NIC, 0x200 + i);
+    flagcxTopoConnectNodes(cpu, pci[i], LINK_PCI, PCI_BW);
+    flagcxTopoConnectNodes(pci[i], cpu, LINK_PCI, PCI_BW);
+    flagcxTopoConnectNodes(pci[i], apu[i], LINK_PCI, 24.0);
+    flagcxTopoConnectNodes(apu[i], pci[i], LINK_PCI, 24.0);
+    flagcxTopoConnectNodes(pci[i], nic[i], LINK_PCI, 24.0);
+    flagcxTopoConnectNodes(nic[i], pci[i], LINK_PCI, 24.0);
+  }
+  flagcxTopoCreateNode(server, &net, NET, 0x300);
+  net->net.dev = 0;
+  net->net.guid = 0xb8cef60300a1b2c3ULL;
+  net->net.port = 1;
+  net->net.ip = 0x0a000001;
+  net->net.gdrSupport = 1;
+  net->net.bw = 25.0;
+  net->net.latency = 0.5;
+  net->net.maxConn = 131072;
+  flagcxTopoConnectNodes(nic[0], net, LINK_NET, 25.0);
+  flagcxTopoConnectNodes(net, nic[0], LINK_NET, 25.0);
+}
+
+static int nodeIndex(struct flagcxTopoServer *server,
+                     struct flagcxTopoNode *node) {
+  return node - server->nodes[node->type].nodes;
+}
+
+static void compareServers(struct flagcxTopoServer *a,
+                           struct flagcxTopoServer *b) {
+  for (int t = 0; t < FLAGCX_TOPO_NODE_TYPES; t++) {
+    EXPECT(a->nodes[t].count == b->nodes[t].count);
+    if (a->nodes[t].count != b->nodes[t].count) {
+      continue;
+    }
+    for (int n = 0; n < a->nodes[t].count; n++) {
+      struct flagcxTopoNode *x = &a->nodes[t].nodes[n];
+      struct flagcxTopoNode *y = &b->nodes[t].nodes[n];
+      EXPECT(y->type == t);
+      EXPECT(FLAGCX_TOPO_ID_LOCAL_ID(x->id) == y->id);
+      if (t == APU) {
+        EXPECT(x->apu.dev == y->apu.dev);
+        EXPECT(x->apu.rank == y->apu.rank);
+        EXPECT(x->apu.vendor == y->apu.vendor);
+        EXPECT(x->apu.gdrSupport == y->apu.gdrSupport);
+      } else if (t == CPU) {
+        EXPECT(x->cpu.arch == y->cpu.arch);
+        EXPECT(x->cpu.vendor == y->cpu.vendor);
+        EXPECT(x->cpu.model == y->cpu.model);
+        EXPECT(CPU_EQUAL(&x->cpu.affinity, &y->cpu.affinity));
+      } else if (t == PCI) {
+        EXPECT(x->pci.device == y->pci.device);
+      } else if (t == NET) {
+        EXPECT(x->net.dev == y->net.dev);
+        EXPECT(x->net.guid == y->net.guid);
+        EXPECT(x->net.port == y->net.port);
+        EXPECT(x->net.ip == y->net.ip);
+        EXPECT(x->net.gdrSupport == y->net.gdrSupport);
+        EXPECT(x->net.bw == y->net.bw);
+        EXPECT(x->net.latency == y->net.latency);
+        EXPECT(x->net.maxConn == y->net.maxConn);
+      }
+      EXPECT(x->nlinks == y->nlinks);
+      for (int l = 0; l < x->nlinks && l < y->nlinks; l++) {
+        EXPECT(x->links[l].type == y->links[l].type);
+        EXPECT(x->links[l].bw == y->links[l].bw);
+        EXPECT(x->links[l].remNode->type == y->links[l].remNode->type);
+        EXPECT(nodeIndex(a, x->links[l].remNode) ==
+               nodeIndex(b, y->links[l].remNode));
+      }
+    }
+  }
+}
+
+static void testRoundTrip() {
+  struct flagcxTopoServer *server, *decoded;
+  flagcxCalloc(&server, 1);
+  flagcxCalloc(&decoded, 1);
+  buildServer(server);
+
+  std::vector<uint8_t> blob;
+  EXPECT(flagcxTopoServerEncode(server, blob) == flagcxSuccess);
+  uint64_t hostHash = 0;
+  EXPECT(flagcxTopoServerDecode(blob.data(), blob.size(), decoded,
+                                &hostHash) == flagcxSuccess);
+  EXPECT(hostHash == server->hostHashes[0]);
+  compareServers(server, decoded);
+
+  // encoding the decoded server has to give the same bytes
+  decoded->hostHashes[0] = hostHash;
+  std::vector<uint8_t> again;
+  EXPECT(flagcxTopoServerEncode(decoded, again) == flagcxSuccess);
+  EXPECT(again == blob);
+  free(server);
+  free(decoded);
+}
+
+// What FLAGCX_TOPO_CACHE_DIR does across two inits, the second one has to get
+// the affinity and gdr support back
+static void testCache() {
+  struct flagcxTopoServer *server, *loaded;
+  flagcxCalloc(&server, 1);
+  flagcxCalloc(&loaded, 1);
+  buildServer(server);
+
+  char path[] = "/tmp/flagcx_topo_cache_XXXXXX";
+  int fd = mkstemp(path);
+  EXPECT(fd >= 0);
+  close(fd);
+  const uint64_t fingerprint = 0x5eedULL;
+  EXPECT(flagcxTopoCacheSave(path, fingerprint, server) == flagcxSuccess);
+  EXPECT(flagcxTopoCacheLoad(path, fingerprint, loaded) == flagcxSuccess);
+  EXPECT(loaded->hostHashes[loaded->serverId] == server->hostHashes[0]);
+  compareServers(server, loaded);
+
+  // another hardware fingerprint misses
+  memset(loaded, 0, sizeof(*loaded));
+  EXPECT(flagcxTopoCacheLoad(path, fingerprint + 1, loaded) != flagcxSuccess);
+  unlink(path);
+  free(server);
+  free(loaded);
+}
+
+static void testMalformed() {
+  struct flagcxTopoServer *server, *decoded;
+  flagcxCalloc(&server, 1);
+  flagcxCalloc(&decoded, 1);
+  buildServer(server);
+  std::vector<uint8_t> blob;
+  uint64_t hostHash;
+
+  // every prefix of a valid blob is truncated
+  EXPECT(flagcxTopoServerEncode(server, blob) == flagcxSuccess);
+  for (size_t size = 0; size < blob.size(); size++) {
+    memset(decoded, 0, sizeof(*decoded));
+    EXPECT(flagcxTopoServerDecode(blob.data(), size, decoded, &hostHash) !=
+           flagcxSuccess);
+  }
+
+  // the NIC of the second switch is dropped while the switch still links
+  // to it, so the blob references a node it does not hold
+  server->nodes[NIC].count = 1;
+  EXPECT(flagcxTopoServerEncode(server, blob) == flagcxSuccess);
+  memset(decoded, 0, sizeof(*decoded));
+  EXPECT(flagcxTopoServerDecode(blob.data(), blob.size(), decoded,
+                                &hostHash) != flagcxSuccess);
+  free(server);
+  free(decoded);
+}
+
+int main(int argc, char *argv[]) {
+  testRoundTrip();
+  testCache();
+  testMalformed();
+  if (failures) {
+    printf("%d topology blob checks failed\n", failures);
+    return 1;
+  }
+  printf("All topology blob checks passed\n");
+  return 0;
+}
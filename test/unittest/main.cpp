@@ -52,6 +52,92 @@ TEST_F(FlagCXCollTest, AllReduce) {
             0);
 }
 
+TEST_F(FlagCXCollTest, CommSplit) {
+  flagcxComm_t &comm = handler->comm;
+  flagcxDeviceHandle_t &devHandle = handler->devHandle;
+  const size_t splitCount = 1024 * 1024;
+
+  // split even and odd ranks, in reverse rank order
+  int color = rank % 2;
+  flagcxComm_t subComm = NULL;
+  auto result = flagcxCommSplit(comm, color, -rank, &subComm);
+  ASSERT_EQ(result, flagcxSuccess);
+  ASSERT_NE(subComm, nullptr);
+  int subRank, subNranks;
+  flagcxCommUserRank(subComm, &subRank);
+  flagcxCommCount(subComm, &subNranks);
+  EXPECT_EQ(subNranks, (nranks - color + 1) / 2);
+  EXPECT_EQ(subRank, subNranks - 1 - rank / 2);
+
+  for (size_t i = 0; i < splitCount; i++) {
+    ((float *)hostsendbuff)[i] = rank;
+  }
+  devHandle->deviceMemcpy(sendbuff, hostsendbuff, splitCount * sizeof(float),
+                          flagcxMemcpyHostToDevice, NULL);
+  flagcxAllReduce(sendbuff, recvbuff, splitCount, flagcxFloat, flagcxSum,
+                  subComm, stream);
+  devHandle->streamSynchronize(stream);
+  devHandle->deviceMemcpy(hostrecvbuff, recvbuff, splitCount * sizeof(float),
+                          flagcxMemcpyDeviceToHost, NULL);
+
+  // sum of the ranks of the same parity
+  float expected = 0;
+  for (int r = color; r < nranks; r += 2) {
+    expected += r;
+  }
+  for (size_t i = 0; i < splitCount; i += 4096) {
+    EXPECT_EQ(((float *)hostrecvbuff)[i], expected);
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  flagcxCommDestroy(subComm);
+}
+
+TEST_F(FlagCXCollTest, CommSplitInterleaved) {
+  flagcxComm_t &comm = handler->comm;
+  flagcxDeviceHandle_t &devHandle = handler->devHandle;
+  const size_t splitCount = 1024 * 1024;
+  const size_t splitSize = splitCount * sizeof(float);
+
+  int color = rank % 2;
+  flagcxComm_t subComm = NULL;
+  auto result = flagcxCommSplit(comm, color, rank, &subComm);
+  ASSERT_EQ(result, flagcxSuccess);
+  ASSERT_NE(subComm, nullptr);
+
+  // operations of the parent and the split communicator are issued back to
+  // back with no sync in between, they share the proxy thread of the parent
+  // but each uses its own connections
+  for (size_t i = 0; i < splitCount; i++) {
+    ((float *)hostsendbuff)[i] = rank;
+  }
+  devHandle->deviceMemcpy(sendbuff, hostsendbuff, splitSize,
+                          flagcxMemcpyHostToDevice, NULL);
+  flagcxAllReduce(sendbuff, recvbuff, splitCount, flagcxFloat, flagcxSum,
+                  subComm, stream);
+  flagcxAllReduce(sendbuff, (char *)recvbuff + splitSize, splitCount,
+                  flagcxFloat, flagcxSum, comm, stream);
+  flagcxAllReduce(sendbuff, (char *)recvbuff + 2 * splitSize, splitCount,
+                  flagcxFloat, flagcxSum, subComm, stream);
+  devHandle->streamSynchronize(stream);
+  devHandle->deviceMemcpy(hostrecvbuff, recvbuff, 3 * splitSize,
+                          flagcxMemcpyDeviceToHost, NULL);
+
+  float subExpected = 0;
+  for (int r = color; r < nranks; r += 2) {
+    subExpected += r;
+  }
+  float expected = nranks * (nranks - 1) / 2.0f;
+  for (size_t i = 0; i < splitCount; i += 4096) {
+    EXPECT_EQ(((float *)hostrecvbuff)[i], subExpected);
+    EXPECT_EQ(((float *)hostrecvbuff)[splitCount + i], expected);
+    EXPECT_EQ(((float *)hostrecvbuff)[2 * splitCount + i], subExpected);
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  flagcxCommDestroy(subComm);
+}
+
 TEST_F(FlagCXTopoTest, TopoDetection) {
   flagcxComm_t &comm = handler->comm;
   flagcxUniqueId_t &uniqueId = handler->uniqueId;